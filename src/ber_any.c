@@ -30,8 +30,13 @@ int ber_any(ODR o, Odr_any **p)
             odr_seterror(o, OPROTO, 2);
             return 0;
         }
-        (*p)->buf = (char *)odr_malloc(o, res);
-        memcpy((*p)->buf, o->op->bp, res);
+        if (o->op->zero_copy)
+            (*p)->buf = (char *) o->op->bp;
+        else
+        {
+            (*p)->buf = (char *)odr_malloc(o, res);
+            memcpy((*p)->buf, o->op->bp, res);
+        }
         (*p)->len = res;
         o->op->bp += res;
         return 1;
@@ -12,6 +12,7 @@
 
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 
 #include <yaz/yaz-iconv.h>
 #include <yaz/log.h>
@@ -20,6 +21,7 @@
 #include <yaz/unix.h>
 #include <yaz/odr.h>
 #include <yaz/matchstr.h>
+#include "odr-priv.h"
 
 static const char *cs_errlist[] =
 {
@@ -279,12 +281,15 @@ static int skip_crlf(const char *buf, int len, int *i)
 
 #define CHUNK_DEBUG 0
 
-static int cs_read_chunk(const char *buf, int i, int len)
+static int cs_read_chunk(const char *buf, int i, int len,
+                         struct cs_complete_state *st)
 {
     /* inside chunked body .. */
     while (1)
     {
         int chunk_len = 0;
+        if (st)
+            st->pos = i; /* resume here with more data */
 #if CHUNK_DEBUG
         if (i < len-2)
         {
@@ -333,7 +338,11 @@ static int cs_read_chunk(const char *buf, int i, int len)
 #endif
         i += chunk_len;
         if (i >= len-2)
+        {
+            if (st)
+                st->need = i + 3;
             return 0;
+        }
         if (!skip_crlf(buf, len, &i))
             return 0;
     }
@@ -355,7 +364,8 @@ static int cs_read_chunk(const char *buf, int i, int len)
     return 0;
 }
 
-static int cs_complete_http(const char *buf, int len, int head_only)
+static int cs_complete_http(const char *buf, int len, int head_only,
+                            struct cs_complete_state *st)
 {
     /* deal with HTTP request/response */
     int i, content_len = 0, chunked = 0;
@@ -405,15 +415,31 @@ static int cs_complete_http(const char *buf, int len, int head_only)
                 if (head_only)
                     return i;
                 else if (chunked)
-                    return cs_read_chunk(buf, i, len);
+                {
+                    if (st)
+                        st->kind = CS_COMPLETE_HTTP_CHUNKED;
+                    return cs_read_chunk(buf, i, len, st);
+                }
                 else
                 {   /* not chunked ; inside body */
                     if (content_len == -1)
+                    {
+                        if (st) /* read until connection is closed */
+                        {
+                            st->kind = CS_COMPLETE_HTTP_BODY;
+                            st->need = INT_MAX;
+                        }
                         return 0;   /* no content length */
+                    }
                     else if (len >= i + content_len)
                     {
                         return i + content_len;
                     }
+                    if (st)
+                    {
+                        st->kind = CS_COMPLETE_HTTP_BODY;
+                        st->need = i + content_len;
+                    }
                 }
                 break;
             }
@@ -456,12 +482,121 @@ static int cs_complete_auto_x(const char *buf, int len, int head_only)
                 && buf[1] >= 0x20 && buf[1] < 0x7f
                 && buf[2] >= 0x20 && buf[2] < 0x7f)
     {
-        int r = cs_complete_http(buf, len, head_only);
+        int r = cs_complete_http(buf, len, head_only, 0);
         return r;
     }
     return completeBER(buf, len);
 }
 
+static int complete_ber_state(struct cs_complete_state *st,
+                              const char *buf, int len)
+{
+    if (st->pos == 0)
+    {   /* tag and length of PDU */
+        int res, hlen, ll, zclass, tag, cons;
+
+        if (len < 2)
+            return 0;
+        if (!buf[0] && !buf[1])
+            return len; /* error */
+        if ((res = ber_dectag(buf, &zclass, &tag, &cons, len)) <= 0)
+            return 0;
+        hlen = res;
+        res = ber_declen(buf + hlen, &ll, len - hlen);
+        if (res == -2)
+            return len; /* error */
+        if (res == -1)
+            return 0;   /* incomplete length */
+        hlen += res;
+        if (ll >= 0)
+        {   /* definite length */
+            st->need = hlen + ll;
+            return len >= st->need ? st->need : 0;
+        }
+        if (!cons)
+            return len; /* error: primitive with indefinite length */
+        st->pos = hlen;
+    }
+    /* indefinite length: skip children already seen to be complete */
+    while (len - st->pos >= 2)
+    {
+        int res;
+
+        if (buf[st->pos] == 0 && buf[st->pos + 1] == 0)
+            return st->pos + 2;
+        res = completeBER_n(buf + st->pos, len - st->pos, 1);
+        if (res < 0)
+            return len; /* error */
+        if (res == 0)
+            return 0;
+        st->pos += res;
+    }
+    return 0;
+}
+
+/* returns offset of HTTP header end (\n followed by optional \r and \n)
+   or 0 if not found. Search starts at st->pos */
+static int http_header_end(struct cs_complete_state *st,
+                           const char *buf, int len)
+{
+    int i;
+    for (i = st->pos; i < len - 1; i++)
+        if (buf[i] == '\n')
+        {
+            if (buf[i + 1] == '\n')
+                return i + 2;
+            if (buf[i + 1] == '\r' && i < len - 2 && buf[i + 2] == '\n')
+                return i + 3;
+        }
+    st->pos = len > 2 ? len - 2 : 0;
+    return 0;
+}
+
+void cs_complete_state_init(struct cs_complete_state *st)
+{
+    st->kind = CS_COMPLETE_NONE;
+    st->need = 0;
+    st->pos = 0;
+}
+
+int cs_complete_auto_state(struct cs_complete_state *st,
+                           const char *buf, int len, int head_only)
+{
+    if (len < st->need)
+        return 0;
+    switch (st->kind)
+    {
+    case CS_COMPLETE_NONE:
+        if (len <= 5)
+            return cs_complete_auto_x(buf, len, head_only);
+        if (buf[0] >= 0x20 && buf[0] < 0x7f
+            && buf[1] >= 0x20 && buf[1] < 0x7f
+            && buf[2] >= 0x20 && buf[2] < 0x7f)
+            st->kind = CS_COMPLETE_HTTP_HEAD;
+        else
+        {
+            st->kind = CS_COMPLETE_BER;
+            return complete_ber_state(st, buf, len);
+        }
+        /* fall through */
+    case CS_COMPLETE_HTTP_HEAD:
+        /* only parse the header when all of it has been received */
+        if (http_header_end(st, buf, len) || len > 8194)
+        {
+            st->pos = 0;
+            return cs_complete_http(buf, len, head_only, st);
+        }
+        return 0;
+    case CS_COMPLETE_HTTP_CHUNKED:
+        return cs_read_chunk(buf, st->pos, len, st);
+    case CS_COMPLETE_HTTP_BODY:
+        return st->need;
+    case CS_COMPLETE_BER:
+        return complete_ber_state(st, buf, len);
+    }
+    return 0;
+}
+
 
 int cs_complete_auto(const char *buf, int len)
 {
@@ -9,51 +9,17 @@
 #include <config.h>
 #endif
 
-#include <string.h>
 #include <yaz/copy_types.h>
 
 /** macro clone_z_type copies a given ASN.1 type */
 #define clone_z_type(x) \
 Z_##x *yaz_clone_z_##x(Z_##x *q, NMEM nmem_out) \
 { \
-    Z_##x *q1 = 0; \
-    ODR enc = odr_createmem(ODR_ENCODE); \
-    ODR dec = odr_createmem(ODR_DECODE); \
-    if (z_##x(enc, &q, 0, 0)) \
-    { \
-        int len; \
-        char *buf = odr_getbuf(enc, &len, 0); \
-        if (buf) \
-        { \
-            odr_setbuf(dec, buf, len, 0); \
-            z_##x(dec, &q1, 0, 0); \
-            nmem_transfer(nmem_out, dec->mem);  \
-        } \
-    } \
-    odr_destroy(enc); \
-    odr_destroy(dec); \
-    return q1; \
+    return z_##x##_clone(nmem_out, q); \
 } \
 int yaz_compare_z_##x(Z_##x *a, Z_##x *b) \
 { \
-    int ret = 0; \
-    ODR o_a = odr_createmem(ODR_ENCODE); \
-    ODR o_b = odr_createmem(ODR_ENCODE); \
-    int r_a = z_##x(o_a, &a, 1, 0); \
-    int r_b = z_##x(o_b, &b, 1, 0); \
-    if (r_a && r_b) \
-    { \
-        int len_a, len_b; \
-        char *buf_a = odr_getbuf(o_a, &len_a, 0); \
-        char *buf_b = odr_getbuf(o_b, &len_b, 0); \
-        if (buf_a && buf_b && len_a == len_b && !memcmp(buf_a, buf_b, len_a)) \
-            ret = 1; \
-        else if (!buf_a && !buf_b) \
-            ret = 1; \
-    } \
-    odr_destroy(o_a); \
-    odr_destroy(o_b); \
-    return ret; \
+    return z_##x##_equal(a, b); \
 }
 
 clone_z_type(NamePlusRecord)
@@ -42,6 +42,7 @@
 #include <yaz/daemon.h>
 #include <yaz/log.h>
 #include <yaz/snprintf.h>
+#include <yaz/xmalloc.h>
 
 #if HAVE_PWD_H
 static void write_pidfile(int pid_fd)
@@ -66,20 +67,34 @@ static void write_pidfile(int pid_fd)
 
 int child_got_signal_from_us = 0;
 pid_t child_pid = 0;
-static void normal_stop_handler(int num)
+
+/* worker processes of yaz_daemon_workers */
+static pid_t *worker_pids = 0;
+static int no_workers = 0;
+static volatile int stop_received = 0;
+
+static void relay_signal(int num)
 {
+    int i;
+
     if (child_pid)
-    {
-        /* relay signal to child */
         kill(child_pid, num);
-    }
+    for (i = 0; i < no_workers; i++)
+        if (worker_pids[i])
+            kill(worker_pids[i], num);
+}
+
+static void normal_stop_handler(int num)
+{
+    stop_received = 1;
+    /* relay signal to child */
+    relay_signal(num);
 }
 
 static void log_reopen_handler(int num)
 {
     yaz_log_reopen();
-    if (child_pid)
-        kill(child_pid, num);
+    relay_signal(num);
 }
 
 static void sigusr2_handler(int num)
@@ -215,6 +230,128 @@ static void keepalive(void (*work)(void *data), void *data)
         yaz_log(YLOG_WARN, "keepalive stop. %d SIGBUS signal(s)", no_sigbus);
     yaz_log(YLOG_LOG, "keepalive stop");
 }
+
+/* like keepalive, but for a number of workers. A worker that exits
+   normally is replaced at once; that is how workers are recycled */
+static void keepalive_workers(void (*work)(void *data), void *data)
+{
+    int no_crashes = 0;
+    int run = 1;
+    int cont = 1;
+    int i;
+    void (*old_sigterm)(int);
+    void (*old_sigusr1)(int);
+    struct sigaction sa2, sa1;
+
+    keepalive_pid = getpid();
+
+    old_sigterm = signal(SIGTERM, normal_stop_handler);
+    old_sigusr1 = signal(SIGUSR1, normal_stop_handler);
+
+    sigemptyset(&sa2.sa_mask);
+    sa2.sa_handler = sigusr2_handler;
+    sa2.sa_flags = 0;
+    sigaction(SIGUSR2, &sa2, &sa1);
+
+    while (cont && !child_got_signal_from_us && !stop_received)
+    {
+        pid_t p;
+        int status;
+
+        for (i = 0; i < no_workers; i++)
+            if (!worker_pids[i])
+            {
+                p = fork();
+                if (p == (pid_t) (-1))
+                {
+                    yaz_log(YLOG_FATAL|YLOG_ERRNO, "fork");
+                    exit(1);
+                }
+                else if (p == 0)
+                {
+                    /* child */
+                    no_workers = 0;
+                    signal(SIGTERM, old_sigterm);/* restore */
+                    signal(SIGUSR1, old_sigusr1);/* restore */
+                    sigaction(SIGUSR2, &sa1, NULL);
+
+                    work(data);
+                    exit(0);
+                }
+                worker_pids[i] = p;
+            }
+        p = waitpid(-1, &status, 0);
+        if (p == (pid_t)(-1))
+        {
+            if (errno != EINTR)
+            {
+                yaz_log(YLOG_FATAL|YLOG_ERRNO, "waitpid");
+                break;
+            }
+            continue;
+        }
+        for (i = 0; i < no_workers; i++)
+            if (worker_pids[i] == p)
+                break;
+        if (i == no_workers)
+            continue; /* not a worker */
+        worker_pids[i] = 0;
+        if (WIFSIGNALED(status))
+        {
+            switch (WTERMSIG(status))
+            {
+            case SIGILL:
+            case SIGABRT:
+            case SIGSEGV:
+            case SIGBUS:
+                /* replace the worker, but slower as we get more errors */
+                yaz_log(YLOG_WARN, "Received SIG %d from worker %ld",
+                        WTERMSIG(status), (long) p);
+                no_crashes++;
+                sleep(1 + run/5);
+                run++;
+                break;
+            case SIGTERM:
+                yaz_log(YLOG_LOG, "Received SIGTERM from worker %ld",
+                        (long) p);
+                cont = 0;
+                break;
+            default:
+                yaz_log(YLOG_WARN, "Received SIG %d from worker %ld",
+                        WTERMSIG(status), (long) p);
+                cont = 0;
+            }
+        }
+        else if (WIFEXITED(status))
+        {
+            if (WEXITSTATUS(status) != 0)
+            {   /* worker exited with error */
+                yaz_log(YLOG_LOG, "Exit %d from worker %ld",
+                        WEXITSTATUS(status), (long) p);
+                cont = 0;
+            }
+            else if (!stop_received)
+                yaz_log(YLOG_LOG, "Worker %ld exited; replacing it",
+                        (long) p);
+        }
+    }
+    /* stop the remaining workers; a worker started while SIGTERM
+       was relayed may not have got it */
+    for (i = 0; i < no_workers; i++)
+        if (worker_pids[i])
+            kill(worker_pids[i], SIGTERM);
+    for (i = 0; i < no_workers; i++)
+        if (worker_pids[i])
+        {
+            while (waitpid(worker_pids[i], 0, 0) == (pid_t)(-1)
+                   && errno == EINTR)
+                ;
+            worker_pids[i] = 0;
+        }
+    if (no_crashes)
+        yaz_log(YLOG_WARN, "keepalive stop. %d worker crash(es)", no_crashes);
+    yaz_log(YLOG_LOG, "keepalive stop");
+}
 #endif
 
 void yaz_daemon_stop(void)
@@ -226,10 +363,10 @@ void yaz_daemon_stop(void)
 }
 
 
-int yaz_daemon(const char *progname,
-               unsigned int flags,
-               void (*work)(void *data), void *data,
-               const char *pidfile, const char *uid)
+static int daemon_main(const char *progname,
+                       unsigned int flags, int workers,
+                       void (*work)(void *data), void *data,
+                       const char *pidfile, const char *uid)
 {
 #if HAVE_PWD_H
     int pid_fd = -1;
@@ -341,7 +478,17 @@ int yaz_daemon(const char *progname,
     {
         signal(SIGHUP, log_reopen_handler);
     }
-    if (flags & YAZ_DAEMON_KEEPALIVE)
+    if (workers > 0)
+    {
+        worker_pids = (pid_t *) xmalloc(sizeof(*worker_pids) * workers);
+        memset(worker_pids, 0, sizeof(*worker_pids) * workers);
+        no_workers = workers;
+        keepalive_workers(work, data);
+        no_workers = 0;
+        xfree(worker_pids);
+        worker_pids = 0;
+    }
+    else if (flags & YAZ_DAEMON_KEEPALIVE)
     {
         keepalive(work, data);
     }
@@ -356,6 +503,22 @@ int yaz_daemon(const char *progname,
 #endif
 }
 
+int yaz_daemon(const char *progname,
+               unsigned int flags,
+               void (*work)(void *data), void *data,
+               const char *pidfile, const char *uid)
+{
+    return daemon_main(progname, flags, 0, work, data, pidfile, uid);
+}
+
+int yaz_daemon_workers(const char *progname,
+                       unsigned int flags, int workers,
+                       void (*work)(void *data), void *data,
+                       const char *pidfile, const char *uid)
+{
+    return daemon_main(progname, flags, workers, work, data, pidfile, uid);
+}
+
 /*
  * Local variables:
  * c-basic-offset: 4
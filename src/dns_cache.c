@@ -0,0 +1,267 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file dns_cache.c
+ * \brief Implements process-wide cache of host lookups.
+ *
+ * Entries are spread over a number of stripes by hash of host and port.
+ * Each stripe has its own mutex and a short list of entries, most
+ * recently used first, so that threads resolving different hosts seldom
+ * wait for each other. The cache is disabled until cs_set_dns_cache is
+ * called with a positive time to live.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <time.h>
+#if HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#endif
+
+#if HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#if HAVE_NETDB_H
+#include <netdb.h>
+#endif
+#if HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#if YAZ_POSIX_THREADS
+#include <pthread.h>
+#endif
+
+#include <yaz/comstack.h>
+#include <yaz/mutex.h>
+#include <yaz/xmalloc.h>
+#include "dns_cache.h"
+
+#define DNS_CACHE_STRIPES 16
+#define DNS_CACHE_STRIPE_MAX 64
+
+struct dns_cache_entry {
+    char *host;
+    char *port;
+    time_t expire;
+    struct addrinfo *ai;
+    struct dns_cache_entry *next;
+};
+
+struct dns_cache_stripe {
+    YAZ_MUTEX mutex;
+    int ttl;
+    int num;
+    struct dns_cache_entry *entries;   /* most recently used first */
+};
+
+static struct dns_cache_stripe dns_cache_stripes[DNS_CACHE_STRIPES];
+/* time to live of cs_set_dns_cache; read without lock */
+static int dns_cache_ttl = 0;
+#if YAZ_POSIX_THREADS
+static pthread_once_t dns_cache_once = PTHREAD_ONCE_INIT;
+#else
+static int dns_cache_init_flag = 0;
+#endif
+
+static void dns_cache_create(void)
+{
+    int i;
+
+    for (i = 0; i < DNS_CACHE_STRIPES; i++)
+    {
+        struct dns_cache_stripe *s = dns_cache_stripes + i;
+
+        s->mutex = 0;
+        yaz_mutex_create(&s->mutex);
+        s->ttl = 0;
+        s->num = 0;
+        s->entries = 0;
+    }
+}
+
+static void dns_cache_init(void)
+{
+#if YAZ_POSIX_THREADS
+    pthread_once(&dns_cache_once, dns_cache_create);
+#else
+    if (!dns_cache_init_flag)
+    {
+        dns_cache_create();
+        dns_cache_init_flag = 1;
+    }
+#endif
+}
+
+static struct dns_cache_stripe *dns_cache_stripe(const char *host,
+                                                 const char *port)
+{
+    unsigned h = 0;
+
+    while (*host)
+        h = h * 65509 + (unsigned char) *host++;
+    while (*port)
+        h = h * 65509 + (unsigned char) *port++;
+    dns_cache_init();
+    return dns_cache_stripes + h % DNS_CACHE_STRIPES;
+}
+
+int dns_cache_enabled(void)
+{
+    return dns_cache_ttl > 0;
+}
+
+struct addrinfo *dns_cache_copy(const struct addrinfo *ai)
+{
+    struct addrinfo *res = 0;
+    struct addrinfo **np = &res;
+
+    for (; ai; ai = ai->ai_next)
+    {
+        /* address is stored after the node */
+        struct addrinfo *n = (struct addrinfo *)
+            xmalloc(sizeof(*n) + ai->ai_addrlen);
+
+        *n = *ai;
+        n->ai_addr = (struct sockaddr *) (n + 1);
+        memcpy(n->ai_addr, ai->ai_addr, ai->ai_addrlen);
+        n->ai_canonname = ai->ai_canonname ? xstrdup(ai->ai_canonname) : 0;
+        n->ai_next = 0;
+        *np = n;
+        np = &n->ai_next;
+    }
+    return res;
+}
+
+void dns_cache_freeaddrinfo(struct addrinfo *ai)
+{
+    while (ai)
+    {
+        struct addrinfo *n = ai->ai_next;
+
+        xfree(ai->ai_canonname);
+        xfree(ai);
+        ai = n;
+    }
+}
+
+static void entry_destroy(struct dns_cache_entry *e)
+{
+    xfree(e->host);
+    xfree(e->port);
+    dns_cache_freeaddrinfo(e->ai);
+    xfree(e);
+}
+
+struct addrinfo *dns_cache_lookup(const char *host, const char *port)
+{
+    struct dns_cache_stripe *s = dns_cache_stripe(host, port);
+    struct dns_cache_entry **ep;
+    struct addrinfo *ai = 0;
+    time_t now = time(0);
+
+    yaz_mutex_enter(s->mutex);
+    for (ep = &s->entries; *ep; ep = &(*ep)->next)
+    {
+        struct dns_cache_entry *e = *ep;
+
+        if (!strcmp(e->host, host) && !strcmp(e->port, port))
+        {
+            *ep = e->next;
+            if (e->expire > now)
+            {
+                ai = dns_cache_copy(e->ai);
+                e->next = s->entries;
+                s->entries = e;
+            }
+            else
+            {
+                s->num--;
+                entry_destroy(e);
+            }
+            break;
+        }
+    }
+    yaz_mutex_leave(s->mutex);
+    return ai;
+}
+
+void dns_cache_add(const char *host, const char *port,
+                   const struct addrinfo *ai)
+{
+    struct dns_cache_stripe *s = dns_cache_stripe(host, port);
+    struct dns_cache_entry **ep;
+    struct dns_cache_entry *e = 0;
+
+    yaz_mutex_enter(s->mutex);
+    if (s->ttl > 0)
+    {
+        e = (struct dns_cache_entry *) xmalloc(sizeof(*e));
+        e->host = xstrdup(host);
+        e->port = xstrdup(port);
+        e->expire = time(0) + s->ttl;
+        e->ai = dns_cache_copy(ai);
+        e->next = s->entries;
+        s->entries = e;
+        s->num++;
+        /* remove older entry for same host and the least recently used
+           one if stripe is full */
+        for (ep = &e->next; *ep; )
+        {
+            struct dns_cache_entry *e1 = *ep;
+
+            if ((!strcmp(e1->host, host) && !strcmp(e1->port, port)) ||
+                (!e1->next && s->num > DNS_CACHE_STRIPE_MAX))
+            {
+                *ep = e1->next;
+                s->num--;
+                entry_destroy(e1);
+            }
+            else
+                ep = &e1->next;
+        }
+    }
+    yaz_mutex_leave(s->mutex);
+}
+
+void cs_set_dns_cache(int ttl)
+{
+    int i;
+
+    dns_cache_init();
+    dns_cache_ttl = ttl;
+    for (i = 0; i < DNS_CACHE_STRIPES; i++)
+    {
+        struct dns_cache_stripe *s = dns_cache_stripes + i;
+
+        yaz_mutex_enter(s->mutex);
+        s->ttl = ttl;
+        while (s->entries)
+        {
+            struct dns_cache_entry *e = s->entries;
+
+            s->entries = e->next;
+            entry_destroy(e);
+        }
+        s->num = 0;
+        yaz_mutex_leave(s->mutex);
+    }
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
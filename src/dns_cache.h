@@ -0,0 +1,66 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file dns_cache.h
+ * \brief Internal header for the process-wide cache of host lookups.
+ *
+ * The cache keeps the result of getaddrinfo for a host and port for a
+ * number of seconds (see cs_set_dns_cache). It is used by the TCP/IP
+ * COMSTACK and may be used by several threads at the same time.
+ */
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <yaz/yconfig.h>
+
+YAZ_BEGIN_CDECL
+
+struct addrinfo;
+
+/** \brief tells whether cache is enabled
+    \retval 1 enabled
+    \retval 0 disabled (cs_set_dns_cache not called with positive TTL)
+
+    Threads that use the cache should be started after it is enabled.
+*/
+int dns_cache_enabled(void);
+
+/** \brief looks up host and port
+    \param host host name
+    \param port port or service
+    \returns copy of addresses (free with dns_cache_freeaddrinfo) or NULL
+*/
+struct addrinfo *dns_cache_lookup(const char *host, const char *port);
+
+/** \brief adds result of lookup; ignored if cache is disabled
+    \param host host name
+    \param port port or service
+    \param ai addresses (as returned by getaddrinfo)
+*/
+void dns_cache_add(const char *host, const char *port,
+                   const struct addrinfo *ai);
+
+/** \brief makes copy of addresses
+    \param ai addresses
+    \returns copy (free with dns_cache_freeaddrinfo)
+*/
+struct addrinfo *dns_cache_copy(const struct addrinfo *ai);
+
+/** \brief frees copy of addresses
+    \param ai addresses (may be NULL)
+*/
+void dns_cache_freeaddrinfo(struct addrinfo *ai);
+
+YAZ_END_CDECL
+
+#endif
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -8,6 +8,15 @@
  *
  * This source implements the main event loop for the Generic Frontend
  * Server.
+ *
+ * On systems with epoll the channels are registered persistently and
+ * only changed channels (see iochan_changed) are updated between waits,
+ * so that a wakeup costs O(ready channels) rather than O(channels).
+ * Idle timeouts are kept in a binary min-heap ordered by deadline
+ * (last_event + max_idle). Event activity only moves last_event, so a
+ * heap entry may be too early; it is corrected when it reaches the top.
+ * Otherwise, or if the epoll instance can not be created, the poll
+ * based loop is used.
  */
 #if HAVE_CONFIG_H
 #include <config.h>
@@ -25,6 +34,10 @@
 #if HAVE_SYS_TIME_H
 #include <sys/time.h>
 #endif
+#if HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
 
 #include <yaz/poll.h>
 
@@ -59,9 +72,43 @@ IOCHAN iochan_create(int fd, IOC_CALLBACK cb, int flags, int chan_id)
     new_iochan->last_event = new_iochan->max_idle = 0;
     new_iochan->next = NULL;
     new_iochan->chan_id = chan_id;
+    new_iochan->loop = 0;
+    new_iochan->prev = 0;
+    new_iochan->dirty_next = 0;
+    new_iochan->force_next = 0;
+    new_iochan->dirty = 0;
+    new_iochan->reg_fd = -1;
+    new_iochan->reg_mask = -1;
+    new_iochan->heap_idx = -1;
     return new_iochan;
 }
 
+struct iochan_timer {
+    time_t deadline;
+    IOCHAN chan;
+};
+
+struct iochan_loop {
+    int epoll_fd;
+    long pid;           /* process that created epoll_fd */
+    IOCHAN dirty;       /* changed channels */
+    struct iochan_timer *heap; /* min-heap of idle deadlines */
+    int heap_num;
+    int heap_max;
+};
+
+void iochan_changed(IOCHAN chan)
+{
+    struct iochan_loop *loop = chan->loop;
+
+    if (loop && !chan->dirty)
+    {
+        chan->dirty = 1;
+        chan->dirty_next = loop->dirty;
+        loop->dirty = chan;
+    }
+}
+
 
 int iochan_is_alive(IOCHAN chan)
 {
@@ -78,7 +125,305 @@ int iochan_is_alive(IOCHAN chan)
     return 1;
 }
 
-int iochan_event_loop(IOCHAN *iochans, int *watch_sig)
+static void iochan_dispatch(IOCHAN p, enum yaz_poll_mask output_mask,
+                            time_t now)
+{
+    int force_event = p->force_event;
+
+    p->force_event = 0;
+    if (!p->destroyed && ((output_mask & yaz_poll_read) ||
+                          force_event == EVENT_INPUT))
+    {
+        p->last_event = now;
+        (*p->fun)(p, EVENT_INPUT);
+    }
+    if (!p->destroyed && ((output_mask & yaz_poll_write) ||
+                          force_event == EVENT_OUTPUT))
+    {
+        p->last_event = now;
+        (*p->fun)(p, EVENT_OUTPUT);
+    }
+    if (!p->destroyed && ((output_mask & yaz_poll_except) ||
+                          force_event == EVENT_EXCEPT))
+    {
+        p->last_event = now;
+        (*p->fun)(p, EVENT_EXCEPT);
+    }
+    if (!p->destroyed && ((p->max_idle && now - p->last_event >=
+                           p->max_idle) || force_event == EVENT_TIMEOUT))
+    {
+        p->last_event = now;
+        (*p->fun)(p, EVENT_TIMEOUT);
+    }
+}
+
+#if HAVE_SYS_EPOLL_H
+static void iochan_heap_swap(struct iochan_loop *loop, int i, int j)
+{
+    struct iochan_timer t = loop->heap[i];
+
+    loop->heap[i] = loop->heap[j];
+    loop->heap[j] = t;
+    loop->heap[i].chan->heap_idx = i;
+    loop->heap[j].chan->heap_idx = j;
+}
+
+static void iochan_heap_up(struct iochan_loop *loop, int i)
+{
+    while (i > 0 && loop->heap[(i - 1) / 2].deadline > loop->heap[i].deadline)
+    {
+        iochan_heap_swap(loop, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void iochan_heap_down(struct iochan_loop *loop, int i)
+{
+    while (1)
+    {
+        int c = 2 * i + 1;
+
+        if (c >= loop->heap_num)
+            break;
+        if (c + 1 < loop->heap_num &&
+            loop->heap[c + 1].deadline < loop->heap[c].deadline)
+            c++;
+        if (loop->heap[i].deadline <= loop->heap[c].deadline)
+            break;
+        iochan_heap_swap(loop, i, c);
+        i = c;
+    }
+}
+
+static void iochan_heap_remove(struct iochan_loop *loop, IOCHAN p)
+{
+    int i = p->heap_idx;
+
+    if (i < 0)
+        return;
+    p->heap_idx = -1;
+    if (i != --loop->heap_num)
+    {
+        loop->heap[i] = loop->heap[loop->heap_num];
+        loop->heap[i].chan->heap_idx = i;
+        iochan_heap_up(loop, i);
+        iochan_heap_down(loop, i);
+    }
+}
+
+/* adds, moves or removes the timer of p according to its idle timeout */
+static void iochan_heap_update(struct iochan_loop *loop, IOCHAN p)
+{
+    int i = p->heap_idx;
+
+    if (p->destroyed || !p->max_idle)
+    {
+        iochan_heap_remove(loop, p);
+        return;
+    }
+    if (i < 0)
+    {
+        if (loop->heap_num == loop->heap_max)
+        {
+            loop->heap_max = loop->heap_max ? 2 * loop->heap_max : 64;
+            loop->heap = (struct iochan_timer *)
+                xrealloc(loop->heap, loop->heap_max * sizeof(*loop->heap));
+        }
+        i = p->heap_idx = loop->heap_num++;
+        loop->heap[i].chan = p;
+    }
+    loop->heap[i].deadline = p->last_event + p->max_idle;
+    iochan_heap_up(loop, i);
+    iochan_heap_down(loop, p->heap_idx);
+}
+
+static void iochan_unlink(IOCHAN *iochans, IOCHAN p)
+{
+    if (p->prev)
+        p->prev->next = p->next;
+    else
+        *iochans = p->next;
+    if (p->next)
+        p->next->prev = p->prev;
+}
+
+static void iochan_epoll_update(struct iochan_loop *loop, IOCHAN p)
+{
+    int mask = p->destroyed ? 0 : p->flags &
+        (EVENT_INPUT | EVENT_OUTPUT | EVENT_EXCEPT);
+
+    if (p->reg_mask != -1 && (p->reg_fd != p->fd || mask == 0))
+    {
+        /* the fd may be closed already; then it is gone from the set */
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, p->reg_fd, 0);
+        p->reg_mask = -1;
+    }
+    if (mask && mask != p->reg_mask)
+    {
+        struct epoll_event ev;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.data.ptr = p;
+        if (mask & EVENT_INPUT)
+            ev.events |= EPOLLIN;
+        if (mask & EVENT_OUTPUT)
+            ev.events |= EPOLLOUT;
+        /* EPOLLERR and EPOLLHUP are always reported (EVENT_EXCEPT) */
+        if (epoll_ctl(loop->epoll_fd, p->reg_mask == -1 ?
+                      EPOLL_CTL_ADD : EPOLL_CTL_MOD, p->fd, &ev) < 0)
+        {
+            yaz_log(YLOG_WARN|YLOG_ERRNO, "epoll_ctl fd=%d", p->fd);
+            p->reg_mask = -1;
+            return;
+        }
+        p->reg_fd = p->fd;
+        p->reg_mask = mask;
+    }
+}
+
+/* a child process shares the epoll instance of its parent, so that
+   changes made by the child would affect the parent. Make a new one */
+static int iochan_epoll_fork_check(struct iochan_loop *loop, IOCHAN iochans)
+{
+    IOCHAN p;
+
+    if (loop->pid == (long) getpid())
+        return 0;
+    close(loop->epoll_fd);
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0)
+    {
+        yaz_log(YLOG_FATAL|YLOG_ERRNO, "epoll_create");
+        return -1;
+    }
+    loop->pid = (long) getpid();
+    for (p = iochans; p; p = p->next)
+        if (p->loop == loop)
+        {
+            p->reg_mask = -1;
+            iochan_changed(p);
+        }
+    return 0;
+}
+
+/* updates registration of changed channel p; frees it if destroyed */
+static void iochan_epoll_apply(struct iochan_loop *loop, IOCHAN *iochans,
+                               IOCHAN p, IOCHAN *forced)
+{
+    p->dirty = 0;
+    iochan_epoll_update(loop, p);
+    iochan_heap_update(loop, p);
+    if (p->destroyed)
+    {
+        /* inform the threadlist that this channel has been destroyed */
+        statserv_remove(p);
+        iochan_unlink(iochans, p);
+        xfree(p);
+        return;
+    }
+    if (p->force_event)
+    {
+        p->force_next = *forced;
+        *forced = p;
+    }
+}
+
+static int iochan_event_loop_epoll(struct iochan_loop *loop, IOCHAN *iochans,
+                                   int *watch_sig)
+{
+    struct epoll_event events[128];
+    int ret = 0;
+
+    while (*iochans)
+    {
+        IOCHAN p, prev = 0, added = 0, forced = 0;
+        time_t now = time(0);
+        int i, res, timeout;
+
+        if (iochan_epoll_fork_check(loop, *iochans))
+        {
+            ret = -1;
+            break;
+        }
+        /* channels added to the head of the list since last time */
+        for (p = *iochans; p && p->loop != loop; prev = p, p = p->next)
+        {
+            p->loop = loop;
+            p->prev = prev;
+            if (p->next)
+                p->next->prev = p;
+            p->dirty = 1;
+            p->dirty_next = added;
+            added = p;
+        }
+        /* changed channels first: a destroyed channel must be removed
+           before its fd number is registered again for a new channel */
+        while ((p = loop->dirty))
+        {
+            loop->dirty = p->dirty_next;
+            iochan_epoll_apply(loop, iochans, p, &forced);
+        }
+        while ((p = added))
+        {
+            added = p->dirty_next;
+            iochan_epoll_apply(loop, iochans, p, &forced);
+        }
+        if (!*iochans)
+            break;
+
+        if (forced)
+            timeout = 0;
+        else if (loop->heap_num == 0 || loop->heap[0].deadline - now > 3600)
+            timeout = 3600 * 1000;
+        else if (loop->heap[0].deadline <= now)
+            timeout = 0;
+        else
+            timeout = (int) (loop->heap[0].deadline - now) * 1000;
+        res = epoll_wait(loop->epoll_fd, events,
+                         sizeof(events) / sizeof(*events), timeout);
+        if (res < 0)
+        {
+            if (yaz_errno() == EINTR)
+            {
+                if (watch_sig && *watch_sig)
+                    break;
+                continue;
+            }
+            yaz_log(YLOG_WARN|YLOG_ERRNO, "epoll_wait");
+            continue;
+        }
+        now = time(0);
+        for (i = 0; i < res; i++)
+        {
+            enum yaz_poll_mask output_mask = yaz_poll_none;
+
+            p = (IOCHAN) events[i].data.ptr;
+            /* same mapping as yaz_poll_poll */
+            if (events[i].events & EPOLLIN)
+                yaz_poll_add(output_mask, yaz_poll_read);
+            if (events[i].events & EPOLLOUT)
+                yaz_poll_add(output_mask, yaz_poll_write);
+            if (events[i].events & ~(EPOLLIN | EPOLLOUT))
+                yaz_poll_add(output_mask, yaz_poll_except);
+            iochan_dispatch(p, output_mask, now);
+        }
+        for (p = forced; p; p = p->force_next)
+            if (p->force_event)
+                iochan_dispatch(p, yaz_poll_none, now);
+        /* expired timers; entries postponed by activity are moved */
+        while (loop->heap_num && loop->heap[0].deadline <= now)
+        {
+            p = loop->heap[0].chan;
+            if (!p->destroyed && now - p->last_event >= p->max_idle)
+                iochan_dispatch(p, yaz_poll_none, now);
+            iochan_heap_update(loop, p);
+        }
+    }
+    return ret;
+}
+#endif
+
+static int iochan_event_loop_poll(IOCHAN *iochans, int *watch_sig)
 {
     do /* loop as long as there are active associations to process */
     {
@@ -140,36 +485,7 @@ int iochan_event_loop(IOCHAN *iochans, int *watch_sig)
         }
         now = time(0);
         for (i = 0, p = *iochans; p; p = p->next, i++)
-        {
-            int force_event = p->force_event;
-            enum yaz_poll_mask output_mask = fds[i].output_mask;
-
-            p->force_event = 0;
-            if (!p->destroyed && ((output_mask & yaz_poll_read) ||
-                                  force_event == EVENT_INPUT))
-            {
-                p->last_event = now;
-                (*p->fun)(p, EVENT_INPUT);
-            }
-            if (!p->destroyed && ((output_mask & yaz_poll_write) ||
-                                  force_event == EVENT_OUTPUT))
-            {
-                p->last_event = now;
-                (*p->fun)(p, EVENT_OUTPUT);
-            }
-            if (!p->destroyed && ((output_mask & yaz_poll_except) ||
-                force_event == EVENT_EXCEPT))
-            {
-                p->last_event = now;
-                (*p->fun)(p, EVENT_EXCEPT);
-            }
-            if (!p->destroyed && ((p->max_idle && now - p->last_event >=
-                p->max_idle) || force_event == EVENT_TIMEOUT))
-            {
-                p->last_event = now;
-                (*p->fun)(p, EVENT_TIMEOUT);
-            }
-        }
+            iochan_dispatch(p, fds[i].output_mask, now);
         xfree(fds);
         for (p = *iochans; p; p = nextp)
         {
@@ -202,6 +518,41 @@ int iochan_event_loop(IOCHAN *iochans, int *watch_sig)
     while (*iochans);
     return 0;
 }
+
+int iochan_event_loop(IOCHAN *iochans, int *watch_sig)
+{
+#if HAVE_SYS_EPOLL_H
+    struct iochan_loop loop;
+
+    loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop.epoll_fd >= 0)
+    {
+        IOCHAN p;
+        int ret;
+
+        loop.pid = (long) getpid();
+        loop.dirty = 0;
+        loop.heap = 0;
+        loop.heap_num = loop.heap_max = 0;
+        ret = iochan_event_loop_epoll(&loop, iochans, watch_sig);
+        /* leaving with channels (signal); detach them from this loop */
+        for (p = *iochans; p; p = p->next)
+        {
+            p->loop = 0;
+            p->dirty = 0;
+            p->reg_mask = -1;
+            p->heap_idx = -1;
+        }
+        xfree(loop.heap);
+        close(loop.epoll_fd);
+        if (ret == 0)
+            return 0;
+    }
+    else
+        yaz_log(YLOG_WARN|YLOG_ERRNO, "epoll_create; using poll");
+#endif
+    return iochan_event_loop_poll(iochans, watch_sig);
+}
 /*
  * Local variables:
  * c-basic-offset: 4
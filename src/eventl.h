@@ -39,6 +39,7 @@
 #include <time.h>
 
 struct iochan;
+struct iochan_loop;
 
 typedef void (*IOC_CALLBACK)(struct iochan *i, int event);
 
@@ -59,26 +60,49 @@ int force_event;
 
     struct iochan *next;
     int chan_id; /* listening port (0 if none ) */
+
+    /* private to the epoll event loop */
+    struct iochan_loop *loop;  /* loop the channel is registered with */
+    struct iochan *prev;       /* previous in list; for O(1) removal */
+    struct iochan *dirty_next; /* list of changed channels */
+    struct iochan *force_next; /* list of channels with forced events */
+    int dirty;
+    int reg_fd;                /* fd registered with epoll */
+    int reg_mask;              /* flags registered with epoll; -1 if none */
+    int heap_idx;              /* position in timer heap; -1 if none */
 } *IOCHAN;
 
-#define iochan_destroy(i) (void)((i)->destroyed = 1)
+/* the macros that modify a channel call iochan_changed so that the
+   event loop can update its registration for that channel only */
+#define iochan_destroy(i) (void)((i)->destroyed = 1, iochan_changed(i))
 #define iochan_getfd(i) ((i)->fd)
-#define iochan_setfd(i, f) ((i)->fd = (f))
+#define iochan_setfd(i, f) ((i)->fd = (f), iochan_changed(i))
 #define iochan_getdata(i) ((i)->data)
 #define iochan_setdata(i, d) ((i)->data = d)
 #define iochan_getflags(i) ((i)->flags)
-#define iochan_setflags(i, d) ((i)->flags = d)
-#define iochan_setflag(i, d) ((i)->flags |= d)
-#define iochan_clearflag(i, d) ((i)->flags &= ~(d))
+#define iochan_setflags(i, d) ((i)->flags = d, iochan_changed(i))
+#define iochan_setflag(i, d) ((i)->flags |= d, iochan_changed(i))
+#define iochan_clearflag(i, d) ((i)->flags &= ~(d), iochan_changed(i))
 #define iochan_getflag(i, d) ((i)->flags & d ? 1 : 0)
 #define iochan_getfun(i) ((i)->fun)
 #define iochan_setfun(i, d) ((i)->fun = d)
-#define iochan_setevent(i, e) ((i)->force_event = (e))
+#define iochan_setevent(i, e) ((i)->force_event = (e), iochan_changed(i))
 #define iochan_getnext(i) ((i)->next)
-#define iochan_settimeout(i, t) ((i)->max_idle = (t), (i)->last_event = time(0))
+#define iochan_settimeout(i, t) ((i)->max_idle = (t), \
+                                 (i)->last_event = time(0), iochan_changed(i))
 
 IOCHAN iochan_create(int fd, IOC_CALLBACK cb, int flags, int port);
+void iochan_changed(IOCHAN chan);
 int iochan_is_alive(IOCHAN chan);
+/** \brief runs event loop until all channels are destroyed
+    \param iochans list of channels
+    \param watch_sig if non-NULL, loop returns on EINTR when *watch_sig is set
+    \retval 0 always
+
+    Uses epoll when available and the portable yaz_poll otherwise.
+    Channels may be added while the loop is running, but only at the
+    head of the list.
+*/
 int iochan_event_loop(IOCHAN *iochans, int *watch_sig);
 void statserv_remove (IOCHAN pIOChannel);
 #endif
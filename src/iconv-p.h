@@ -39,6 +39,9 @@
 
 void yaz_iconv_set_errno(yaz_iconv_t cd, int no);
 
+/** \brief returns handle to the state it had after yaz_iconv_open */
+void yaz_iconv_reset(yaz_iconv_t cd);
+
 typedef struct yaz_iconv_encoder_s *yaz_iconv_encoder_t;
 struct yaz_iconv_encoder_s {
     void *data;
@@ -0,0 +1,183 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file iconv_cache.c
+ * \brief Per-thread cache of yaz_iconv handles
+ *
+ * yaz_iconv_open probes all encoders and decoders of YAZ and may call
+ * iconv_open(3). Each thread keeps the handles it has released with
+ * yaz_iconv_close_cached, so that a later yaz_iconv_open_cached for the
+ * same conversion can take one of those. Unsupported conversions are
+ * remembered as well.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <yaz/xmalloc.h>
+#include "iconv-p.h"
+
+#if YAZ_POSIX_THREADS
+#include <pthread.h>
+#endif
+
+/* maximum number of idle entries per thread */
+#define ICONV_CACHE_MAX 16
+
+struct iconv_cache_entry {
+    char *tocode;
+    char *fromcode;
+    yaz_iconv_t cd;             /* 0 if conversion is unsupported */
+    int in_use;                 /* 1 if cd is held by caller */
+    struct iconv_cache_entry *next;
+};
+
+struct iconv_cache {
+    struct iconv_cache_entry *entries; /* most recently used first */
+};
+
+#if YAZ_POSIX_THREADS
+static pthread_key_t iconv_cache_key;
+static pthread_once_t iconv_cache_once = PTHREAD_ONCE_INIT;
+
+static void entry_destroy(struct iconv_cache_entry *e)
+{
+    if (e->cd)
+        yaz_iconv_close(e->cd);
+    xfree(e->tocode);
+    xfree(e->fromcode);
+    xfree(e);
+}
+
+static void cache_destroy(void *p)
+{
+    struct iconv_cache *c = (struct iconv_cache *) p;
+
+    while (c->entries)
+    {
+        struct iconv_cache_entry *e = c->entries;
+        c->entries = e->next;
+        entry_destroy(e);
+    }
+    xfree(c);
+}
+
+static void cache_key_create(void)
+{
+    pthread_key_create(&iconv_cache_key, cache_destroy);
+}
+
+/* destroys idle entries beyond ICONV_CACHE_MAX */
+static void cache_trim(struct iconv_cache *c)
+{
+    struct iconv_cache_entry **ep = &c->entries;
+    int no_idle = 0;
+
+    while (*ep)
+    {
+        struct iconv_cache_entry *e = *ep;
+        if (!e->in_use && ++no_idle > ICONV_CACHE_MAX)
+        {
+            *ep = e->next;
+            entry_destroy(e);
+        }
+        else
+            ep = &e->next;
+    }
+}
+
+/* returns cache for calling thread; NULL if not available */
+static struct iconv_cache *cache_get(void)
+{
+    struct iconv_cache *c;
+
+    pthread_once(&iconv_cache_once, cache_key_create);
+    c = (struct iconv_cache *) pthread_getspecific(iconv_cache_key);
+    if (!c)
+    {
+        c = (struct iconv_cache *) xmalloc(sizeof(*c));
+        c->entries = 0;
+        if (pthread_setspecific(iconv_cache_key, c))
+        {
+            xfree(c);
+            return 0;
+        }
+    }
+    return c;
+}
+#endif
+
+yaz_iconv_t yaz_iconv_open_cached(const char *tocode, const char *fromcode)
+{
+#if YAZ_POSIX_THREADS
+    struct iconv_cache *c = cache_get();
+    struct iconv_cache_entry *e, **ep;
+
+    if (!c)
+        return yaz_iconv_open(tocode, fromcode);
+    for (ep = &c->entries; (e = *ep); ep = &e->next)
+        if (!e->in_use && !strcmp(e->tocode, tocode)
+            && !strcmp(e->fromcode, fromcode))
+        {
+            if (e->cd)
+                e->in_use = 1;
+            /* move to front */
+            *ep = e->next;
+            e->next = c->entries;
+            c->entries = e;
+            return e->cd;
+        }
+    e = (struct iconv_cache_entry *) xmalloc(sizeof(*e));
+    e->tocode = xstrdup(tocode);
+    e->fromcode = xstrdup(fromcode);
+    e->cd = yaz_iconv_open(tocode, fromcode);
+    e->in_use = e->cd ? 1 : 0;
+    e->next = c->entries;
+    c->entries = e;
+    cache_trim(c);
+    return e->cd;
+#else
+    return yaz_iconv_open(tocode, fromcode);
+#endif
+}
+
+int yaz_iconv_close_cached(yaz_iconv_t cd)
+{
+#if YAZ_POSIX_THREADS
+    struct iconv_cache *c;
+    struct iconv_cache_entry **ep;
+#endif
+
+    if (!cd)
+        return 0;
+#if YAZ_POSIX_THREADS
+    c = cache_get();
+    for (ep = c ? &c->entries : 0; ep && *ep; ep = &(*ep)->next)
+        if ((*ep)->cd == cd && (*ep)->in_use)
+        {
+            struct iconv_cache_entry *e = *ep;
+
+            yaz_iconv_reset(cd);
+            e->in_use = 0;
+            /* move to front */
+            *ep = e->next;
+            e->next = c->entries;
+            c->entries = e;
+            cache_trim(c);
+            return 0;
+        }
+#endif
+    return yaz_iconv_close(cd);
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -9,6 +9,9 @@
 # Default prefix
 set default-prefix {ill_ ILL_ ILL_}
 
+# Generate deep copy (_clone) and equality (_equal) functions
+set default-clone 1
+
 # ----------------------------------------------------------
 set m ISO-10161-ILL-1
 
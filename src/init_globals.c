@@ -13,6 +13,7 @@
 #endif
 
 #include <yaz/log.h>
+#include <yaz/nmem.h>
 
 #if YAZ_POSIX_THREADS
 #include <pthread.h>
@@ -84,6 +85,7 @@ void yaz_deinit_globals(void)
     if (yaz_init_flag)
     {
         yaz_log_deinit_globals();
+        nmem_cache_flush();
 #if HAVE_GNUTLS_H
         gnutls_global_deinit();
 #endif
@@ -32,12 +32,24 @@
 #if YAZ_POSIX_THREADS
 static pthread_mutex_t nmem_mutex = PTHREAD_MUTEX_INITIALIZER;
 #endif
+/* statistics of exited threads and threads without per-thread state.
+   Protected by nmem_mutex */
 static size_t no_nmem_handles = 0;
 static size_t no_nmem_blocks = 0;
 static size_t nmem_allocated = 0;
 
 #define NMEM_CHUNK (4*1024)
 
+/* blocks for a handle grow geometrically from NMEM_CHUNK up to this size */
+#define NMEM_CHUNK_MAX (64*1024)
+
+/* number of size classes in per-thread block cache. Class c holds
+   blocks of size [NMEM_CHUNK << c, NMEM_CHUNK << (c+1)) */
+#define NMEM_CACHE_CLASSES 6
+
+/* default number of bytes retained per thread */
+#define NMEM_CACHE_MAX (256*1024)
+
 struct nmem_block
 {
     char *buf;              /* memory allocated in this block */
@@ -46,13 +58,50 @@ struct nmem_block
     struct nmem_block *next;
 };
 
+/* xmalloc'ed buffer owned by NMEM handle (nmem_adopt_buf) */
+struct nmem_buf
+{
+    void *buf;
+    struct nmem_buf *next;
+};
+
 struct nmem_control
 {
     size_t total;
+    size_t chunk;           /* size of next block */
     struct nmem_block *blocks;
+    struct nmem_buf *bufs;
     struct nmem_control *next;
 };
 
+/* per-thread state: statistics and cache of free blocks.
+   The counters are only modified by the owning thread and merged by
+   nmem_get_status. They are unsigned and may wrap, since handles and
+   blocks may be released by another thread than the one creating them;
+   the sum over all threads is still right */
+struct nmem_thread
+{
+    size_t handles;
+    size_t blocks;
+    size_t allocated;
+    size_t cache_size;      /* total size of blocks retained */
+    struct nmem_block *cache[NMEM_CACHE_CLASSES];
+#if YAZ_POSIX_THREADS
+    pthread_mutex_t mutex;  /* only contended by nmem_get_status */
+#endif
+    struct nmem_thread *next;
+};
+
+static size_t nmem_cache_max = NMEM_CACHE_MAX;
+
+/* all per-thread states. Protected by nmem_mutex */
+static struct nmem_thread *nmem_threads = 0;
+
+#if YAZ_POSIX_THREADS
+static pthread_key_t nmem_thread_key;
+static pthread_once_t nmem_thread_once = PTHREAD_ONCE_INIT;
+#endif
+
 struct align {
     char x;
     union {
@@ -87,59 +136,224 @@ static void nmem_unlock(void)
 #endif
 }
 
-static void free_block(struct nmem_block *p)
+#if YAZ_POSIX_THREADS
+static void nmem_atfork_prepare(void)
 {
+    struct nmem_thread *t;
+
     nmem_lock();
-    no_nmem_blocks--;
-    nmem_allocated -= p->size;
+    for (t = nmem_threads; t; t = t->next)
+        pthread_mutex_lock(&t->mutex);
+}
+
+static void nmem_atfork_release(void)
+{
+    struct nmem_thread *t;
+
+    for (t = nmem_threads; t; t = t->next)
+        pthread_mutex_unlock(&t->mutex);
     nmem_unlock();
-    xfree(p->buf);
-    xfree(p);
+}
+#endif
+
+static int cache_class(size_t size)
+{
+    int c = 0;
+    while (c < NMEM_CACHE_CLASSES - 1 && size >= (NMEM_CHUNK << (c + 1)))
+        c++;
+    return c;
+}
+
+static void cache_flush(struct nmem_thread *t)
+{
+    int i;
+    for (i = 0; i < NMEM_CACHE_CLASSES; i++)
+    {
+        struct nmem_block *p;
+        while ((p = t->cache[i]))
+        {
+            t->cache[i] = p->next;
+            xfree(p->buf);
+            xfree(p);
+        }
+    }
+    t->cache_size = 0;
+}
+
+#if YAZ_POSIX_THREADS
+static void thread_destroy(void *p)
+{
+    struct nmem_thread **tp, *t = (struct nmem_thread *) p;
+
+    nmem_lock();
+    no_nmem_handles += t->handles;
+    no_nmem_blocks += t->blocks;
+    nmem_allocated += t->allocated;
+    for (tp = &nmem_threads; *tp; tp = &(*tp)->next)
+        if (*tp == t)
+        {
+            *tp = t->next;
+            break;
+        }
+    nmem_unlock();
+    cache_flush(t);
+    pthread_mutex_destroy(&t->mutex);
+    xfree(t);
+}
+
+static void thread_key_create(void)
+{
+    pthread_key_create(&nmem_thread_key, thread_destroy);
+}
+#endif
+
+/* returns state for calling thread; NULL if not available */
+static struct nmem_thread *thread_get(void)
+{
+#if YAZ_POSIX_THREADS
+    struct nmem_thread *t;
+
+    pthread_once(&nmem_thread_once, thread_key_create);
+    t = (struct nmem_thread *) pthread_getspecific(nmem_thread_key);
+    if (!t)
+    {
+        int i;
+        t = (struct nmem_thread *) xmalloc(sizeof(*t));
+        t->handles = t->blocks = t->allocated = 0;
+        t->cache_size = 0;
+        for (i = 0; i < NMEM_CACHE_CLASSES; i++)
+            t->cache[i] = 0;
+        if (pthread_setspecific(nmem_thread_key, t))
+        {
+            xfree(t);
+            return 0;
+        }
+        pthread_mutex_init(&t->mutex, 0);
+        nmem_lock();
+        t->next = nmem_threads;
+        nmem_threads = t;
+        nmem_unlock();
+    }
+    return t;
+#else
+    return 0;
+#endif
+}
+
+/* adds to statistics. Use 0 - v for subtraction */
+static void stat_add(struct nmem_thread *t, size_t handles, size_t blocks,
+                     size_t allocated)
+{
+#if YAZ_POSIX_THREADS
+    if (t)
+    {
+        pthread_mutex_lock(&t->mutex);
+        t->handles += handles;
+        t->blocks += blocks;
+        t->allocated += allocated;
+        pthread_mutex_unlock(&t->mutex);
+        return;
+    }
+#endif
+    nmem_lock();
+    no_nmem_handles += handles;
+    no_nmem_blocks += blocks;
+    nmem_allocated += allocated;
+    nmem_unlock();
+}
+
+/* takes a block with at least size bytes from cache; NULL if none */
+static struct nmem_block *cache_take(struct nmem_thread *t, size_t size)
+{
+    int i = cache_class(size);
+    struct nmem_block **pp = &t->cache[i];
+
+    for (; *pp; pp = &(*pp)->next)
+        if ((*pp)->size >= size)
+            break;
+    if (!*pp && i < NMEM_CACHE_CLASSES - 1)
+        pp = &t->cache[i + 1]; /* all blocks in next class are big enough */
+    if (*pp)
+    {
+        struct nmem_block *r = *pp;
+        *pp = r->next;
+        t->cache_size -= r->size;
+        return r;
+    }
+    return 0;
+}
+
+static void free_block(struct nmem_thread *t, struct nmem_block *p)
+{
+    stat_add(t, 0, 0 - (size_t) 1, 0 - p->size);
     if (log_level)
         yaz_log(log_level, "nmem free_block p=%p", p);
+    if (t && p->size <= nmem_cache_max && t->cache_size <= nmem_cache_max
+        && p->size <= nmem_cache_max - t->cache_size)
+    {
+        int i = cache_class(p->size);
+        p->next = t->cache[i];
+        t->cache[i] = p;
+        t->cache_size += p->size;
+        return;
+    }
+    xfree(p->buf);
+    xfree(p);
 }
 
 /*
  * acquire a block with a minimum of size free bytes.
  */
-static struct nmem_block *get_block(size_t size)
+static struct nmem_block *get_block(size_t chunk, size_t size)
 {
-    struct nmem_block *r;
-    size_t get = NMEM_CHUNK;
+    struct nmem_block *r = 0;
+    struct nmem_thread *t = thread_get();
+    size_t get = chunk;
 
     if (log_level)
         yaz_log(log_level, "nmem get_block size=%ld", (long) size);
 
     if (get < size)
         get = size;
-    if (log_level)
-        yaz_log(log_level, "nmem get_block alloc new block size=%ld",
-                (long) get);
-
-    r = (struct nmem_block *) xmalloc(sizeof(*r));
-    r->buf = (char *)xmalloc(r->size = get);
+    if (t && t->cache_size)
+        r = cache_take(t, get);
+    if (!r)
+    {
+        if (log_level)
+            yaz_log(log_level, "nmem get_block alloc new block size=%ld",
+                    (long) get);
+        r = (struct nmem_block *) xmalloc(sizeof(*r));
+        r->buf = (char *)xmalloc(r->size = get);
+    }
     r->top = 0;
-    nmem_lock();
-    no_nmem_blocks++;
-    nmem_allocated += r->size;
-    nmem_unlock();
+    stat_add(t, 0, 1, r->size);
     return r;
 }
 
 void nmem_reset(NMEM n)
 {
-    struct nmem_block *t;
+    struct nmem_block *b;
+    struct nmem_thread *t;
 
     yaz_log(log_level, "nmem_reset p=%p", n);
     if (!n)
         return;
+    t = thread_get();
     while (n->blocks)
     {
-        t = n->blocks;
+        b = n->blocks;
         n->blocks = n->blocks->next;
-        free_block(t);
+        free_block(t, b);
+    }
+    while (n->bufs)
+    {
+        struct nmem_buf *a = n->bufs;
+        n->bufs = a->next;
+        xfree(a->buf);
+        xfree(a);
     }
     n->total = 0;
+    n->chunk = NMEM_CHUNK;
 }
 
 void *nmem_malloc(NMEM n, size_t size)
@@ -155,9 +369,11 @@ void *nmem_malloc(NMEM n, size_t size)
     p = n->blocks;
     if (!p || p->size < size + p->top)
     {
-        p = get_block(size);
+        p = get_block(n->chunk, size);
         p->next = n->blocks;
         n->blocks = p;
+        if (n->chunk < NMEM_CHUNK_MAX)
+            n->chunk *= 2;
     }
     r = p->buf + p->top;
     /* align size */
@@ -174,7 +390,8 @@ size_t nmem_total(NMEM n)
 void nmem_init_globals(void)
 {
 #if YAZ_POSIX_THREADS
-    pthread_atfork(nmem_lock, nmem_unlock, nmem_unlock);
+    pthread_atfork(nmem_atfork_prepare, nmem_atfork_release,
+                   nmem_atfork_release);
 #endif
 }
 
@@ -182,9 +399,7 @@ NMEM nmem_create(void)
 {
     NMEM r;
 
-    nmem_lock();
-    no_nmem_handles++;
-    nmem_unlock();
+    stat_add(thread_get(), 1, 0, 0);
     if (!log_level_initialized)
     {
         /* below will call nmem_init_globals once */
@@ -195,7 +410,9 @@ NMEM nmem_create(void)
     r = (struct nmem_control *)xmalloc(sizeof(*r));
 
     r->blocks = 0;
+    r->bufs = 0;
     r->total = 0;
+    r->chunk = NMEM_CHUNK;
     r->next = 0;
 
     return r;
@@ -208,32 +425,93 @@ void nmem_destroy(NMEM n)
 
     nmem_reset(n);
     xfree(n);
-    nmem_lock();
-    no_nmem_handles--;
-    nmem_unlock();
+    stat_add(thread_get(), 0 - (size_t) 1, 0, 0);
+}
+
+void nmem_mark(NMEM n, nmem_mark_t *mark)
+{
+    mark->block = n->blocks;
+    mark->top = n->blocks ? n->blocks->top : 0;
+    mark->total = n->total;
+}
+
+void nmem_release_to_mark(NMEM n, const nmem_mark_t *mark)
+{
+    struct nmem_thread *t = thread_get();
+
+    while (n->blocks && n->blocks != mark->block)
+    {
+        struct nmem_block *b = n->blocks;
+        n->blocks = b->next;
+        free_block(t, b);
+    }
+    if (n->blocks)
+        n->blocks->top = mark->top;
+    n->total = mark->total;
+}
+
+void nmem_adopt_buf(NMEM n, void *buf)
+{
+    struct nmem_buf *a = (struct nmem_buf *) xmalloc(sizeof(*a));
+
+    a->buf = buf;
+    a->next = n->bufs;
+    n->bufs = a;
 }
 
 void nmem_transfer(NMEM dst, NMEM src)
 {
     struct nmem_block *t;
+    struct nmem_buf *a;
     while ((t = src->blocks))
     {
         src->blocks = t->next;
         t->next = dst->blocks;
         dst->blocks = t;
     }
+    while ((a = src->bufs))
+    {
+        src->bufs = a->next;
+        a->next = dst->bufs;
+        dst->bufs = a;
+    }
     dst->total += src->total;
     src->total = 0;
 }
 
+void nmem_set_cache_max(size_t max)
+{
+    nmem_cache_max = max;
+}
+
+void nmem_cache_flush(void)
+{
+    struct nmem_thread *t = thread_get();
+    if (t)
+        cache_flush(t);
+}
+
 int nmem_get_status(char *dst, size_t l)
 {
     size_t handles, blocks, allocated;
+    struct nmem_thread *t;
 
     nmem_lock();
     handles = no_nmem_handles;
     blocks = no_nmem_blocks;
     allocated = nmem_allocated;
+    for (t = nmem_threads; t; t = t->next)
+    {
+#if YAZ_POSIX_THREADS
+        pthread_mutex_lock(&t->mutex);
+#endif
+        handles += t->handles;
+        blocks += t->blocks;
+        allocated += t->allocated;
+#if YAZ_POSIX_THREADS
+        pthread_mutex_unlock(&t->mutex);
+#endif
+    }
     nmem_unlock();
     yaz_snprintf(dst, l,
                  "<nmem>\n"
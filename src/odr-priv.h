@@ -70,6 +70,7 @@ struct odr_constack
     int len_offset;
     int lenlen;                  /** length of length-field */
     const char *name;            /** name of stack entry */
+    int lens_index;              /** index in lens (sized encoding) */
 
     struct odr_constack *prev;   /** pointer back in stack */
     struct odr_constack *next;   /** pointer forward */
@@ -112,6 +113,15 @@ struct Odr_private {
     int lenlen;          /* force length-of-lenght (odr_setlen()) */
     FILE *print;         /* output file handler for direction print */
     int indent;          /* current indent level for printing */
+    int zero_copy;       /* decoded octet strings refer to buffer */
+
+    /* sized encoding (odr_encode_sized) */
+    int sized;           /* 0=off, 1=sizing pass, 2=writing pass */
+    int skipped;         /* bytes not written in sizing pass */
+    int *lens;           /* content lengths of constructed in order */
+    int lens_num;        /* number of lengths in use */
+    int lens_max;        /* allocated size of lens */
+    int lens_pos;        /* next length to use in writing pass */
 };
 
 #define ODR_STACK_POP(x) (x)->op->stack_top = (x)->op->stack_top->prev
@@ -157,6 +167,28 @@ struct Odr_private {
         -1 \
 )
 
+/** \brief checks whether BER buffer holds a complete element
+    \param buf buffer
+    \param len number of bytes in buffer
+    \param level nesting level (completeBER starts at 0)
+    \retval 0 incomplete
+    \retval <0 bad BER
+    \retval >0 number of bytes of element
+
+    This is the worker of completeBER.
+*/
+int completeBER_n(const char *buf, int len, int level);
+
+/** \brief decodes/encodes octet string; may refer to decode buffer
+    \param o ODR stream
+    \param p octet string
+    \param cons whether constructed
+    \param refer 1=refer to buffer if zero-copy is enabled; 0=always copy
+    \retval 1 success
+    \retval 0 failure
+*/
+int ber_octetstring_x(ODR o, Odr_oct *p, int cons, int refer);
+
 #endif
 /*
  * Local variables:
@@ -217,6 +217,11 @@ ODR odr_createmem(int direction)
     o->op->enable_bias = 1;
     o->op->odr_ber_tag.lclass = -1;
     o->op->iconv_handle = 0;
+    o->op->zero_copy = 0;
+    o->op->sized = 0;
+    o->op->skipped = 0;
+    o->op->lens = 0;
+    o->op->lens_num = o->op->lens_max = o->op->lens_pos = 0;
     odr_setprint_noclose(o, stderr);
     odr_reset(o);
     yaz_log(log_level, "odr_createmem dir=%d o=%p", direction, o);
@@ -259,6 +264,7 @@ void odr_destroy(ODR o)
         o->op->stream_close(o->op->print);
     if (o->op->iconv_handle != 0)
         yaz_iconv_close(o->op->iconv_handle);
+    xfree(o->op->lens);
     xfree(o->op);
     xfree(o);
     yaz_log(log_level, "odr_destroy o=%p", o);
@@ -274,6 +280,11 @@ void odr_setbuf(ODR o, char *buf, int len, int can_grow)
     o->op->size = len;
 }
 
+void odr_set_zero_copy(ODR o, int enable)
+{
+    o->op->zero_copy = enable;
+}
+
 char *odr_getbuf(ODR o, int *len, int *size)
 {
     *len = o->op->top;
@@ -0,0 +1,254 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file odr_clone.c
+ * \brief Deep copy and comparison of basic ODR types.
+ *
+ * These are the building blocks for the _clone and _equal functions
+ * generated by yaz-asncomp. All clone functions return NULL for a
+ * NULL input. The equal functions consider two NULL values equal.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include "odr-priv.h"
+
+Odr_int *odr_integer_clone(NMEM nmem, const Odr_int *p)
+{
+    return p ? nmem_intdup(nmem, *p) : 0;
+}
+
+int odr_integer_equal(const Odr_int *a, const Odr_int *b)
+{
+    if (!a || !b)
+        return a == b;
+    return *a == *b;
+}
+
+Odr_int *odr_enum_clone(NMEM nmem, const Odr_int *p)
+{
+    return odr_integer_clone(nmem, p);
+}
+
+int odr_enum_equal(const Odr_int *a, const Odr_int *b)
+{
+    return odr_integer_equal(a, b);
+}
+
+Odr_bool *odr_bool_clone(NMEM nmem, const Odr_bool *p)
+{
+    return p ? nmem_booldup(nmem, *p) : 0;
+}
+
+int odr_bool_equal(const Odr_bool *a, const Odr_bool *b)
+{
+    if (!a || !b)
+        return a == b;
+    return (*a != 0) == (*b != 0);
+}
+
+Odr_null *odr_null_clone(NMEM nmem, const Odr_null *p)
+{
+    return p ? odr_nullval() : 0;
+}
+
+int odr_null_equal(const Odr_null *a, const Odr_null *b)
+{
+    return (a == 0) == (b == 0);
+}
+
+Odr_oct *odr_octetstring_clone(NMEM nmem, const Odr_oct *p)
+{
+    Odr_oct *r;
+
+    if (!p)
+        return 0;
+    r = (Odr_oct *) nmem_malloc(nmem, sizeof(*r));
+    r->len = p->len;
+    r->buf = (char *) nmem_malloc(nmem, p->len + 1);
+    if (p->len)
+        memcpy(r->buf, p->buf, p->len);
+    r->buf[p->len] = '\0';
+    return r;
+}
+
+int odr_octetstring_equal(const Odr_oct *a, const Odr_oct *b)
+{
+    if (!a || !b)
+        return a == b;
+    return a->len == b->len && !memcmp(a->buf, b->buf, a->len);
+}
+
+Odr_any *odr_any_clone(NMEM nmem, const Odr_any *p)
+{
+    return odr_octetstring_clone(nmem, p);
+}
+
+int odr_any_equal(const Odr_any *a, const Odr_any *b)
+{
+    return odr_octetstring_equal(a, b);
+}
+
+Odr_bitmask *odr_bitstring_clone(NMEM nmem, const Odr_bitmask *p)
+{
+    Odr_bitmask *r;
+
+    if (!p)
+        return 0;
+    r = (Odr_bitmask *) nmem_malloc(nmem, sizeof(*r));
+    memcpy(r, p, sizeof(*r));
+    return r;
+}
+
+int odr_bitstring_equal(const Odr_bitmask *a, const Odr_bitmask *b)
+{
+    if (!a || !b)
+        return a == b;
+    return a->top == b->top &&
+        (a->top < 0 || !memcmp(a->bits, b->bits, a->top + 1));
+}
+
+Odr_oid *odr_oid_clone(NMEM nmem, const Odr_oid *p)
+{
+    return p ? odr_oiddup_nmem(nmem, p) : 0;
+}
+
+int odr_oid_equal(const Odr_oid *a, const Odr_oid *b)
+{
+    if (!a || !b)
+        return a == b;
+    return !oid_oidcmp(a, b);
+}
+
+char *odr_generalstring_clone(NMEM nmem, const char *p)
+{
+    return nmem_strdup_null(nmem, p);
+}
+
+int odr_generalstring_equal(const char *a, const char *b)
+{
+    if (!a || !b)
+        return a == b;
+    return !strcmp(a, b);
+}
+
+char *odr_visiblestring_clone(NMEM nmem, const char *p)
+{
+    return nmem_strdup_null(nmem, p);
+}
+
+int odr_visiblestring_equal(const char *a, const char *b)
+{
+    return odr_generalstring_equal(a, b);
+}
+
+char *odr_graphicstring_clone(NMEM nmem, const char *p)
+{
+    return nmem_strdup_null(nmem, p);
+}
+
+int odr_graphicstring_equal(const char *a, const char *b)
+{
+    return odr_generalstring_equal(a, b);
+}
+
+char *odr_generalizedtime_clone(NMEM nmem, const char *p)
+{
+    return nmem_strdup_null(nmem, p);
+}
+
+int odr_generalizedtime_equal(const char *a, const char *b)
+{
+    return odr_generalstring_equal(a, b);
+}
+
+Odr_external *odr_external_clone(NMEM nmem, const Odr_external *p)
+{
+    Odr_external *r;
+
+    if (!p)
+        return 0;
+    r = (Odr_external *) nmem_malloc(nmem, sizeof(*r));
+    r->direct_reference = odr_oid_clone(nmem, p->direct_reference);
+    r->indirect_reference = odr_integer_clone(nmem, p->indirect_reference);
+    r->descriptor = odr_graphicstring_clone(nmem, p->descriptor);
+    r->which = p->which;
+    switch (p->which)
+    {
+    case ODR_EXTERNAL_single:
+        r->u.single_ASN1_type = odr_any_clone(nmem, p->u.single_ASN1_type);
+        break;
+    case ODR_EXTERNAL_octet:
+        r->u.octet_aligned = odr_octetstring_clone(nmem, p->u.octet_aligned);
+        break;
+    case ODR_EXTERNAL_arbitrary:
+        r->u.arbitrary = odr_bitstring_clone(nmem, p->u.arbitrary);
+        break;
+    default:
+        r->u = p->u;
+    }
+    return r;
+}
+
+int odr_external_equal(const Odr_external *a, const Odr_external *b)
+{
+    if (!a || !b)
+        return a == b;
+    if (!odr_oid_equal(a->direct_reference, b->direct_reference) ||
+        !odr_integer_equal(a->indirect_reference, b->indirect_reference) ||
+        !odr_graphicstring_equal(a->descriptor, b->descriptor) ||
+        a->which != b->which)
+        return 0;
+    switch (a->which)
+    {
+    case ODR_EXTERNAL_single:
+        return odr_any_equal(a->u.single_ASN1_type, b->u.single_ASN1_type);
+    case ODR_EXTERNAL_octet:
+        return odr_octetstring_equal(a->u.octet_aligned, b->u.octet_aligned);
+    case ODR_EXTERNAL_arbitrary:
+        return odr_bitstring_equal(a->u.arbitrary, b->u.arbitrary);
+    }
+    return 1;
+}
+
+void *odr_sequence_of_clone(NMEM nmem, void *p, int num,
+                            Odr_clone_fun clone)
+{
+    void **src = (void **) p;
+    void **dst;
+    int i;
+
+    if (!src || num <= 0)
+        return src ? nmem_malloc(nmem, sizeof(*dst)) : 0;
+    dst = (void **) nmem_malloc(nmem, sizeof(*dst) * num);
+    for (i = 0; i < num; i++)
+        dst[i] = (*clone)(nmem, src[i]);
+    return dst;
+}
+
+int odr_sequence_of_equal(void *a, int num_a, void *b, int num_b,
+                          Odr_equal_fun equal)
+{
+    void **pa = (void **) a;
+    void **pb = (void **) b;
+    int i;
+
+    if (num_a != num_b)
+        return 0;
+    for (i = 0; i < num_a; i++)
+        if (!(*equal)(pa[i], pb[i]))
+            return 0;
+    return 1;
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -15,12 +15,46 @@
 #include <assert.h>
 
 #include "odr-priv.h"
+#include <yaz/xmalloc.h>
 
 void odr_setlenlen(ODR o, int len)
 {
     o->op->lenlen = len;
 }
 
+int odr_encode_sized(ODR o, Odr_fun type, void *p, const char *name)
+{
+    int pos0 = o->op->pos, top0 = o->op->top;
+    int ret, total;
+
+    if (o->direction != ODR_ENCODE)
+        return (*type)(o, (char **) p, 0, name);
+    /* pass 1: compute content length of each constructed */
+    o->op->sized = 1;
+    o->op->skipped = 0;
+    o->op->lens_num = 0;
+    ret = (*type)(o, (char **) p, 0, name);
+    total = o->op->top + o->op->skipped;
+    o->op->sized = 2;
+    o->op->skipped = 0;
+    o->op->lens_pos = 0;
+    if (ret)
+    {
+        /* pass 2: write into buffer of the exact size */
+        o->op->pos = pos0;
+        o->op->top = top0;
+        if (total > o->op->size && odr_grow_block(o, total - o->op->size))
+        {
+            odr_seterror(o, OSPACE, 58);
+            ret = 0;
+        }
+        else
+            ret = (*type)(o, (char **) p, 0, name);
+    }
+    o->op->sized = 0;
+    return ret;
+}
+
 int odr_constructed_begin(ODR o, void *xxp, int zclass, int tag,
                           const char *name)
 {
@@ -86,7 +120,35 @@ int odr_constructed_begin(ODR o, void *xxp, int zclass, int tag,
     o->op->stack_top->lenb = o->op->bp;
     o->op->stack_top->len_offset = odr_tell(o);
     o->op->stack_top->name = name ? name : "?";
-    if (o->direction == ODR_ENCODE)
+    if (o->direction == ODR_ENCODE && o->op->sized == 1)
+    {
+        /* sizing pass: length octets are counted in odr_constructed_end */
+        if (o->op->lens_num == o->op->lens_max)
+        {
+            o->op->lens_max = o->op->lens_max ? 2 * o->op->lens_max : 64;
+            o->op->lens = (int *)
+                xrealloc(o->op->lens, o->op->lens_max * sizeof(int));
+        }
+        o->op->stack_top->lens_index = o->op->lens_num++;
+    }
+    else if (o->direction == ODR_ENCODE && o->op->sized == 2)
+    {
+        /* writing pass: length is known from the sizing pass */
+        if (o->op->lens_pos >= o->op->lens_num)
+        {
+            odr_seterror(o, OLENOV, 56);
+            ODR_STACK_POP(o);
+            return 0;
+        }
+        o->op->stack_top->lens_index = o->op->lens_pos;
+        if (ber_enclen(o, o->op->lens[o->op->lens_pos++],
+                       sizeof(int) + 1, 0) <= 0)
+        {
+            ODR_STACK_POP(o);
+            return 0;
+        }
+    }
+    else if (o->direction == ODR_ENCODE)
     {
         static char dummy[sizeof(int)+1];
 
@@ -129,7 +191,7 @@ int odr_constructed_begin(ODR o, void *xxp, int zclass, int tag,
         return 0;
     }
     o->op->stack_top->base = o->op->bp;
-    o->op->stack_top->base_offset = odr_tell(o);
+    o->op->stack_top->base_offset = odr_tell(o) + o->op->skipped;
     return 1;
 }
 
@@ -182,7 +244,31 @@ int odr_constructed_end(ODR o)
         ODR_STACK_POP(o);
         return 1;
     case ODR_ENCODE:
-        pos = odr_tell(o);
+        pos = odr_tell(o) + o->op->skipped;
+        if (o->op->sized == 1)
+        {
+            int len = pos - o->op->stack_top->base_offset;
+
+            o->op->lens[o->op->stack_top->lens_index] = len;
+            /* account for the length octets */
+            o->op->skipped++;
+            if (len > 127)
+                for (; len; len >>= 8)
+                    o->op->skipped++;
+            ODR_STACK_POP(o);
+            return 1;
+        }
+        if (o->op->sized == 2)
+        {
+            if (pos - o->op->stack_top->base_offset !=
+                o->op->lens[o->op->stack_top->lens_index])
+            {
+                odr_seterror(o, OLENOV, 57);
+                return 0;
+            }
+            ODR_STACK_POP(o);
+            return 1;
+        }
         odr_seek(o, ODR_S_SET, o->op->stack_top->len_offset);
         if ((res = ber_enclen(o, pos - o->op->stack_top->base_offset,
                               o->op->stack_top->lenlen, 1)) < 0)
@@ -102,7 +102,13 @@ int odr_write(ODR o, const char *buf, int bytes)
         odr_seterror(o, OSPACE, 40);
         return -1;
     }
-    if (o->op->pos + bytes >= o->op->size && odr_grow_block(o, bytes))
+    if (o->op->sized == 1)
+    {
+        /* sizing pass: only the length matters */
+        o->op->skipped += bytes;
+        return 0;
+    }
+    if (o->op->pos + bytes > o->op->size && odr_grow_block(o, bytes))
     {
         odr_seterror(o, OSPACE, 40);
         return -1;
@@ -48,7 +48,7 @@ int odr_octetstring(ODR o, Odr_oct **p, int opt, const char *name)
         (*p)->len = 0;
         (*p)->buf = 0;
     }
-    if (ber_octetstring(o, *p, cons))
+    if (ber_octetstring_x(o, *p, cons, 1))
         return 1;
     odr_seterror(o, OOTHER, 43);
     return 0;
@@ -259,6 +259,100 @@ int z_External(ODR o, Z_External **p, int opt, const char *name)
         odr_sequence_end(o);
 }
 
+#define EXT_CLONE(which, f) \
+    {which, (Odr_clone_fun) f##_clone, (Odr_equal_fun) f##_equal}
+
+/* clone and equal functions for each arm of the EXTERNAL CHOICE */
+static struct ext_clone_ent {
+    int which;
+    Odr_clone_fun clone;
+    Odr_equal_fun equal;
+} ext_clone_table[] =
+{
+    EXT_CLONE(Z_External_single, odr_any),
+    EXT_CLONE(Z_External_octet, odr_octetstring),
+    EXT_CLONE(Z_External_arbitrary, odr_bitstring),
+    EXT_CLONE(Z_External_sutrs, z_SUTRS),
+    EXT_CLONE(Z_External_explainRecord, z_ExplainRecord),
+    EXT_CLONE(Z_External_resourceReport1, z_ResourceReport1),
+    EXT_CLONE(Z_External_resourceReport2, z_ResourceReport2),
+    EXT_CLONE(Z_External_promptObject1, z_PromptObject1),
+    EXT_CLONE(Z_External_grs1, z_GenericRecord),
+    EXT_CLONE(Z_External_extendedService, z_TaskPackage),
+    EXT_CLONE(Z_External_itemOrder, z_IOItemOrder),
+    EXT_CLONE(Z_External_diag1, z_DiagnosticFormat),
+    EXT_CLONE(Z_External_espec1, z_Espec1),
+    EXT_CLONE(Z_External_summary, z_BriefBib),
+    EXT_CLONE(Z_External_OPAC, z_OPACRecord),
+    EXT_CLONE(Z_External_searchResult1, z_SearchInfoReport),
+    EXT_CLONE(Z_External_update, z_IUUpdate),
+    EXT_CLONE(Z_External_dateTime, z_DateTime),
+    EXT_CLONE(Z_External_universeReport, z_UniverseReport),
+    EXT_CLONE(Z_External_ESAdmin, z_Admin),
+    EXT_CLONE(Z_External_update0, z_IU0Update),
+    EXT_CLONE(Z_External_userInfo1, z_OtherInformation),
+    EXT_CLONE(Z_External_userFacets, z_FacetList),
+    EXT_CLONE(Z_External_charSetandLanguageNegotiation, z_CharSetandLanguageNegotiation),
+    EXT_CLONE(Z_External_acfPrompt1, z_PromptObject1),
+    EXT_CLONE(Z_External_acfDes1, z_DES_RN_Object),
+    EXT_CLONE(Z_External_acfKrb1, z_KRBObject),
+    EXT_CLONE(Z_External_multisrch2, z_MultipleSearchTerms_2),
+    EXT_CLONE(Z_External_CQL, z_InternationalString),
+    EXT_CLONE(Z_External_OCLCUserInfo, z_OCLC_UserInformation),
+    EXT_CLONE(Z_External_persistentResultSet, z_PRPersistentResultSet),
+    EXT_CLONE(Z_External_persistentQuery, z_PQueryPersistentQuery),
+    EXT_CLONE(Z_External_periodicQuerySchedule, z_PQSPeriodicQuerySchedule),
+    EXT_CLONE(Z_External_exportSpecification, z_ESExportSpecification),
+    EXT_CLONE(Z_External_exportInvocation, z_EIExportInvocation),
+    {-1, 0, 0}
+};
+
+static struct ext_clone_ent *ext_clone_getent(int which)
+{
+    struct ext_clone_ent *e;
+
+    for (e = ext_clone_table; e->which != -1; e++)
+        if (e->which == which)
+            return e;
+    return 0;
+}
+
+Z_External *z_External_clone(NMEM nmem, const Z_External *p)
+{
+    struct ext_clone_ent *e;
+    Z_External *r;
+
+    if (!p)
+        return 0;
+    r = (Z_External *) nmem_malloc(nmem, sizeof(*r));
+    r->direct_reference = odr_oid_clone(nmem, p->direct_reference);
+    r->indirect_reference = odr_integer_clone(nmem, p->indirect_reference);
+    r->descriptor = odr_graphicstring_clone(nmem, p->descriptor);
+    r->which = p->which;
+    if ((e = ext_clone_getent(p->which)))
+        r->u.single_ASN1_type = (Odr_any *)
+            (*e->clone)(nmem, p->u.single_ASN1_type);
+    else
+        r->u = p->u;
+    return r;
+}
+
+int z_External_equal(const Z_External *a, const Z_External *b)
+{
+    struct ext_clone_ent *e;
+
+    if (!a || !b)
+        return a == b;
+    if (!odr_oid_equal(a->direct_reference, b->direct_reference) ||
+        !odr_integer_equal(a->indirect_reference, b->indirect_reference) ||
+        !odr_graphicstring_equal(a->descriptor, b->descriptor) ||
+        a->which != b->which)
+        return 0;
+    if ((e = ext_clone_getent(a->which)))
+        return (*e->equal)(a->u.single_ASN1_type, b->u.single_ASN1_type);
+    return a->u.single_ASN1_type == b->u.single_ASN1_type;
+}
+
 Z_External *z_ext_record_oid_nmem(NMEM nmem, const Odr_oid *oid,
                                   const char *buf, int len)
 {
@@ -26,6 +26,7 @@
 #include <yaz/url.h>
 #include <yaz/srw.h>
 #include <yaz/timing.h>
+#include <yaz/mutex.h>
 
 #if YAZ_HAVE_XML2
 #include <libxml/parser.h>
@@ -36,6 +37,7 @@
 #if YAZ_HAVE_XSLT
 #include <libxslt/xsltutils.h>
 #include <libxslt/transform.h>
+#include <libxslt/imports.h>
 #endif
 #if YAZ_HAVE_EXSLT
 #include <libexslt/exslt.h>
@@ -59,6 +61,12 @@ struct yaz_record_conv_struct {
     char *path;
 };
 
+/** \brief configured yaz_marc_t handle, not in use */
+struct marc_handle {
+    yaz_marc_t mt;
+    struct marc_handle *next;
+};
+
 struct marc_info {
     NMEM nmem;
     const char *input_charset;
@@ -66,15 +74,48 @@ struct marc_info {
     int input_format_mode;
     int output_format_mode;
     const char *leader_spec;
+    /** \brief protects handles */
+    YAZ_MUTEX mutex;
+    /** \brief idle handles, one for each thread that converted at once */
+    struct marc_handle *handles;
 };
 
 /** \brief transformation info (rule info) */
 struct yaz_record_conv_rule {
     struct yaz_record_conv_type *type;
     void *info;
+    /** \brief converts a parsed record; 0 if the rule takes bytes only
+
+        Takes ownership of doc. If doc_out is non-NULL the result may be
+        left as a tree in *doc_out; otherwise it is written to record.
+    */
+    int (*convert_doc)(void *info, xmlDocPtr doc, xmlDocPtr *doc_out,
+                       WRBUF record, WRBUF wr_error);
     struct yaz_record_conv_rule *next;
 };
 
+static xmlDocPtr parse_record(WRBUF record, WRBUF wr_error)
+{
+    xmlDocPtr doc = xmlParseMemory(wrbuf_buf(record), wrbuf_len(record));
+    if (!doc)
+        wrbuf_printf(wr_error, "xmlParseMemory failed");
+    return doc;
+}
+
+/* serializes a tree handed on by a rule the way that rule would have */
+static void record_tree_dump(xmlDocPtr doc, xmlChar **buf, int *len)
+{
+#if YAZ_HAVE_XSLT && HAVE_XSLTSAVERESULTTOSTRING
+    if (doc->_private) /* stylesheet of xslt rule */
+    {
+        xsltSaveResultToString(buf, len, doc,
+                               (xsltStylesheetPtr) doc->_private);
+        return;
+    }
+#endif
+    xmlDocDumpFormatMemory(doc, buf, len, 1);
+}
+
 /** \brief reset rules+configuration */
 static void yaz_record_conv_reset(yaz_record_conv_t p)
 {
@@ -108,7 +149,8 @@ void yaz_record_conv_destroy(yaz_record_conv_t p)
 #if YAZ_HAVE_XSLT
 struct xslt_info {
     NMEM nmem;
-    xmlDocPtr xsp_doc;
+    /** \brief compiled stylesheet; read-only when converting */
+    xsltStylesheetPtr xsp;
     const char **xsl_parms;
 };
 
@@ -206,7 +248,7 @@ static void *construct_xslt(const xmlNode *ptr,
     else
     {
         char fullpath[1024];
-        xsltStylesheetPtr xsp;
+        xmlDocPtr xsp_doc;
         if (!yaz_filepath_resolve(stylesheet, path, 0, fullpath))
         {
             wrbuf_printf(wr_error, "Element <xslt stylesheet=\"%s\"/>:"
@@ -218,8 +260,8 @@ static void *construct_xslt(const xmlNode *ptr,
             nmem_destroy(nmem);
             return 0;
         }
-        info->xsp_doc = xmlParseFile(fullpath);
-        if (!info->xsp_doc)
+        xsp_doc = xmlParseFile(fullpath);
+        if (!xsp_doc)
         {
             wrbuf_printf(wr_error, "Element: <xslt stylesheet=\"%s\"/>:"
                          " xml parse failed: %s", stylesheet, fullpath);
@@ -228,10 +270,10 @@ static void *construct_xslt(const xmlNode *ptr,
             nmem_destroy(nmem);
             return 0;
         }
-        /* need to copy this before passing it to the processor. It will
-           be encapsulated in the xsp and destroyed by xsltFreeStylesheet */
-        xsp = xsltParseStylesheetDoc(xmlCopyDoc(info->xsp_doc, 1));
-        if (!xsp)
+        /* xsp_doc is encapsulated in the xsp and destroyed by
+           xsltFreeStylesheet */
+        info->xsp = xsltParseStylesheetDoc(xsp_doc);
+        if (!info->xsp)
         {
             wrbuf_printf(wr_error, "Element: <xslt stylesheet=\"%s\"/>:"
                          " xslt parse failed: %s", stylesheet, fullpath);
@@ -245,78 +287,90 @@ static void *construct_xslt(const xmlNode *ptr,
                          "EXSLT not supported"
 #endif
                          ")");
-            xmlFreeDoc(info->xsp_doc);
+            xmlFreeDoc(xsp_doc);
             nmem_destroy(info->nmem);
         }
         else
-        {
-            xsltFreeStylesheet(xsp);
             return info;
-        }
     }
     return 0;
 }
 
-static int convert_xslt(void *vinfo, WRBUF record, WRBUF wr_error)
+/* returns 1 if serializing res and parsing it again yields the same tree
+   (apart from whitespace added by indent="yes") */
+static int xslt_result_is_xml(xsltStylesheetPtr xsp, xmlDocPtr res)
+{
+    const xmlChar *method;
+
+    XSLT_GET_IMPORT_PTR(method, xsp, method);
+    return res->type == XML_DOCUMENT_NODE && xmlDocGetRootElement(res)
+        && (!method || xmlStrEqual(method, BAD_CAST "xml"));
+}
+
+static int convert_xslt_doc(void *vinfo, xmlDocPtr doc, xmlDocPtr *doc_out,
+                            WRBUF record, WRBUF wr_error)
 {
     int ret = 0;
     struct xslt_info *info = vinfo;
+    /* the transformation context is private to this call, so the
+       compiled stylesheet may be applied by several threads at once */
+    xsltStylesheetPtr xsp = info->xsp;
+    xmlDocPtr res = xsltApplyStylesheet(xsp, doc, info->xsl_parms);
 
-    xmlDocPtr doc = xmlParseMemory(wrbuf_buf(record),
-                                   wrbuf_len(record));
-    if (!doc)
+    xmlFreeDoc(doc);
+    if (!res)
     {
-        wrbuf_printf(wr_error, "xmlParseMemory failed");
+        wrbuf_printf(wr_error, "xsltApplyStylesheet failed");
         ret = -1;
     }
+    else if (doc_out && xslt_result_is_xml(xsp, res))
+    {
+        res->_private = xsp;
+        *doc_out = res;
+    }
     else
     {
-        xmlDocPtr xsp_doc = xmlCopyDoc(info->xsp_doc, 1);
-        xsltStylesheetPtr xsp = xsltParseStylesheetDoc(xsp_doc);
-        xmlDocPtr res = xsltApplyStylesheet(xsp, doc, info->xsl_parms);
-        if (res)
-        {
-            xmlChar *out_buf = 0;
-            int out_len;
+        xmlChar *out_buf = 0;
+        int out_len;
 
 #if HAVE_XSLTSAVERESULTTOSTRING
-            xsltSaveResultToString(&out_buf, &out_len, res, xsp);
+        xsltSaveResultToString(&out_buf, &out_len, res, xsp);
 #else
-            xmlDocDumpFormatMemory (res, &out_buf, &out_len, 1);
+        xmlDocDumpFormatMemory (res, &out_buf, &out_len, 1);
 #endif
-            if (!out_buf)
-            {
-                wrbuf_printf(wr_error,
-                             "xsltSaveResultToString failed");
-                ret = -1;
-            }
-            else
-            {
-                wrbuf_rewind(record);
-                wrbuf_write(record, (const char *) out_buf, out_len);
-
-                xmlFree(out_buf);
-            }
-            xmlFreeDoc(res);
+        if (!out_buf)
+        {
+            wrbuf_printf(wr_error,
+                         "xsltSaveResultToString failed");
+            ret = -1;
         }
         else
         {
-            wrbuf_printf(wr_error, "xsltApplyStylesheet failed");
-            ret = -1;
+            wrbuf_rewind(record);
+            wrbuf_write(record, (const char *) out_buf, out_len);
+
+            xmlFree(out_buf);
         }
-        xmlFreeDoc(doc);
-        xsltFreeStylesheet(xsp); /* frees xsp_doc too */
+        xmlFreeDoc(res);
     }
     return ret;
 }
 
+static int convert_xslt(void *vinfo, WRBUF record, WRBUF wr_error)
+{
+    xmlDocPtr doc = parse_record(record, wr_error);
+    if (!doc)
+        return -1;
+    return convert_xslt_doc(vinfo, doc, 0, record, wr_error);
+}
+
 static void destroy_xslt(void *vinfo)
 {
     struct xslt_info *info = vinfo;
 
     if (info)
     {
-        xmlFreeDoc(info->xsp_doc);
+        xsltFreeStylesheet(info->xsp); /* frees stylesheet doc too */
         nmem_destroy(info->nmem);
     }
 }
@@ -357,51 +411,67 @@ static void *construct_select(const xmlNode *ptr,
     }
 }
 
-static int convert_select(void *vinfo, WRBUF record, WRBUF wr_error)
+static int convert_select_doc(void *vinfo, xmlDocPtr doc, xmlDocPtr *doc_out,
+                              WRBUF record, WRBUF wr_error)
 {
-    int ret = 0;
     struct select_info *info = vinfo;
+    xmlXPathContextPtr xpathCtx = xmlXPathNewContext(doc);
+    int matched = 0;
 
-    xmlDocPtr doc = xmlParseMemory(wrbuf_buf(record),
-                                   wrbuf_len(record));
-    if (!doc)
+    if (xpathCtx && info->xpath_expr)
     {
-        wrbuf_printf(wr_error, "xmlParseMemory failed");
-        ret = -1;
-    }
-    else
-    {
-        xmlXPathContextPtr xpathCtx = xmlXPathNewContext(doc);
-        if (xpathCtx && info->xpath_expr)
+        xmlXPathObjectPtr xpathObj =
+            xmlXPathEvalExpression((const xmlChar *) info->xpath_expr,
+                                   xpathCtx);
+        if (xpathObj)
         {
-            xmlXPathObjectPtr xpathObj =
-                xmlXPathEvalExpression((const xmlChar *) info->xpath_expr,
-                                       xpathCtx);
-            if (xpathObj)
+            xmlNodeSetPtr nodes = xpathObj->nodesetval;
+            if (nodes)
             {
-                xmlNodeSetPtr nodes = xpathObj->nodesetval;
-                if (nodes)
+                int i;
+                if (nodes->nodeNr > 0)
                 {
-                    int i;
-                    if (nodes->nodeNr > 0)
-                        wrbuf_rewind(record);
-                    for (i = 0; i < nodes->nodeNr; i++)
-                    {
-                        xmlNode *ptr = nodes->nodeTab[i];
-                        if (ptr->type == XML_ELEMENT_NODE)
-                            ptr = ptr->children;
-                        for (; ptr; ptr = ptr->next)
-                            if (ptr->type == XML_TEXT_NODE)
-                                wrbuf_puts(record, (const char *) ptr->content);
-                    }
+                    wrbuf_rewind(record);
+                    matched = 1;
+                }
+                for (i = 0; i < nodes->nodeNr; i++)
+                {
+                    xmlNode *ptr = nodes->nodeTab[i];
+                    if (ptr->type == XML_ELEMENT_NODE)
+                        ptr = ptr->children;
+                    for (; ptr; ptr = ptr->next)
+                        if (ptr->type == XML_TEXT_NODE)
+                            wrbuf_puts(record, (const char *) ptr->content);
                 }
-                xmlXPathFreeObject(xpathObj);
             }
-            xmlXPathFreeContext(xpathCtx);
+            xmlXPathFreeObject(xpathObj);
         }
-        xmlFreeDoc(doc);
     }
-    return ret;
+    if (xpathCtx)
+        xmlXPathFreeContext(xpathCtx);
+    if (!matched && wrbuf_len(record) == 0)
+    {
+        /* input was handed over as a tree; output it unchanged */
+        xmlChar *out_buf = 0;
+        int out_len;
+
+        record_tree_dump(doc, &out_buf, &out_len);
+        if (out_buf)
+        {
+            wrbuf_write(record, (const char *) out_buf, out_len);
+            xmlFree(out_buf);
+        }
+    }
+    xmlFreeDoc(doc);
+    return 0;
+}
+
+static int convert_select(void *vinfo, WRBUF record, WRBUF wr_error)
+{
+    xmlDocPtr doc = parse_record(record, wr_error);
+    if (!doc)
+        return -1;
+    return convert_select_doc(vinfo, doc, 0, record, wr_error);
 }
 
 static void destroy_select(void *vinfo)
@@ -609,78 +679,127 @@ static void *construct_marc(const xmlNode *ptr,
     }
     info->input_charset = nmem_strdup(info->nmem, info->input_charset);
     info->output_charset = nmem_strdup(info->nmem, info->output_charset);
+    info->mutex = 0;
+    yaz_mutex_create(&info->mutex);
+    info->handles = 0;
     return info;
 }
 
+/* converts the record read into mt and writes it to record */
+static int convert_marc_write(struct marc_info *mi, yaz_marc_t mt,
+                              const char *input_charset,
+                              WRBUF record, WRBUF wr_error)
+{
+    int ret;
+    yaz_iconv_t cd = yaz_iconv_open_cached(mi->output_charset, input_charset);
+
+    yaz_marc_iconv(mt, cd);
+
+    wrbuf_rewind(record);
+    ret = yaz_marc_write_mode(mt, record);
+    if (ret)
+        wrbuf_printf(wr_error, "yaz_marc_write_mode failed");
+    yaz_marc_iconv(mt, 0);
+    yaz_iconv_close_cached(cd);
+    return ret;
+}
+
+/* takes an idle handle of the rule, or creates one */
+static struct marc_handle *marc_handle_get(struct marc_info *mi)
+{
+    struct marc_handle *h;
+
+    yaz_mutex_enter(mi->mutex);
+    h = mi->handles;
+    if (h)
+        mi->handles = h->next;
+    yaz_mutex_leave(mi->mutex);
+    if (!h)
+    {
+        h = (struct marc_handle *) xmalloc(sizeof(*h));
+        h->mt = yaz_marc_create();
+        yaz_marc_xml(h->mt, mi->output_format_mode);
+        if (mi->leader_spec)
+            yaz_marc_leader_spec(h->mt, mi->leader_spec);
+    }
+    return h;
+}
+
+/* resets handle and returns it to the idle handles of the rule */
+static void marc_handle_put(struct marc_info *mi, struct marc_handle *h)
+{
+    yaz_marc_reset(h->mt);
+    yaz_mutex_enter(mi->mutex);
+    h->next = mi->handles;
+    mi->handles = h;
+    yaz_mutex_leave(mi->mutex);
+}
+
+/* for MARCXML and TurboMARC input only */
+static int convert_marc_doc(void *info, xmlDocPtr doc, xmlDocPtr *doc_out,
+                            WRBUF record, WRBUF wr_error)
+{
+    struct marc_info *mi = info;
+    struct marc_handle *h = marc_handle_get(mi);
+    int ret = yaz_marc_read_xml(h->mt, xmlDocGetRootElement(doc));
+
+    if (ret)
+        wrbuf_printf(wr_error, "yaz_marc_read_xml failed");
+    else
+        ret = convert_marc_write(mi, h->mt, mi->input_charset,
+                                 record, wr_error);
+    marc_handle_put(mi, h);
+    xmlFreeDoc(doc);
+    return ret;
+}
+
 static int convert_marc(void *info, WRBUF record, WRBUF wr_error)
 {
     struct marc_info *mi = info;
     const char *input_charset = mi->input_charset;
     int ret = 0;
-    yaz_marc_t mt = yaz_marc_create();
-
-    yaz_marc_xml(mt, mi->output_format_mode);
-    if (mi->leader_spec)
-        yaz_marc_leader_spec(mt, mi->leader_spec);
+    struct marc_handle *h;
 
-    if (mi->input_format_mode == YAZ_MARC_ISO2709)
-    {
-        int sz = yaz_marc_read_iso2709(mt, wrbuf_buf(record),
-                                       wrbuf_len(record));
-        if (sz > 0)
-        {
-            if (yaz_marc_check_marc21_coding(input_charset, wrbuf_buf(record),
-                                             wrbuf_len(record)))
-                input_charset = "utf-8";
-            ret = 0;
-        }
-        else
-            ret = -1;
-    }
-    else if (mi->input_format_mode == YAZ_MARC_MARCXML ||
-             mi->input_format_mode == YAZ_MARC_TURBOMARC)
+    if (mi->input_format_mode == YAZ_MARC_MARCXML ||
+        mi->input_format_mode == YAZ_MARC_TURBOMARC)
     {
-        xmlDocPtr doc = xmlParseMemory(wrbuf_buf(record),
-                                       wrbuf_len(record));
+        xmlDocPtr doc = parse_record(record, wr_error);
         if (!doc)
-        {
-            wrbuf_printf(wr_error, "xmlParseMemory failed");
-            ret = -1;
-        }
-        else
-        {
-            ret = yaz_marc_read_xml(mt, xmlDocGetRootElement(doc));
-            if (ret)
-                wrbuf_printf(wr_error, "yaz_marc_read_xml failed");
-        }
-        xmlFreeDoc(doc);
+            return -1;
+        return convert_marc_doc(info, doc, 0, record, wr_error);
     }
-    else
+    if (mi->input_format_mode != YAZ_MARC_ISO2709)
     {
         wrbuf_printf(wr_error, "unsupported input format");
-        ret = -1;
+        return -1;
     }
-    if (ret == 0)
+    h = marc_handle_get(mi);
+    if (yaz_marc_read_iso2709(h->mt, wrbuf_buf(record),
+                              wrbuf_len(record)) > 0)
     {
-        yaz_iconv_t cd = yaz_iconv_open(mi->output_charset, input_charset);
-
-        if (cd)
-            yaz_marc_iconv(mt, cd);
-
-        wrbuf_rewind(record);
-        ret = yaz_marc_write_mode(mt, record);
-        if (ret)
-            wrbuf_printf(wr_error, "yaz_marc_write_mode failed");
-        if (cd)
-            yaz_iconv_close(cd);
+        if (yaz_marc_check_marc21_coding(input_charset, wrbuf_buf(record),
+                                         wrbuf_len(record)))
+            input_charset = "utf-8";
+        ret = convert_marc_write(mi, h->mt, input_charset, record, wr_error);
     }
-    yaz_marc_destroy(mt);
+    else
+        ret = -1;
+    marc_handle_put(mi, h);
     return ret;
 }
 
 static void destroy_marc(void *info)
 {
     struct marc_info *mi = info;
+
+    while (mi->handles)
+    {
+        struct marc_handle *h = mi->handles;
+        mi->handles = h->next;
+        yaz_marc_destroy(h->mt);
+        xfree(h);
+    }
+    yaz_mutex_destroy(&mi->mutex);
     nmem_destroy(mi->nmem);
 }
 
@@ -1054,66 +1173,67 @@ static void rdf_lookup_node(xmlNode *n, xmlXPathContextPtr xpathCtx,
     wrbuf_destroy(uri);
 }
 
-static int convert_rdf_lookup(void *rinfo, WRBUF record, WRBUF wr_error)
+static int convert_rdf_lookup_doc(void *rinfo, xmlDocPtr doc,
+                                  xmlDocPtr *doc_out,
+                                  WRBUF record, WRBUF wr_error)
 {
     int ret = 0;
     struct rdf_lookup_info *info = rinfo;
+    xmlXPathContextPtr xpathCtx = xmlXPathNewContext(doc);
 
-    xmlDocPtr doc = xmlParseMemory(wrbuf_buf(record),
-                                   wrbuf_len(record));
     yaz_log(YLOG_DEBUG, "rdf_lookup convert starting");
-    if (!doc)
+    if (xpathCtx)
     {
-        wrbuf_printf(wr_error, "xmlParseMemory failed");
-        ret = -1;
-    }
-    else
-    {
-        xmlChar *out_buf = 0;
-        int out_len;
-        xmlXPathContextPtr xpathCtx = xmlXPathNewContext(doc);
-        if (xpathCtx)
+        char **ns = info->namespacelist;
+        while (*ns)
         {
-            char **ns = info->namespacelist;
-            while (*ns)
-            {
-                xmlXPathRegisterNs(xpathCtx, (const xmlChar *)ns[0],
-                                   (const xmlChar *)ns[1]);
-                ns += 2;
-            }
-            while (info)
+            xmlXPathRegisterNs(xpathCtx, (const xmlChar *)ns[0],
+                               (const xmlChar *)ns[1]);
+            ns += 2;
+        }
+        while (info)
+        {
+            xmlXPathObjectPtr xpathObj =
+                xmlXPathEvalExpression((xmlChar *)(info->xpath), xpathCtx);
+            yaz_log(YLOG_DEBUG, "xpath: %p %s", xpathObj, info->xpath);
+            if (xpathObj)
             {
-                xmlXPathObjectPtr xpathObj =
-                    xmlXPathEvalExpression((xmlChar *)(info->xpath), xpathCtx);
-                yaz_log(YLOG_DEBUG, "xpath: %p %s", xpathObj, info->xpath);
-                if (xpathObj)
+                xmlNodeSetPtr nodes = xpathObj->nodesetval;
+                yaz_log(YLOG_DEBUG, "nodeset: %p", nodes);
+                if (nodes)
                 {
-                    xmlNodeSetPtr nodes = xpathObj->nodesetval;
-                    yaz_log(YLOG_DEBUG, "nodeset: %p", nodes);
-                    if (nodes)
+                    int i;
+                    for (i = 0; i < nodes->nodeNr; i++)
                     {
-                        int i;
-                        for (i = 0; i < nodes->nodeNr; i++)
-                        {
-                            xmlNode *ptr = nodes->nodeTab[i];
-                            yaz_log(YLOG_DEBUG, " node %d: t=%d n='%s' c='%s'", i, ptr->type,
-                                    (const char*) ptr->name, ptr->content);
-                            rdf_lookup_node(ptr, xpathCtx, info);
-                        }
+                        xmlNode *ptr = nodes->nodeTab[i];
+                        yaz_log(YLOG_DEBUG, " node %d: t=%d n='%s' c='%s'", i, ptr->type,
+                                (const char*) ptr->name, ptr->content);
+                        rdf_lookup_node(ptr, xpathCtx, info);
                     }
-                    xmlXPathFreeObject(xpathObj);
                 }
-                else
-                {
-                    wrbuf_printf(wr_error,
-                                 "Cannot compile X-Path expr: %s",
-                                 info->xpath);
-                    ret = -1;
-                }
-                info = info->next;
+                xmlXPathFreeObject(xpathObj);
             }
-            xmlXPathFreeContext(xpathCtx);
+            else
+            {
+                wrbuf_printf(wr_error,
+                             "Cannot compile X-Path expr: %s",
+                             info->xpath);
+                ret = -1;
+            }
+            info = info->next;
         }
+        xmlXPathFreeContext(xpathCtx);
+    }
+    if (doc_out && ret == 0)
+    {
+        doc->_private = 0;
+        *doc_out = doc;
+    }
+    else
+    {
+        xmlChar *out_buf = 0;
+        int out_len;
+
         xmlDocDumpFormatMemory (doc, &out_buf, &out_len, 1);
         if (!out_buf)
         {
@@ -1133,6 +1253,14 @@ static int convert_rdf_lookup(void *rinfo, WRBUF record, WRBUF wr_error)
     return ret;
 }
 
+static int convert_rdf_lookup(void *rinfo, WRBUF record, WRBUF wr_error)
+{
+    xmlDocPtr doc = parse_record(record, wr_error);
+    if (!doc)
+        return -1;
+    return convert_rdf_lookup_doc(rinfo, doc, 0, record, wr_error);
+}
+
 int yaz_record_conv_configure_t(yaz_record_conv_t p, const xmlNode *ptr,
                                 struct yaz_record_conv_type *types)
 {
@@ -1198,6 +1326,22 @@ int yaz_record_conv_configure_t(yaz_record_conv_t p, const xmlNode *ptr,
         r = (struct yaz_record_conv_rule *) nmem_malloc(p->nmem, sizeof(*r));
         r->next = 0;
         r->info = info;
+        r->convert_doc = 0;
+        if (t->construct == construct_select)
+            r->convert_doc = convert_select_doc;
+        else if (t->construct == construct_marc)
+        {
+            struct marc_info *mi = info;
+            if (mi->input_format_mode == YAZ_MARC_MARCXML ||
+                mi->input_format_mode == YAZ_MARC_TURBOMARC)
+                r->convert_doc = convert_marc_doc;
+        }
+#if YAZ_HAVE_XSLT
+        else if (t->construct == construct_xslt)
+            r->convert_doc = convert_xslt_doc;
+        else if (t->construct == construct_rdf_lookup)
+            r->convert_doc = convert_rdf_lookup_doc;
+#endif
         r->type = nmem_malloc(p->nmem, sizeof(*t));
         memcpy(r->type, t, sizeof(*t));
         *p->rules_p = r;
@@ -1211,19 +1355,42 @@ int yaz_record_conv_configure(yaz_record_conv_t p, const xmlNode *ptr)
     return yaz_record_conv_configure_t(p, ptr, 0);
 }
 
-static int yaz_record_conv_record_rule(yaz_record_conv_t p,
-                                       struct yaz_record_conv_rule *r,
+static int yaz_record_conv_record_rule(struct yaz_record_conv_rule *r,
                                        const char *input_record_buf,
                                        size_t input_record_len,
-                                       WRBUF output_record)
+                                       WRBUF output_record, WRBUF wr_error)
 {
     int ret = 0;
     WRBUF record = output_record; /* pointer transfer */
-    wrbuf_rewind(p->wr_error);
+    xmlDocPtr doc = 0; /* record as tree, when record itself is empty */
+    wrbuf_rewind(wr_error);
 
     wrbuf_write(record, input_record_buf, input_record_len);
     for (; ret == 0 && r; r = r->next)
-        ret = r->type->convert(r->info, record, p->wr_error);
+    {
+        /* a tree is handed on only to a rule that takes one */
+        int tree_out = r->next && r->next->convert_doc;
+
+        if (r->convert_doc && (doc || tree_out))
+        {
+            xmlDocPtr doc_out = 0;
+
+            if (!doc && !(doc = parse_record(record, wr_error)))
+                ret = -1;
+            else
+            {
+                ret = r->convert_doc(r->info, doc, tree_out ? &doc_out : 0,
+                                     record, wr_error);
+                doc = doc_out;
+                if (doc)
+                    wrbuf_rewind(record);
+            }
+        }
+        else
+            ret = r->type->convert(r->info, record, wr_error);
+    }
+    if (doc)
+        xmlFreeDoc(doc);
     return ret;
 }
 
@@ -1256,31 +1423,26 @@ int yaz_record_conv_opac_record(yaz_record_conv_t p,
         yaz_iconv_t cd;
 
         WRBUF res = wrbuf_alloc();
-        yaz_marc_t mt = yaz_marc_create();
+        struct marc_handle *h = marc_handle_get(mi);
 
         if (yaz_opac_check_marc21_coding(input_charset, input_record))
             input_charset = "utf-8";
-        cd = yaz_iconv_open("utf-8", input_charset);
+        cd = yaz_iconv_open_cached("utf-8", input_charset);
 
         wrbuf_rewind(p->wr_error);
-        yaz_marc_xml(mt, mi->output_format_mode);
 
-        if (mi->leader_spec)
-            yaz_marc_leader_spec(mt, mi->leader_spec);
-
-        yaz_marc_iconv(mt, cd);
+        yaz_marc_iconv(h->mt, cd);
 
-        yaz_opac_decode_wrbuf(mt, input_record, res);
+        yaz_opac_decode_wrbuf(h->mt, input_record, res);
         if (ret != -1)
         {
-            ret = yaz_record_conv_record_rule(p,
-                                              r->next,
+            ret = yaz_record_conv_record_rule(r->next,
                                               wrbuf_buf(res), wrbuf_len(res),
-                                              output_record);
+                                              output_record, p->wr_error);
         }
-        yaz_marc_destroy(mt);
-        if (cd)
-            yaz_iconv_close(cd);
+        yaz_marc_iconv(h->mt, 0);
+        marc_handle_put(mi, h);
+        yaz_iconv_close_cached(cd);
         wrbuf_destroy(res);
     }
     return ret;
@@ -1291,9 +1453,21 @@ int yaz_record_conv_record(yaz_record_conv_t p,
                            size_t input_record_len,
                            WRBUF output_record)
 {
-    return yaz_record_conv_record_rule(p, p->rules,
+    return yaz_record_conv_record_rule(p->rules,
+                                       input_record_buf,
+                                       input_record_len, output_record,
+                                       p->wr_error);
+}
+
+int yaz_record_conv_record_r(yaz_record_conv_t p,
+                             const char *input_record_buf,
+                             size_t input_record_len,
+                             WRBUF output_record, WRBUF wr_error)
+{
+    return yaz_record_conv_record_rule(p->rules,
                                        input_record_buf,
-                                       input_record_len, output_record);
+                                       input_record_len, output_record,
+                                       wr_error);
 }
 
 const char *yaz_record_conv_get_error(yaz_record_conv_t p)
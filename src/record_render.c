@@ -68,12 +68,12 @@ static yaz_iconv_t iconv_create_charset(const char *record_charset,
     {
         if (yaz_marc_check_marc21_coding(from_set1, marc_buf, sz))
             from_set1 = "utf-8";
-        cd = yaz_iconv_open(to_set, from_set1);
+        cd = yaz_iconv_open_cached(to_set, from_set1);
     }
     if (cd2)
     {
         if (from_set2)
-            *cd2 = yaz_iconv_open(to_set, from_set2);
+            *cd2 = yaz_iconv_open_cached(to_set, from_set2);
         else
             *cd2 = 0;
     }
@@ -100,7 +100,7 @@ static const char *return_marc_record(WRBUF wrbuf,
     }
     yaz_marc_destroy(mt);
     if (cd)
-        yaz_iconv_close(cd);
+        yaz_iconv_close_cached(cd);
     return ret_string;
 }
 
@@ -138,9 +138,9 @@ static const char *return_opac_record(WRBUF wrbuf,
     yaz_marc_destroy(mt);
 
     if (cd)
-        yaz_iconv_close(cd);
+        yaz_iconv_close_cached(cd);
     if (cd2)
-        yaz_iconv_close(cd2);
+        yaz_iconv_close_cached(cd2);
     *len = wrbuf_len(wrbuf);
     return wrbuf_cstr(wrbuf);
 }
@@ -159,7 +159,7 @@ static const char *return_string_record(WRBUF wrbuf,
 
         buf = wrbuf_cstr(wrbuf);
         sz = wrbuf_len(wrbuf);
-        yaz_iconv_close(cd);
+        yaz_iconv_close_cached(cd);
     }
     *len = sz;
     return buf;
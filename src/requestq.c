@@ -83,6 +83,8 @@ request *request_get(request_q *q)
     r->request_mem = 0;
     r->len_response = 0;
     r->clientData = 0;
+    r->search_rr = 0;
+    r->pack = 0;
     r->state = REQUEST_IDLE;
     r->next = 0;
     return r;
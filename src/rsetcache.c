@@ -0,0 +1,293 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file rsetcache.c
+ * \brief Implements the GFS result set cache.
+ *
+ * Entries are kept in a hash table on the search key and in a list in
+ * least recently used order. An entry expires after the time given
+ * when it was added, but never later than the TTL of the cache. When
+ * the entries take more memory than the budget, the least recently
+ * used ones are removed.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <time.h>
+
+#include <yaz/log.h>
+#include <yaz/mutex.h>
+#include <yaz/xmalloc.h>
+#include "rsetcache.h"
+
+#define RSETCACHE_HASH 1021
+
+struct rsetcache_entry {
+    char *key;
+    char *owner;
+    char *setname;
+    char *extra_response_data;
+    Odr_int hits;
+    int estimated_hit_count;
+    int partial_resultset;
+    time_t expire;
+    size_t size;
+    struct rsetcache_entry *hash_next;
+    struct rsetcache_entry *lru_prev;  /* more recently used */
+    struct rsetcache_entry *lru_next;  /* less recently used */
+};
+
+struct rsetcache_s {
+    YAZ_MUTEX mutex;
+    int ttl;
+    size_t max_size;
+    size_t size;
+    struct rsetcache_entry *hash[RSETCACHE_HASH];
+    struct rsetcache_entry *lru_first;
+    struct rsetcache_entry *lru_last;
+    long no_hits;
+    long no_misses;
+    long no_evictions;
+    int log_level;
+};
+
+static unsigned rsetcache_hash(const char *key)
+{
+    unsigned h = 0;
+
+    while (*key)
+        h = h * 65509 + (unsigned char) *key++;
+    return h % RSETCACHE_HASH;
+}
+
+rsetcache_t rsetcache_create(int ttl, size_t max_size)
+{
+    rsetcache_t c = (rsetcache_t) xmalloc(sizeof(*c));
+    int i;
+
+    c->mutex = 0;
+    yaz_mutex_create(&c->mutex);
+    c->ttl = ttl;
+    c->max_size = max_size;
+    c->size = 0;
+    for (i = 0; i < RSETCACHE_HASH; i++)
+        c->hash[i] = 0;
+    c->lru_first = c->lru_last = 0;
+    c->no_hits = c->no_misses = c->no_evictions = 0;
+    c->log_level = yaz_log_module_level("rsetcache");
+    return c;
+}
+
+static void lru_unlink(rsetcache_t c, struct rsetcache_entry *e)
+{
+    if (e->lru_prev)
+        e->lru_prev->lru_next = e->lru_next;
+    else
+        c->lru_first = e->lru_next;
+    if (e->lru_next)
+        e->lru_next->lru_prev = e->lru_prev;
+    else
+        c->lru_last = e->lru_prev;
+}
+
+static void lru_push(rsetcache_t c, struct rsetcache_entry *e)
+{
+    e->lru_prev = 0;
+    e->lru_next = c->lru_first;
+    if (c->lru_first)
+        c->lru_first->lru_prev = e;
+    else
+        c->lru_last = e;
+    c->lru_first = e;
+}
+
+/* unlinks entry from cache and frees it; mutex must be held */
+static void entry_remove(rsetcache_t c, struct rsetcache_entry *e)
+{
+    struct rsetcache_entry **ep = &c->hash[rsetcache_hash(e->key)];
+
+    for (; *ep; ep = &(*ep)->hash_next)
+        if (*ep == e)
+        {
+            *ep = e->hash_next;
+            break;
+        }
+    lru_unlink(c, e);
+    c->size -= e->size;
+    xfree(e->key);
+    xfree(e->owner);
+    xfree(e->setname);
+    xfree(e->extra_response_data);
+    xfree(e);
+}
+
+/* returns entry for key; expired entries are removed */
+static struct rsetcache_entry *entry_lookup(rsetcache_t c, const char *key,
+                                            time_t now)
+{
+    struct rsetcache_entry *e = c->hash[rsetcache_hash(key)];
+
+    for (; e; e = e->hash_next)
+        if (!strcmp(e->key, key))
+        {
+            if (e->expire > now)
+                return e;
+            entry_remove(c, e);
+            break;
+        }
+    return 0;
+}
+
+static void entry_get(struct rsetcache_entry *e, time_t now, ODR o,
+                      struct rsetcache_set *set)
+{
+    set->setname = odr_strdup(o, e->setname);
+    set->hits = e->hits;
+    set->estimated_hit_count = e->estimated_hit_count;
+    set->partial_resultset = e->partial_resultset;
+    set->idle_time = (int) (e->expire - now);
+    set->extra_response_data = odr_strdup_null(o, e->extra_response_data);
+}
+
+void rsetcache_destroy(rsetcache_t c)
+{
+    if (!c)
+        return;
+    yaz_log(YLOG_LOG, "rsetcache: hits=%ld misses=%ld evictions=%ld",
+            c->no_hits, c->no_misses, c->no_evictions);
+    while (c->lru_first)
+        entry_remove(c, c->lru_first);
+    yaz_mutex_destroy(&c->mutex);
+    xfree(c);
+}
+
+int rsetcache_lookup(rsetcache_t c, const char *key, ODR o,
+                     struct rsetcache_set *set)
+{
+    time_t now = time(0);
+    struct rsetcache_entry *e;
+
+    yaz_mutex_enter(c->mutex);
+    e = entry_lookup(c, key, now);
+    if (e)
+    {
+        lru_unlink(c, e);
+        lru_push(c, e);
+        entry_get(e, now, o, set);
+        c->no_hits++;
+    }
+    else
+        c->no_misses++;
+    yaz_log(c->log_level, "rsetcache: %s hits=%ld misses=%ld",
+            e ? "hit" : "miss", c->no_hits, c->no_misses);
+    yaz_mutex_leave(c->mutex);
+    return e ? 1 : 0;
+}
+
+int rsetcache_lookup_name(rsetcache_t c, const char *setname,
+                          const char *owner, ODR o,
+                          struct rsetcache_set *set)
+{
+    time_t now = time(0);
+    struct rsetcache_entry *e;
+
+    yaz_mutex_enter(c->mutex);
+    /* names are looked up rarely; a scan of the entries will do.
+       A name is only good for the user who searched */
+    for (e = c->lru_first; e; e = e->lru_next)
+        if (!strcmp(e->setname, setname) && !strcmp(e->owner, owner)
+            && e->expire > now)
+        {
+            entry_get(e, now, o, set);
+            break;
+        }
+    if (e)
+        c->no_hits++;
+    else
+        c->no_misses++;
+    yaz_log(c->log_level, "rsetcache: %s set %s hits=%ld misses=%ld",
+            e ? "hit" : "miss", setname, c->no_hits, c->no_misses);
+    yaz_mutex_leave(c->mutex);
+    return e ? 1 : 0;
+}
+
+void rsetcache_add(rsetcache_t c, const char *key, const char *owner,
+                   const struct rsetcache_set *set)
+{
+    time_t now = time(0);
+    struct rsetcache_entry *e;
+    int idle_time = set->idle_time;
+
+    if (idle_time > c->ttl)
+        idle_time = c->ttl;
+    if (idle_time <= 0)
+        return;
+
+    e = (struct rsetcache_entry *) xmalloc(sizeof(*e));
+    e->key = xstrdup(key);
+    e->owner = xstrdup(owner);
+    e->setname = xstrdup(set->setname);
+    e->extra_response_data = set->extra_response_data ?
+        xstrdup(set->extra_response_data) : 0;
+    e->hits = set->hits;
+    e->estimated_hit_count = set->estimated_hit_count;
+    e->partial_resultset = set->partial_resultset;
+    e->expire = now + idle_time;
+    e->size = sizeof(*e) + strlen(key) + strlen(owner)
+        + strlen(set->setname) + 3;
+    if (e->extra_response_data)
+        e->size += strlen(e->extra_response_data) + 1;
+
+    yaz_mutex_enter(c->mutex);
+    {
+        struct rsetcache_entry *old = entry_lookup(c, key, now);
+        unsigned h = rsetcache_hash(key);
+
+        if (old)
+            entry_remove(c, old);
+        e->hash_next = c->hash[h];
+        c->hash[h] = e;
+        lru_push(c, e);
+        c->size += e->size;
+    }
+    while (c->size > c->max_size && c->lru_last)
+    {
+        struct rsetcache_entry *last = c->lru_last;
+
+        if (last->expire > now)
+            c->no_evictions++;
+        entry_remove(c, last);
+    }
+    yaz_log(c->log_level, "rsetcache: add size=%ld evictions=%ld",
+            (long) c->size, c->no_evictions);
+    yaz_mutex_leave(c->mutex);
+}
+
+void rsetcache_remove_name(rsetcache_t c, const char *setname)
+{
+    struct rsetcache_entry *e;
+
+    yaz_mutex_enter(c->mutex);
+    e = c->lru_first;
+    while (e)
+    {
+        struct rsetcache_entry *e_next = e->lru_next;
+
+        if (!strcmp(e->setname, setname))
+            entry_remove(c, e);
+        e = e_next;
+    }
+    yaz_mutex_leave(c->mutex);
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
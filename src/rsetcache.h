@@ -0,0 +1,100 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file rsetcache.h
+ * \brief Internal header for the GFS result set cache.
+ *
+ * The cache maps a search (database, query and sort keys) to a result
+ * set that the backend has made available to all sessions. It is
+ * shared by the sessions of a server process and is used for SRU
+ * searchRetrieve, so that pages of the same query do not search again.
+ */
+#ifndef RSETCACHE_H
+#define RSETCACHE_H
+
+#include <stddef.h>
+#include <yaz/odr.h>
+
+YAZ_BEGIN_CDECL
+
+/** \brief result set cache handle */
+typedef struct rsetcache_s *rsetcache_t;
+
+/** \brief result set held by the cache */
+struct rsetcache_set {
+    char *setname;             /**< backend result set name */
+    Odr_int hits;              /**< number of hits */
+    int estimated_hit_count;   /**< 1=hits is an estimate */
+    int partial_resultset;     /**< 1=partial results */
+    int idle_time;             /**< seconds left before set expires */
+    char *extra_response_data; /**< SRU extra response data or NULL */
+};
+
+/** \brief creates result set cache
+    \param ttl maximum time in seconds that a set is kept
+    \param max_size memory budget in bytes for the entries
+    \returns cache handle
+*/
+rsetcache_t rsetcache_create(int ttl, size_t max_size);
+
+/** \brief destroys result set cache
+    \param c cache handle (may be NULL)
+*/
+void rsetcache_destroy(rsetcache_t c);
+
+/** \brief looks up a search
+    \param c cache handle
+    \param key search key
+    \param o stream for the result set name
+    \param set result set (output)
+    \retval 1 found
+    \retval 0 not found
+*/
+int rsetcache_lookup(rsetcache_t c, const char *key, ODR o,
+                     struct rsetcache_set *set);
+
+/** \brief looks up a result set by name
+    \param c cache handle
+    \param setname backend result set name
+    \param owner credentials of the searcher
+    \param o stream for the result set name
+    \param set result set (output)
+    \retval 1 found
+    \retval 0 not found
+
+    Only result sets added with the same owner are found.
+*/
+int rsetcache_lookup_name(rsetcache_t c, const char *setname,
+                          const char *owner, ODR o,
+                          struct rsetcache_set *set);
+
+/** \brief adds a search
+    \param c cache handle
+    \param key search key
+    \param owner credentials of the searcher; also part of key
+    \param set result set; kept for at most set->idle_time seconds
+
+    An existing entry for key is replaced.
+*/
+void rsetcache_add(rsetcache_t c, const char *key, const char *owner,
+                   const struct rsetcache_set *set);
+
+/** \brief removes all entries for a result set
+    \param c cache handle
+    \param setname backend result set name
+*/
+void rsetcache_remove_name(rsetcache_t c, const char *setname);
+
+YAZ_END_CDECL
+
+#endif
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -33,6 +33,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <errno.h>
 
 #if HAVE_SYS_TYPES_H
 #include <sys/types.h>
@@ -61,6 +62,7 @@
 #include <yaz/comstack.h>
 #include "eventl.h"
 #include "session.h"
+#include "workq.h"
 #include "mime.h"
 #include <yaz/proto.h>
 #include <yaz/oid_db.h>
@@ -83,13 +85,18 @@ static void process_gdu_request(association *assoc, request *req);
 static int process_z_request(association *assoc, request *req, char **msg);
 static int process_gdu_response(association *assoc, request *req, Z_GDU *res);
 static int process_z_response(association *assoc, request *req, Z_APDU *res);
+static void process_complete(association *assoc);
 static Z_APDU *process_initRequest(association *assoc, request *reqb);
 static Z_External *init_diagnostics(ODR odr, int errcode,
                                     const char *errstring);
 static Z_APDU *process_searchRequest(association *assoc, request *reqb);
 static Z_APDU *response_searchRequest(association *assoc, request *reqb,
                                       bend_search_rr *bsrr);
+static Z_APDU *response_searchRequest_end(association *assoc, request *reqb,
+                                          bend_search_rr *bsrr, Z_APDU *apdu);
 static Z_APDU *process_presentRequest(association *assoc, request *reqb);
+static Z_APDU *process_presentRequest_end(association *assoc, request *reqb,
+                                          Z_APDU *apdu, int errcode);
 static Z_APDU *process_scanRequest(association *assoc, request *reqb);
 static Z_APDU *process_sortRequest(association *assoc, request *reqb);
 static void process_close(association *assoc, request *reqb);
@@ -198,9 +205,70 @@ association *create_association(IOCHAN channel, COMSTACK link,
     request_initq(&anew->outgoing);
     anew->proto = cs_getproto(link);
     anew->server = 0;
+    anew->complete_pipe = 0;
+    anew->pending = 0;
     return anew;
 }
 
+/* reads the byte written by bend_complete; blocks until it arrives */
+static void wait_complete(association *a)
+{
+    int fd = yaz_spipe_get_read_fd(a->complete_pipe);
+    char buf[1];
+    int r;
+
+#ifdef WIN32
+    r = recv(fd, buf, 1, 0);
+#else
+    while ((r = read(fd, buf, 1)) < 0 && errno == EINTR)
+        ;
+#endif
+    if (r != 1)
+        yaz_log(YLOG_WARN|YLOG_ERRNO, "read of backend completion");
+}
+
+/* creates the pipe for bend_complete if the backend is asynchronous */
+static int assoc_async_init(association *a)
+{
+    WRBUF err;
+
+    if (!a->init->async_backend || a->complete_pipe)
+        return 0;
+    err = wrbuf_alloc();
+    a->complete_pipe = yaz_spipe_create(0, &err);
+    if (!a->complete_pipe)
+        yaz_log(YLOG_WARN, "async backend: %s", wrbuf_cstr(err));
+    wrbuf_destroy(err);
+    return a->complete_pipe ? 0 : -1;
+}
+
+/* returns 1 if the backend handler result r means that it is pending */
+static int backend_pending(association *a, int r)
+{
+    return r == BEND_PENDING && a->init->async_backend && a->complete_pipe;
+}
+
+/*
+ * The association waits for a pending backend operation. Socket I/O
+ * stops (except for sending responses already queued) and the channel
+ * watches the completion pipe instead until bend_complete is called.
+ */
+static void assoc_wait_backend(association *a)
+{
+    iochan_setfd(a->client_chan, yaz_spipe_get_read_fd(a->complete_pipe));
+    iochan_setflags(a->client_chan, EVENT_INPUT);
+}
+
+static void request_pending(association *a, request *req)
+{
+    req->state = REQUEST_PENDING;
+    a->pending = req;
+    if (request_head(&a->outgoing))
+        iochan_setflags(a->client_chan, a->cs_put_mask);
+    else
+        assoc_wait_backend(a);
+}
+
 /*
  * Free association and release resources.
  */
@@ -209,6 +277,14 @@ void destroy_association(association *h)
     statserv_options_block *cb = statserv_getcontrol();
     request *req;
 
+    if (h->pending)
+    {   /* the backend may still use the association */
+        yaz_log(log_session, "Waiting for backend");
+        wait_complete(h);
+        request_release(h->pending);
+    }
+    if (h->complete_pipe)
+        yaz_spipe_destroy(h->complete_pipe);
     xfree(h->init);
     odr_destroy(h->decode);
     odr_destroy(h->encode);
@@ -286,6 +362,8 @@ int ir_read(IOCHAN h, int event)
         {
             int res = cs_get(conn, &assoc->input_buffer,
                              &assoc->input_buffer_len);
+            char *input;
+
             if (res < 0 && cs_errno(conn) == CSBUFSIZE)
             {
                 yaz_log(log_session, "Connection error: %s res=%d",
@@ -315,7 +393,17 @@ int ir_read(IOCHAN h, int event)
                     assoc->input_buffer[2] & 0xff);
             req = request_get(&assoc->incoming); /* get a new request */
             odr_reset(assoc->decode);
-            odr_setbuf(assoc->decode, assoc->input_buffer, res, 0);
+            input = assoc->input_buffer;
+            odr_setbuf(assoc->decode, input, res, 0);
+            if (assoc->init && assoc->init->zero_copy_decode)
+            {
+                /* decoded octet strings refer to input; hand it over to
+                   the request memory and let cs_get allocate a new one */
+                odr_set_zero_copy(assoc->decode, 1);
+                nmem_adopt_buf(odr_getmem(assoc->decode), input);
+                assoc->input_buffer = 0;
+                assoc->input_buffer_len = 0;
+            }
             if (!z_GDU(assoc->decode, &req->gdu_request, 0, 0))
             {
                 yaz_log(YLOG_WARN, "ODR error on incoming PDU: %s [element %s] "
@@ -326,7 +414,7 @@ int ir_read(IOCHAN h, int event)
                 if (assoc->decode->error != OHTTP)
                 {
                     yaz_log(YLOG_WARN, "PDU dump:");
-                    odr_dumpBER(yaz_log_file(), assoc->input_buffer, res);
+                    odr_dumpBER(yaz_log_file(), input, res);
                     request_release(req);
                     do_close(assoc, Z_Close_protocolError, "Malformed package");
                 }
@@ -370,6 +458,17 @@ void ir_session(IOCHAN h, int event)
     request *req;
 
     assert(h && conn && assoc);
+    if (assoc->pending)
+    {
+        if (event == EVENT_TIMEOUT)
+            return; /* not idle; the backend is working */
+        if (iochan_getfd(h) != cs_fileno(conn))
+        {
+            if (event & EVENT_INPUT)
+                process_complete(assoc);
+            return;
+        }
+    }
     if (event == EVENT_TIMEOUT)
     {
         if (assoc->state != ASSOC_UP)
@@ -418,7 +517,7 @@ void ir_session(IOCHAN h, int event)
         if (!ir_read(h, event))
             return;
         req = request_head(&assoc->incoming);
-        if (req->state == REQUEST_IDLE)
+        if (req->state == REQUEST_IDLE && !assoc->pending)
         {
             request_deq(&assoc->incoming);
             process_gdu_request(assoc, req);
@@ -447,7 +546,9 @@ void ir_session(IOCHAN h, int event)
 #endif
             request_deq(&assoc->outgoing);
             request_release(req);
-            if (!request_head(&assoc->outgoing))
+            if (!request_head(&assoc->outgoing) && assoc->pending)
+                assoc_wait_backend(assoc);
+            else if (!request_head(&assoc->outgoing))
             {   /* restore mask for cs_get operation ... */
                 iochan_clearflag(h, EVENT_OUTPUT|EVENT_INPUT);
                 iochan_setflag(h, assoc->cs_get_mask);
@@ -508,6 +609,9 @@ static void assoc_init_reset(association *assoc, const char *peer_name1)
     assoc->init->bend_srw_scan = NULL;
     assoc->init->bend_srw_update = NULL;
     assoc->init->named_result_sets = 0;
+    assoc->init->zero_copy_decode = 0;
+    assoc->init->async_backend = 0;
+    assoc->init->bend_fetch_batch = NULL;
 
     assoc->init->charneg_request = NULL;
     assoc->init->charneg_response = NULL;
@@ -579,6 +683,8 @@ static int srw_bend_init(association *assoc, Z_HTTP_Header *headers,
         }
         assoc->backend = binitres->handle;
         assoc->init->auth = 0;
+        if (!binitres->errcode && assoc_async_init(assoc))
+            binitres->errcode = YAZ_BIB1_TEMPORARY_SYSTEM_ERROR;
         if (binitres->errcode)
         {
             int srw_code = yaz_diag_bib1_to_srw(binitres->errcode);
@@ -592,18 +698,46 @@ static int srw_bend_init(association *assoc, Z_HTTP_Header *headers,
     return 1;
 }
 
-static int retrieve_fetch(association *assoc, bend_fetch_rr *rr)
+/* record converted by retrieve_convert */
+struct conv_result {
+    int done;                  /* 1 if converted (r is result) */
+    int r;
+    char *buf;                 /* converted record if r == 0 */
+    int len;
+    const char *details;       /* error if r != 0 */
+};
+
+/* record conversion that follows bend_fetch (retrieval configuration) */
+struct fetch_conv {
+    yaz_record_conv_t rc;
+    const char *match_schema;
+    Odr_oid *match_syntax;
+    struct conv_result *res;   /* converted records or NULL */
+    int res_start;             /* position of first record in res */
+    int res_num;
+};
+
+/*
+ * Maps schema and syntax of a fetch request according to the retrieval
+ * configuration. Returns -1 if the request is rejected (error in rr),
+ * 0 otherwise.
+ */
+static int retrieve_map(association *assoc, bend_fetch_rr *rr,
+                        struct fetch_conv *fc)
 {
+    fc->res = 0;
+    fc->rc = 0;
+    fc->match_schema = 0;
+    fc->match_syntax = 0;
 #if YAZ_HAVE_XML2
-    yaz_record_conv_t rc = 0;
-    const char *match_schema = 0;
-    Odr_oid *match_syntax = 0;
-
     if (assoc->server)
     {
         int r;
         const char *input_schema = yaz_get_esn(rr->comp);
         Odr_oid *input_syntax_raw = rr->request_format;
+        yaz_record_conv_t rc = 0;
+        const char *match_schema = 0;
+        Odr_oid *match_syntax = 0;
 
         const char *backend_schema = 0;
         Odr_oid *backend_syntax = 0;
@@ -652,14 +786,121 @@ static int retrieve_fetch(association *assoc, bend_fetch_rr *rr)
         }
         if (backend_syntax)
             rr->request_format = backend_syntax;
+        fc->rc = rc;
+        fc->match_schema = match_schema;
+        fc->match_syntax = match_syntax;
+    }
+#endif
+    return 0;
+}
+
+/*
+ * Starts fetch of a record: maps the request according to the retrieval
+ * configuration and calls bend_fetch. Returns -1 if the request is
+ * rejected (backend not called), BEND_PENDING if the backend finishes
+ * later or 0 if the record is fetched. retrieve_fetch_end completes it.
+ */
+static int retrieve_fetch_begin(association *assoc, bend_fetch_rr *rr,
+                                struct fetch_conv *fc)
+{
+    int ret;
+
+    if (retrieve_map(assoc, rr, fc))
+        return -1;
+    ret = (*assoc->init->bend_fetch)(assoc->backend, rr);
+    return backend_pending(assoc, ret) ? BEND_PENDING : 0;
+}
+
+/*
+ * Whether records are fetched a range at a time: by bend_fetch_batch
+ * or, so that they can be converted in parallel, by bend_fetch ahead
+ * of conversion. The latter is not done for asynchronous backends.
+ */
+static int retrieve_batch_enabled(association *assoc)
+{
+    if (assoc->init->bend_fetch_batch)
+        return 1;
+    return statserv_getcontrol()->convert_threads > 1 &&
+        assoc->init->bend_fetch && !assoc->init->async_backend;
+}
+
+/*
+ * Starts fetch of number records from start with bend_fetch_batch
+ * (or bend_fetch for each, see retrieve_batch_enabled).
+ * tmpl is mapped as in retrieve_fetch_begin and each entry of
+ * brr->records is initialised from it. Returns as retrieve_fetch_begin,
+ * with the error in tmpl. retrieve_fetch_end completes each entry.
+ */
+static int retrieve_fetch_batch_begin(association *assoc, bend_fetch_rr *tmpl,
+                                      bend_fetch_batch_rr *brr,
+                                      int start, int number,
+                                      struct fetch_conv *fc)
+{
+    int i, ret;
+
+    if (retrieve_map(assoc, tmpl, fc))
+        return -1;
+    brr->setname = tmpl->setname;
+    brr->start = start;
+    brr->number = number;
+    brr->referenceId = tmpl->referenceId;
+    brr->request_format = tmpl->request_format;
+    brr->comp = tmpl->comp;
+    brr->stream = tmpl->stream;
+    brr->print = tmpl->print;
+    brr->schema = tmpl->schema;
+    brr->association = assoc;
+    brr->records = (bend_fetch_rr *)
+        odr_malloc(tmpl->stream, sizeof(*brr->records) * number);
+    for (i = 0; i < number; i++)
+    {
+        brr->records[i] = *tmpl;
+        brr->records[i].number = start + i;
+    }
+    if (!assoc->init->bend_fetch_batch)
+    {
+        for (i = 0; i < number; i++)
+        {
+            bend_fetch_rr *rr = brr->records + i;
+
+            (*assoc->init->bend_fetch)(assoc->backend, rr);
+            if (rr->last_in_set || (rr->errcode && !rr->surrogate_flag) ||
+                (!rr->record && !rr->errcode))
+                break;
+        }
+        return 0;
     }
-    (*assoc->init->bend_fetch)(assoc->backend, rr);
+    ret = (*assoc->init->bend_fetch_batch)(assoc->backend, brr);
+    return backend_pending(assoc, ret) ? BEND_PENDING : 0;
+}
+
+/* converts the record fetched by retrieve_fetch_begin */
+static void retrieve_fetch_end(association *assoc, bend_fetch_rr *rr,
+                               struct fetch_conv *fc)
+{
+#if YAZ_HAVE_XML2
+    yaz_record_conv_t rc = fc->rc;
+    const char *match_schema = fc->match_schema;
+    Odr_oid *match_syntax = fc->match_syntax;
+
     if (rc && rr->record && rr->errcode == 0)
     {   /* post conversion must take place .. */
         WRBUF output_record = wrbuf_alloc();
+        struct conv_result *cr = 0;
         int r = 1;
         const char *details = 0;
-        if (rr->len > 0)
+
+        if (fc->res && rr->number >= fc->res_start &&
+            rr->number < fc->res_start + fc->res_num)
+            cr = fc->res + (rr->number - fc->res_start);
+        if (cr && cr->done)
+        {
+            r = cr->r;
+            details = cr->details;
+            if (r == 0)
+                wrbuf_write(output_record, cr->buf, cr->len);
+        }
+        else if (rr->len > 0)
         {
             r = yaz_record_conv_record(rc, rr->record, rr->len, output_record);
             if (r)
@@ -682,7 +923,7 @@ static int retrieve_fetch(association *assoc, bend_fetch_rr *rr)
 
             const char *output_charset = yaz_record_get_output_charset(rc);
             if (output_charset)
-                cd = yaz_iconv_open(output_charset, "utf-8");
+                cd = yaz_iconv_open_cached(output_charset, "utf-8");
             if (yaz_xml_to_opac(mt, wrbuf_buf(output_record),
                                 wrbuf_len(output_record),
                                 &opac, cd, rr->stream->mem, 0)
@@ -697,6 +938,7 @@ static int retrieve_fetch(association *assoc, bend_fetch_rr *rr)
                 r = 1;
             }
             yaz_marc_destroy(mt);
+            yaz_iconv_close_cached(cd);
         }
         else if (r == 0)
         {
@@ -717,75 +959,187 @@ static int retrieve_fetch(association *assoc, bend_fetch_rr *rr)
         rr->output_format = match_syntax;
     if (match_schema)
         rr->schema = odr_strdup(rr->stream, match_schema);
-#else
-    (*assoc->init->bend_fetch)(assoc->backend, rr);
 #endif
-    return 0;
 }
 
-static int srw_bend_fetch(association *assoc, int pos,
-                          Z_SRW_searchRetrieveRequest *srw_req,
-                          Z_SRW_record *record,
-                          const char **addinfo, int *last_in_set)
+#if YAZ_HAVE_XML2
+struct conv_job {
+    yaz_record_conv_t rc;
+    bend_fetch_rr *records;
+    WRBUF *output;
+    WRBUF *error;
+    int *r;
+};
+
+/* worker: converts record i of a batch */
+static void convert_record(void *data, int i)
 {
-    bend_fetch_rr rr;
-    ODR o = assoc->encode;
+    struct conv_job *job = (struct conv_job *) data;
+    bend_fetch_rr *rr = job->records + i;
+
+    if (rr->record && rr->errcode == 0 && rr->len > 0)
+    {
+        job->output[i] = wrbuf_alloc();
+        job->error[i] = wrbuf_alloc();
+        job->r[i] = yaz_record_conv_record_r(job->rc, rr->record, rr->len,
+                                             job->output[i], job->error[i]);
+    }
+}
+#endif
+
+/*
+ * Converts the records of a batch in parallel (convert_threads > 1).
+ * retrieve_fetch_end then picks up the result for each record.
+ */
+static void retrieve_convert(association *assoc, bend_fetch_batch_rr *brr,
+                             struct fetch_conv *fc)
+{
+#if YAZ_HAVE_XML2
+    int max_parallel = statserv_getcontrol()->convert_threads;
+    ODR o = brr->stream;
+    struct conv_job job;
+    int i, num = 0;
+
+    if (!fc->rc || max_parallel <= 1)
+        return;
+    while (num < brr->number)
+    {   /* up to the end of the range */
+        bend_fetch_rr *rr = brr->records + num++;
+        if (rr->last_in_set || (rr->errcode && !rr->surrogate_flag) ||
+            (!rr->record && !rr->errcode))
+            break;
+    }
+    if (num <= 1)
+        return;
+    job.rc = fc->rc;
+    job.records = brr->records;
+    job.output = (WRBUF *) odr_malloc(o, sizeof(*job.output) * num);
+    job.error = (WRBUF *) odr_malloc(o, sizeof(*job.error) * num);
+    job.r = (int *) odr_malloc(o, sizeof(*job.r) * num);
+    for (i = 0; i < num; i++)
+        job.output[i] = job.error[i] = 0;
+    workq_run(max_parallel, convert_record, &job, num);
+
+    fc->res = (struct conv_result *) odr_malloc(o, sizeof(*fc->res) * num);
+    fc->res_start = brr->start;
+    fc->res_num = num;
+    for (i = 0; i < num; i++)
+    {
+        struct conv_result *cr = fc->res + i;
+
+        cr->done = job.output[i] ? 1 : 0;
+        if (!cr->done)
+            continue;
+        cr->r = job.r[i];
+        cr->len = wrbuf_len(job.output[i]);
+        cr->buf = (char *) odr_malloc(o, cr->len);
+        memcpy(cr->buf, wrbuf_buf(job.output[i]), cr->len);
+        cr->details = cr->r ? odr_strdup(o, wrbuf_cstr(job.error[i])) : 0;
+        wrbuf_destroy(job.output[i]);
+        wrbuf_destroy(job.error[i]);
+    }
+#endif
+}
+
+static int retrieve_fetch(association *assoc, bend_fetch_rr *rr)
+{
+    struct fetch_conv fc;
+    int r = retrieve_fetch_begin(assoc, rr, &fc);
 
-    rr.setname = "default";
-    rr.number = pos;
-    rr.referenceId = 0;
-    rr.request_format = odr_oiddup(assoc->decode, yaz_oid_recsyn_xml);
+    if (r == -1)
+        return -1;
+    if (r == BEND_PENDING)
+    {   /* no event loop here; wait for the backend */
+        wait_complete(assoc);
+    }
+    retrieve_fetch_end(assoc, rr, &fc);
+    return 0;
+}
 
-    rr.comp = (Z_RecordComposition *)
-            odr_malloc(assoc->decode, sizeof(*rr.comp));
-    rr.comp->which = Z_RecordComp_complex;
-    rr.comp->u.complex = (Z_CompSpec *)
+static void srw_fetch_init(association *assoc, const char *setname, int pos,
+                           Z_SRW_searchRetrieveRequest *srw_req,
+                           bend_fetch_rr *rr)
+{
+    rr->setname = odr_strdup(assoc->decode, setname);
+    rr->number = pos;
+    rr->referenceId = 0;
+    rr->request_format = odr_oiddup(assoc->decode, yaz_oid_recsyn_xml);
+
+    rr->comp = (Z_RecordComposition *)
+            odr_malloc(assoc->decode, sizeof(*rr->comp));
+    rr->comp->which = Z_RecordComp_complex;
+    rr->comp->u.complex = (Z_CompSpec *)
             odr_malloc(assoc->decode, sizeof(Z_CompSpec));
-    rr.comp->u.complex->selectAlternativeSyntax = (bool_t *)
+    rr->comp->u.complex->selectAlternativeSyntax = (bool_t *)
         odr_malloc(assoc->encode, sizeof(bool_t));
-    *rr.comp->u.complex->selectAlternativeSyntax = 0;
-    rr.comp->u.complex->num_dbSpecific = 0;
-    rr.comp->u.complex->dbSpecific = 0;
-    rr.comp->u.complex->num_recordSyntax = 0;
-    rr.comp->u.complex->recordSyntax = 0;
+    *rr->comp->u.complex->selectAlternativeSyntax = 0;
+    rr->comp->u.complex->num_dbSpecific = 0;
+    rr->comp->u.complex->dbSpecific = 0;
+    rr->comp->u.complex->num_recordSyntax = 0;
+    rr->comp->u.complex->recordSyntax = 0;
 
-    rr.comp->u.complex->generic = (Z_Specification *)
+    rr->comp->u.complex->generic = (Z_Specification *)
             odr_malloc(assoc->decode, sizeof(Z_Specification));
 
     /* schema uri = recordSchema (or NULL if recordSchema is not given) */
-    rr.comp->u.complex->generic->which = Z_Schema_uri;
-    rr.comp->u.complex->generic->schema.uri = srw_req->recordSchema;
+    rr->comp->u.complex->generic->which = Z_Schema_uri;
+    rr->comp->u.complex->generic->schema.uri = srw_req->recordSchema;
 
     /* ESN = recordSchema if recordSchema is present */
-    rr.comp->u.complex->generic->elementSpec = 0;
+    rr->comp->u.complex->generic->elementSpec = 0;
     if (srw_req->recordSchema)
     {
-        rr.comp->u.complex->generic->elementSpec =
+        rr->comp->u.complex->generic->elementSpec =
             (Z_ElementSpec *) odr_malloc(assoc->encode, sizeof(Z_ElementSpec));
-        rr.comp->u.complex->generic->elementSpec->which =
+        rr->comp->u.complex->generic->elementSpec->which =
             Z_ElementSpec_elementSetName;
-        rr.comp->u.complex->generic->elementSpec->u.elementSetName =
+        rr->comp->u.complex->generic->elementSpec->u.elementSetName =
             srw_req->recordSchema;
     }
 
-    rr.stream = assoc->encode;
-    rr.print = assoc->print;
-
-    rr.basename = 0;
-    rr.len = 0;
-    rr.record = 0;
-    rr.last_in_set = 0;
-    rr.errcode = 0;
-    rr.errstring = 0;
-    rr.surrogate_flag = 0;
-    rr.schema = srw_req->recordSchema;
+    rr->stream = assoc->encode;
+    rr->print = assoc->print;
+    rr->association = assoc;
+
+    rr->basename = 0;
+    rr->len = 0;
+    rr->record = 0;
+    rr->last_in_set = 0;
+    rr->errcode = 0;
+    rr->errstring = 0;
+    rr->surrogate_flag = 0;
+    rr->schema = srw_req->recordSchema;
+}
 
-    if (!assoc->init->bend_fetch)
-        return 1;
+/*
+ * Fetches the SRU record at pos. If batch is given, the record is taken
+ * from that (fetched by bend_fetch_batch) rather than from bend_fetch.
+ */
+static int srw_bend_fetch(association *assoc, const char *setname, int pos,
+                          Z_SRW_searchRetrieveRequest *srw_req,
+                          bend_fetch_batch_rr *batch, struct fetch_conv *fc,
+                          Z_SRW_record *record,
+                          const char **addinfo, int *last_in_set)
+{
+    bend_fetch_rr rr;
+    ODR o = assoc->encode;
 
-    retrieve_fetch(assoc, &rr);
+    if (batch)
+    {
+        rr = batch->records[pos - batch->start];
+        retrieve_fetch_end(assoc, &rr, fc);
+    }
+    else
+    {
+        if (!assoc->init->bend_fetch)
+            return 1;
+        srw_fetch_init(assoc, setname, pos, srw_req, &rr);
+        retrieve_fetch(assoc, &rr);
+    }
 
     *last_in_set = rr.last_in_set;
+    if (batch && !rr.record && !rr.errcode)
+        *last_in_set = 1; /* end of the range fetched */
 
     if (rr.errcode && rr.surrogate_flag)
     {
@@ -809,6 +1163,34 @@ static int srw_bend_fetch(association *assoc, int pos,
     return 0;
 }
 
+/*
+ * Fetches number SRU records from start with bend_fetch_batch. Returns
+ * NULL if the request is rejected; the error is then in errcode and
+ * addinfo.
+ */
+static bend_fetch_batch_rr *srw_bend_fetch_batch(
+    association *assoc, const char *setname, int start, int number,
+    Z_SRW_searchRetrieveRequest *srw_req, struct fetch_conv *fc,
+    int *errcode, const char **addinfo)
+{
+    bend_fetch_rr tmpl;
+    bend_fetch_batch_rr *brr = (bend_fetch_batch_rr *)
+        odr_malloc(assoc->encode, sizeof(*brr));
+
+    srw_fetch_init(assoc, setname, start, srw_req, &tmpl);
+    switch (retrieve_fetch_batch_begin(assoc, &tmpl, brr, start, number, fc))
+    {
+    case -1:
+        *errcode = tmpl.errcode;
+        *addinfo = tmpl.errstring;
+        return 0;
+    case BEND_PENDING:
+        wait_complete(assoc);
+    }
+    retrieve_convert(assoc, brr, fc);
+    return brr;
+}
+
 static int cql2pqf(ODR odr, const char *cql, cql_transform_t ct,
                    Z_Query *query_result, char **sortkeys_p)
 {
@@ -921,6 +1303,73 @@ static int ccl2pqf(ODR odr, const Odr_oct *ccl, CCL_bibset bibset,
     return 0;
 }
 
+/*
+ * Returns the result set name if the CQL query refers to a result set
+ * (cql.resultSetId = name); NULL otherwise.
+ */
+static char *cql_resultset_ref(ODR odr, const char *cql)
+{
+    CQL_parser cp = cql_parser_create();
+    char *setname = 0;
+
+    if (!cql_parser_string(cp, cql))
+    {
+        struct cql_node *cn = cql_parser_result(cp);
+
+        if (cn->which == CQL_NODE_ST && !cn->u.st.modifiers
+            && (!yaz_strcasecmp(cn->u.st.index, "cql.resultSetId")
+                || !yaz_strcasecmp(cn->u.st.index, "resultSetId"))
+            && (!strcmp(cn->u.st.relation, "=")
+                || !strcmp(cn->u.st.relation, "==")))
+            setname = odr_strdup(odr, cn->u.st.term);
+    }
+    cql_parser_destroy(cp);
+    return setname;
+}
+
+/* returns credentials of sr; the backend may give results depending
+   on who is searching */
+static char *rsetcache_owner(ODR odr, Z_SRW_PDU *sr)
+{
+    WRBUF w = wrbuf_alloc();
+    char *owner;
+
+    wrbuf_printf(w, "%s\n%s", sr->username ? sr->username : "",
+                 sr->password ? sr->password : "");
+    owner = odr_strdup(odr, wrbuf_cstr(w));
+    wrbuf_destroy(w);
+    return owner;
+}
+
+/* returns result set cache key for search by owner */
+static char *rsetcache_key(ODR odr, bend_search_rr *rr, const char *owner)
+{
+    WRBUF w = wrbuf_alloc();
+    Z_SRW_extra_arg *a;
+    char *key;
+    int i;
+
+    wrbuf_printf(w, "%s\n", owner);
+    for (i = 0; i < rr->num_bases; i++)
+    {
+        wrbuf_puts(w, rr->basenames[i] ? rr->basenames[i] : "");
+        wrbuf_putc(w, '\n');
+    }
+    yaz_query_to_wrbuf(w, rr->query);
+    wrbuf_putc(w, '\n');
+    if (rr->srw_sortKeys)
+        wrbuf_puts(w, rr->srw_sortKeys);
+    for (a = rr->extra_args; a; a = a->next)
+    {
+        wrbuf_printf(w, "\n%s", a->name);
+        if (a->value)
+            wrbuf_printf(w, "=%s", a->value);
+    }
+    key = odr_strdup(odr, wrbuf_cstr(w));
+    wrbuf_destroy(w);
+    return key;
+}
+
 static void srw_bend_search(association *assoc,
                             Z_HTTP_Header *headers,
                             Z_SRW_PDU *sr,
@@ -931,14 +1380,24 @@ static void srw_bend_search(association *assoc,
     int srw_error = 0;
     Z_External *ext;
     Z_SRW_searchRetrieveRequest *srw_req = sr->u.request;
+    rsetcache_t rsetcache = 0;
+    struct rsetcache_set cache_set;
+    int cache_hit = 0;
 
     *http_code = 200;
     yaz_log(log_requestdetail, "Got SRW SearchRetrieveRequest");
     srw_bend_init(assoc, headers,
                   &srw_res->diagnostics, &srw_res->num_diagnostics, sr);
+    /* facets are computed by the backend for each search */
+    if (assoc->server && !srw_req->facetList)
+        rsetcache = assoc->server->rsetcache;
     if (srw_res->num_diagnostics == 0 && assoc->init)
     {
         bend_search_rr rr;
+        const char *setname = "default";
+        char *cache_key = 0;
+        char *cache_owner = 0;
+        char *setref = 0;
         rr.setname = "default";
         rr.replace_set = 1;
         rr.num_bases = 1;
@@ -956,7 +1415,20 @@ static void srw_bend_search(association *assoc,
         rr.present_number = srw_req->maximumRecords ?
             *srw_req->maximumRecords : 0;
 
-        if (!srw_req->queryType || !strcmp(srw_req->queryType, "cql"))
+        if ((!srw_req->queryType || !strcmp(srw_req->queryType, "cql"))
+            && rsetcache
+            && (setref = cql_resultset_ref(assoc->decode, srw_req->query)))
+        {
+            cache_hit = rsetcache_lookup_name(
+                rsetcache, setref, rsetcache_owner(assoc->decode, sr),
+                assoc->encode, &cache_set);
+            if (!cache_hit)
+                yaz_add_srw_diagnostic(assoc->encode, &srw_res->diagnostics,
+                                       &srw_res->num_diagnostics,
+                                       YAZ_SRW_RESULT_SET_DOES_NOT_EXIST,
+                                       setref);
+        }
+        else if (!srw_req->queryType || !strcmp(srw_req->queryType, "cql"))
         {
             if (assoc->server && assoc->server->cql_transform)
             {
@@ -1017,7 +1489,7 @@ static void srw_bend_search(association *assoc,
                                    &srw_res->num_diagnostics,
                                    YAZ_SRW_UNSUPP_QUERY_TYPE, 0);
         }
-        if (rr.query->u.type_1)
+        if (rr.query->u.type_1 || cache_hit)
         {
             rr.stream = assoc->encode;
             rr.decode = assoc->decode;
@@ -1036,9 +1508,49 @@ static void srw_bend_search(association *assoc,
                 yaz_oi_set_facetlist(&rr.search_input, assoc->encode,
                                      srw_req->facetList);
 
-            yaz_log_zquery_level(log_requestdetail,rr.query);
+            if (rsetcache && !cache_hit)
+            {
+                cache_owner = rsetcache_owner(assoc->decode, sr);
+                cache_key = rsetcache_key(assoc->decode, &rr, cache_owner);
+                cache_hit = rsetcache_lookup(rsetcache, cache_key,
+                                             assoc->encode, &cache_set);
+            }
+            if (cache_hit)
+            {
+                rr.hits = cache_set.hits;
+                rr.estimated_hit_count = cache_set.estimated_hit_count;
+                rr.partial_resultset = cache_set.partial_resultset;
+                rr.srw_setname = cache_set.setname;
+                rr.srw_setnameIdleTime = &cache_set.idle_time;
+                rr.extra_response_data = cache_set.extra_response_data;
+            }
+            else
+            {
+                yaz_log_zquery_level(log_requestdetail,rr.query);
 
-            (assoc->init->bend_search)(assoc->backend, &rr);
+                if (backend_pending(assoc,
+                                    (assoc->init->bend_search)(assoc->backend,
+                                                               &rr)))
+                {   /* SRU is served in one go; wait for the backend */
+                    wait_complete(assoc);
+                }
+                /* only result sets that the backend has named are kept */
+                if (cache_key && !rr.errcode && rr.srw_setname
+                    && rr.srw_setnameIdleTime && !rr.search_info)
+                {
+                    cache_set.setname = rr.srw_setname;
+                    cache_set.hits = rr.hits;
+                    cache_set.estimated_hit_count = rr.estimated_hit_count;
+                    cache_set.partial_resultset = rr.partial_resultset;
+                    cache_set.idle_time = *rr.srw_setnameIdleTime;
+                    cache_set.extra_response_data = rr.extra_response_data;
+                    rsetcache_add(rsetcache, cache_key, cache_owner,
+                                  &cache_set);
+                }
+            }
+            /* with the cache, sets named by the backend are used by name */
+            if (rsetcache && rr.srw_setname)
+                setname = rr.srw_setname;
             if (rr.errcode)
             {
                 if (rr.errcode == YAZ_BIB1_DATABASE_UNAVAILABLE)
@@ -1096,7 +1608,7 @@ static void srw_bend_search(association *assoc,
                     {
                         bend_present_rr *bprr = (bend_present_rr*)
                             odr_malloc(assoc->decode, sizeof(*bprr));
-                        bprr->setname = "default";
+                        bprr->setname = odr_strdup(assoc->decode, setname);
                         bprr->start = start;
                         bprr->number = number;
                         if (srw_req->recordSchema)
@@ -1123,6 +1635,9 @@ static void srw_bend_search(association *assoc,
 
                         if (bprr->errcode)
                         {
+                            if (cache_hit && bprr->errcode ==
+                                YAZ_BIB1_SPECIFIED_RESULT_SET_DOES_NOT_EXIST)
+                                rsetcache_remove_name(rsetcache, setname);
                             srw_error = yaz_diag_bib1_to_srw(bprr->errcode);
                             yaz_add_srw_diagnostic(assoc->encode,
                                                    &srw_res->diagnostics,
@@ -1136,6 +1651,8 @@ static void srw_bend_search(association *assoc,
                     {
                         int j = 0;
                         int packing = Z_SRW_recordPacking_string;
+                        bend_fetch_batch_rr *batch = 0;
+                        struct fetch_conv fc;
                         if (srw_req->recordPacking)
                         {
                             packing =
@@ -1151,6 +1668,28 @@ static void srw_bend_search(association *assoc,
                             odr_malloc(assoc->encode,
                                        number*sizeof(*srw_res->extra_records));
 
+                        if (retrieve_batch_enabled(assoc))
+                        {
+                            int errcode = 0;
+                            const char *addinfo = 0;
+
+                            batch = srw_bend_fetch_batch(assoc, setname,
+                                                         start, number,
+                                                         srw_req, &fc,
+                                                         &errcode, &addinfo);
+                            if (!batch)
+                            {
+                                if (cache_hit && errcode ==
+                                    YAZ_BIB1_SPECIFIED_RESULT_SET_DOES_NOT_EXIST)
+                                    rsetcache_remove_name(rsetcache, setname);
+                                yaz_add_srw_diagnostic(assoc->encode,
+                                                       &srw_res->diagnostics,
+                                                       &srw_res->num_diagnostics,
+                                                       yaz_diag_bib1_to_srw(errcode),
+                                                       addinfo);
+                                number = 0;
+                            }
+                        }
                         for (i = 0; i<number; i++)
                         {
                             int errcode;
@@ -1161,11 +1700,15 @@ static void srw_bend_search(association *assoc,
                             srw_res->records[j].recordData_buf = 0;
                             srw_res->extra_records[j] = 0;
                             yaz_log(YLOG_DEBUG, "srw_bend_fetch %d", i+start);
-                            errcode = srw_bend_fetch(assoc, i+start, srw_req,
+                            errcode = srw_bend_fetch(assoc, setname, i+start,
+                                                     srw_req, batch, &fc,
                                                      srw_res->records + j,
                                                      &addinfo, &last_in_set);
                             if (errcode)
                             {
+                                if (cache_hit && errcode ==
+                                    YAZ_BIB1_SPECIFIED_RESULT_SET_DOES_NOT_EXIST)
+                                    rsetcache_remove_name(rsetcache, setname);
                                 yaz_add_srw_diagnostic(assoc->encode,
                                                        &srw_res->diagnostics,
                                                        &srw_res->num_diagnostics,
@@ -2126,6 +2669,11 @@ static int process_z_request(association *assoc, request *req, char **msg)
         *msg = "Bad APDU received";
         return -1;
     }
+    if (req->state == REQUEST_PENDING)
+    {
+        yaz_log(YLOG_DEBUG, "  result pending");
+        return 0;
+    }
     if (res)
     {
         yaz_log(YLOG_DEBUG, "  result immediately available");
@@ -2173,7 +2721,7 @@ static int process_gdu_response(association *assoc, request *req, Z_GDU *res)
     for (;;)
     {
         req = request_head(&assoc->incoming);
-        if (req && req->state == REQUEST_IDLE)
+        if (req && req->state == REQUEST_IDLE && !assoc->pending)
         {
             request_deq(&assoc->incoming);
             process_gdu_request(assoc, req);
@@ -2269,6 +2817,8 @@ static Z_APDU *process_initRequest(association *assoc, request *reqb)
             return 0;
         }
         assoc->backend = binitres->handle;
+        if (!binitres->errcode && assoc_async_init(assoc))
+            binitres->errcode = YAZ_BIB1_TEMPORARY_SYSTEM_ERROR;
     }
     else
     {
@@ -2517,115 +3067,182 @@ static Z_NamePlusRecord *surrogatediagrec(association *assoc,
     return zget_surrogateDiagRec(assoc->encode, dbname, error, addinfo);
 }
 
-static Z_Records *pack_records(association *a, char *setname, Odr_int start,
-                               Odr_int *num, Z_RecordComposition *comp,
-                               Odr_int *next, Odr_int *pres,
-                               Z_ReferenceId *referenceId,
-                               Odr_oid *oid, int *errcode)
+/* releases memory of fetched record and returns surrogate diagnostic */
+static Z_NamePlusRecord *drop_record(association *assoc, nmem_mark_t *mark,
+                                     const char *dbname, int error)
 {
-    int recno;
-    Odr_int dumped_records = 0;
-    int toget = odr_int_to_int(*num);
-    Z_Records *records =
-        (Z_Records *) odr_malloc(a->encode, sizeof(*records));
-    Z_NamePlusRecordList *reclist =
-        (Z_NamePlusRecordList *) odr_malloc(a->encode, sizeof(*reclist));
-
-    records->which = Z_Records_DBOSD;
-    records->u.databaseOrSurDiagnostics = reclist;
-    reclist->num_records = 0;
+    Z_NamePlusRecord *rec;
+    /* dbname may be allocated by the backend after mark */
+    char *dbname_copy = dbname ? xstrdup(dbname) : 0;
 
-    if (toget < 0)
-        return diagrec(a, YAZ_BIB1_PRESENT_REQUEST_OUT_OF_RANGE, 0);
-    else if (toget == 0)
-        reclist->records = odr_nullval();
-    else
-        reclist->records = (Z_NamePlusRecord **)
-            odr_malloc(a->encode, sizeof(*reclist->records) * toget);
+    nmem_release_to_mark(odr_getmem(assoc->encode), mark);
+    rec = surrogatediagrec(assoc, dbname_copy, error, 0);
+    xfree(dbname_copy);
+    return rec;
+}
 
-    *pres = Z_PresentStatus_success;
-    *num = 0;
-    *next = 0;
+/*
+ * State of pack_records. Kept in the request while bend_fetch is
+ * pending; packing then resumes with the record fetched.
+ */
+struct pack_state {
+    Z_APDU *apdu;              /* response the records are for */
+    Z_Records *records;
+    Z_NamePlusRecordList *reclist;
+    char *setname;
+    Odr_int start;
+    int toget;
+    int recno;
+    Odr_int *num;
+    Z_RecordComposition *comp;
+    Odr_int *next;
+    Odr_int *pres;
+    Z_ReferenceId *referenceId;
+    Odr_oid *oid;
+    int errcode;               /* non-surrogate diagnostic, if any */
+    int pending;               /* 1=bend_fetch, 2=bend_fetch_batch pending */
+    Odr_int total_length;
+    nmem_mark_t mark;
+    bend_fetch_rr freq;
+    struct fetch_conv conv;
+    bend_fetch_batch_rr *batch; /* records from bend_fetch_batch or NULL */
+    Odr_int batch_size;        /* bytes allocated by bend_fetch_batch */
+    Odr_int batch_used;        /* of which accounted for packed records */
+};
+
+static void pack_fetch_init(association *a, struct pack_state *ps,
+                            bend_fetch_rr *freq, int recno)
+{
+    freq->errcode = 0;
+    freq->errstring = 0;
+    freq->basename = 0;
+    freq->len = 0;
+    freq->record = 0;
+    freq->last_in_set = 0;
+    freq->setname = ps->setname;
+    freq->surrogate_flag = 0;
+    freq->number = recno;
+    freq->comp = ps->comp;
+    freq->request_format = ps->oid;
+    freq->output_format = 0;
+    freq->stream = a->encode;
+    freq->print = a->print;
+    freq->referenceId = ps->referenceId;
+    freq->schema = 0;
+    freq->association = a;
+}
 
-    yaz_log(log_requestdetail, "Request to pack " ODR_INT_PRINTF "+%d %s", start, toget, setname);
-    yaz_log(log_requestdetail, "pms=%d, mrs=%d", a->preferredMessageSize,
-        a->maximumRecordSize);
-    for (recno = odr_int_to_int(start); reclist->num_records < toget; recno++)
+static Z_Records *pack_records_fetch(association *a, request *reqb,
+                                     struct pack_state *ps)
+{
+    Z_NamePlusRecordList *reclist = ps->reclist;
+    Odr_int *next = ps->next;
+    Odr_int *pres = ps->pres;
+    int toget = ps->toget;
+
+    if (ps->pending == 2)
+    {   /* bend_fetch_batch resumed by bend_complete */
+        ps->pending = 0;
+        retrieve_convert(a, ps->batch, &ps->conv);
+        ps->batch_size = odr_total(a->encode) - ps->batch_size;
+    }
+    for (; reclist->num_records < toget; ps->recno++)
     {
-        bend_fetch_rr freq;
+        bend_fetch_rr *freq = &ps->freq;
+        int recno = ps->recno;
         Z_NamePlusRecord *thisrec;
         Odr_int this_length = 0;
-        /*
-         * we get the number of bytes allocated on the stream before any
-         * allocation done by the backend - this should give us a reasonable
-         * idea of the total size of the data so far.
-         */
-        Odr_int total_length = odr_total(a->encode) - dumped_records;
-        freq.errcode = 0;
-        freq.errstring = 0;
-        freq.basename = 0;
-        freq.len = 0;
-        freq.record = 0;
-        freq.last_in_set = 0;
-        freq.setname = setname;
-        freq.surrogate_flag = 0;
-        freq.number = recno;
-        freq.comp = comp;
-        freq.request_format = oid;
-        freq.output_format = 0;
-        freq.stream = a->encode;
-        freq.print = a->print;
-        freq.referenceId = referenceId;
-        freq.schema = 0;
-
-        retrieve_fetch(a, &freq);
-
-        *next = freq.last_in_set ? 0 : recno + 1;
-
-        if (freq.errcode)
-        {
-            if (!freq.surrogate_flag) /* non-surrogate diagnostic i.e. global */
+        Odr_int total_length;
+
+        if (ps->pending)
+        {   /* resumed by bend_complete */
+            ps->pending = 0;
+            retrieve_fetch_end(a, freq, &ps->conv);
+        }
+        else if (ps->batch)
+        {
+            /*
+             * the records of the batch are allocated already; they are
+             * left out of the total until packed.
+             */
+            ps->total_length = odr_total(a->encode) - ps->batch_size
+                + ps->batch_used;
+            *freq = ps->batch->records[recno - ps->batch->start];
+            nmem_mark(odr_getmem(a->encode), &ps->mark);
+            retrieve_fetch_end(a, freq, &ps->conv);
+        }
+        else
+        {
+            /*
+             * we get the number of bytes allocated on the stream before any
+             * allocation done by the backend - this should give us a
+             * reasonable idea of the total size of the data so far.
+             */
+            ps->total_length = odr_total(a->encode);
+            pack_fetch_init(a, ps, freq, recno);
+
+            /* memory used by records that are dropped is released */
+            nmem_mark(odr_getmem(a->encode), &ps->mark);
+            switch (retrieve_fetch_begin(a, freq, &ps->conv))
+            {
+            case BEND_PENDING:
+                ps->pending = 1;
+                reqb->pack = ps;
+                request_pending(a, reqb);
+                return 0;
+            case 0:
+                retrieve_fetch_end(a, freq, &ps->conv);
+            }
+        }
+        total_length = ps->total_length;
+
+        *next = freq->last_in_set ? 0 : recno + 1;
+
+        if (freq->errcode)
+        {
+            if (!freq->surrogate_flag) /* non-surrogate diagnostic i.e. global */
             {
                 char s[20];
                 *pres = Z_PresentStatus_failure;
                 /* for 'present request out of range',
                    set addinfo to record position if not set */
-                if (freq.errcode == YAZ_BIB1_PRESENT_REQUEST_OUT_OF_RANGE  &&
-                                freq.errstring == 0)
+                if (freq->errcode == YAZ_BIB1_PRESENT_REQUEST_OUT_OF_RANGE  &&
+                                freq->errstring == 0)
                 {
                     sprintf(s, "%d", recno);
-                    freq.errstring = s;
+                    freq->errstring = s;
                 }
-                if (errcode)
-                    *errcode = freq.errcode;
-                return diagrec(a, freq.errcode, freq.errstring);
+                ps->errcode = freq->errcode;
+                return diagrec(a, freq->errcode, freq->errstring);
             }
             reclist->records[reclist->num_records] =
-                surrogatediagrec(a, freq.basename, freq.errcode,
-                                 freq.errstring);
+                surrogatediagrec(a, freq->basename, freq->errcode,
+                                 freq->errstring);
             reclist->num_records++;
             continue;
         }
-        if (freq.record == 0)  /* no error and no record ? */
+        if (freq->record == 0)  /* no error and no record ? */
         {
             *pres = Z_PresentStatus_partial_4;
             *next = 0;   /* signal end-of-set and stop */
             break;
         }
-        if (freq.len >= 0)
-            this_length = freq.len;
+        if (freq->len >= 0)
+            this_length = freq->len;
+        else if (ps->batch) /* share of what bend_fetch_batch allocated */
+            this_length = ps->batch_size / ps->batch->number;
         else
-            this_length = odr_total(a->encode) - total_length - dumped_records;
+            this_length = odr_total(a->encode) - total_length;
         yaz_log(log_requestdetail, "  fetched record, len=" ODR_INT_PRINTF
-                " total=" ODR_INT_PRINTF " dumped=" ODR_INT_PRINTF,
-                this_length, total_length, dumped_records);
+                " total=" ODR_INT_PRINTF, this_length, total_length);
         if (a->preferredMessageSize > 0 &&
             this_length + total_length > a->preferredMessageSize)
         {
             /* record is small enough, really */
-            if (this_length <= a->preferredMessageSize && recno > start)
+            if (this_length <= a->preferredMessageSize && recno > ps->start)
             {
                 yaz_log(log_requestdetail, "  Dropped last normal-sized record");
+                nmem_release_to_mark(odr_getmem(a->encode), &ps->mark);
                 *pres = Z_PresentStatus_partial_2;
                 if (*next > 0)
                     (*next)--;
@@ -2639,11 +3256,10 @@ static Z_Records *pack_records(association *a, char *setname, Odr_int start,
                 {
                     yaz_log(YLOG_DEBUG, "  Dropped it");
                     reclist->records[reclist->num_records] =
-                         surrogatediagrec(
-                             a, freq.basename,
-                             YAZ_BIB1_RECORD_EXCEEDS_PREFERRED_MESSAGE_SIZE, 0);
+                        drop_record(
+                            a, &ps->mark, freq->basename,
+                            YAZ_BIB1_RECORD_EXCEEDS_PREFERRED_MESSAGE_SIZE);
                     reclist->num_records++;
-                    dumped_records += this_length;
                     continue;
                 }
             }
@@ -2653,11 +3269,9 @@ static Z_Records *pack_records(association *a, char *setname, Odr_int start,
                         "this=" ODR_INT_PRINTF " max=%d",
                         this_length, a->maximumRecordSize);
                 reclist->records[reclist->num_records] =
-                    surrogatediagrec(
-                        a, freq.basename,
-                        YAZ_BIB1_RECORD_EXCEEDS_MAXIMUM_RECORD_SIZE, 0);
+                    drop_record(a, &ps->mark, freq->basename,
+                                YAZ_BIB1_RECORD_EXCEEDS_MAXIMUM_RECORD_SIZE);
                 reclist->num_records++;
-                dumped_records += this_length;
                 continue;
             }
         }
@@ -2665,24 +3279,111 @@ static Z_Records *pack_records(association *a, char *setname, Odr_int start,
         if (!(thisrec = (Z_NamePlusRecord *)
               odr_malloc(a->encode, sizeof(*thisrec))))
             return 0;
-        thisrec->databaseName = odr_strdup_null(a->encode, freq.basename);
+        thisrec->databaseName = odr_strdup_null(a->encode, freq->basename);
         thisrec->which = Z_NamePlusRecord_databaseRecord;
 
-        if (!freq.output_format)
+        if (!freq->output_format)
         {
             yaz_log(YLOG_WARN, "bend_fetch output_format not set");
             return 0;
         }
         thisrec->u.databaseRecord = z_ext_record_oid(
-            a->encode, freq.output_format, freq.record, freq.len);
+            a->encode, freq->output_format, freq->record, freq->len);
         if (!thisrec->u.databaseRecord)
             return 0;
         reclist->records[reclist->num_records] = thisrec;
         reclist->num_records++;
-        if (freq.last_in_set)
+        if (ps->batch && freq->len < 0)
+            ps->batch_used += this_length;
+        if (freq->last_in_set)
             break;
     }
-    *num = reclist->num_records;
+    *ps->num = reclist->num_records;
+    return ps->records;
+}
+
+/*
+ * Packs records for the response apdu. Returns 0 on failure and also
+ * if a fetch is pending (request state is then REQUEST_PENDING).
+ */
+static Z_Records *pack_records(association *a, request *reqb, Z_APDU *apdu,
+                               char *setname, Odr_int start,
+                               Odr_int *num, Z_RecordComposition *comp,
+                               Odr_int *next, Odr_int *pres,
+                               Z_ReferenceId *referenceId,
+                               Odr_oid *oid, int *errcode)
+{
+    struct pack_state *ps;
+    int toget = odr_int_to_int(*num);
+    Z_Records *records =
+        (Z_Records *) odr_malloc(a->encode, sizeof(*records));
+    Z_NamePlusRecordList *reclist =
+        (Z_NamePlusRecordList *) odr_malloc(a->encode, sizeof(*reclist));
+
+    records->which = Z_Records_DBOSD;
+    records->u.databaseOrSurDiagnostics = reclist;
+    reclist->num_records = 0;
+
+    if (toget < 0)
+        return diagrec(a, YAZ_BIB1_PRESENT_REQUEST_OUT_OF_RANGE, 0);
+    else if (toget == 0)
+        reclist->records = odr_nullval();
+    else
+        reclist->records = (Z_NamePlusRecord **)
+            odr_malloc(a->encode, sizeof(*reclist->records) * toget);
+
+    *pres = Z_PresentStatus_success;
+    *num = 0;
+    *next = 0;
+
+    yaz_log(log_requestdetail, "Request to pack " ODR_INT_PRINTF "+%d %s", start, toget, setname);
+    yaz_log(log_requestdetail, "pms=%d, mrs=%d", a->preferredMessageSize,
+        a->maximumRecordSize);
+
+    ps = (struct pack_state *) odr_malloc(a->encode, sizeof(*ps));
+    ps->apdu = apdu;
+    ps->records = records;
+    ps->reclist = reclist;
+    ps->setname = setname;
+    ps->start = start;
+    ps->toget = toget;
+    ps->recno = odr_int_to_int(start);
+    ps->num = num;
+    ps->comp = comp;
+    ps->next = next;
+    ps->pres = pres;
+    ps->referenceId = referenceId;
+    ps->oid = oid;
+    ps->errcode = 0;
+    ps->pending = 0;
+    ps->batch = 0;
+    if (retrieve_batch_enabled(a) && toget > 0)
+    {
+        ps->batch = (bend_fetch_batch_rr *)
+            odr_malloc(a->encode, sizeof(*ps->batch));
+        ps->batch_size = odr_total(a->encode);
+        ps->batch_used = 0;
+        pack_fetch_init(a, ps, &ps->freq, ps->recno);
+        switch (retrieve_fetch_batch_begin(a, &ps->freq, ps->batch, ps->recno,
+                                           toget, &ps->conv))
+        {
+        case -1:
+            *pres = Z_PresentStatus_failure;
+            if (errcode)
+                *errcode = ps->freq.errcode;
+            return diagrec(a, ps->freq.errcode, ps->freq.errstring);
+        case BEND_PENDING:
+            ps->pending = 2;
+            reqb->pack = ps;
+            request_pending(a, reqb);
+            return 0;
+        }
+        retrieve_convert(a, ps->batch, &ps->conv);
+        ps->batch_size = odr_total(a->encode) - ps->batch_size;
+    }
+    records = pack_records_fetch(a, reqb, ps);
+    if (errcode && ps->errcode)
+        *errcode = ps->errcode;
     return records;
 }
 
@@ -2770,8 +3471,14 @@ static Z_APDU *process_searchRequest(association *assoc, request *reqb)
                 bsrr->errcode = yaz_diag_srw_to_bib1(srw_errcode);
         }
 
-        if (!bsrr->errcode)
-            (assoc->init->bend_search)(assoc->backend, bsrr);
+        reqb->search_rr = bsrr;
+        if (!bsrr->errcode &&
+            backend_pending(assoc,
+                            (assoc->init->bend_search)(assoc->backend, bsrr)))
+        {
+            request_pending(assoc, reqb);
+            return 0;
+        }
     }
     else
     {
@@ -2782,9 +3489,9 @@ static Z_APDU *process_searchRequest(association *assoc, request *reqb)
 }
 
 /*
- * Prepare a searchresponse based on the backend results. We probably want
- * to look at making the fetching of records nonblocking as well, but
- * so far, we'll keep things simple.
+ * Prepare a searchresponse based on the backend results. Returns 0 if
+ * piggy-backed records are pending; response_searchRequest_end is called
+ * when they have been packed.
  * If bsrt is null, that means we're called in response to a communications
  * event, and we'll have to get the response for ourselves.
  */
@@ -2798,7 +3505,6 @@ static Z_APDU *response_searchRequest(association *assoc, request *reqb,
     Odr_int *nulint = odr_intdup(assoc->encode, 0);
     Odr_int *next = odr_intdup(assoc->encode, 0);
     Odr_int *none = odr_intdup(assoc->encode, Z_SearchResponse_none);
-    Odr_int returnedrecs = 0;
 
     apdu->which = Z_APDU_searchResponse;
     apdu->u.searchResponse = resp;
@@ -2852,9 +3558,25 @@ static Z_APDU *response_searchRequest(association *assoc, request *reqb,
         else
             *toget = 0;
 
+        resp->nextResultSetPosition = next;
+        resp->searchStatus = sr;
+        resp->resultSetStatus = 0;
+        if (bsrt->estimated_hit_count)
+        {
+            resp->resultSetStatus = odr_intdup(assoc->encode,
+                                               Z_SearchResponse_estimate);
+        }
+        else if (bsrt->partial_resultset)
+        {
+            resp->resultSetStatus = odr_intdup(assoc->encode,
+                                               Z_SearchResponse_subset);
+        }
         if (*toget && !resp->records)
         {
             Odr_int *presst = odr_intdup(assoc->encode, 0);
+
+            resp->numberOfRecordsReturned = toget;
+            resp->presentStatus = presst;
             /* Call bend_present if defined */
             if (assoc->init->bend_present)
             {
@@ -2879,17 +3601,15 @@ static Z_APDU *response_searchRequest(association *assoc, request *reqb,
                     *resp->presentStatus = Z_PresentStatus_failure;
                 }
             }
-
             if (!resp->records)
+            {
                 resp->records = pack_records(
-                    assoc, req->resultSetName, 1,
+                    assoc, reqb, apdu, req->resultSetName, 1,
                     toget, compp, next, presst, req->referenceId,
                     req->preferredRecordSyntax, NULL);
-            if (!resp->records)
-                return 0;
-            resp->numberOfRecordsReturned = toget;
-            returnedrecs = *toget;
-            resp->presentStatus = presst;
+                if (reqb->state == REQUEST_PENDING)
+                    return 0;
+            }
         }
         else
         {
@@ -2898,19 +3618,23 @@ static Z_APDU *response_searchRequest(association *assoc, request *reqb,
             resp->numberOfRecordsReturned = nulint;
             resp->presentStatus = 0;
         }
-        resp->nextResultSetPosition = next;
-        resp->searchStatus = sr;
-        resp->resultSetStatus = 0;
-        if (bsrt->estimated_hit_count)
-        {
-            resp->resultSetStatus = odr_intdup(assoc->encode,
-                                               Z_SearchResponse_estimate);
-        }
-        else if (bsrt->partial_resultset)
-        {
-            resp->resultSetStatus = odr_intdup(assoc->encode,
-                                               Z_SearchResponse_subset);
-        }
+    }
+    return response_searchRequest_end(assoc, reqb, bsrt, apdu);
+}
+
+/* finishes the search response once records are packed */
+static Z_APDU *response_searchRequest_end(association *assoc, request *reqb,
+                                          bend_search_rr *bsrt, Z_APDU *apdu)
+{
+    Z_SearchRequest *req = reqb->apdu_request->u.searchRequest;
+    Z_SearchResponse *resp = apdu->u.searchResponse;
+    Odr_int returnedrecs = 0;
+
+    if (resp->presentStatus)
+    {
+        if (!resp->records)
+            return 0;
+        returnedrecs = *resp->numberOfRecordsReturned;
     }
     resp->additionalSearchInfo = bsrt->search_info;
 
@@ -3002,17 +3726,32 @@ static Z_APDU *process_presentRequest(association *assoc, request *reqb)
     apdu->u.presentResponse = resp;
     resp->referenceId = req->referenceId;
     resp->otherInfo = 0;
+    resp->numberOfRecordsReturned = num;
+    resp->nextResultSetPosition = next;
 
     if (!resp->records)
     {
         *num = *req->numberOfRecordsRequested;
         resp->records =
-            pack_records(assoc, req->resultSetId, *req->resultSetStartPoint,
+            pack_records(assoc, reqb, apdu, req->resultSetId,
+                         *req->resultSetStartPoint,
                          num, req->recordComposition, next,
                          resp->presentStatus,
                          req->referenceId, req->preferredRecordSyntax,
                          &errcode);
+        if (reqb->state == REQUEST_PENDING)
+            return 0;
     }
+    return process_presentRequest_end(assoc, reqb, apdu, errcode);
+}
+
+/* finishes the present response once records are packed */
+static Z_APDU *process_presentRequest_end(association *assoc, request *reqb,
+                                          Z_APDU *apdu, int errcode)
+{
+    Z_PresentRequest *req = reqb->apdu_request->u.presentRequest;
+    Z_PresentResponse *resp = apdu->u.presentResponse;
+
     if (log_request)
     {
         WRBUF wr = wrbuf_alloc();
@@ -3034,9 +3773,6 @@ static Z_APDU *process_presentRequest(association *assoc, request *reqb)
     }
     if (!resp->records)
         return 0;
-    resp->numberOfRecordsReturned = num;
-    resp->nextResultSetPosition = next;
-
     return apdu;
 }
 
@@ -3547,6 +4283,67 @@ static Z_APDU *process_ESRequest(association *assoc, request *reqb)
     return apdu;
 }
 
+/*
+ * The backend has completed the pending operation (bend_complete).
+ * Socket I/O is resumed and the response is made.
+ */
+static void process_complete(association *assoc)
+{
+    request *req = assoc->pending;
+    struct pack_state *ps = req->pack;
+    Z_APDU *res;
+
+    wait_complete(assoc); /* readable, so it does not block */
+    assoc->pending = 0;
+    req->state = REQUEST_IDLE;
+    iochan_setfd(assoc->client_chan, cs_fileno(assoc->client_link));
+    iochan_setflags(assoc->client_chan, assoc->cs_get_mask);
+    if (ps && ps->pending)
+    {
+        Z_Records *records = pack_records_fetch(assoc, req, ps);
+
+        if (req->state == REQUEST_PENDING)
+            return; /* next record pending */
+        if (ps->apdu->which == Z_APDU_searchResponse)
+        {
+            ps->apdu->u.searchResponse->records = records;
+            res = response_searchRequest_end(assoc, req, req->search_rr,
+                                             ps->apdu);
+        }
+        else
+        {
+            ps->apdu->u.presentResponse->records = records;
+            res = process_presentRequest_end(assoc, req, ps->apdu,
+                                             ps->errcode);
+        }
+    }
+    else
+    {
+        res = response_searchRequest(assoc, req, req->search_rr);
+        if (req->state == REQUEST_PENDING)
+            return; /* piggy-backed records pending */
+    }
+    if (res)
+        process_z_response(assoc, req, res);
+    else
+        do_close_req(assoc, Z_Close_systemProblem, "Unknown Error", req);
+}
+
+void bend_complete(bend_association assoc)
+{
+    int fd = yaz_spipe_get_write_fd(assoc->complete_pipe);
+    int r;
+
+#ifdef WIN32
+    r = send(fd, "", 1, 0);
+#else
+    while ((r = write(fd, "", 1)) < 0 && errno == EINTR)
+        ;
+#endif
+    if (r != 1)
+        yaz_log(YLOG_WARN|YLOG_ERRNO, "bend_complete");
+}
+
 int bend_assoc_is_alive(bend_association assoc)
 {
     if (assoc->state == ASSOC_DEAD)
@@ -38,7 +38,9 @@
 #include <yaz/proto.h>
 #include <yaz/backend.h>
 #include <yaz/retrieval.h>
+#include <yaz/spipe.h>
 #include "eventl.h"
+#include "rsetcache.h"
 
 struct gfs_server {
     statserv_options_block cb;
@@ -53,6 +55,7 @@ struct gfs_server {
     char *stylesheet;
     char *client_query_charset;
     yaz_retrieval_t retrieval;
+    rsetcache_t rsetcache;
     struct gfs_server *next;
 };
 
@@ -81,6 +84,8 @@ typedef struct request
     char *response;        /* encoded data waiting for transmission */
 
     void *clientData;
+    bend_search_rr *search_rr;  /* search of request (async backend) */
+    struct pack_state *pack;    /* records being packed (async backend) */
     struct request *next;
     struct request_q *q;
 } request;
@@ -134,6 +139,9 @@ typedef struct association
     statserv_options_block *last_control;
 
     struct gfs_server *server;
+
+    yaz_spipe_t complete_pipe;    /* signalled by bend_complete */
+    request *pending;             /* request waiting for bend_complete */
 } association;
 
 association *create_association(IOCHAN channel, COMSTACK link,
@@ -300,6 +300,17 @@ void yaz_iconv_set_errno(yaz_iconv_t cd, int no)
     cd->my_errno = no;
 }
 
+void yaz_iconv_reset(yaz_iconv_t cd)
+{
+#if HAVE_ICONV_H
+    if (cd->iconv_cd != (iconv_t) (-1))
+        iconv(cd->iconv_cd, 0, 0, 0, 0);
+#endif
+    cd->my_errno = YAZ_ICONV_UNKNOWN;
+    cd->unget_x = 0;
+    cd->init_flag = 1;
+}
+
 /*
  * Local variables:
  * c-basic-offset: 4
@@ -62,11 +62,16 @@
 #include <yaz/log.h>
 #include "eventl.h"
 #include "session.h"
+#include "workq.h"
 #include <yaz/statserv.h>
 #include <yaz/daemon.h>
 #include <yaz/yaz-iconv.h>
+#include <yaz/mutex.h>
 
 static IOCHAN pListener = NULL;
+/* listener addresses of command line; added once all options are read */
+static char **cmd_listeners = 0;
+static int num_cmd_listeners = 0;
 
 static char gfs_root_dir[FILENAME_MAX+1];
 static struct gfs_server *gfs_server_list = 0;
@@ -121,7 +126,11 @@ statserv_options_block control_block = {
     0,                          /* background daemon */
     "",                         /* SSL certificate filename */
     "",                         /* XML config filename */
-    1                           /* keepalive */
+    1,                          /* keepalive */
+    0,                          /* thread pool size */
+    0,                          /* reuseport listeners per thread */
+    0,                          /* prefork worker processes */
+    0                           /* parallel record conversions */
 };
 
 static int max_sessions = 0;
@@ -229,6 +238,7 @@ static struct gfs_server * gfs_server_new(const char *id)
     n->client_query_charset = 0;
     n->id = nmem_strdup_null(gfs_nmem, id);
     n->retrieval = yaz_retrieval_create();
+    n->rsetcache = 0;
     return n;
 }
 #endif
@@ -354,7 +364,54 @@ static void xml_config_read(const char *base_path)
         if (ptr->type != XML_ELEMENT_NODE)
             continue;
         attr = ptr->properties;
-        if (!strcmp((const char *) ptr->name, "listen"))
+        if (!strcmp((const char *) ptr->name, "threads"))
+        {
+            /*
+              <threads reuseport="1">8</threads>
+            */
+            int num = atoi(nmem_dup_xml_content(gfs_nmem, ptr->children));
+#if YAZ_POSIX_THREADS && !defined(WIN32)
+            if (num > 0)
+            {
+                control_block.dynamic = 0;
+                control_block.threads = 1;
+                control_block.thread_pool = num;
+            }
+            for ( ; attr; attr = attr->next)
+                if (!xmlStrcmp(attr->name, BAD_CAST "reuseport")
+                    && attr->children && attr->children->type == XML_TEXT_NODE)
+                    control_block.reuseport =
+                        atoi(nmem_dup_xml_content(gfs_nmem, attr->children));
+#else
+            yaz_log(YLOG_WARN, "Threaded mode not available; "
+                    "ignoring threads %d in config %s", num,
+                    control_block.xml_config);
+#endif
+        }
+        else if (!strcmp((const char *) ptr->name, "prefork"))
+        {
+            /*
+              <prefork sessions="1000">8</prefork>
+            */
+            int num = atoi(nmem_dup_xml_content(gfs_nmem, ptr->children));
+#ifndef WIN32
+            if (num > 0)
+            {
+                control_block.dynamic = 0;
+                control_block.prefork = num;
+            }
+            for ( ; attr; attr = attr->next)
+                if (!xmlStrcmp(attr->name, BAD_CAST "sessions")
+                    && attr->children && attr->children->type == XML_TEXT_NODE)
+                    max_sessions =
+                        atoi(nmem_dup_xml_content(gfs_nmem, attr->children));
+#else
+            yaz_log(YLOG_WARN, "Prefork mode not available; "
+                    "ignoring prefork %d in config %s", num,
+                    control_block.xml_config);
+#endif
+        }
+        else if (!strcmp((const char *) ptr->name, "listen"))
         {
             /*
               <listen id="listenerid">tcp:@:9999</listen>
@@ -501,6 +558,33 @@ static void xml_config_read(const char *base_path)
                 {
                     ; /* being processed separately */
                 }
+                else if (!strcmp((const char *) ptr->name, "resultsetcache"))
+                {
+                    /*
+                      <resultsetcache ttl="300" size="1048576"/>
+                    */
+                    int ttl = 300;
+                    int size = 1048576;
+                    for (attr = ptr->properties; attr; attr = attr->next)
+                        if (!xmlStrcmp(attr->name, BAD_CAST "ttl")
+                            && attr->children
+                            && attr->children->type == XML_TEXT_NODE)
+                            ttl = atoi(nmem_dup_xml_content(gfs_nmem,
+                                                            attr->children));
+                        else if (!xmlStrcmp(attr->name, BAD_CAST "size")
+                                 && attr->children
+                                 && attr->children->type == XML_TEXT_NODE)
+                            size = atoi(nmem_dup_xml_content(gfs_nmem,
+                                                             attr->children));
+                        else
+                            yaz_log(YLOG_WARN, "Unknown attribute '%s' for "
+                                    "resultsetcache", attr->name);
+                    if (ttl > 0 && size > 0)
+                    {
+                        rsetcache_destroy(gfs->rsetcache);
+                        gfs->rsetcache = rsetcache_create(ttl, size);
+                    }
+                }
                 else if (!strcmp((const char *) ptr->name, "retrievalinfo"))
                 {
                     if (base_path)
@@ -597,7 +681,11 @@ static void xml_config_close(void)
         xml_config_doc = 0;
     }
 #endif
-    gfs_server_list = 0;
+    while (gfs_server_list)
+    {
+        rsetcache_destroy(gfs_server_list->rsetcache);
+        gfs_server_list = gfs_server_list->next;
+    }
     nmem_destroy(gfs_nmem);
 #ifdef WIN32
     if (init_control_tls)
@@ -922,12 +1010,424 @@ static void listener(IOCHAN h, int event)
 
 #else /* ! WIN32 */
 
+/*
+ * Accepted connection. Sessions may be started by another thread after
+ * the listener is gone, so what is needed of it is copied here.
+ */
+struct gfs_accepted {
+    COMSTACK line;
+    int listen_id;           /* chan_id of listener */
+    int session_no;          /* no_sessions when accepted */
+};
+
+static IOCHAN new_session(struct gfs_accepted *a);
+static int no_sessions = 0;
+
+#if YAZ_POSIX_THREADS
+/*
+ * Thread pool mode (-T N or <threads>N</threads>).  Sessions are
+ * multiplexed over a fixed number of worker threads, each running its
+ * own event loop. The listener hands accepted connections to the least
+ * loaded worker through a bounded queue and wakes it up through a pipe.
+ * When the queues of all workers are full, the listeners stop accepting
+ * until a worker catches up.
+ *
+ * With reuseport (-R) each worker instead owns its own listener for each
+ * listening address, all bound with SO_REUSEPORT. The kernel then
+ * distributes connections over the workers and there is no handoff.
+ */
+#define GFS_POOL_QUEUE_MAX 64
+
+struct gfs_worker {
+    int id;
+    pthread_t tid;
+    IOCHAN chans;            /* channels owned by this worker */
+    IOCHAN wakeup_chan;
+    int wakeup_fd[2];        /* pipe: listener -> worker */
+    struct gfs_accepted queue[GFS_POOL_QUEUE_MAX]; /* not yet started */
+    int queue_head;
+    int queue_num;
+    int sessions;            /* live sessions in this worker */
+};
+
+struct gfs_pool {
+    int num_workers;
+    struct gfs_worker *workers;
+    YAZ_MUTEX mutex;         /* protects queues, counters and flags */
+    int paused;              /* listeners not accepting */
+    int stopped;             /* last session accepted (-1, -A) */
+    int resume_fd[2];        /* pipe: worker -> listener thread */
+    pthread_key_t worker_key;
+};
+
+static struct gfs_pool *gfs_pool = 0;
+
+/* per-worker listeners; moved to workers when the pool starts */
+struct gfs_reactor_listen {
+    IOCHAN chan;
+    int worker;
+    struct gfs_reactor_listen *next;
+};
+
+static struct gfs_reactor_listen *gfs_reactor_listeners = 0;
+
+static void listener(IOCHAN h, int event);
+
+static struct gfs_worker *gfs_pool_current_worker(void)
+{
+    if (!gfs_pool)
+        return 0;
+    return (struct gfs_worker *) pthread_getspecific(gfs_pool->worker_key);
+}
+
+static int gfs_pool_pipe(int *fds)
+{
+    if (pipe(fds))
+        return -1;
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+}
+
+static void gfs_pool_drain_pipe(int fd)
+{
+    char buf[64];
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+}
+
+/* returns 1 if at least one worker can take another session */
+static int gfs_pool_has_room(struct gfs_pool *pool)
+{
+    int i;
+    for (i = 0; i < pool->num_workers; i++)
+        if (pool->workers[i].queue_num < GFS_POOL_QUEUE_MAX)
+            return 1;
+    return 0;
+}
+
+static int gfs_pool_queued(struct gfs_pool *pool)
+{
+    int i, num = 0;
+    for (i = 0; i < pool->num_workers; i++)
+        num += pool->workers[i].queue_num;
+    return num;
+}
+
+static void gfs_pool_set_accept(int accept)
+{
+    IOCHAN p;
+    for (p = pListener; p; p = p->next)
+        if (p->fun == listener && !p->destroyed)
+        {
+            if (accept)
+                iochan_setflag(p, EVENT_INPUT);
+            else
+                iochan_clearflag(p, EVENT_INPUT);
+        }
+}
+
+/* worker thread: once the last session has been accepted, remove own
+   listeners and let the event loop of the worker end when its sessions
+   are over */
+static void gfs_worker_check_stop(struct gfs_worker *w)
+{
+    int stopped, idle;
+
+    yaz_mutex_enter(gfs_pool->mutex);
+    stopped = gfs_pool->stopped;
+    idle = w->sessions == 0 && w->queue_num == 0;
+    yaz_mutex_leave(gfs_pool->mutex);
+    if (!stopped)
+        return;
+    remove_listeners();
+    if (idle && w->wakeup_chan)
+    {
+        iochan_destroy(w->wakeup_chan);
+        w->wakeup_chan = 0;
+    }
+}
+
+/* worker thread: start session; it is already counted in w->sessions */
+static void gfs_worker_start_session(struct gfs_worker *w,
+                                     struct gfs_accepted *a)
+{
+    IOCHAN chan = new_session(a);
+    if (chan)
+    {
+        /* new channels must go at the head of the list */
+        chan->next = w->chans;
+        w->chans = chan;
+    }
+    else
+    {
+        yaz_mutex_enter(gfs_pool->mutex);
+        w->sessions--;
+        yaz_mutex_leave(gfs_pool->mutex);
+        gfs_worker_check_stop(w);
+    }
+}
+
+/* worker thread: connection accepted on own listener */
+static void gfs_worker_accepted(struct gfs_worker *w, struct gfs_accepted *a)
+{
+    int load;
+
+    yaz_mutex_enter(gfs_pool->mutex);
+    load = ++w->sessions;
+    yaz_mutex_leave(gfs_pool->mutex);
+    yaz_log(log_sessiondetail, "Session %d on worker %d load=%d",
+            a->session_no, w->id, load);
+    gfs_worker_start_session(w, a);
+}
+
+/* worker thread: start the sessions queued for this worker */
+static void gfs_worker_wakeup(IOCHAN h, int event)
+{
+    struct gfs_worker *w = (struct gfs_worker *) iochan_getdata(h);
+    struct gfs_pool *pool = gfs_pool;
+
+    gfs_pool_drain_pipe(w->wakeup_fd[0]);
+    for (;;)
+    {
+        struct gfs_accepted a;
+        int resume = 0;
+
+        a.line = 0;
+        yaz_mutex_enter(pool->mutex);
+        if (w->queue_num > 0)
+        {
+            a = w->queue[w->queue_head];
+            w->queue_head = (w->queue_head + 1) % GFS_POOL_QUEUE_MAX;
+            w->queue_num--;
+            w->sessions++;
+            if (pool->paused && w->queue_num == 0)
+                resume = 1;
+        }
+        yaz_mutex_leave(pool->mutex);
+        if (resume && write(pool->resume_fd[1], "", 1) < 0 && errno != EAGAIN)
+            yaz_log(YLOG_WARN|YLOG_ERRNO, "write resume pipe");
+        if (!a.line)
+            break;
+        gfs_worker_start_session(w, &a);
+    }
+    gfs_worker_check_stop(w);
+}
+
+/* listener thread: resume accepting when a worker has drained its queue */
+static void gfs_pool_resume(IOCHAN h, int event)
+{
+    struct gfs_pool *pool = (struct gfs_pool *) iochan_getdata(h);
+    int resume = 0, queued;
+
+    gfs_pool_drain_pipe(pool->resume_fd[0]);
+    yaz_mutex_enter(pool->mutex);
+    if (pool->stopped)
+    {
+        yaz_mutex_leave(pool->mutex);
+        /* the main event loop ends with the listeners */
+        remove_listeners();
+        iochan_destroy(h);
+        return;
+    }
+    if (pool->paused && gfs_pool_has_room(pool))
+    {
+        pool->paused = 0;
+        resume = 1;
+    }
+    queued = gfs_pool_queued(pool);
+    yaz_mutex_leave(pool->mutex);
+    if (resume)
+    {
+        yaz_log(log_server, "Resuming accept queued=%d", queued);
+        gfs_pool_set_accept(1);
+    }
+}
+
+/* listener thread: hand new connection to least loaded worker */
+static void gfs_pool_dispatch(struct gfs_accepted *a)
+{
+    struct gfs_pool *pool = gfs_pool;
+    struct gfs_worker *best = 0;
+    int i, best_load = 0, queued, full;
+
+    yaz_mutex_enter(pool->mutex);
+    for (i = 0; i < pool->num_workers; i++)
+    {
+        struct gfs_worker *w = pool->workers + i;
+        int load = w->sessions + w->queue_num;
+        if (w->queue_num < GFS_POOL_QUEUE_MAX && (!best || load < best_load))
+        {
+            best = w;
+            best_load = load;
+        }
+    }
+    if (best)
+    {
+        best->queue[(best->queue_head + best->queue_num)
+                    % GFS_POOL_QUEUE_MAX] = *a;
+        best->queue_num++;
+    }
+    queued = gfs_pool_queued(pool);
+    full = !gfs_pool_has_room(pool);
+    if (full)
+        pool->paused = 1;
+    yaz_mutex_leave(pool->mutex);
+
+    if (!best)
+    {   /* can not happen: listeners are paused when all queues are full */
+        yaz_log(YLOG_WARN, "Session queue full; closing connection");
+        cs_close(a->line);
+    }
+    else
+    {
+        yaz_log(log_sessiondetail, "Session %d to worker %d load=%d queued=%d",
+                a->session_no, best->id, best_load + 1, queued);
+        if (write(best->wakeup_fd[1], "", 1) < 0 && errno != EAGAIN)
+            yaz_log(YLOG_WARN|YLOG_ERRNO, "write wakeup pipe");
+    }
+    if (full)
+    {
+        yaz_log(YLOG_WARN, "Session queues full queued=%d; pausing accept",
+                queued);
+        gfs_pool_set_accept(0);
+    }
+}
+
+/* any thread: the last session has been accepted and handed to a
+   worker. Tell the main thread and the workers to stop listening */
+static void gfs_pool_stop(void)
+{
+    struct gfs_pool *pool = gfs_pool;
+    int i;
+
+    yaz_mutex_enter(pool->mutex);
+    pool->stopped = 1;
+    yaz_mutex_leave(pool->mutex);
+    yaz_log(log_server, "Last session accepted; stop listening");
+    for (i = 0; i < pool->num_workers; i++)
+        if (write(pool->workers[i].wakeup_fd[1], "", 1) < 0
+            && errno != EAGAIN)
+            yaz_log(YLOG_WARN|YLOG_ERRNO, "write wakeup pipe");
+    if (write(pool->resume_fd[1], "", 1) < 0 && errno != EAGAIN)
+        yaz_log(YLOG_WARN|YLOG_ERRNO, "write resume pipe");
+}
+
+/* main thread: wait for the workers if they are ending (-1, -A) */
+static void gfs_pool_join(void)
+{
+    struct gfs_pool *pool = gfs_pool;
+    int i, stopped;
+
+    if (!pool)
+        return;
+    yaz_mutex_enter(pool->mutex);
+    stopped = pool->stopped;
+    yaz_mutex_leave(pool->mutex);
+    if (!stopped)
+        return;
+    for (i = 0; i < pool->num_workers; i++)
+    {
+        struct gfs_worker *w = pool->workers + i;
+
+        pthread_join(w->tid, 0);
+        close(w->wakeup_fd[0]);
+        close(w->wakeup_fd[1]);
+    }
+    yaz_log(log_server, "Session threads ended PID=%ld", (long) getpid());
+}
+
+static void *gfs_worker_thread(void *vp)
+{
+    struct gfs_worker *w = (struct gfs_worker *) vp;
+
+    pthread_setspecific(gfs_pool->worker_key, w);
+    iochan_event_loop(&w->chans, 0);
+    return 0;
+}
+
+/* starts the workers; must be called in the process that serves */
+static int gfs_pool_start(int num_workers)
+{
+    struct gfs_pool *pool = (struct gfs_pool *) xmalloc(sizeof(*pool));
+    struct gfs_reactor_listen *rl;
+    IOCHAN chan;
+    int i;
+
+    pool->num_workers = num_workers;
+    pool->workers = (struct gfs_worker *)
+        xmalloc(sizeof(*pool->workers) * num_workers);
+    pool->mutex = 0;
+    yaz_mutex_create(&pool->mutex);
+    pool->paused = 0;
+    pool->stopped = 0;
+    pthread_key_create(&pool->worker_key, 0);
+    if (gfs_pool_pipe(pool->resume_fd))
+    {
+        yaz_log(YLOG_FATAL|YLOG_ERRNO, "pipe");
+        return -1;
+    }
+    chan = iochan_create(pool->resume_fd[0], gfs_pool_resume, EVENT_INPUT, 0);
+    iochan_setdata(chan, pool);
+    chan->next = pListener;
+    pListener = chan;
+    gfs_pool = pool;
+
+    for (i = 0; i < num_workers; i++)
+    {
+        struct gfs_worker *w = pool->workers + i;
+
+        w->id = i + 1;
+        w->queue_head = w->queue_num = w->sessions = 0;
+        if (gfs_pool_pipe(w->wakeup_fd))
+        {
+            yaz_log(YLOG_FATAL|YLOG_ERRNO, "pipe");
+            return -1;
+        }
+        w->wakeup_chan = iochan_create(w->wakeup_fd[0], gfs_worker_wakeup,
+                                       EVENT_INPUT, 0);
+        iochan_setdata(w->wakeup_chan, w);
+        w->chans = w->wakeup_chan;
+        for (rl = gfs_reactor_listeners; rl; rl = rl->next)
+            if (rl->worker == i)
+            {
+                rl->chan->next = w->chans;
+                w->chans = rl->chan;
+            }
+        if (pthread_create(&w->tid, 0, gfs_worker_thread, w))
+        {
+            yaz_log(YLOG_FATAL|YLOG_ERRNO, "pthread_create");
+            return -1;
+        }
+    }
+    yaz_log(log_server, "Started %d session threads PID=%ld", num_workers,
+            (long) getpid());
+    return 0;
+}
+
+/* called by event loop when a channel is freed */
+void statserv_remove(IOCHAN pIOChannel)
+{
+    struct gfs_worker *w = gfs_pool_current_worker();
+
+    if (w && pIOChannel->fun == ir_session)
+    {
+        yaz_mutex_enter(gfs_pool->mutex);
+        w->sessions--;
+        yaz_mutex_leave(gfs_pool->mutex);
+        gfs_worker_check_stop(w);
+    }
+}
+#else
 /* To save having an #ifdef in event_loop we need to
    define this empty function
 */
 void statserv_remove(IOCHAN pIOChannel)
 {
 }
+#endif
 
 static void statserv_closedown(void)
 {
@@ -941,8 +1441,64 @@ static void statserv_closedown(void)
     xml_config_close();
 }
 
-static void *new_session(void *vp);
-static int no_sessions = 0;
+#if YAZ_POSIX_THREADS
+/* number of threads of thread-per-session mode (-T 0) still running */
+static pthread_mutex_t session_threads_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t session_threads_cond = PTHREAD_COND_INITIALIZER;
+static int session_threads = 0;
+
+static void *new_session_thread(void *vp)
+{
+    IOCHAN new_chan = new_session((struct gfs_accepted *) vp);
+
+    xfree(vp);
+    if (new_chan)
+        iochan_event_loop(&new_chan, 0);
+    pthread_mutex_lock(&session_threads_mutex);
+    if (--session_threads == 0)
+        pthread_cond_signal(&session_threads_cond);
+    pthread_mutex_unlock(&session_threads_mutex);
+    return 0;
+}
+
+/* waits for the sessions to end when no more are accepted (-A) */
+static void session_threads_wait(void)
+{
+    pthread_mutex_lock(&session_threads_mutex);
+    while (session_threads > 0)
+        pthread_cond_wait(&session_threads_cond, &session_threads_mutex);
+    pthread_mutex_unlock(&session_threads_mutex);
+}
+#endif
+
+/*
+ * Counts an accepted connection and sets its number. Returns 1 if it is
+ * the last session to serve (-1 or -A), -1 if the last one has been
+ * accepted already and 0 otherwise.
+ */
+static int count_session(int *session_no)
+{
+    int limit = control_block.one_shot ? 1 : max_sessions;
+    int ret = 0;
+
+#if YAZ_POSIX_THREADS
+    if (gfs_pool)   /* listeners may run in several threads */
+        yaz_mutex_enter(gfs_pool->mutex);
+#endif
+    if (limit && no_sessions >= limit)
+        ret = -1;
+    else
+    {
+        *session_no = ++no_sessions;
+        if (limit && no_sessions == limit)
+            ret = 1;
+    }
+#if YAZ_POSIX_THREADS
+    if (gfs_pool)
+        yaz_mutex_leave(gfs_pool->mutex);
+#endif
+    return ret;
+}
 
 /* UNIX listener */
 static void listener(IOCHAN h, int event)
@@ -953,10 +1509,15 @@ static void listener(IOCHAN h, int event)
     if (event == EVENT_INPUT)
     {
         COMSTACK new_line;
+        IOCHAN new_chan;
+        struct gfs_accepted a;
+        int last;
         if ((res = cs_listen_check(line, 0, 0, control_block.check_ip,
                                    control_block.daemon_name)) < 0)
         {
-            yaz_log(YLOG_WARN|YLOG_ERRNO, "cs_listen failed");
+            /* prefork: another worker got the connection */
+            if (cs_errno(line) != CSNODATA)
+                yaz_log(YLOG_WARN|YLOG_ERRNO, "cs_listen failed");
             return;
         }
         else if (res == 1)
@@ -972,12 +1533,19 @@ static void listener(IOCHAN h, int event)
             return;
         }
 
-        if (control_block.one_shot)
+        a.line = new_line;
+        a.listen_id = h->chan_id;
+        last = count_session(&a.session_no);
+        if (last)
             remove_listeners();
+        if (last < 0)
+        {   /* another pool thread took the last session */
+            cs_close(new_line);
+            return;
+        }
 
         yaz_log(log_sessiondetail, "Connect from %s", cs_addrstr(new_line));
 
-        no_sessions++;
         if (control_block.dynamic)
         {
             if ((res = fork()) < 0)
@@ -997,7 +1565,7 @@ static void listener(IOCHAN h, int event)
                     cs_close(l);
                     iochan_destroy(pp);
                 }
-                sprintf(nbuf, "%s(%d)", me, no_sessions);
+                sprintf(nbuf, "%s(%d)", me, a.session_no);
                 yaz_log_init_prefix(nbuf);
                 /* ensure that bend_stop is not called when each child exits -
                    only for the main process ..  */
@@ -1010,18 +1578,47 @@ static void listener(IOCHAN h, int event)
             }
         }
 
+#if YAZ_POSIX_THREADS
+        if (gfs_pool)
+        {
+            struct gfs_worker *w = gfs_pool_current_worker();
+            if (w)
+                gfs_worker_accepted(w, &a);
+            else
+                gfs_pool_dispatch(&a);
+            if (last)
+                gfs_pool_stop();
+            return;
+        }
         if (control_block.threads)
         {
-#if YAZ_POSIX_THREADS
             pthread_t child_thread;
-            pthread_create(&child_thread, 0, new_session, new_line);
+            struct gfs_accepted *ap = (struct gfs_accepted *)
+                xmalloc(sizeof(*ap));
+
+            *ap = a;
+            pthread_mutex_lock(&session_threads_mutex);
+            session_threads++;
+            pthread_mutex_unlock(&session_threads_mutex);
+            if (pthread_create(&child_thread, 0, new_session_thread, ap))
+            {
+                yaz_log(YLOG_FATAL|YLOG_ERRNO, "pthread_create");
+                pthread_mutex_lock(&session_threads_mutex);
+                session_threads--;
+                pthread_mutex_unlock(&session_threads_mutex);
+                xfree(ap);
+                cs_close(new_line);
+                return;
+            }
             pthread_detach(child_thread);
-#else
-            new_session(new_line);
+            return;
+        }
 #endif
+        if ((new_chan = new_session(&a)))
+        {
+            new_chan->next = pListener;
+            pListener = new_chan;
         }
-        else
-            new_session(new_line);
     }
     else if (event == EVENT_TIMEOUT)
     {
@@ -1035,13 +1632,13 @@ static void listener(IOCHAN h, int event)
     }
 }
 
-static void *new_session(void *vp)
+/* creates channel and association for new connection */
+static IOCHAN new_session(struct gfs_accepted *acc)
 {
+    COMSTACK new_line = acc->line;
     const char *a;
     association *newas;
     IOCHAN new_chan;
-    COMSTACK new_line = (COMSTACK) vp;
-    IOCHAN parent_chan = (IOCHAN) new_line->user;
 
     unsigned cs_get_mask, cs_accept_mask, mask =
         ((new_line->io_pending & CS_WANT_WRITE) ? EVENT_OUTPUT : 0) |
@@ -1059,7 +1656,7 @@ static void *new_session(void *vp)
     }
 
     if (!(new_chan = iochan_create(cs_fileno(new_line), ir_session, mask,
-                                   parent_chan->chan_id)))
+                                   acc->listen_id)))
     {
         yaz_log(YLOG_FATAL, "Failed to create iochan");
         return 0;
@@ -1082,19 +1679,8 @@ static void *new_session(void *vp)
 #endif
     yaz_log_xml_errors(0, YLOG_WARN);
     yaz_log(log_session, "Session - OK %d %s PID=%ld",
-            no_sessions, a ? a : "[Unknown]", (long) getpid());
-    if (max_sessions && no_sessions >= max_sessions)
-        control_block.one_shot = 1;
-    if (control_block.threads)
-    {
-        iochan_event_loop(&new_chan, 0);
-    }
-    else
-    {
-        new_chan->next = pListener;
-        pListener = new_chan;
-    }
-    return 0;
+            acc->session_no, a ? a : "[Unknown]", (long) getpid());
+    return new_chan;
 }
 
 /* UNIX */
@@ -1141,33 +1727,28 @@ static void inetd_connection(int what)
 }
 
 /*
- * Set up a listening endpoint, and give it to the event-handler.
+ * Create a listening endpoint. If reuseport is set, the address may be
+ * bound by other listeners as well; returns 0 if that is not supported.
  */
-static int add_listener(char *where, int listen_id)
+static IOCHAN create_listener(const char *where, int listen_id, int reuseport)
 {
     COMSTACK l;
     void *ap;
     IOCHAN lst = NULL;
-    const char *mode;
-
-    if (control_block.dynamic)
-        mode = "dynamic";
-    else if (control_block.threads)
-        mode = "threaded";
-    else
-        mode = "static";
-
-    yaz_log(log_server, "Adding %s listener on %s id=%d PID=%ld", mode, where,
-            listen_id, (long) getpid());
 
     l = cs_create_host(where, 2, &ap);
     if (!l)
     {
         yaz_log(YLOG_FATAL, "Failed to listen on %s", where);
-        return -1;
+        return 0;
     }
     if (*control_block.cert_fname)
         cs_set_ssl_certificate_file(l, control_block.cert_fname);
+    if (reuseport && cs_set_reuseport(l, 1))
+    {
+        cs_close(l);
+        return 0;
+    }
 
     if (cs_bind(l, ap, CS_SERVER) < 0)
     {
@@ -1177,17 +1758,81 @@ static int add_listener(char *where, int listen_id)
             yaz_log(YLOG_FATAL, "Failed to bind to %s: %s", where,
                     cs_strerror(l));
         cs_close(l);
-        return -1;
+        return 0;
     }
     if (!(lst = iochan_create(cs_fileno(l), listener, EVENT_INPUT |
                               EVENT_EXCEPT, listen_id)))
     {
         yaz_log(YLOG_FATAL|YLOG_ERRNO, "Failed to create IOCHAN-type");
         cs_close(l);
-        return -1;
+        return 0;
     }
     iochan_setdata(lst, l); /* user-defined data for listener is COMSTACK */
     l->user = lst;  /* user-defined data for COMSTACK is listener chan */
+    return lst;
+}
+
+#if !defined(WIN32) && YAZ_POSIX_THREADS
+/*
+ * Set up one SO_REUSEPORT listener for each pool thread.
+ * Returns 1 if not supported for this address.
+ */
+static int add_reactor_listeners(char *where, int listen_id)
+{
+    int i;
+
+    for (i = 0; i < control_block.thread_pool; i++)
+    {
+        struct gfs_reactor_listen *rl;
+        IOCHAN lst = create_listener(where, listen_id, 1);
+
+        if (!lst)
+            return i ? -1 : 1;
+        rl = (struct gfs_reactor_listen *) xmalloc(sizeof(*rl));
+        rl->chan = lst;
+        rl->worker = i;
+        rl->next = gfs_reactor_listeners;
+        gfs_reactor_listeners = rl;
+    }
+    return 0;
+}
+#endif
+
+/*
+ * Set up a listening endpoint, and give it to the event-handler.
+ */
+static int add_listener(char *where, int listen_id)
+{
+    IOCHAN lst;
+    const char *mode;
+
+    if (control_block.dynamic)
+        mode = "dynamic";
+    else if (control_block.prefork > 0)
+        mode = "prefork";
+    else if (control_block.thread_pool > 0 && control_block.reuseport)
+        mode = "reuseport";
+    else if (control_block.threads)
+        mode = "threaded";
+    else
+        mode = "static";
+
+    yaz_log(log_server, "Adding %s listener on %s id=%d PID=%ld", mode, where,
+            listen_id, (long) getpid());
+
+#if !defined(WIN32) && YAZ_POSIX_THREADS
+    if (!control_block.dynamic && control_block.thread_pool > 0
+        && control_block.reuseport)
+    {
+        int r = add_reactor_listeners(where, listen_id);
+        if (r <= 0)
+            return r;
+        yaz_log(YLOG_WARN, "SO_REUSEPORT unsupported for %s; "
+                "using shared listener", where);
+    }
+#endif
+    if (!(lst = create_listener(where, listen_id, 0)))
+        return -1;
 
     /* Add listener to chain */
     lst->next = pListener;
@@ -1195,11 +1840,39 @@ static int add_listener(char *where, int listen_id)
     return 0; /* OK */
 }
 
+/*
+ * Add the listeners given on the command line. Done after option
+ * parsing, so that options such as -T and -R apply wherever they are.
+ */
+static int cmd_config_add_listeners(void)
+{
+    int i, ret = 0;
+
+    for (i = 0; i < num_cmd_listeners && !ret; i++)
+        if (add_listener(cmd_listeners[i], 0))
+            ret = 1;  /* failed to create listener */
+    xfree(cmd_listeners);
+    cmd_listeners = 0;
+    num_cmd_listeners = 0;
+    return ret;
+}
+
 static void remove_listeners(void)
 {
-    IOCHAN l = pListener;
-    for (; l; l = l->next)
-        iochan_destroy(l);
+    IOCHAN l;
+#if !defined(WIN32) && YAZ_POSIX_THREADS
+    struct gfs_worker *w = gfs_pool_current_worker();
+    if (w)
+    {   /* pool thread with own listeners: only touch own channels */
+        for (l = w->chans; l; l = l->next)
+            if (l->fun == listener)
+                iochan_destroy(l);
+        return;
+    }
+#endif
+    for (l = pListener; l; l = l->next)
+        if (l->fun == listener)
+            iochan_destroy(l);
 }
 
 #ifndef WIN32
@@ -1254,6 +1927,15 @@ static void statserv_reset(void)
 {
 }
 
+static int have_reactor_listeners(void)
+{
+#if !defined(WIN32) && YAZ_POSIX_THREADS
+    return gfs_reactor_listeners != 0;
+#else
+    return 0;
+#endif
+}
+
 static int sig_received = 0;
 
 #ifndef WIN32
@@ -1266,7 +1948,21 @@ static void normal_stop_handler(int num)
 static void daemon_handler(void *data)
 {
     IOCHAN *pListener = data;
+#if !defined(WIN32) && YAZ_POSIX_THREADS
+    if (control_block.thread_pool > 0 && !control_block.inetd)
+    {
+        if (gfs_pool_start(control_block.thread_pool))
+            return;
+    }
+#endif
     iochan_event_loop(pListener, &sig_received);
+#if !defined(WIN32) && YAZ_POSIX_THREADS
+    if (!sig_received)
+    {
+        gfs_pool_join();
+        session_threads_wait();
+    }
+#endif
 }
 
 static void show_version(void)
@@ -1308,6 +2004,7 @@ static int statserv_sc_main(yaz_sc_t s, int argc, char **argv)
         return 1;
 
     xml_config_bend_start();
+    workq_init(control_block.convert_threads);
 
     if (control_block.inetd)
     {
@@ -1319,10 +2016,12 @@ static int statserv_sc_main(yaz_sc_t s, int argc, char **argv)
     }
     else
     {
+        if (cmd_config_add_listeners())
+            return 1;
         if (xml_config_add_listeners())
             return 1;
 
-        if (!pListener)
+        if (!pListener && !have_reactor_listeners())
             add_listener("tcp:@:9999", 0);
 
 #ifndef WIN32
@@ -1330,7 +2029,7 @@ static int statserv_sc_main(yaz_sc_t s, int argc, char **argv)
             signal(SIGCHLD, catchchld);
 #endif
     }
-    if (pListener == NULL)
+    if (pListener == NULL && !have_reactor_listeners())
         return 1;
     if (s)
         yaz_sc_running(s);
@@ -1338,11 +2037,20 @@ static int statserv_sc_main(yaz_sc_t s, int argc, char **argv)
 #ifndef WIN32
     signal(SIGTERM, normal_stop_handler);
 #endif
-    yaz_daemon(programname,
-               (control_block.background ? YAZ_DAEMON_FORK : 0),
-               daemon_handler, &pListener,
-               *control_block.pid_fname ? control_block.pid_fname : 0,
-               *control_block.setuid ? control_block.setuid : 0);
+    if (control_block.prefork > 0)
+        yaz_daemon_workers(programname,
+                           (control_block.background ? YAZ_DAEMON_FORK : 0),
+                           control_block.prefork,
+                           daemon_handler, &pListener,
+                           *control_block.pid_fname ?
+                           control_block.pid_fname : 0,
+                           *control_block.setuid ? control_block.setuid : 0);
+    else
+        yaz_daemon(programname,
+                   (control_block.background ? YAZ_DAEMON_FORK : 0),
+                   daemon_handler, &pListener,
+                   *control_block.pid_fname ? control_block.pid_fname : 0,
+                   *control_block.setuid ? control_block.setuid : 0);
 #ifndef WIN32
     if (sig_received)
         yaz_log(YLOG_LOG, "Received SIGTERM PID=%ld", (long) getpid());
@@ -1365,14 +2073,16 @@ int check_options(int argc, char **argv)
 
     get_logbits(1);
 
-    while ((ret = options("1a:iszSTl:v:u:c:w:t:k:Kd:A:p:DC:f:m:r:V",
+    while ((ret = options("1a:iszST:Rl:v:u:c:w:t:k:Kd:A:p:P:j:DC:f:m:r:V",
                           argv, argc, &arg)) != -2)
     {
         switch (ret)
         {
         case 0:
-            if (add_listener(arg, 0))
-                return 1;  /* failed to create listener */
+            cmd_listeners = (char **)
+                xrealloc(cmd_listeners,
+                         (num_cmd_listeners + 1) * sizeof(*cmd_listeners));
+            cmd_listeners[num_cmd_listeners++] = arg;
             break;
         case '1':
             control_block.one_shot = 1;
@@ -1390,8 +2100,23 @@ int check_options(int argc, char **argv)
             break;
         case 'T':
 #if YAZ_POSIX_THREADS
+            if (!arg || *arg < '0' || *arg > '9')
+            {
+                fprintf(stderr, "%s: Specify number of threads for -T.\n",
+                        me);
+                return 1;
+            }
             control_block.dynamic = 0;
             control_block.threads = 1;
+            control_block.thread_pool = atoi(arg);  /* 0: one per session */
+#else
+            fprintf(stderr, "%s: Threaded mode not available.\n", me);
+            return 1;
+#endif
+            break;
+        case 'R':
+#if YAZ_POSIX_THREADS
+            control_block.reuseport = 1;
 #else
             fprintf(stderr, "%s: Threaded mode not available.\n", me);
             return 1;
@@ -1462,6 +2187,28 @@ int check_options(int argc, char **argv)
         case 'p':
             option_copy(control_block.pid_fname, arg);
             break;
+        case 'P':
+#ifdef WIN32
+            fprintf(stderr, "%s: Prefork mode not available.\n", me);
+            return 1;
+#else
+            if (!arg || (r = atoi(arg)) <= 0)
+            {
+                fprintf(stderr, "%s: Specify positive number for -P.\n", me);
+                return 1;
+            }
+            control_block.prefork = r;
+            control_block.dynamic = 0;
+#endif
+            break;
+        case 'j':
+            if (!arg || (r = atoi(arg)) <= 0)
+            {
+                fprintf(stderr, "%s: Specify positive number for -j.\n", me);
+                return 1;
+            }
+            control_block.convert_threads = r;
+            break;
         case 'f':
 #if YAZ_HAVE_XML2
             option_copy(control_block.xml_config, arg);
@@ -1488,7 +2235,8 @@ int check_options(int argc, char **argv)
             fprintf(stderr, "Usage: %s [ -a <pdufile> -v <loglevel>"
                     " -l <logfile> -u <user> -c <config> -t <minutes>"
                     " -k <kilobytes> -d <daemon> -p <pidfile> -C certfile"
-                    " -zKiDSTV1 -m <time-format> -w <directory> <listener-addr>... ]\n", me);
+                    " -T <threads> -P <processes> -A <sessions> -j <threads>"
+                    " -zKiDRSV1 -m <time-format> -w <directory> <listener-addr>... ]\n", me);
             return 1;
         }
     }
@@ -64,6 +64,7 @@
 #include <yaz/comstack.h>
 #include <yaz/errno.h>
 #include <yaz/tcpip.h>
+#include "dns_cache.h"
 
 #ifndef WIN32
 #define RESOLVER_THREAD 1
@@ -91,7 +92,7 @@ static int tcpip_listen(COMSTACK h, char *raddr, int *addrlen,
 static int tcpip_set_blocking(COMSTACK p, int blocking);
 
 struct addrinfo *tcpip_getaddrinfo(const char *str, const char *port,
-                                   int *ipv6_only);
+                                   int *ipv6_only, int *ai_copy);
 
 static COMSTACK tcpip_accept(COMSTACK h);
 static const char *tcpip_addrstr(COMSTACK h);
@@ -118,11 +119,14 @@ typedef struct tcpip_state
     int written;  /* -1 if we aren't writing */
     int towrite;  /* to verify against user input */
     int (*complete)(const char *buf, int len); /* length/complete. */
+    struct cs_complete_state complete_state; /* for cs_complete_auto.. */
     char *bind_host;
     char *host_port;
     struct addrinfo *ai;
+    int ai_copy; /* 1 if ai is a copy from the DNS cache */
     struct addrinfo *ai_connect;
     int ipv6_only;
+    int reuseport; /* set SO_REUSEPORT on bind */
 #if RESOLVER_THREAD
     int pipefd[2];
     const char *port;
@@ -143,6 +147,16 @@ typedef struct tcpip_state
 
 static int log_level = 0;
 
+/* checks for complete PDU, resuming from previous call when possible */
+static int tcpip_complete(tcpip_state *sp, const char *buf, int len)
+{
+    if (sp->complete == cs_complete_auto)
+        return cs_complete_auto_state(&sp->complete_state, buf, len, 0);
+    if (sp->complete == cs_complete_auto_head)
+        return cs_complete_auto_state(&sp->complete_state, buf, len, 1);
+    return (*sp->complete)(buf, len);
+}
+
 static int tcpip_init(void)
 {
     static int log_level_set = 0;
@@ -178,10 +192,13 @@ static struct tcpip_state *tcpip_state_create(void)
     sp->altsize = sp->altlen = 0;
     sp->towrite = sp->written = -1;
     sp->complete = cs_complete_auto;
+    cs_complete_state_init(&sp->complete_state);
     sp->bind_host = 0;
     sp->host_port = 0;
     sp->ai = 0;
+    sp->ai_copy = 0;
     sp->ai_connect = 0;
+    sp->reuseport = 0;
 #if RESOLVER_THREAD
     sp->pipefd[0] = sp->pipefd[1] = -1;
     sp->port = 0;
@@ -414,7 +431,7 @@ static void parse_host_port(const char *host_port, char *tmp, size_t tmp_sz,
 
 struct addrinfo *tcpip_getaddrinfo(const char *host_and_port,
                                    const char *port,
-                                   int *ipv6_only)
+                                   int *ipv6_only, int *ai_copy)
 {
     struct addrinfo hints, *res;
     int error;
@@ -430,6 +447,7 @@ struct addrinfo *tcpip_getaddrinfo(const char *host_and_port,
     hints.ai_canonname      = NULL;
     hints.ai_next           = NULL;
 
+    *ai_copy = 0;
     /* default port, might be changed below */
     parse_host_port(host_and_port, tmp, sizeof tmp, &host, &port);
 
@@ -456,14 +474,32 @@ struct addrinfo *tcpip_getaddrinfo(const char *host_and_port,
     }
     else
     {
-        error = getaddrinfo(host, port, &hints, &res);
+        int cache = dns_cache_enabled();
+
         *ipv6_only = -1;
+        if (cache && (res = dns_cache_lookup(host, port)))
+        {
+            *ai_copy = 1;
+            return res;
+        }
+        error = getaddrinfo(host, port, &hints, &res);
+        if (!error && cache)
+            dns_cache_add(host, port, res);
     }
     if (error)
         return 0;
     return res;
 }
 
+/* frees addresses returned by tcpip_getaddrinfo */
+static void tcpip_freeaddrinfo(struct addrinfo *ai, int ai_copy)
+{
+    if (ai_copy)
+        dns_cache_freeaddrinfo(ai);
+    else
+        freeaddrinfo(ai);
+}
+
 static struct addrinfo *create_net_socket(COMSTACK h)
 {
     tcpip_state *sp = (tcpip_state *)h->cprivate;
@@ -503,7 +539,7 @@ static struct addrinfo *create_net_socket(COMSTACK h)
     if (sp->bind_host)
     {
         int r = -1;
-        int ipv6_only = 0;
+        int ipv6_only = 0, ai_copy;
         struct addrinfo *ai;
 
 #ifndef WIN32
@@ -515,7 +551,7 @@ static struct addrinfo *create_net_socket(COMSTACK h)
             return 0;
         }
 #endif
-        ai = tcpip_getaddrinfo(sp->bind_host, "0", &ipv6_only);
+        ai = tcpip_getaddrinfo(sp->bind_host, "0", &ipv6_only, &ai_copy);
         if (!ai)
             return 0;
         {
@@ -530,10 +566,10 @@ static struct addrinfo *create_net_socket(COMSTACK h)
         if (r)
         {
             h->cerrno = CSYSERR;
-            freeaddrinfo(ai);
+            tcpip_freeaddrinfo(ai, ai_copy);
             return 0;
         }
-        freeaddrinfo(ai);
+        tcpip_freeaddrinfo(ai, ai_copy);
     }
     if (!tcpip_set_blocking(h, h->flags))
         return 0;
@@ -549,8 +585,9 @@ void *resolver_thread(void *arg)
 
     sp->ipv6_only = 0;
     if (sp->ai)
-        freeaddrinfo(sp->ai);
-    sp->ai = tcpip_getaddrinfo(sp->host_port, sp->port, &sp->ipv6_only);
+        tcpip_freeaddrinfo(sp->ai, sp->ai_copy);
+    sp->ai = tcpip_getaddrinfo(sp->host_port, sp->port, &sp->ipv6_only,
+                               &sp->ai_copy);
     write(sp->pipefd[1], "1", 1);
     return 0;
 }
@@ -602,8 +639,9 @@ void *tcpip_straddr(COMSTACK h, const char *str)
     }
 #endif
     if (sp->ai)
-        freeaddrinfo(sp->ai);
-    sp->ai = tcpip_getaddrinfo(sp->host_port, port, &sp->ipv6_only);
+        tcpip_freeaddrinfo(sp->ai, sp->ai_copy);
+    sp->ai = tcpip_getaddrinfo(sp->host_port, port, &sp->ipv6_only,
+                               &sp->ai_copy);
     if (sp->ai && h->state == CS_ST_UNBND)
     {
         return create_net_socket(h);
@@ -615,7 +653,7 @@ int tcpip_more(COMSTACK h)
 {
     tcpip_state *sp = (tcpip_state *)h->cprivate;
 
-    return sp->altlen && (*sp->complete)(sp->altbuf, sp->altlen);
+    return sp->altlen && tcpip_complete(sp, sp->altbuf, sp->altlen);
 }
 
 static int cont_connect(COMSTACK h)
@@ -749,6 +787,7 @@ int tcpip_rcvconnect(COMSTACK h)
         int r;
 
         sp->complete = cs_complete_auto_head;
+        cs_complete_state_init(&sp->complete_state);
         if (sp->connect_request_len > 0)
         {
             r = tcpip_put(h, sp->connect_request_buf,
@@ -770,6 +809,7 @@ int tcpip_rcvconnect(COMSTACK h)
         xfree(sp->connect_request_buf);
         sp->connect_request_buf = 0;
         sp->complete = cs_complete_auto;
+        cs_complete_state_init(&sp->complete_state);
     }
 #if HAVE_GNUTLS_H
     if (h->type == ssl_type && !sp->session)
@@ -854,9 +894,17 @@ static int tcpip_bind(COMSTACK h, void *address, int mode)
         h->cerrno = CSYSERR;
         return -1;
     }
+#endif
+#ifdef SO_REUSEPORT
+    if (sp->reuseport && setsockopt(h->iofile, SOL_SOCKET, SO_REUSEPORT,
+                                    (char*) &one, sizeof(one)) < 0)
+    {
+        h->cerrno = CSYSERR;
+        return -1;
+    }
 #endif
     r = bind(h->iofile, ai->ai_addr, ai->ai_addrlen);
-    freeaddrinfo(sp->ai);
+    tcpip_freeaddrinfo(sp->ai, sp->ai_copy);
     sp->ai = 0;
     if (r)
     {
@@ -1079,7 +1127,7 @@ int tcpip_get(COMSTACK h, char **buf, int *bufsize)
         sp->altsize = tmpi;
     }
     h->io_pending = 0;
-    while (!(berlen = (*sp->complete)(*buf, hasread)))
+    while (!(berlen = tcpip_complete(sp, *buf, hasread)))
     {
         if (!*bufsize)
         {
@@ -1163,7 +1211,10 @@ int tcpip_get(COMSTACK h, char **buf, int *bufsize)
 #endif
             }
             else if (!res)
+            {
+                cs_complete_state_init(&sp->complete_state);
                 return hasread;
+            }
         }
         hasread += res;
         if (hasread > h->max_recv_bytes)
@@ -1172,6 +1223,8 @@ int tcpip_get(COMSTACK h, char **buf, int *bufsize)
             return -1;
         }
     }
+    if (berlen) /* next PDU */
+        cs_complete_state_init(&sp->complete_state);
     yaz_log(log_level, "  Out of read loop with hasread=%d, berlen=%d",
                 hasread, berlen);
     /* move surplus buffer (or everything if we didn't get a BER rec.) */
@@ -1345,7 +1398,7 @@ void tcpip_close(COMSTACK h)
     }
 #endif
     if (sp->ai)
-        freeaddrinfo(sp->ai);
+        tcpip_freeaddrinfo(sp->ai, sp->ai_copy);
     xfree(sp->host_port);
     xfree(sp->connect_request_buf);
     xfree(sp->connect_response_buf);
@@ -1608,8 +1661,23 @@ int cs_set_head_only(COMSTACK cs, int head_only)
             sp->complete = cs_complete_auto_head;
         else
             sp->complete = cs_complete_auto;
+        cs_complete_state_init(&sp->complete_state);
+        return 0;
+    }
+    cs->cerrno = CS_ST_INCON;
+    return -1;
+}
+
+int cs_set_reuseport(COMSTACK cs, int reuseport)
+{
+#ifdef SO_REUSEPORT
+    if (cs->type == tcpip_type || cs->type == ssl_type)
+    {
+        tcpip_state *sp = (tcpip_state *)cs->cprivate;
+        sp->reuseport = reuseport;
         return 0;
     }
+#endif
     cs->cerrno = CS_ST_INCON;
     return -1;
 }
@@ -82,6 +82,7 @@ typedef struct unix_state
     int written;  /* -1 if we aren't writing */
     int towrite;  /* to verify against user input */
     int (*complete)(const char *buf, int len); /* length/complete. */
+    struct cs_complete_state complete_state; /* for cs_complete_auto.. */
     struct sockaddr_un addr;  /* returned by cs_straddr */
     int uid;
     int gid;
@@ -91,6 +92,16 @@ typedef struct unix_state
 
 static int log_level = 0;
 
+/* checks for complete PDU, resuming from previous call when possible */
+static int unix_complete(unix_state *sp, const char *buf, int len)
+{
+    if (sp->complete == cs_complete_auto)
+        return cs_complete_auto_state(&sp->complete_state, buf, len, 0);
+    if (sp->complete == cs_complete_auto_head)
+        return cs_complete_auto_state(&sp->complete_state, buf, len, 1);
+    return (*sp->complete)(buf, len);
+}
+
 static void unix_init (void)
 {
     static int log_level_set = 0;
@@ -163,6 +174,7 @@ COMSTACK unix_type(int s, int flags, int protocol, void *vp)
     state->altsize = state->altlen = 0;
     state->towrite = state->written = -1;
     state->complete = cs_complete_auto;
+    cs_complete_state_init(&state->complete_state);
 
     yaz_log(log_level, "Created UNIX comstack h=%p", p);
 
@@ -305,7 +317,7 @@ static int unix_more(COMSTACK h)
 {
     unix_state *sp = (unix_state *)h->cprivate;
 
-    return sp->altlen && (*sp->complete)(sp->altbuf, sp->altlen);
+    return sp->altlen && unix_complete(sp, sp->altbuf, sp->altlen);
 }
 
 /*
@@ -532,6 +544,7 @@ static COMSTACK unix_accept(COMSTACK h)
         state->altsize = state->altlen = 0;
         state->towrite = state->written = -1;
         state->complete = st->complete;
+        cs_complete_state_init(&state->complete_state);
         memcpy(&state->addr, &st->addr, sizeof(state->addr));
         cnew->state = CS_ST_ACCEPT;
         cnew->event = CS_NONE;
@@ -581,7 +594,7 @@ static int unix_get(COMSTACK h, char **buf, int *bufsize)
         sp->altsize = tmpi;
     }
     h->io_pending = 0;
-    while (!(berlen = (*sp->complete)(*buf, hasread)))
+    while (!(berlen = unix_complete(sp, *buf, hasread)))
     {
         if (!*bufsize)
         {
@@ -613,9 +626,14 @@ static int unix_get(COMSTACK h, char **buf, int *bufsize)
                 return -1;
         }
         else if (!res)
+        {
+            cs_complete_state_init(&sp->complete_state);
             return hasread;
+        }
         hasread += res;
     }
+    if (berlen) /* next PDU */
+        cs_complete_state_init(&sp->complete_state);
     yaz_log(log_level, "  Out of read loop with hasread=%d, berlen=%d",
                   hasread, berlen);
     /* move surplus buffer (or everything if we didn't get a BER rec.) */
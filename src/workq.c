@@ -0,0 +1,177 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file workq.c
+ * \brief Implements the GFS worker threads.
+ *
+ * Each workq_run call is a job with num items. Jobs that have items
+ * not yet taken are kept in a list. Worker threads take one item at a
+ * time from the first job that has room for another helper. The thread
+ * that runs the job takes items too and then waits for the items
+ * taken by workers.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <yaz/log.h>
+#include <yaz/mutex.h>
+#include <yaz/thread_create.h>
+#include "workq.h"
+
+struct workq_job {
+    void (*fn)(void *data, int i);
+    void *data;
+    int num;                   /* number of items */
+    int next;                  /* next item to take */
+    int done;                  /* items completed */
+    int helpers;               /* workers running an item of this job */
+    int max_helpers;
+    struct workq_job *next_job;
+};
+
+static YAZ_MUTEX workq_mutex = 0;
+static YAZ_COND workq_cond = 0;        /* a job was added */
+static YAZ_COND workq_done_cond = 0;   /* a worker completed an item */
+static struct workq_job *workq_jobs = 0;
+static int workq_size = 0;             /* workers to start; 0=serial */
+static int workq_started = 0;          /* workers started */
+
+void workq_init(int num_threads)
+{
+    if (num_threads <= 1 || workq_size)
+        return;
+    yaz_mutex_create(&workq_mutex);
+    yaz_cond_create(&workq_cond);
+    yaz_cond_create(&workq_done_cond);
+    if (workq_cond && workq_done_cond)
+        workq_size = num_threads - 1;
+}
+
+/* removes job from list of jobs with items left; mutex must be held */
+static void workq_unlink(struct workq_job *job)
+{
+    struct workq_job **jp = &workq_jobs;
+
+    for (; *jp; jp = &(*jp)->next_job)
+        if (*jp == job)
+        {
+            *jp = job->next_job;
+            break;
+        }
+}
+
+static void *workq_handler(void *p)
+{
+    yaz_mutex_enter(workq_mutex);
+    while (1)
+    {
+        struct workq_job *job = workq_jobs;
+        int i;
+
+        while (job && job->helpers >= job->max_helpers)
+            job = job->next_job;
+        if (!job)
+        {
+            yaz_cond_wait(workq_cond, workq_mutex, 0);
+            continue;
+        }
+        i = job->next++;
+        if (job->next == job->num)
+            workq_unlink(job);
+        job->helpers++;
+        yaz_mutex_leave(workq_mutex);
+
+        (*job->fn)(job->data, i);
+
+        yaz_mutex_enter(workq_mutex);
+        job->helpers--;
+        if (++job->done == job->num)
+            yaz_cond_broadcast(workq_done_cond);
+    }
+    return 0;
+}
+
+/*
+ * Starts the workers if not already done; mutex must be held.
+ * Returns number of workers running.
+ */
+static int workq_start(void)
+{
+    static int failed = 0;
+
+    for (; workq_started < workq_size && !failed; workq_started++)
+    {
+        yaz_thread_t tid = yaz_thread_create(workq_handler, 0);
+        if (!tid)
+        {
+            yaz_log(YLOG_WARN|YLOG_ERRNO, "workq: thread create");
+            failed = 1;
+            break;
+        }
+        yaz_thread_detach(&tid);
+    }
+    return workq_started;
+}
+
+void workq_run(int max_parallel, void (*fn)(void *data, int i), void *data,
+               int num)
+{
+    struct workq_job job, **jp;
+    int i;
+
+    if (!workq_size || max_parallel <= 1 || num <= 1)
+    {
+        for (i = 0; i < num; i++)
+            (*fn)(data, i);
+        return;
+    }
+    job.fn = fn;
+    job.data = data;
+    job.num = num;
+    job.next = 0;
+    job.done = 0;
+    job.helpers = 0;
+    job.max_helpers = max_parallel - 1;
+
+    yaz_mutex_enter(workq_mutex);
+    if (!workq_start())
+    {
+        yaz_mutex_leave(workq_mutex);
+        for (i = 0; i < num; i++)
+            (*fn)(data, i);
+        return;
+    }
+    for (jp = &workq_jobs; *jp; jp = &(*jp)->next_job)
+        ;
+    job.next_job = 0;
+    *jp = &job;
+    yaz_cond_broadcast(workq_cond);
+    while (job.next < job.num)
+    {
+        i = job.next++;
+        if (job.next == job.num)
+            workq_unlink(&job);
+        yaz_mutex_leave(workq_mutex);
+
+        (*fn)(data, i);
+
+        yaz_mutex_enter(workq_mutex);
+        job.done++;
+    }
+    while (job.done < job.num)
+        yaz_cond_wait(workq_done_cond, workq_mutex, 0);
+    yaz_mutex_leave(workq_mutex);
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
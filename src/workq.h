@@ -0,0 +1,51 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file workq.h
+ * \brief Internal header for the GFS worker threads.
+ *
+ * A small set of threads, shared by all sessions of a server process,
+ * that run the items of parallel loops, such as the records of a page
+ * to be converted.
+ */
+#ifndef WORKQ_H
+#define WORKQ_H
+
+#include <yaz/yconfig.h>
+
+YAZ_BEGIN_CDECL
+
+/** \brief sets up the worker threads
+    \param num_threads maximum number of items run at a time (0, 1=serial)
+
+    Must be called before any sessions are served. The threads are
+    started by the first workq_run in the process that uses them.
+*/
+void workq_init(int num_threads);
+
+/** \brief runs a loop of independent items
+    \param max_parallel maximum number of items run at a time
+    \param fn item handler; called as fn(data, i)
+    \param data user data for handler
+    \param num number of items
+
+    Calls fn for i = 0, .., num-1 and returns when all calls have
+    completed. The calling thread runs items too, so at most
+    max_parallel - 1 worker threads take part.
+*/
+void workq_run(int max_parallel, void (*fn)(void *data, int i), void *data,
+               int num);
+
+YAZ_END_CDECL
+
+#endif
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -113,8 +113,32 @@ typedef struct bend_fetch_rr {
     char *errstring;           /**< Additional info (output) */
     int surrogate_flag;        /**< 1=surrogate diagnostic(SD); 0=NSD (output)*/
     char *schema;              /**< string record schema (input/output) */
+    bend_association association; /**< GFS association / session (input) */
 } bend_fetch_rr;
 
+/** \brief Information for batched fetch handler
+
+    Fetches a range of records in one call. records[i] is for position
+    start + i and has its input members set as for bend_fetch. The
+    handler fills in the output members of each entry. An entry with
+    neither record nor errcode ends the range, as does last_in_set.
+    A non-surrogate diagnostic in an entry fails the whole request.
+*/
+typedef struct {
+    char *setname;             /**< result set ID (input) */
+    int start;                 /**< range start, starting from 1 (input) */
+    int number;                /**< number of records to fetch (input) */
+    Z_ReferenceId *referenceId;/**< reference ID (input) */
+    Odr_oid *request_format;   /**< record syntax OID (input) */
+    Z_RecordComposition *comp; /**< Formatting instructions (input) */
+    ODR stream;                /**< encoding stream (input) */
+    ODR print;                 /**< printing stream (input) */
+    char *schema;              /**< string record schema (input) */
+    bend_association association; /**< GFS association / session (input) */
+
+    bend_fetch_rr *records;    /**< number entries (input/output) */
+} bend_fetch_batch_rr;
+
 /** \brief Information for scan entry */
 struct scan_entry {
     char *term;         /**< the returned scan term (output) */
@@ -315,8 +339,31 @@ typedef struct bend_initrequest
 
     /** \brief whether named result sets are supported (0=disable, 1=enable) */
     int named_result_sets;
+    /** \brief whether octet strings in subsequent requests may refer to
+        the receive buffer (0=copy, 1=refer). When enabled, Odr_oct buffers,
+        such as records in update requests, are not NUL-terminated */
+    int zero_copy_decode;
+    /** \brief whether bend_search and bend_fetch may return BEND_PENDING
+        (0=no, 1=yes). When enabled, the handler may finish the operation
+        later, from any thread, and then call bend_complete */
+    int async_backend;
+    /** \brief SRU/Z39.50 batched fetch handler (optional)
+
+        Used instead of bend_fetch when records are fetched for a
+        present, a piggy-backed present or SRU searchRetrieve. May
+        return BEND_PENDING if async_backend is set */
+    int (*bend_fetch_batch)(void *handle, bend_fetch_batch_rr *rr);
 } bend_initrequest;
 
+/** \brief bend_search / bend_fetch / bend_fetch_batch return value:
+    operation not finished
+
+    The output members of the request are filled in later, after which
+    the handler calls bend_complete for the association. Only honored
+    if async_backend is set by bend_init.
+*/
+#define BEND_PENDING 2
+
 /** \brief result for init handler (must be filled by handler) */
 typedef struct bend_initresult
 {
@@ -363,6 +410,10 @@ typedef struct statserv_options_block
     char cert_fname[BEND_NAME_MAX];/**< SSL certificate fname */
     char xml_config[BEND_NAME_MAX];/**< XML config filename */
     int keepalive;                 /**< keep alive if HTTP 1.1 (default: 1) */
+    int thread_pool;               /**< session threads; 0=one per session */
+    int reuseport;                 /**< each pool thread has own listeners */
+    int prefork;                   /**< worker processes; 0=no prefork */
+    int convert_threads;           /**< parallel record conversions */
 } statserv_options_block;
 
 YAZ_EXPORT int statserv_main(
@@ -376,6 +427,15 @@ YAZ_EXPORT int check_ip_tcpd(void *cd, const char *addr, int len, int type);
 
 YAZ_EXPORT int bend_assoc_is_alive(bend_association assoc);
 
+/** \brief signals completion of a pending search or fetch
+    \param assoc association of the pending operation
+
+    Must be called exactly once for each handler call that returned
+    BEND_PENDING. May be called from any thread. The GFS resumes the
+    request in the thread that serves the association.
+*/
+YAZ_EXPORT void bend_complete(bend_association assoc);
+
 YAZ_END_CDECL
 
 #endif
@@ -128,6 +128,41 @@ YAZ_EXPORT COMSTACK cs_create_host2(const char *vhost, int blocking, void **vp,
 YAZ_EXPORT void cs_get_host_args(const char *type_and_host, const char **args);
 YAZ_EXPORT int cs_complete_auto_head(const char *buf, int len);
 YAZ_EXPORT int cs_complete_auto(const char *buf, int len);
+
+/** \brief state for resumable PDU completion, see cs_complete_auto_state */
+struct cs_complete_state {
+    int kind;   /* what is being parsed: CS_COMPLETE_.. */
+    int need;   /* PDU can not be complete with fewer bytes than this */
+    int pos;    /* offset where parsing continues */
+};
+#define CS_COMPLETE_NONE 0
+#define CS_COMPLETE_BER 1
+#define CS_COMPLETE_HTTP_HEAD 2
+#define CS_COMPLETE_HTTP_BODY 3
+#define CS_COMPLETE_HTTP_CHUNKED 4
+
+/** \brief initializes state for cs_complete_auto_state
+    \param st state
+
+    Must be called before the first call for every PDU.
+*/
+YAZ_EXPORT void cs_complete_state_init(struct cs_complete_state *st);
+
+/** \brief checks whether BER or HTTP PDU is complete, resuming work
+    \param st state from previous call for the same PDU
+    \param buf PDU buffer. Prefix must be same as in previous call
+    \param len number of bytes in buffer
+    \param head_only 1=HTTP header only; 0=HTTP header and body
+    \retval 0 PDU incomplete
+    \retval >0 length of PDU
+
+    Returns same result as cs_complete_auto (cs_complete_auto_head)
+    but continues where the previous call ended rather than scanning
+    the buffer from the beginning every time.
+*/
+YAZ_EXPORT int cs_complete_auto_state(struct cs_complete_state *st,
+                                      const char *buf, int len,
+                                      int head_only);
 YAZ_EXPORT void *cs_get_ssl(COMSTACK cs)
 #ifdef __GNUC__
     __attribute__ ((deprecated))
@@ -148,6 +183,27 @@ YAZ_EXPORT int cs_parse_host(const char *uri, const char **host,
                              char **connect_host);
 YAZ_EXPORT int cs_set_head_only(COMSTACK cs, int head_only);
 
+/** \brief lets several listeners bind the same address (SO_REUSEPORT)
+    \param cs listening COMSTACK; must be called before cs_bind
+    \param reuseport 1=enable, 0=disable
+    \retval 0 OK
+    \retval -1 not supported by this COMSTACK type or platform
+
+    The kernel distributes incoming connections over all listeners
+    bound to the address.
+*/
+YAZ_EXPORT int cs_set_reuseport(COMSTACK cs, int reuseport);
+
+/** \brief enables process-wide cache of host name lookups
+    \param ttl seconds that a lookup is kept; 0 disables cache (default)
+
+    Connecting to the same host again, from any thread, then uses the
+    cached addresses rather than resolving the name again. Changing the
+    setting empties the cache. Enable the cache before starting threads
+    that connect.
+*/
+YAZ_EXPORT void cs_set_dns_cache(int ttl);
+
 /*
  * error management.
  */
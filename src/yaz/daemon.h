@@ -71,6 +71,34 @@ int yaz_daemon(const char *progname,
                void (*work)(void *data), void *data,
                const char *pidfile, const char *uid);
 
+/** \brief daemon utility with a pool of worker processes
+    \param progname program name for logging purposes.
+    \param flags flags which is a bit-wise combination of YAZ_DAEMON_..
+    \param workers number of worker processes
+    \param work working handler (called in each worker process)
+    \param data opaque data to be passed to work handler
+    \param pidfile filename with Process-ID (NULL for no file)
+    \param uid effective user ID for handler (NULL for no same as caller)
+    \returns 0 for success, non-zero for failure.
+
+    Like yaz_daemon, but keeps the given number of worker processes
+    running, each calling the work handler. This is the keepalive mode
+    for more than one process, and YAZ_DAEMON_KEEPALIVE is implied.
+    A worker that returns from the work handler is replaced right away,
+    so a worker may return when it wants to be recycled. A worker that
+    crashes is replaced too. The pool stops when the parent receives
+    SIGTERM, which is sent to all workers, when a worker is killed by
+    SIGTERM, or when a worker exits with a non-zero status.
+
+    Flag YAZ_DAEMON_DEBUG runs the work handler once in the calling
+    process, like yaz_daemon.
+*/
+YAZ_EXPORT
+int yaz_daemon_workers(const char *progname,
+                       unsigned int flags, int workers,
+                       void (*work)(void *data), void *data,
+                       const char *pidfile, const char *uid);
+
 /** \brief stop daemon - stop parent process
 
     This function sends a signal to the parent keepalive process that
@@ -178,6 +178,39 @@ YAZ_EXPORT nmem_int_t *nmem_intdup(NMEM nmem, nmem_int_t v);
 */
 YAZ_EXPORT nmem_bool_t *nmem_booldup(NMEM nmem, nmem_bool_t v);
 
+/** \brief position in NMEM handle, see nmem_mark */
+typedef struct nmem_mark_s {
+    void *block;
+    size_t top;
+    size_t total;
+} nmem_mark_t;
+
+/** \brief saves current allocation position of NMEM handle
+    \param n NMEM handle
+    \param mark resulting position
+ */
+YAZ_EXPORT void nmem_mark(NMEM n, nmem_mark_t *mark);
+
+/** \brief releases memory allocated after a position
+    \param n NMEM handle
+    \param mark position as returned by nmem_mark
+
+    Memory allocated on the handle since nmem_mark was called must not
+    be used afterwards. The position is no longer valid if the handle
+    is reset or is the source of nmem_transfer.
+ */
+YAZ_EXPORT void nmem_release_to_mark(NMEM n, const nmem_mark_t *mark);
+
+/** \brief hands over a buffer to NMEM handle
+    \param n NMEM handle
+    \param buf buffer allocated with xmalloc
+
+    The buffer is freed with xfree when the handle is reset or destroyed.
+    It is moved along with the other memory by nmem_transfer and is not
+    released by nmem_release_to_mark.
+ */
+YAZ_EXPORT void nmem_adopt_buf(NMEM n, void *buf);
+
 /** \brief transfers memory from one NMEM handle to another
     \param src source NMEM handle
     \param dst destination NMEM handle
@@ -201,6 +234,19 @@ YAZ_EXPORT void nmem_destroy(NMEM n);
  */
 YAZ_EXPORT void *nmem_malloc(NMEM n, size_t size);
 
+/** \brief sets maximum size of per-thread cache of free NMEM blocks
+    \param max number of bytes retained per thread (0 disables cache)
+
+    Blocks released by nmem_reset and nmem_destroy are kept in a cache
+    local to the calling thread and reused by later allocations in that
+    thread. Should be called before threads are started.
+ */
+YAZ_EXPORT void nmem_set_cache_max(size_t max);
+
+/** \brief releases all free NMEM blocks cached for the calling thread
+ */
+YAZ_EXPORT void nmem_cache_flush(void);
+
 /** \brief returns memory status for NMEM - as XML
     \param dst buffer for result
     \param l size of buffer (200 should suffice)
@@ -134,6 +134,11 @@ struct odr
 
 typedef int (*Odr_fun)(ODR, char **, int, const char *);
 
+/** \brief deep copy function for a type (see odr_sequence_of_clone) */
+typedef void *(*Odr_clone_fun)(NMEM nmem, const void *p);
+/** \brief equality function for a type (see odr_sequence_of_equal) */
+typedef int (*Odr_equal_fun)(const void *a, const void *b);
+
 typedef struct odr_arm
 {
     int tagmode;
@@ -176,6 +181,19 @@ YAZ_EXPORT ODR odr_createmem(int direction);
 YAZ_EXPORT void odr_reset(ODR o);
 YAZ_EXPORT void odr_destroy(ODR o);
 YAZ_EXPORT void odr_setbuf(ODR o, char *buf, int len, int can_grow);
+
+/** \brief enables or disables zero-copy decoding of octet strings
+    \param o ODR stream (decoding)
+    \param enable 1=refer to decode buffer; 0=copy (default)
+
+    When enabled, Odr_oct and Odr_any values decoded by odr_octetstring
+    and odr_any point into the buffer given by odr_setbuf rather than
+    to a copy. Such buffers are not NUL-terminated. The decode buffer
+    must live as long as the decoded data; it can be handed over with
+    nmem_adopt_buf(odr_getmem(o), buf). odr_cstring and odr_iconv_string
+    always copy.
+*/
+YAZ_EXPORT void odr_set_zero_copy(ODR o, int enable);
 YAZ_EXPORT char *odr_getbuf(ODR o, int *len, int *size);
 YAZ_EXPORT void *odr_malloc(ODR o, size_t size);
 YAZ_EXPORT char *odr_strdup(ODR o, const char *str);
@@ -287,6 +305,23 @@ YAZ_EXPORT Odr_oid *odr_getoidbystr_nmem(NMEM o, const char *str);
 YAZ_EXPORT int odr_initmember(ODR o, void *p, int size);
 YAZ_EXPORT int odr_peektag(ODR o, int *zclass, int *tag, int *cons);
 YAZ_EXPORT void odr_setlenlen(ODR o, int len);
+
+/** \brief encodes in two passes using definite lengths
+    \param o ODR stream (encoding)
+    \param type codec, such as z_APDU
+    \param p pointer to data to be encoded
+    \param name element name (may be NULL)
+    \retval 1 success
+    \retval 0 failure
+
+    The first pass computes the length of each constructed element
+    without copying octet strings. The second pass writes definite
+    lengths directly into a buffer of the exact size. Unlike the default
+    encoding, constructed elements longer than 127 octets are not
+    encoded with indefinite length.
+*/
+YAZ_EXPORT int odr_encode_sized(ODR o, Odr_fun type, void *p,
+                                const char *name);
 YAZ_EXPORT int odr_missing(ODR o, int opt, const char *name);
 YAZ_EXPORT char *odr_prepend(ODR o, const char *prefix, const char *old);
 
@@ -334,6 +369,61 @@ YAZ_EXPORT Odr_int odr_atoi(const char *s);
 
 YAZ_EXPORT Odr_int odr_strtol(const char *nptr, char **endptr, int base);
 
+/* deep copy (_clone) and structural comparison (_equal) of basic types.
+   These are used by the code generated by yaz-asncomp. A clone of
+   NULL is NULL; two NULL values are equal. */
+YAZ_EXPORT Odr_int *odr_integer_clone(NMEM nmem, const Odr_int *p);
+YAZ_EXPORT int odr_integer_equal(const Odr_int *a, const Odr_int *b);
+YAZ_EXPORT Odr_int *odr_enum_clone(NMEM nmem, const Odr_int *p);
+YAZ_EXPORT int odr_enum_equal(const Odr_int *a, const Odr_int *b);
+YAZ_EXPORT Odr_bool *odr_bool_clone(NMEM nmem, const Odr_bool *p);
+YAZ_EXPORT int odr_bool_equal(const Odr_bool *a, const Odr_bool *b);
+YAZ_EXPORT Odr_null *odr_null_clone(NMEM nmem, const Odr_null *p);
+YAZ_EXPORT int odr_null_equal(const Odr_null *a, const Odr_null *b);
+YAZ_EXPORT Odr_oct *odr_octetstring_clone(NMEM nmem, const Odr_oct *p);
+YAZ_EXPORT int odr_octetstring_equal(const Odr_oct *a, const Odr_oct *b);
+YAZ_EXPORT Odr_any *odr_any_clone(NMEM nmem, const Odr_any *p);
+YAZ_EXPORT int odr_any_equal(const Odr_any *a, const Odr_any *b);
+YAZ_EXPORT Odr_bitmask *odr_bitstring_clone(NMEM nmem, const Odr_bitmask *p);
+YAZ_EXPORT int odr_bitstring_equal(const Odr_bitmask *a,
+                                   const Odr_bitmask *b);
+YAZ_EXPORT Odr_oid *odr_oid_clone(NMEM nmem, const Odr_oid *p);
+YAZ_EXPORT int odr_oid_equal(const Odr_oid *a, const Odr_oid *b);
+YAZ_EXPORT char *odr_generalstring_clone(NMEM nmem, const char *p);
+YAZ_EXPORT int odr_generalstring_equal(const char *a, const char *b);
+YAZ_EXPORT char *odr_visiblestring_clone(NMEM nmem, const char *p);
+YAZ_EXPORT int odr_visiblestring_equal(const char *a, const char *b);
+YAZ_EXPORT char *odr_graphicstring_clone(NMEM nmem, const char *p);
+YAZ_EXPORT int odr_graphicstring_equal(const char *a, const char *b);
+YAZ_EXPORT char *odr_generalizedtime_clone(NMEM nmem, const char *p);
+YAZ_EXPORT int odr_generalizedtime_equal(const char *a, const char *b);
+YAZ_EXPORT Odr_external *odr_external_clone(NMEM nmem,
+                                            const Odr_external *p);
+YAZ_EXPORT int odr_external_equal(const Odr_external *a,
+                                  const Odr_external *b);
+
+/** \brief deep copies a SEQUENCE OF / SET OF array
+    \param nmem memory for the copy
+    \param p array of pointers (T **)
+    \param num number of elements in p
+    \param clone clone function for elements
+    \returns copy of array (NULL if p is NULL)
+*/
+YAZ_EXPORT void *odr_sequence_of_clone(NMEM nmem, void *p, int num,
+                                       Odr_clone_fun clone);
+
+/** \brief compares two SEQUENCE OF / SET OF arrays element by element
+    \param a first array (T **)
+    \param num_a number of elements in a
+    \param b second array (T **)
+    \param num_b number of elements in b
+    \param equal equality function for elements
+    \retval 1 equal
+    \retval 0 different
+*/
+YAZ_EXPORT int odr_sequence_of_equal(void *a, int num_a, void *b, int num_b,
+                                     Odr_equal_fun equal);
+
 YAZ_END_CDECL
 
 #include <yaz/xmalloc.h>
@@ -150,6 +150,10 @@ struct Z_External
 
 /** \brief codec for BER EXTERNAL */
 YAZ_EXPORT int z_External(ODR o, Z_External **p, int opt, const char *name);
+/** \brief deep copies EXTERNAL (NULL if p is NULL) */
+YAZ_EXPORT Z_External *z_External_clone(NMEM nmem, const Z_External *p);
+/** \brief compares two EXTERNALs; returns 1 if equal, 0 otherwise */
+YAZ_EXPORT int z_External_equal(const Z_External *a, const Z_External *b);
 /** \brief returns type information for OID (NULL if not known) */
 YAZ_EXPORT Z_ext_typeent *z_ext_getentbyref(const Odr_oid *oid);
 /** \brief encodes EXTERNAL record based on OID (NULL if not known) */
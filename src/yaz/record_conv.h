@@ -126,6 +126,24 @@ int yaz_record_conv_record(yaz_record_conv_t p, const char *input_record_buf,
                            size_t input_record_len,
                            WRBUF output_record);
 
+/** performs record conversion on record buffer (re-entrant)
+    \param p record conversion handle
+    \param input_record_buf input record buffer
+    \param input_record_len length of input record buffer
+    \param output_record resultint record (WRBUF string)
+    \param wr_error error string on failure (WRBUF string)
+    \retval 0 success
+    \retval -1 failure
+
+    Unlike yaz_record_conv_record, the error is not kept in p, so this
+    may be called for the same handle from several threads.
+*/
+YAZ_EXPORT
+int yaz_record_conv_record_r(yaz_record_conv_t p,
+                             const char *input_record_buf,
+                             size_t input_record_len,
+                             WRBUF output_record, WRBUF wr_error);
+
 
 /** performs record conversion on OPAC record
     \param p record conversion handle
@@ -64,6 +64,27 @@ YAZ_EXPORT int yaz_iconv_close(yaz_iconv_t cd);
 /** \brief tests whether conversion is handled by YAZ' iconv or system iconv */
 YAZ_EXPORT int yaz_iconv_isbuiltin(yaz_iconv_t cd);
 
+/** \brief opens iconv handle, reusing one released by the calling thread
+    \param tocode destination encoding
+    \param fromcode source encoding
+    \returns handle or NULL if the conversion is unsupported
+
+    Like yaz_iconv_open, but if the calling thread has released a handle
+    for the same conversion with yaz_iconv_close_cached, that handle is
+    returned instead of opening a new one. Unsupported conversions are
+    cached too. The handle must be released by the same thread.
+*/
+YAZ_EXPORT yaz_iconv_t yaz_iconv_open_cached(const char *tocode,
+                                             const char *fromcode);
+
+/** \brief releases handle returned by yaz_iconv_open_cached
+    \param cd handle (NULL is ignored)
+
+    The handle is reset and kept for later use by the calling thread.
+    Each thread keeps a limited number of idle handles.
+*/
+YAZ_EXPORT int yaz_iconv_close_cached(yaz_iconv_t cd);
+
 YAZ_EXPORT unsigned long yaz_read_UTF8_char(const unsigned char *inp,
                                             size_t inbytesleft,
                                             size_t *no_read,
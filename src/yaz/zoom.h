@@ -55,6 +55,7 @@ typedef struct ZOOM_record_p *ZOOM_record;
 typedef struct ZOOM_facet_field_p *ZOOM_facet_field;
 typedef struct ZOOM_scanset_p *ZOOM_scanset;
 typedef struct ZOOM_package_p *ZOOM_package;
+typedef struct ZOOM_reactor_p *ZOOM_reactor;
 
 typedef const char *(*ZOOM_options_callback)(void *handle, const char *name);
 
@@ -565,6 +566,95 @@ ZOOM_connection_peek_event(ZOOM_connection c);
 ZOOM_API(const char *)
 ZOOM_get_event_str(int event);
 
+/** \brief event handler for connection in reactor
+    \param data user data given to ZOOM_reactor_add
+    \param c connection
+    \param event event that occurred (ZOOM_EVENT_CONNECT, ..)
+*/
+typedef void (*ZOOM_reactor_handler)(void *data, ZOOM_connection c,
+                                     int event);
+
+/** \brief creates reactor for connections
+    \returns reactor
+
+    A reactor waits for events on many connections. Unlike ZOOM_event,
+    the sockets are registered once (epoll where available) and only
+    connections that are ready or have changed are visited. Each
+    connection has its own timeout.
+*/
+ZOOM_API(ZOOM_reactor)
+ZOOM_reactor_create(void);
+
+/** \brief destroys reactor
+    \param r reactor (may be NULL)
+
+    The connections of the reactor are not destroyed.
+*/
+ZOOM_API(void)
+ZOOM_reactor_destroy(ZOOM_reactor r);
+
+/** \brief adds connection to reactor
+    \param r reactor
+    \param c connection
+    \param handler event handler (may be NULL)
+    \param data user data for handler
+    \retval 0 success
+    \retval -1 failure (connection already in a reactor)
+
+    A connection is removed from the reactor when it is destroyed.
+*/
+ZOOM_API(int)
+ZOOM_reactor_add(ZOOM_reactor r, ZOOM_connection c,
+                 ZOOM_reactor_handler handler, void *data);
+
+/** \brief removes connection from reactor
+    \param r reactor
+    \param c connection
+*/
+ZOOM_API(void)
+ZOOM_reactor_remove(ZOOM_reactor r, ZOOM_connection c);
+
+/** \brief waits for an event on the connections of reactor (BLOCKING)
+    \param r reactor
+    \returns connection for which an event occurred; NULL if none is pending
+
+    Processes one event, like ZOOM_event. The handler of the connection,
+    if any, is called before this function returns. The event is
+    also available with ZOOM_connection_last_event. The handler may
+    destroy the connection; the pointer returned must then only be
+    compared with NULL.
+*/
+ZOOM_API(ZOOM_connection)
+ZOOM_reactor_event(ZOOM_reactor r);
+
+/** \brief runs reactor until no more events are pending
+    \param r reactor
+    \returns number of events processed
+
+    Calls ZOOM_reactor_event until it returns NULL. Use with handlers.
+*/
+ZOOM_API(int)
+ZOOM_reactor_run(ZOOM_reactor r);
+
+/** \brief sets limits of connection pool
+    \param max_idle maximum number of idle associations in pool
+    \param max_per_target maximum number of idle associations per target
+
+    Connections with option "pool" set return their association to a
+    process-wide pool when destroyed, if it is idle. A later connect to
+    the same target with the same authentication, charset and Init
+    options takes it from the pool instead of connecting and sending an
+    Init. Least recently used associations beyond the limits are closed.
+    The defaults are 64 and 8.
+*/
+ZOOM_API(void)
+ZOOM_pool_set_limits(int max_idle, int max_per_target);
+
+/** \brief closes all idle associations of connection pool
+*/
+ZOOM_API(void)
+ZOOM_pool_clear(void);
+
 #ifdef WRBUF_H
 
 /** \brief log APDUs to WRBUF
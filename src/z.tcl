@@ -9,6 +9,9 @@
 # Default prefix
 set default-prefix {z_ Z_ Z_}
 
+# Generate deep copy (_clone) and equality (_equal) functions
+set default-clone 1
+
 # Name clash in extended services (TargetPart, OriginPartToKeep, etc)
 # You can possibly think of better names :)
 set prefix(ESFormat-PersistentResultSet) {z_PR Z_PR Z_PR}
@@ -31,6 +34,8 @@ set filename($m) z-core
 set init($m,h) {
 typedef struct Z_External Z_External;
 YAZ_EXPORT int z_External(ODR o, Z_External **p, int opt, const char *name);
+YAZ_EXPORT Z_External *z_External_clone(NMEM nmem, const Z_External *p);
+YAZ_EXPORT int z_External_equal(const Z_External *a, const Z_External *b);
 }
 
 set body($m,h) "
@@ -39,6 +44,8 @@ extern \"C\" \{
 #endif
 
 int z_ANY_type_0 (ODR o, void **p, int opt);
+void *z_ANY_type_0_clone(NMEM nmem, const void *p);
+int z_ANY_type_0_equal(const void *a, const void *b);
 
 #ifdef __cplusplus
 \}
@@ -52,6 +59,16 @@ int z_ANY_type_0 (ODR o, void **p, int opt)
     return 0;
 }
 
+void *z_ANY_type_0_clone(NMEM nmem, const void *p)
+{
+    return 0;
+}
+
+int z_ANY_type_0_equal(const void *a, const void *b)
+{
+    return a == b;
+}
+
 }
 
 # Type Name overrides
@@ -210,11 +227,23 @@ int z_SUTRS (ODR o, Odr_oct **p, int opt, const char *name)
     return odr_implicit_tag(o, odr_octetstring, p, ODR_UNIVERSAL,
         ODR_GENERALSTRING, opt, name);
 }
+
+Odr_oct *z_SUTRS_clone(NMEM nmem, const Odr_oct *p)
+{
+    return odr_octetstring_clone(nmem, p);
+}
+
+int z_SUTRS_equal(const Odr_oct *a, const Odr_oct *b)
+{
+    return odr_octetstring_equal(a, b);
+}
 }
 
 set init($m,h) {
 typedef Odr_oct Z_SUTRS;
 YAZ_EXPORT int z_SUTRS (ODR o, Odr_oct **p, int opt, const char *name);
+YAZ_EXPORT Odr_oct *z_SUTRS_clone(NMEM nmem, const Odr_oct *p);
+YAZ_EXPORT int z_SUTRS_equal(const Odr_oct *a, const Odr_oct *b);
 }
 # ----
 set m RecordSyntax-opac
@@ -13,6 +13,9 @@
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
+#if YAZ_POSIX_THREADS
+#include <pthread.h>
+#endif
 #include "zoom-p.h"
 
 #include <yaz/yaz-util.h>
@@ -35,6 +38,8 @@ static int log_api0 = 0;
 static int log_details0 = 0;
 
 static void resultset_destroy(ZOOM_resultset r);
+static ZOOM_record resultset_record_immediate(ZOOM_resultset s, size_t pos,
+                                              int stat);
 static zoom_ret do_write_ex(ZOOM_connection c, char *buf_out, int len_out);
 
 static void initlog(void)
@@ -160,6 +165,7 @@ ZOOM_task ZOOM_connection_add_task(ZOOM_connection c, int which)
     (*taskp)->which = which;
     (*taskp)->next = 0;
     clear_error(c);
+    ZOOM_reactor_changed(c);
     return *taskp;
 }
 
@@ -247,6 +253,10 @@ ZOOM_API(ZOOM_connection)
 
     c->proto = PROTO_Z3950;
     c->cs = 0;
+    c->reactor_entry = 0;
+    c->pool_key = 0;
+    c->init_done = 0;
+    c->record_cache = 0;
     ZOOM_connection_set_mask(c, 0);
     c->reconnect_ok = 0;
     c->state = STATE_IDLE;
@@ -280,6 +290,7 @@ ZOOM_API(ZOOM_connection)
 
     c->maximum_record_size = 0;
     c->preferred_message_size = 0;
+    c->message_size = 0;
 
     c->odr_in = odr_createmem(ODR_DECODE);
     c->odr_out = odr_createmem(ODR_ENCODE);
@@ -287,6 +298,7 @@ ZOOM_API(ZOOM_connection)
     c->odr_save = 0;
 
     c->async = 0;
+    c->zero_copy_decode = 0;
     c->support_named_resultsets = 0;
     c->last_event = ZOOM_EVENT_NONE;
 
@@ -526,8 +538,11 @@ ZOOM_API(void)
         ZOOM_options_get_int(c->options, "maximumRecordSize", 64*1024*1024);
     c->preferred_message_size =
         ZOOM_options_get_int(c->options, "preferredMessageSize", 64*1024*1024);
+    c->message_size = c->preferred_message_size;
 
     c->async = ZOOM_options_get_bool(c->options, "async", 0);
+    c->zero_copy_decode =
+        ZOOM_options_get_bool(c->options, "zeroCopyDecode", 0);
 
     yaz_cookies_destroy(c->cookies);
     c->cookies = yaz_cookies_create();
@@ -572,6 +587,12 @@ ZOOM_API(void)
     }
 
     yaz_log(c->log_details, "%p ZOOM_connection_connect async=%d", c, c->async);
+    if (ZOOM_pool_get(c))
+    {
+        /* like a reconnect: the pooled association may have been lost */
+        c->reconnect_ok = 1;
+        return;
+    }
     ZOOM_connection_add_task(c, ZOOM_TASK_CONNECT);
 
     if (!c->async)
@@ -609,9 +630,12 @@ ZOOM_API(void)
         return;
     yaz_log(c->log_api, "%p ZOOM_connection_destroy", c);
 
+    ZOOM_reactor_connection_destroy(c);
     ZOOM_memcached_destroy(c);
+    ZOOM_pool_put(c);
     if (c->cs)
         cs_close(c->cs);
+    xfree(c->pool_key);
 
     for (r = c->resultsets; r; r = r->next)
         r->connection = 0;
@@ -628,6 +652,7 @@ ZOOM_API(void)
     ZOOM_options_destroy(c->options);
     ZOOM_connection_remove_tasks(c);
     ZOOM_connection_remove_events(c);
+    ZOOM_record_cache_destroy(c->record_cache);
     xfree(c->host_port);
     xfree(c->proxy);
     xfree(c->tproxy);
@@ -660,14 +685,23 @@ void ZOOM_resultset_addref(ZOOM_resultset r)
 
 static int g_resultsets = 0;
 static YAZ_MUTEX g_resultset_mutex = 0;
+#if YAZ_POSIX_THREADS
+static pthread_once_t g_resultset_once = PTHREAD_ONCE_INIT;
+#endif
 
-/* TODO We need to initialize this before running threaded:
- * call resultset_use(0)  */
+static void resultset_mutex_create(void)
+{
+    yaz_mutex_create(&g_resultset_mutex);
+}
 
 static int resultset_use(int delta) {
     int resultset_count;
+#if YAZ_POSIX_THREADS
+    pthread_once(&g_resultset_once, resultset_mutex_create);
+#else
     if (g_resultset_mutex == 0)
-        yaz_mutex_create(&g_resultset_mutex);
+        resultset_mutex_create();
+#endif
     yaz_mutex_enter(g_resultset_mutex);
     g_resultsets += delta;
     resultset_count = g_resultsets;
@@ -681,7 +715,6 @@ int resultsets_count(void) {
 
 ZOOM_resultset ZOOM_resultset_create(void)
 {
-    int i;
     ZOOM_resultset r = (ZOOM_resultset) xmalloc(sizeof(*r));
 
     initlog();
@@ -693,8 +726,11 @@ ZOOM_resultset ZOOM_resultset_create(void)
     r->piggyback = 1;
     r->setname = 0;
     r->step = 0;
-    for (i = 0; i<RECORD_HASH_SIZE; i++)
-        r->record_hash[i] = 0;
+    r->record_cache = 0;
+    r->cache_key[0] = '\0';
+    r->cache_pins = 0;
+    r->cache_gen = 0;
+    r->cache_block = 0;
     r->r_sort_spec = 0;
     r->query = 0;
     r->connection = 0;
@@ -715,6 +751,9 @@ ZOOM_resultset ZOOM_resultset_create(void)
     resultset_use(1);
     r->mc_key = 0;
     r->live_set = 0;
+    r->record_size = 0;
+    r->read_ahead = 0;
+    r->read_ahead_pos = 0;
     return r;
 }
 
@@ -756,6 +795,7 @@ ZOOM_API(ZOOM_resultset)
                                        (cp != 0 ? "presentChunk": "step"), 0);
     }
     r->piggyback = ZOOM_options_get_bool(r->options, "piggyback", 1);
+    r->read_ahead = ZOOM_options_get_int(r->options, "readAhead", 0);
     r->setname = odr_strdup_null(r->odr,
                                  ZOOM_options_get(r->options, "setname"));
     r->databaseNames = ZOOM_connection_get_databases(c, c->options,
@@ -764,6 +804,7 @@ ZOOM_API(ZOOM_resultset)
     r->connection = c;
     r->next = c->resultsets;
     c->resultsets = r;
+    ZOOM_record_cache_attach(r);
 
     ZOOM_memcached_resultset(r, q);
 
@@ -785,6 +826,8 @@ ZOOM_API(ZOOM_resultset)
     task->u.search.resultset = r;
     task->u.search.start = start;
     task->u.search.count = count;
+    task->u.search.requested = 0;
+    task->u.search.fetch_one = 0;
 
     syntax = ZOOM_options_get(r->options, "preferredRecordSyntax");
     task->u.search.syntax = syntax ? xstrdup(syntax) : 0;
@@ -878,7 +921,7 @@ static void resultset_destroy(ZOOM_resultset r)
         yaz_mutex_leave(r->mutex);
 
         yaz_log(log_details0, "%p ZOOM_connection resultset_destroy: Deleting resultset (%p) ", r->connection, r);
-        ZOOM_resultset_cache_reset(r);
+        ZOOM_record_cache_detach(r);
         ZOOM_resultset_release(r);
         ZOOM_query_destroy(r->query);
         ZOOM_options_destroy(r->options);
@@ -918,22 +961,14 @@ int ZOOM_test_reconnect(ZOOM_connection c)
     return 1;
 }
 
-static void ZOOM_resultset_retrieve(ZOOM_resultset r,
-                                    int force_sync, int start, int count)
+static void resultset_add_retrieve_task(ZOOM_resultset r,
+                                        int start, int count)
 {
     ZOOM_task task;
-    ZOOM_connection c;
+    ZOOM_connection c = r->connection;
     const char *cp;
     const char *syntax, *elementSetName;
 
-    if (!r)
-        return;
-    yaz_log(log_details0, "%p ZOOM_resultset_retrieve force_sync=%d start=%d"
-            " count=%d", r, force_sync, start, count);
-    c = r->connection;
-    if (!c)
-        return;
-
     if (c->host_port && c->proto == PROTO_HTTP)
     {
         if (!c->cs)
@@ -952,6 +987,8 @@ static void ZOOM_resultset_retrieve(ZOOM_resultset r,
     task->u.search.resultset = r;
     task->u.search.start = start;
     task->u.search.count = count;
+    task->u.search.requested = 0;
+    task->u.search.fetch_one = 0;
 
     syntax = ZOOM_options_get(r->options, "preferredRecordSyntax");
     task->u.search.syntax = syntax ? xstrdup(syntax) : 0;
@@ -963,12 +1000,46 @@ static void ZOOM_resultset_retrieve(ZOOM_resultset r,
     task->u.search.schema = cp ? xstrdup(cp) : 0;
 
     ZOOM_resultset_addref(r);
+}
 
+static void ZOOM_resultset_retrieve(ZOOM_resultset r,
+                                    int force_sync, int start, int count)
+{
+    if (!r)
+        return;
+    yaz_log(log_details0, "%p ZOOM_resultset_retrieve force_sync=%d start=%d"
+            " count=%d", r, force_sync, start, count);
+    if (!r->connection)
+        return;
+    resultset_add_retrieve_task(r, start, count);
     if (!r->connection->async || force_sync)
         while (r->connection && ZOOM_event(1, &r->connection))
             ;
 }
 
+/* sends present for records following pos, unless the connection is busy
+   or enough records are cached or underway already */
+static void resultset_read_ahead(ZOOM_resultset r, size_t pos)
+{
+    ZOOM_connection c = r->connection;
+    int count;
+
+    if (!c || !c->cs || c->tasks || c->proto != PROTO_Z3950 ||
+        c->state != STATE_ESTABLISHED || r->live_set != 2)
+        return;
+    if (r->read_ahead_pos <= (Odr_int) pos)
+        r->read_ahead_pos = pos + 1;
+    if (r->read_ahead_pos >= r->size ||
+        r->read_ahead_pos - (Odr_int) pos > r->read_ahead)
+        return;
+    count = ZOOM_Z3950_present_fit(c, r, r->read_ahead);
+    yaz_log(log_details0, "%p resultset_read_ahead start=" ODR_INT_PRINTF
+            " count=%d", r, r->read_ahead_pos, count);
+    resultset_add_retrieve_task(r, (int) r->read_ahead_pos, count);
+    r->read_ahead_pos += count;
+    ZOOM_connection_exec_task(c);
+}
+
 ZOOM_API(void)
     ZOOM_resultset_records(ZOOM_resultset r, ZOOM_record *recs,
                            size_t start, size_t count)
@@ -986,7 +1057,7 @@ ZOOM_API(void)
     {
         size_t i;
         for (i = 0; i< count; i++)
-            recs[i] = ZOOM_resultset_record_immediate(r, i+start);
+            recs[i] = resultset_record_immediate(r, i+start, 0);
     }
 }
 
@@ -1076,7 +1147,11 @@ static zoom_ret do_connect_host(ZOOM_connection c, const char *logical_url)
     void *add;
 
     if (c->cs)
+    {
+        ZOOM_reactor_socket_close(c);
         cs_close(c->cs);
+    }
+    c->init_done = 0;
     c->cs = cs_create_host2(logical_url, CS_FLAGS_DNS_NO_BLOCK, &add,
                             c->tproxy ? c->tproxy : c->proxy,
                             &c->proxy_mode);
@@ -1139,8 +1214,9 @@ static zoom_ret do_connect_host(ZOOM_connection c, const char *logical_url)
    0 if PDU was not sent OK (nothing to wait for)
 */
 
-ZOOM_API(ZOOM_record)
-    ZOOM_resultset_record_immediate(ZOOM_resultset s,size_t pos)
+/* stat: whether to count as hit or miss of record cache */
+static ZOOM_record resultset_record_immediate(ZOOM_resultset s, size_t pos,
+                                              int stat)
 {
     const char *syntax =
         ZOOM_options_get(s->options, "preferredRecordSyntax");
@@ -1149,7 +1225,14 @@ ZOOM_API(ZOOM_record)
     const char *schema =
         ZOOM_options_get(s->options, "schema");
 
-    return ZOOM_record_cache_lookup_i(s, pos, syntax, elementSetName, schema);
+    return ZOOM_record_cache_lookup_i(s, pos, syntax, elementSetName, schema,
+                                      stat);
+}
+
+ZOOM_API(ZOOM_record)
+    ZOOM_resultset_record_immediate(ZOOM_resultset s,size_t pos)
+{
+    return resultset_record_immediate(s, pos, 1);
 }
 
 ZOOM_API(ZOOM_record)
@@ -1166,10 +1249,18 @@ ZOOM_API(ZOOM_record)
          * behaviour.
          */
         int force_sync = 1;
+        int count = 1;
         if (getenv("ZOOM_RECORD_NO_FORCE_SYNC")) force_sync = 0;
-        ZOOM_resultset_retrieve(r, force_sync, pos, 1);
-        rec = ZOOM_resultset_record_immediate(r, pos);
+        if (r->read_ahead > 0 && r->connection)
+        {
+            count = ZOOM_Z3950_present_fit(r->connection, r, r->read_ahead);
+            r->read_ahead_pos = pos + count;
+        }
+        ZOOM_resultset_retrieve(r, force_sync, pos, count);
+        rec = resultset_record_immediate(r, pos, 0);
     }
+    if (rec && r->read_ahead > 0)
+        resultset_read_ahead(r, pos);
     return rec;
 }
 
@@ -1666,9 +1757,18 @@ static int do_read(ZOOM_connection c)
     {
         Z_GDU *gdu;
         ZOOM_Event event;
+        char *buf = c->buf_in;
 
         odr_reset(c->odr_in);
-        odr_setbuf(c->odr_in, c->buf_in, r, 0);
+        odr_setbuf(c->odr_in, buf, r, 0);
+        odr_set_zero_copy(c->odr_in, c->zero_copy_decode);
+        if (c->zero_copy_decode)
+        {
+            /* records refer to buf; it goes along with the decode memory */
+            nmem_adopt_buf(odr_getmem(c->odr_in), buf);
+            c->buf_in = 0;
+            c->len_in = 0;
+        }
         event = ZOOM_Event_create(ZOOM_EVENT_RECV_APDU);
         ZOOM_connection_put_event(c, event);
 
@@ -1690,7 +1790,7 @@ static int do_read(ZOOM_connection c)
                 {
                     FILE *ber_file = yaz_log_file();
                     if (ber_file)
-                        odr_dumpBER(ber_file, c->buf_in, r);
+                        odr_dumpBER(ber_file, buf, r);
                 }
                 ZOOM_connection_close(c);
             }
@@ -1831,7 +1931,9 @@ ZOOM_API(void)
 ZOOM_API(const char *)
     ZOOM_resultset_option_get(ZOOM_resultset r, const char *key)
 {
-    return ZOOM_options_get(r->options, key);
+    const char *v = ZOOM_record_cache_option_get(r, key);
+
+    return v ? v : ZOOM_options_get(r->options, key);
 }
 
 ZOOM_API(void)
@@ -2110,6 +2212,7 @@ ZOOM_API(int) ZOOM_connection_get_socket(ZOOM_connection c)
 ZOOM_API(int) ZOOM_connection_set_mask(ZOOM_connection c, int mask)
 {
     c->mask = mask;
+    ZOOM_reactor_changed(c);
     if (!c->cs)
         return -1;
     return 0;
@@ -2130,8 +2233,12 @@ ZOOM_API(int) ZOOM_connection_get_timeout(ZOOM_connection c)
 ZOOM_API(void) ZOOM_connection_close(ZOOM_connection c)
 {
     if (c->cs)
+    {
+        ZOOM_reactor_socket_close(c);
         cs_close(c->cs);
+    }
     c->cs = 0;
+    c->init_done = 0;
     ZOOM_connection_set_mask(c, 0);
     c->state = STATE_IDLE;
 }
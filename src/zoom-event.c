@@ -85,6 +85,7 @@ void ZOOM_connection_put_event(ZOOM_connection c, ZOOM_Event event)
     event->next = c->m_queue_back;
     event->prev = 0;
     c->m_queue_back = event;
+    ZOOM_reactor_changed(c);
 }
 
 void ZOOM_Event_destroy(ZOOM_Event event)
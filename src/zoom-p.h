@@ -97,11 +97,13 @@ struct ZOOM_connection_p {
     int url_authentication;
 
     int async;
+    int zero_copy_decode;
     int support_named_resultsets;
     int last_event;
 
     int maximum_record_size;
     int preferred_message_size;
+    int message_size;    /* preferredMessageSize agreed in Init */
 
     ZOOM_task tasks;
     ZOOM_options options;
@@ -124,12 +126,14 @@ struct ZOOM_connection_p {
 #endif
     int expire_search;
     int expire_record;
+    struct ZOOM_reactor_entry *reactor_entry;
+    char *pool_key;      /* key in connection pool; NULL if not pooled */
+    struct ZOOM_record_cache_p *record_cache;  /* recordCache=connection */
+    int init_done;       /* Init response has been accepted */
 };
 
 typedef struct ZOOM_record_cache_p *ZOOM_record_cache;
 
-#define RECORD_HASH_SIZE  131
-
 struct ZOOM_resultset_p {
     Z_SortKeySpecList *r_sort_spec;
     ZOOM_query query;
@@ -139,7 +143,11 @@ struct ZOOM_resultset_p {
     int piggyback;
     char *setname;
     ODR odr;
-    ZOOM_record_cache record_hash[RECORD_HASH_SIZE];
+    ZOOM_record_cache record_cache;
+    char cache_key[41];                /* SHA1 of search */
+    struct record_pin *cache_pins;     /* records in use */
+    int cache_gen;                     /* responses handled */
+    struct record_block *cache_block;  /* of response being handled */
     ZOOM_options options;
     ZOOM_connection connection;
     char **databaseNames;
@@ -155,6 +163,9 @@ struct ZOOM_resultset_p {
     char **facets_names; /* redundant. For ZOOM_resultset_facets_names only */
     WRBUF mc_key;
     int live_set; /* 0=no hit count, 1=cached hit, 2=hits + real set */
+    int record_size;      /* average bytes per record; -1: don't adapt */
+    int read_ahead;       /* records to fetch ahead of reader; 0=off */
+    Odr_int read_ahead_pos;  /* position after records asked for */
 };
 
 struct facet_term_p {
@@ -198,6 +209,8 @@ struct ZOOM_task_p {
         struct {
             int count;
             int start;
+            int requested;   /* records asked for in last request */
+            int fetch_one;   /* next present asks for one record only */
             ZOOM_resultset resultset;
             char *syntax;
             char *elementSetName;
@@ -238,6 +251,7 @@ ZOOM_Event ZOOM_Event_create(int kind);
 void ZOOM_connection_put_event(ZOOM_connection c, ZOOM_Event event);
 
 zoom_ret ZOOM_connection_Z3950_search(ZOOM_connection c);
+int ZOOM_Z3950_present_fit(ZOOM_connection c, ZOOM_resultset r, int count);
 zoom_ret ZOOM_connection_Z3950_send_scan(ZOOM_connection c);
 zoom_ret ZOOM_send_buf(ZOOM_connection c);
 zoom_ret send_Z3950_sort(ZOOM_connection c, ZOOM_resultset resultset);
@@ -283,6 +297,13 @@ void ZOOM_Event_destroy(ZOOM_Event event);
 zoom_ret ZOOM_send_GDU(ZOOM_connection c, Z_GDU *gdu);
 void ZOOM_handle_facet_list(ZOOM_resultset r, Z_FacetList *fl);
 
+void ZOOM_reactor_changed(ZOOM_connection c);
+void ZOOM_reactor_socket_close(ZOOM_connection c);
+void ZOOM_reactor_connection_destroy(ZOOM_connection c);
+
+int ZOOM_pool_get(ZOOM_connection c);
+int ZOOM_pool_put(ZOOM_connection c);
+
 void ZOOM_memcached_init(ZOOM_connection c);
 int ZOOM_memcached_configure(ZOOM_connection c);
 void ZOOM_memcached_destroy(ZOOM_connection c);
@@ -302,7 +323,12 @@ Z_NamePlusRecord *ZOOM_memcached_lookup(ZOOM_resultset r, int pos,
 ZOOM_record ZOOM_record_cache_lookup_i(ZOOM_resultset r, int pos,
                                        const char *syntax,
                                        const char *elementSetName,
-                                       const char *schema);
+                                       const char *schema, int stat);
+void ZOOM_record_cache_attach(ZOOM_resultset r);
+void ZOOM_record_cache_detach(ZOOM_resultset r);
+void ZOOM_record_cache_adopt(ZOOM_resultset r, NMEM nmem, size_t extra);
+void ZOOM_record_cache_destroy(ZOOM_record_cache rc);
+const char *ZOOM_record_cache_option_get(ZOOM_resultset r, const char *key);
 void ZOOM_handle_facet_result(ZOOM_connection c, ZOOM_resultset r,
                               Z_OtherInformation *o);
 void ZOOM_handle_search_result(ZOOM_connection c, ZOOM_resultset resultset,
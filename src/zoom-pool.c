@@ -0,0 +1,550 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file zoom-pool.c
+ * \brief Implements ZOOM connection pool.
+ *
+ * Connections with option "pool" set hand their association to a
+ * process-wide pool when they are destroyed, provided it is established,
+ * idle and without error. A later connect with the same target, proxy,
+ * authentication, charset and Init options takes the association from
+ * the pool rather than connecting and sending an Init again. The Init
+ * response options are kept with the association and set again on the
+ * new connection.
+ *
+ * The pool may be used by several threads. Targets are spread over a
+ * number of stripes by hash of their key, each with its own mutex, so
+ * that threads connecting to different targets seldom wait for each
+ * other. In a stripe, idle associations are kept per target, most
+ * recently used first, and in one list in least recently used order.
+ * The number of idle associations of the pool is kept under a separate
+ * mutex. When it exceeds the limit, least recently used associations
+ * of the stripe at hand are closed, so the order over the whole pool is
+ * approximate.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "zoom-p.h"
+
+#include <yaz/log.h>
+#include <yaz/poll.h>
+#include <yaz/xmalloc.h>
+
+#if YAZ_POSIX_THREADS
+#include <pthread.h>
+#endif
+
+#define POOL_STRIPES 16
+#define POOL_HASH 31
+
+struct pool_target;
+
+struct pool_entry {
+    COMSTACK cs;
+    enum oid_proto proto;
+    int support_named_resultsets;
+    int message_size;
+    char *cookie_in;
+    int num_options;
+    char **option_names;
+    char **option_values;
+    struct pool_target *target;
+    struct pool_entry *next;       /* next in target */
+    struct pool_entry *lru_prev;   /* more recently used */
+    struct pool_entry *lru_next;   /* less recently used */
+};
+
+struct pool_target {
+    char *key;
+    unsigned hash;
+    int num;
+    struct pool_entry *entries;    /* most recently used first */
+    struct pool_target *next;
+};
+
+struct pool_stripe {
+    YAZ_MUTEX mutex;
+    struct pool_target *hash[POOL_HASH];
+    struct pool_entry *lru_first;
+    struct pool_entry *lru_last;
+    int num;
+};
+
+static struct pool_stripe pool_stripes[POOL_STRIPES];
+#if YAZ_POSIX_THREADS
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+#else
+static int pool_init_flag = 0;
+#endif
+static YAZ_MUTEX pool_count_mutex = 0;  /* for the three below */
+static int pool_num = 0;
+static int pool_max_idle = 64;
+static int pool_max_per_target = 8;
+
+/* options that an Init response sets on the connection */
+static const char *init_option_names[] = {
+    "serverImplementationId",
+    "serverImplementationName",
+    "serverImplementationVersion",
+    "targetImplementationId",
+    "targetImplementationName",
+    "targetImplementationVersion",
+    "negotiation-charset",
+    "negotiation-lang",
+    "negotiation-charset-in-effect-for-records",
+    "sslPeerCert",
+    0
+};
+
+static void pool_create(void)
+{
+    int i;
+
+    for (i = 0; i < POOL_STRIPES; i++)
+    {
+        struct pool_stripe *s = pool_stripes + i;
+        int j;
+
+        s->mutex = 0;
+        yaz_mutex_create(&s->mutex);
+        for (j = 0; j < POOL_HASH; j++)
+            s->hash[j] = 0;
+        s->lru_first = s->lru_last = 0;
+        s->num = 0;
+    }
+    yaz_mutex_create(&pool_count_mutex);
+}
+
+static void pool_init(void)
+{
+#if YAZ_POSIX_THREADS
+    pthread_once(&pool_once, pool_create);
+#else
+    if (!pool_init_flag)
+    {
+        pool_create();
+        pool_init_flag = 1;
+    }
+#endif
+}
+
+static unsigned pool_hash_key(const char *key)
+{
+    unsigned h = 0;
+
+    while (*key)
+        h = h * 65509 + (unsigned char) *key++;
+    return h;
+}
+
+static struct pool_stripe *pool_stripe(unsigned h)
+{
+    pool_init();
+    return pool_stripes + h % POOL_STRIPES;
+}
+
+/* adjusts number of idle associations and returns number beyond limit */
+static int pool_count(int delta, int *max_per_target)
+{
+    int excess;
+
+    yaz_mutex_enter(pool_count_mutex);
+    pool_num += delta;
+    excess = pool_num - pool_max_idle;
+    if (max_per_target)
+        *max_per_target = pool_max_per_target;
+    yaz_mutex_leave(pool_count_mutex);
+    return excess;
+}
+
+static void key_add(WRBUF w, const char *value)
+{
+    if (value)
+        wrbuf_puts(w, value);
+    wrbuf_putc(w, '\n');
+}
+
+/* makes key of all that goes into connect and Init */
+static char *pool_make_key(ZOOM_connection c)
+{
+    static const char *names[] = {
+        "implementationId", "implementationName", "implementationVersion",
+        "sru", 0
+    };
+    WRBUF w = wrbuf_alloc();
+    char *key;
+    int i;
+
+    key_add(w, c->host_port);
+    key_add(w, c->proxy);
+    key_add(w, c->tproxy);
+    key_add(w, c->user);
+    key_add(w, c->group);
+    key_add(w, c->password);
+    key_add(w, c->charset);
+    key_add(w, c->lang);
+    key_add(w, c->cookie_out);
+    key_add(w, c->client_IP);
+    key_add(w, c->sru_version);
+    wrbuf_printf(w, "%d %d %d\n", c->url_authentication,
+                 c->maximum_record_size, c->preferred_message_size);
+    for (i = 0; names[i]; i++)
+        key_add(w, ZOOM_options_get(c->options, names[i]));
+    key = xstrdup(wrbuf_cstr(w));
+    wrbuf_destroy(w);
+    return key;
+}
+
+static void add_init_option(const char *name, void *client_data)
+{
+    WRBUF w = (WRBUF) client_data;
+
+    wrbuf_printf(w, "init_opt_%.70s", name);
+    wrbuf_putc(w, '\0');
+}
+
+/* saves the options that the Init response has set */
+static void entry_save_options(struct pool_entry *e, ZOOM_connection c)
+{
+    WRBUF w = wrbuf_alloc();
+    Odr_bitmask all;
+    const char *cp;
+    int i, no = 0;
+
+    for (i = 0; init_option_names[i]; i++)
+    {
+        wrbuf_puts(w, init_option_names[i]);
+        wrbuf_putc(w, '\0');
+    }
+    /* all bits set to get the names of all Init options */
+    ODR_MASK_ZERO(&all);
+    for (i = 0; i < 64; i++)
+        ODR_MASK_SET(&all, i);
+    yaz_init_opt_decode(&all, add_init_option, w);
+
+    e->num_options = 0;
+    e->option_names = 0;
+    e->option_values = 0;
+    for (cp = wrbuf_buf(w); cp < wrbuf_buf(w) + wrbuf_len(w);
+         cp += strlen(cp) + 1)
+        no++;
+    e->option_names = (char **) xmalloc(no * sizeof(char *));
+    e->option_values = (char **) xmalloc(no * sizeof(char *));
+    for (cp = wrbuf_buf(w); cp < wrbuf_buf(w) + wrbuf_len(w);
+         cp += strlen(cp) + 1)
+    {
+        int len;
+        const char *v = ZOOM_options_getl(c->options, cp, &len);
+
+        if (v)
+        {
+            e->option_names[e->num_options] = xstrdup(cp);
+            e->option_values[e->num_options] = (char *) xmalloc(len + 1);
+            memcpy(e->option_values[e->num_options], v, len);
+            e->option_values[e->num_options][len] = '\0';
+            e->num_options++;
+        }
+    }
+    wrbuf_destroy(w);
+}
+
+static void entry_destroy(struct pool_entry *e)
+{
+    int i;
+
+    if (e->cs)
+        cs_close(e->cs);
+    for (i = 0; i < e->num_options; i++)
+    {
+        xfree(e->option_names[i]);
+        xfree(e->option_values[i]);
+    }
+    xfree(e->option_names);
+    xfree(e->option_values);
+    xfree(e->cookie_in);
+    xfree(e);
+}
+
+/* unlinks entry from stripe; mutex of stripe must be held */
+static void entry_unlink(struct pool_stripe *s, struct pool_entry *e)
+{
+    struct pool_target *t = e->target;
+    struct pool_entry **ep = &t->entries;
+
+    for (; *ep; ep = &(*ep)->next)
+        if (*ep == e)
+        {
+            *ep = e->next;
+            break;
+        }
+    t->num--;
+    if (e->lru_prev)
+        e->lru_prev->lru_next = e->lru_next;
+    else
+        s->lru_first = e->lru_next;
+    if (e->lru_next)
+        e->lru_next->lru_prev = e->lru_prev;
+    else
+        s->lru_last = e->lru_prev;
+    s->num--;
+    if (t->num == 0)
+    {
+        struct pool_target **tp = &s->hash[(t->hash / POOL_STRIPES) %
+                                           POOL_HASH];
+
+        for (; *tp; tp = &(*tp)->next)
+            if (*tp == t)
+            {
+                *tp = t->next;
+                break;
+            }
+        xfree(t->key);
+        xfree(t);
+    }
+}
+
+static struct pool_target *target_lookup(struct pool_stripe *s,
+                                         const char *key, unsigned h)
+{
+    struct pool_target *t = s->hash[(h / POOL_STRIPES) % POOL_HASH];
+
+    for (; t; t = t->next)
+        if (t->hash == h && !strcmp(t->key, key))
+            break;
+    return t;
+}
+
+/* removes least recently used entries of stripe beyond limits; mutex of
+   stripe must be held. The entries are added to list (linked by next)
+   and their number is returned */
+static int pool_trim(struct pool_stripe *s, int excess, int max_per_target,
+                     struct pool_entry **list)
+{
+    struct pool_entry *e = s->lru_last;
+    int no = 0;
+
+    while (e)
+    {
+        struct pool_entry *e_prev = e->lru_prev;
+
+        if (excess > no || e->target->num > max_per_target)
+        {
+            entry_unlink(s, e);
+            e->next = *list;
+            *list = e;
+            no++;
+        }
+        e = e_prev;
+    }
+    return no;
+}
+
+static void list_destroy(struct pool_entry *list)
+{
+    while (list)
+    {
+        struct pool_entry *e = list;
+
+        list = e->next;
+        entry_destroy(e);
+    }
+}
+
+/* returns 1 if association has been closed or has unexpected data */
+static int cs_is_stale(COMSTACK cs)
+{
+    struct yaz_poll_fd fds;
+
+    fds.fd = cs_fileno(cs);
+    fds.input_mask = yaz_poll_read;
+    return yaz_poll(&fds, 1, 0, 0) != 0;
+}
+
+int ZOOM_pool_get(ZOOM_connection c)
+{
+    struct pool_entry *e = 0;
+    struct pool_entry *stale = 0;
+    struct pool_stripe *s;
+    unsigned h;
+    int i, no = 0;
+
+    xfree(c->pool_key);
+    c->pool_key = 0;
+    if (!ZOOM_options_get_bool(c->options, "pool", 0))
+        return 0;
+    c->pool_key = pool_make_key(c);
+    h = pool_hash_key(c->pool_key);
+    s = pool_stripe(h);
+
+    yaz_mutex_enter(s->mutex);
+    while (1)
+    {
+        struct pool_target *t = target_lookup(s, c->pool_key, h);
+
+        if (!t)
+            break;
+        e = t->entries;
+        entry_unlink(s, e);
+        no++;
+        if (!cs_is_stale(e->cs))
+            break;
+        e->next = stale;
+        stale = e;
+        e = 0;
+    }
+    yaz_mutex_leave(s->mutex);
+    if (no)
+        pool_count(-no, 0);
+    list_destroy(stale);
+    if (!e)
+    {
+        yaz_log(c->log_details, "%p ZOOM_pool_get none", c);
+        return 0;
+    }
+    yaz_log(c->log_details, "%p ZOOM_pool_get cs=%p", c, e->cs);
+    c->cs = e->cs;
+    e->cs = 0;
+    c->proto = e->proto;
+    c->support_named_resultsets = e->support_named_resultsets;
+    c->message_size = e->message_size;
+    xfree(c->cookie_in);
+    c->cookie_in = e->cookie_in;
+    e->cookie_in = 0;
+    for (i = 0; i < e->num_options; i++)
+        ZOOM_connection_option_set(c, e->option_names[i],
+                                   e->option_values[i]);
+    c->state = STATE_ESTABLISHED;
+    c->init_done = 1;
+    ZOOM_connection_set_mask(c, 0);
+    entry_destroy(e);
+    return 1;
+}
+
+int ZOOM_pool_put(ZOOM_connection c)
+{
+    struct pool_entry *e;
+    struct pool_target *t;
+    struct pool_entry *list = 0;
+    struct pool_stripe *s;
+    unsigned h;
+    int excess, max_per_target, no;
+
+    if (!c->pool_key || !c->cs || c->tasks || c->error ||
+        c->state != STATE_ESTABLISHED ||
+        (c->proto == PROTO_Z3950 && !c->init_done) || cs_is_stale(c->cs))
+        return 0;
+    yaz_log(c->log_details, "%p ZOOM_pool_put cs=%p", c, c->cs);
+    e = (struct pool_entry *) xmalloc(sizeof(*e));
+    e->cs = c->cs;
+    c->cs = 0;
+    e->proto = c->proto;
+    e->support_named_resultsets = c->support_named_resultsets;
+    e->message_size = c->message_size;
+    e->cookie_in = c->cookie_in ? xstrdup(c->cookie_in) : 0;
+    entry_save_options(e, c);
+
+    h = pool_hash_key(c->pool_key);
+    s = pool_stripe(h);
+    excess = pool_count(1, &max_per_target);
+    yaz_mutex_enter(s->mutex);
+    t = target_lookup(s, c->pool_key, h);
+    if (!t)
+    {
+        struct pool_target **tp = &s->hash[(h / POOL_STRIPES) % POOL_HASH];
+
+        t = (struct pool_target *) xmalloc(sizeof(*t));
+        t->key = xstrdup(c->pool_key);
+        t->hash = h;
+        t->num = 0;
+        t->entries = 0;
+        t->next = *tp;
+        *tp = t;
+    }
+    e->target = t;
+    e->next = t->entries;
+    t->entries = e;
+    t->num++;
+    e->lru_prev = 0;
+    e->lru_next = s->lru_first;
+    if (s->lru_first)
+        s->lru_first->lru_prev = e;
+    else
+        s->lru_last = e;
+    s->lru_first = e;
+    s->num++;
+    no = pool_trim(s, excess, max_per_target, &list);
+    yaz_mutex_leave(s->mutex);
+    if (no)
+        pool_count(-no, 0);
+    list_destroy(list);
+    return 1;
+}
+
+ZOOM_API(void)
+    ZOOM_pool_set_limits(int max_idle, int max_per_target)
+{
+    int i;
+
+    pool_init();
+    yaz_mutex_enter(pool_count_mutex);
+    pool_max_idle = max_idle;
+    pool_max_per_target = max_per_target;
+    yaz_mutex_leave(pool_count_mutex);
+    for (i = 0; i < POOL_STRIPES; i++)
+    {
+        struct pool_stripe *s = pool_stripes + i;
+        struct pool_entry *list = 0;
+        int no;
+
+        yaz_mutex_enter(s->mutex);
+        no = pool_trim(s, pool_count(0, 0), max_per_target, &list);
+        yaz_mutex_leave(s->mutex);
+        if (no)
+            pool_count(-no, 0);
+        list_destroy(list);
+    }
+}
+
+ZOOM_API(void)
+    ZOOM_pool_clear(void)
+{
+    int i;
+
+    pool_init();
+    for (i = 0; i < POOL_STRIPES; i++)
+    {
+        struct pool_stripe *s = pool_stripes + i;
+        struct pool_entry *list = 0;
+        int no = 0;
+
+        yaz_mutex_enter(s->mutex);
+        while (s->lru_first)
+        {
+            struct pool_entry *e = s->lru_first;
+
+            entry_unlink(s, e);
+            e->next = list;
+            list = e;
+            no++;
+        }
+        yaz_mutex_leave(s->mutex);
+        if (no)
+            pool_count(-no, 0);
+        list_destroy(list);
+    }
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -0,0 +1,584 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+/**
+ * \file zoom-reactor.c
+ * \brief Implements ZOOM reactor.
+ *
+ * A reactor keeps the sockets of its connections registered with epoll
+ * and only visits connections that are ready or that have changed (new
+ * task, new event or new socket mask, see ZOOM_reactor_changed). The
+ * timeouts of the connections are kept in a binary min-heap ordered by
+ * deadline. Without epoll, or if the epoll instance can not be created,
+ * the registered sockets are polled with yaz_poll.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#if HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#if HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#if HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
+#include <yaz/poll.h>
+#include <yaz/gettimeofday.h>
+#include "zoom-p.h"
+
+#include <yaz/log.h>
+#include <yaz/xmalloc.h>
+
+#define REACTOR_MAX_EVENTS 256
+
+struct ZOOM_reactor_entry {
+    ZOOM_reactor reactor;
+    ZOOM_connection c;
+    ZOOM_reactor_handler handler;
+    void *data;
+    int reg_fd;          /* socket registered; -1 for none */
+    int reg_mask;        /* mask registered; 0 for none */
+    double deadline;     /* timeout of connection when reg_mask != 0 */
+    int heap_idx;        /* position in heap; -1 for none */
+    int changed;         /* 1=on changed list */
+    struct ZOOM_reactor_entry *prev;
+    struct ZOOM_reactor_entry *next;
+    struct ZOOM_reactor_entry *changed_prev;
+    struct ZOOM_reactor_entry *changed_next;
+};
+
+struct ZOOM_reactor_p {
+    int epoll_fd;        /* -1 for poll */
+    struct ZOOM_reactor_entry *entries;
+    struct ZOOM_reactor_entry *changed_front;
+    struct ZOOM_reactor_entry *changed_back;
+    struct ZOOM_reactor_entry **heap;
+    int heap_num;
+    int heap_max;
+    int no_active;       /* entries with a socket registered */
+    struct ZOOM_reactor_entry **fd_owner; /* entry that registered fd */
+    int fd_max;
+    struct yaz_poll_fd *fds;
+    int fds_max;
+    int log_details;
+};
+
+static double reactor_now(void)
+{
+    struct timeval tv;
+
+    yaz_gettimeofday(&tv);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void heap_swap(ZOOM_reactor r, int i, int j)
+{
+    struct ZOOM_reactor_entry *e = r->heap[i];
+
+    r->heap[i] = r->heap[j];
+    r->heap[j] = e;
+    r->heap[i]->heap_idx = i;
+    r->heap[j]->heap_idx = j;
+}
+
+static void heap_up(ZOOM_reactor r, int i)
+{
+    while (i > 0 && r->heap[(i - 1) / 2]->deadline > r->heap[i]->deadline)
+    {
+        heap_swap(r, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void heap_down(ZOOM_reactor r, int i)
+{
+    while (1)
+    {
+        int c = 2 * i + 1;
+
+        if (c >= r->heap_num)
+            break;
+        if (c + 1 < r->heap_num &&
+            r->heap[c + 1]->deadline < r->heap[c]->deadline)
+            c++;
+        if (r->heap[i]->deadline <= r->heap[c]->deadline)
+            break;
+        heap_swap(r, i, c);
+        i = c;
+    }
+}
+
+static void heap_remove(ZOOM_reactor r, struct ZOOM_reactor_entry *e)
+{
+    int i = e->heap_idx;
+
+    if (i < 0)
+        return;
+    e->heap_idx = -1;
+    if (i != --r->heap_num)
+    {
+        r->heap[i] = r->heap[r->heap_num];
+        r->heap[i]->heap_idx = i;
+        heap_up(r, i);
+        heap_down(r, i);
+    }
+}
+
+static void heap_set(ZOOM_reactor r, struct ZOOM_reactor_entry *e,
+                     double deadline)
+{
+    int i = e->heap_idx;
+
+    if (i < 0)
+    {
+        if (r->heap_num == r->heap_max)
+        {
+            r->heap_max = r->heap_max ? 2 * r->heap_max : 64;
+            r->heap = (struct ZOOM_reactor_entry **)
+                xrealloc(r->heap, r->heap_max * sizeof(*r->heap));
+        }
+        i = e->heap_idx = r->heap_num++;
+        r->heap[i] = e;
+    }
+    e->deadline = deadline;
+    heap_up(r, i);
+    heap_down(r, e->heap_idx);
+}
+
+static void changed_push(ZOOM_reactor r, struct ZOOM_reactor_entry *e)
+{
+    if (e->changed)
+        return;
+    e->changed = 1;
+    e->changed_next = 0;
+    e->changed_prev = r->changed_back;
+    if (r->changed_back)
+        r->changed_back->changed_next = e;
+    else
+        r->changed_front = e;
+    r->changed_back = e;
+}
+
+static void changed_remove(ZOOM_reactor r, struct ZOOM_reactor_entry *e)
+{
+    if (!e->changed)
+        return;
+    if (e->changed_prev)
+        e->changed_prev->changed_next = e->changed_next;
+    else
+        r->changed_front = e->changed_next;
+    if (e->changed_next)
+        e->changed_next->changed_prev = e->changed_prev;
+    else
+        r->changed_back = e->changed_prev;
+    e->changed = 0;
+}
+
+static struct ZOOM_reactor_entry *changed_pop(ZOOM_reactor r)
+{
+    struct ZOOM_reactor_entry *e = r->changed_front;
+
+    if (e)
+        changed_remove(r, e);
+    return e;
+}
+
+static void fd_owner_set(ZOOM_reactor r, int fd, struct ZOOM_reactor_entry *e)
+{
+    if (fd >= r->fd_max)
+    {
+        int i = r->fd_max;
+
+        r->fd_max = fd + 64;
+        r->fd_owner = (struct ZOOM_reactor_entry **)
+            xrealloc(r->fd_owner, r->fd_max * sizeof(*r->fd_owner));
+        for (; i < r->fd_max; i++)
+            r->fd_owner[i] = 0;
+    }
+    r->fd_owner[fd] = e;
+}
+
+/* removes socket of e from the epoll set */
+static void entry_unregister(ZOOM_reactor r, struct ZOOM_reactor_entry *e)
+{
+    if (!e->reg_mask)
+        return;
+    /* the comstack may close a socket by itself, for example when
+       trying the next address; the number may then be registered by
+       another connection already */
+    if (e->reg_fd < r->fd_max && r->fd_owner[e->reg_fd] == e)
+    {
+#if HAVE_SYS_EPOLL_H
+        if (r->epoll_fd != -1)
+            epoll_ctl(r->epoll_fd, EPOLL_CTL_DEL, e->reg_fd, 0);
+#endif
+        r->fd_owner[e->reg_fd] = 0;
+    }
+    e->reg_fd = -1;
+    e->reg_mask = 0;
+    r->no_active--;
+}
+
+/* registers socket and mask of connection and sets its deadline */
+static void entry_update(ZOOM_reactor r, struct ZOOM_reactor_entry *e)
+{
+    int fd = ZOOM_connection_get_socket(e->c);
+    int mask = fd == -1 ? 0 : ZOOM_connection_get_mask(e->c);
+
+    if (e->reg_mask && (e->reg_fd != fd || !mask))
+        entry_unregister(r, e);
+    if (mask && mask != e->reg_mask)
+    {
+#if HAVE_SYS_EPOLL_H
+        if (r->epoll_fd != -1)
+        {
+            struct epoll_event ev;
+            int op = e->reg_mask ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+            int res;
+
+            memset(&ev, 0, sizeof(ev));
+            ev.data.ptr = e;
+            if (mask & ZOOM_SELECT_READ)
+                ev.events |= EPOLLIN;
+            if (mask & ZOOM_SELECT_WRITE)
+                ev.events |= EPOLLOUT;
+            /* EPOLLERR and EPOLLHUP are always reported */
+            res = epoll_ctl(r->epoll_fd, op, fd, &ev);
+            /* the socket may have been closed and opened again with
+               the same number (ENOENT), or be registered for a
+               connection whose socket was closed (EEXIST) */
+            if (res < 0 && (errno == ENOENT || errno == EEXIST))
+                res = epoll_ctl(r->epoll_fd, op == EPOLL_CTL_MOD ?
+                                EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev);
+            if (res < 0)
+            {
+                /* rather than waiting forever, let the connection
+                   time out now */
+                yaz_log(YLOG_WARN|YLOG_ERRNO, "epoll_ctl fd=%d", fd);
+                entry_unregister(r, e);
+                heap_remove(r, e);
+                ZOOM_connection_fire_event_timeout(e->c);
+                changed_push(r, e);
+                return;
+            }
+        }
+#endif
+        if (!e->reg_mask)
+            r->no_active++;
+        fd_owner_set(r, fd, e);
+        e->reg_fd = fd;
+        e->reg_mask = mask;
+    }
+    if (mask)
+        heap_set(r, e,
+                 reactor_now() + ZOOM_connection_get_timeout(e->c));
+    else
+        heap_remove(r, e);
+}
+
+void ZOOM_reactor_changed(ZOOM_connection c)
+{
+    struct ZOOM_reactor_entry *e = c->reactor_entry;
+
+    if (e)
+        changed_push(e->reactor, e);
+}
+
+void ZOOM_reactor_socket_close(ZOOM_connection c)
+{
+    struct ZOOM_reactor_entry *e = c->reactor_entry;
+
+    /* must be done before the socket is closed: once closed, the same
+       number may be used by the socket of another connection */
+    if (e)
+    {
+        entry_unregister(e->reactor, e);
+        changed_push(e->reactor, e);
+    }
+}
+
+void ZOOM_reactor_connection_destroy(ZOOM_connection c)
+{
+    struct ZOOM_reactor_entry *e = c->reactor_entry;
+
+    if (e)
+        ZOOM_reactor_remove(e->reactor, c);
+}
+
+ZOOM_API(ZOOM_reactor)
+    ZOOM_reactor_create(void)
+{
+    ZOOM_reactor r = (ZOOM_reactor) xmalloc(sizeof(*r));
+
+    r->epoll_fd = -1;
+#if HAVE_SYS_EPOLL_H
+    r->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (r->epoll_fd < 0)
+    {
+        yaz_log(YLOG_WARN|YLOG_ERRNO, "epoll_create");
+        r->epoll_fd = -1;
+    }
+#endif
+    r->entries = 0;
+    r->changed_front = r->changed_back = 0;
+    r->heap = 0;
+    r->heap_num = r->heap_max = 0;
+    r->no_active = 0;
+    r->fd_owner = 0;
+    r->fd_max = 0;
+    r->fds = 0;
+    r->fds_max = 0;
+    r->log_details = yaz_log_module_level("zoom_details");
+    return r;
+}
+
+ZOOM_API(void)
+    ZOOM_reactor_destroy(ZOOM_reactor r)
+{
+    if (!r)
+        return;
+    while (r->entries)
+        ZOOM_reactor_remove(r, r->entries->c);
+#if HAVE_SYS_EPOLL_H
+    if (r->epoll_fd != -1)
+        close(r->epoll_fd);
+#endif
+    xfree(r->heap);
+    xfree(r->fd_owner);
+    xfree(r->fds);
+    xfree(r);
+}
+
+ZOOM_API(int)
+    ZOOM_reactor_add(ZOOM_reactor r, ZOOM_connection c,
+                     ZOOM_reactor_handler handler, void *data)
+{
+    struct ZOOM_reactor_entry *e;
+
+    if (c->reactor_entry)
+        return -1;
+    e = (struct ZOOM_reactor_entry *) xmalloc(sizeof(*e));
+    e->reactor = r;
+    e->c = c;
+    e->handler = handler;
+    e->data = data;
+    e->reg_fd = -1;
+    e->reg_mask = 0;
+    e->deadline = 0.0;
+    e->heap_idx = -1;
+    e->changed = 0;
+    e->changed_prev = e->changed_next = 0;
+    e->prev = 0;
+    e->next = r->entries;
+    if (r->entries)
+        r->entries->prev = e;
+    r->entries = e;
+    c->reactor_entry = e;
+    changed_push(r, e);
+    yaz_log(r->log_details, "%p ZOOM_reactor_add c=%p", r, c);
+    return 0;
+}
+
+ZOOM_API(void)
+    ZOOM_reactor_remove(ZOOM_reactor r, ZOOM_connection c)
+{
+    struct ZOOM_reactor_entry *e = c->reactor_entry;
+
+    if (!e || e->reactor != r)
+        return;
+    yaz_log(r->log_details, "%p ZOOM_reactor_remove c=%p", r, c);
+    entry_unregister(r, e);
+    heap_remove(r, e);
+    changed_remove(r, e);
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        r->entries = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    c->reactor_entry = 0;
+    xfree(e);
+}
+
+static void reactor_fire(struct ZOOM_reactor_entry *e, int mask)
+{
+    ZOOM_reactor r = e->reactor;
+
+    ZOOM_connection_fire_event_socket(e->c, mask);
+    changed_push(r, e);
+}
+
+/* waits for sockets and fires socket and timeout events */
+static int reactor_wait(ZOOM_reactor r)
+{
+    double now = reactor_now();
+    int timeout_ms = -1;
+    int i, n;
+
+    if (r->heap_num)
+    {
+        double left = r->heap[0]->deadline - now;
+
+        timeout_ms = left > 0.0 ? (int) (left * 1000.0) + 1 : 0;
+    }
+#if HAVE_SYS_EPOLL_H
+    if (r->epoll_fd != -1)
+    {
+        struct epoll_event events[REACTOR_MAX_EVENTS];
+
+        n = epoll_wait(r->epoll_fd, events, REACTOR_MAX_EVENTS, timeout_ms);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                return 0;
+            yaz_log(YLOG_WARN|YLOG_ERRNO, "epoll_wait");
+            return -1;
+        }
+        for (i = 0; i < n; i++)
+        {
+            struct ZOOM_reactor_entry *e =
+                (struct ZOOM_reactor_entry *) events[i].data.ptr;
+            int mask = 0;
+
+            if (events[i].events & EPOLLIN)
+                mask |= ZOOM_SELECT_READ;
+            if (events[i].events & EPOLLOUT)
+                mask |= ZOOM_SELECT_WRITE;
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+                mask |= ZOOM_SELECT_EXCEPT;
+            reactor_fire(e, mask);
+        }
+    }
+    else
+#endif
+    {
+        struct ZOOM_reactor_entry *e;
+        int nfds = 0;
+
+        if (r->fds_max < r->no_active)
+        {
+            r->fds_max = 2 * r->no_active;
+            r->fds = (struct yaz_poll_fd *)
+                xrealloc(r->fds, r->fds_max * sizeof(*r->fds));
+        }
+        for (e = r->entries; e; e = e->next)
+            if (e->reg_mask)
+            {
+                enum yaz_poll_mask input_mask = yaz_poll_none;
+
+                if (e->reg_mask & ZOOM_SELECT_READ)
+                    yaz_poll_add(input_mask, yaz_poll_read);
+                if (e->reg_mask & ZOOM_SELECT_WRITE)
+                    yaz_poll_add(input_mask, yaz_poll_write);
+                if (e->reg_mask & ZOOM_SELECT_EXCEPT)
+                    yaz_poll_add(input_mask, yaz_poll_except);
+                r->fds[nfds].fd = e->reg_fd;
+                r->fds[nfds].input_mask = input_mask;
+                r->fds[nfds].client_data = e;
+                nfds++;
+            }
+        if (timeout_ms < 0)   /* no timeout */
+            n = yaz_poll(r->fds, nfds, -1, 0);
+        else
+            n = yaz_poll(r->fds, nfds, timeout_ms / 1000,
+                         (timeout_ms % 1000) * 1000000);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                return 0;
+            yaz_log(YLOG_WARN|YLOG_ERRNO, "yaz_poll");
+            return -1;
+        }
+        for (i = 0; n > 0 && i < nfds; i++)
+        {
+            enum yaz_poll_mask output_mask = r->fds[i].output_mask;
+            int mask = 0;
+
+            if (output_mask & yaz_poll_read)
+                mask |= ZOOM_SELECT_READ;
+            if (output_mask & yaz_poll_write)
+                mask |= ZOOM_SELECT_WRITE;
+            if (output_mask & yaz_poll_except)
+                mask |= ZOOM_SELECT_EXCEPT;
+            if (mask)
+                reactor_fire((struct ZOOM_reactor_entry *)
+                             r->fds[i].client_data, mask);
+        }
+    }
+    now = reactor_now();
+    while (r->heap_num && r->heap[0]->deadline <= now)
+    {
+        struct ZOOM_reactor_entry *e = r->heap[0];
+
+        heap_remove(r, e);
+        /* a connection that was just served gets a new deadline */
+        if (!e->changed)
+        {
+            yaz_log(r->log_details, "%p ZOOM_reactor timeout c=%p", r, e->c);
+            ZOOM_connection_fire_event_timeout(e->c);
+            changed_push(r, e);
+        }
+    }
+    return 0;
+}
+
+ZOOM_API(ZOOM_connection)
+    ZOOM_reactor_event(ZOOM_reactor r)
+{
+    while (1)
+    {
+        struct ZOOM_reactor_entry *e;
+
+        while ((e = changed_pop(r)))
+        {
+            ZOOM_connection c = e->c;
+
+            if (ZOOM_connection_process(c))
+            {
+                ZOOM_reactor_handler handler = e->handler;
+                void *data = e->data;
+
+                /* visit again: more events may be pending */
+                changed_push(r, e);
+                /* handler may destroy c and e: neither is used after it */
+                if (handler)
+                    (*handler)(data, c, ZOOM_connection_last_event(c));
+                return c;
+            }
+            changed_remove(r, e);
+            entry_update(r, e);
+        }
+        if (!r->no_active)
+            return 0;
+        if (reactor_wait(r) < 0)
+            return 0;
+    }
+}
+
+ZOOM_API(int)
+    ZOOM_reactor_run(ZOOM_reactor r)
+{
+    int no = 0;
+
+    while (ZOOM_reactor_event(r))
+        no++;
+    return no;
+}
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
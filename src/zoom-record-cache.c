@@ -5,6 +5,25 @@
 /**
  * \file zoom-record-cache.c
  * \brief Implements ZOOM record caching
+ *
+ * Records are kept in a hash that grows and shrinks with the number of
+ * records and in a list in least recently used order. A cache may be
+ * private to a result set or shared by the result sets of a connection
+ * or of the whole process (option recordCache), so it has a mutex.
+ * Records are looked up on a key of the search (target, databases,
+ * user and query) and on position, syntax, element set name and schema,
+ * so result sets of the same search share records.
+ *
+ * The records of a response are decoded into one NMEM handle, which
+ * is freed when the last of its records is gone. If the size of these
+ * handles exceeds the limit of the cache (option recordCacheSize), the
+ * least recently used records are removed, whichever result set
+ * fetched them.
+ *
+ * A result set is handed a pin of a record rather than the cache entry.
+ * The pin has the render buffer of the result set and keeps the entry
+ * alive, even if it is removed from the cache, until the result set
+ * has handled its next response.
  */
 #if HAVE_CONFIG_H
 #include <config.h>
@@ -13,6 +32,9 @@
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
+#if YAZ_POSIX_THREADS
+#include <pthread.h>
+#endif
 #include "zoom-p.h"
 
 #include <yaz/diagbib1.h>
@@ -23,6 +45,8 @@
 YAZ_SHPTR_TYPE(WRBUF)
 #endif
 
+#define RECORD_HASH_MIN 64
+
 struct ZOOM_record_p {
     ODR odr;
 #if SHPTR
@@ -40,85 +64,549 @@ struct ZOOM_record_p {
     const char *diag_set;
 };
 
-struct ZOOM_record_cache_p {
-    struct ZOOM_record_p rec;
+/* memory of records of one response */
+struct record_block {
+    NMEM nmem;       /* 0 while the response is being handled */
+    size_t size;
+    int refcount;    /* entries, plus one while being handled */
+    int cached;      /* entries in cache; size is counted while > 0 */
+};
+
+struct record_cache_entry {
+    char key[41];                /* of search; see resultset_key */
+    unsigned key_hash;
+    int pos;
     char *elementSetName;
     char *syntax;
     char *schema;
-    int pos;
-    ZOOM_record_cache next;
+    Z_NamePlusRecord *npr;
+    char *diag_set;
+    char *diag_uri;
+    char *diag_message;
+    char *diag_details;
+    int cached;                  /* in hash and LRU list */
+    struct record_block *block;
+    struct record_pin *pins;
+    struct record_cache_entry *hash_next;
+    struct record_cache_entry *lru_prev;   /* more recently used */
+    struct record_cache_entry *lru_next;   /* less recently used */
 };
 
-static size_t record_hash(int pos)
+/* record as seen by one result set */
+struct record_pin {
+    struct ZOOM_record_p rec;
+    struct record_cache_entry *entry;
+    ZOOM_resultset resultset;
+    int gen;                        /* r->cache_gen when last handed out */
+    struct record_pin *entry_next;  /* pins of same entry */
+    struct record_pin *rs_next;     /* pins of same result set */
+};
+
+struct ZOOM_record_cache_p {
+    YAZ_MUTEX mutex;
+    int refcount;
+    struct record_cache_entry **hash;
+    int hash_size;                 /* power of 2 */
+    int num;
+    struct record_cache_entry *lru_first;
+    struct record_cache_entry *lru_last;
+    size_t bytes;
+    size_t max_bytes;              /* 0 for no limit */
+    unsigned resets;               /* for keys of sorted result sets */
+    Odr_int hits;
+    Odr_int misses;
+    Odr_int evictions;
+};
+
+static ZOOM_record_cache process_cache = 0;
+#if YAZ_POSIX_THREADS
+static pthread_once_t process_cache_once = PTHREAD_ONCE_INIT;
+#endif
+
+static void hash_alloc(ZOOM_record_cache rc, int size)
 {
-    if (pos < 0)
-        pos = 0;
-    return pos % RECORD_HASH_SIZE;
+    int i;
+
+    rc->hash = (struct record_cache_entry **)
+        xmalloc(sizeof(*rc->hash) * size);
+    for (i = 0; i < size; i++)
+        rc->hash[i] = 0;
+    rc->hash_size = size;
 }
 
-static ZOOM_record record_cache_add(ZOOM_resultset r,
-                                    Z_NamePlusRecord *npr,
-                                    int pos,
-                                    const char *syntax,
-                                    const char *elementSetName,
-                                    const char *schema,
-                                    Z_SRW_diagnostic *diag)
+static ZOOM_record_cache cache_create(void)
 {
-    ZOOM_record_cache rc = 0;
+    ZOOM_record_cache rc = (ZOOM_record_cache) xmalloc(sizeof(*rc));
+
+    rc->mutex = 0;
+    yaz_mutex_create(&rc->mutex);
+    rc->refcount = 1;
+    hash_alloc(rc, RECORD_HASH_MIN);
+    rc->num = 0;
+    rc->lru_first = rc->lru_last = 0;
+    rc->bytes = 0;
+    rc->max_bytes = 0;
+    rc->resets = 0;
+    rc->hits = rc->misses = rc->evictions = 0;
+    return rc;
+}
 
-    ZOOM_Event event = ZOOM_Event_create(ZOOM_EVENT_RECV_RECORD);
-    ZOOM_connection_put_event(r->connection, event);
+static void process_cache_create(void)
+{
+    process_cache = cache_create();
+}
+
+static unsigned key_hash(const char *key)
+{
+    unsigned h = 0;
 
-    for (rc = r->record_hash[record_hash(pos)]; rc; rc = rc->next)
+    while (*key)
+        h = h * 31 + (unsigned char) *key++;
+    return h;
+}
+
+static unsigned entry_hash(ZOOM_record_cache rc, unsigned kh, int pos)
+{
+    unsigned h = kh + (unsigned) pos * 2654435761U;
+
+    return h & (rc->hash_size - 1);
+}
+
+static void hash_resize(ZOOM_record_cache rc, int size)
+{
+    struct record_cache_entry **old_hash = rc->hash;
+    int i, old_size = rc->hash_size;
+
+    hash_alloc(rc, size);
+    for (i = 0; i < old_size; i++)
     {
-        if (pos == rc->pos
-            && yaz_strcmp_null(schema, rc->schema) == 0
-            && yaz_strcmp_null(elementSetName,rc->elementSetName) == 0
-            && yaz_strcmp_null(syntax, rc->syntax) == 0)
-            break;
+        struct record_cache_entry *e = old_hash[i];
+
+        while (e)
+        {
+            struct record_cache_entry *e_next = e->hash_next;
+            unsigned h = entry_hash(rc, e->key_hash, e->pos);
+
+            e->hash_next = rc->hash[h];
+            rc->hash[h] = e;
+            e = e_next;
+        }
     }
+    xfree(old_hash);
+}
+
+static void lru_unlink(ZOOM_record_cache rc, struct record_cache_entry *e)
+{
+    if (e->lru_prev)
+        e->lru_prev->lru_next = e->lru_next;
+    else
+        rc->lru_first = e->lru_next;
+    if (e->lru_next)
+        e->lru_next->lru_prev = e->lru_prev;
+    else
+        rc->lru_last = e->lru_prev;
+}
+
+static void lru_push(ZOOM_record_cache rc, struct record_cache_entry *e)
+{
+    e->lru_prev = 0;
+    e->lru_next = rc->lru_first;
+    if (rc->lru_first)
+        rc->lru_first->lru_prev = e;
+    else
+        rc->lru_last = e;
+    rc->lru_first = e;
+}
+
+static struct record_block *block_create(void)
+{
+    struct record_block *b = (struct record_block *) xmalloc(sizeof(*b));
+
+    b->nmem = 0;
+    b->size = 0;
+    b->refcount = 1;
+    b->cached = 0;
+    return b;
+}
+
+static void block_release(struct record_block *b)
+{
+    if (b && --b->refcount == 0)
+    {
+        if (b->nmem)
+            nmem_destroy(b->nmem);
+        xfree(b);
+    }
+}
+
+static void entry_free(struct record_cache_entry *e)
+{
+    block_release(e->block);
+    xfree(e->elementSetName);
+    xfree(e->syntax);
+    xfree(e->schema);
+    xfree(e->diag_set);
+    xfree(e->diag_uri);
+    xfree(e->diag_message);
+    xfree(e->diag_details);
+    xfree(e);
+}
+
+/* removes entry from cache and frees it unless pinned; mutex of cache
+   must be held */
+static void entry_remove(ZOOM_record_cache rc, struct record_cache_entry *e)
+{
+    struct record_cache_entry **ep =
+        &rc->hash[entry_hash(rc, e->key_hash, e->pos)];
+    struct record_block *b = e->block;
+
+    for (; *ep; ep = &(*ep)->hash_next)
+        if (*ep == e)
+        {
+            *ep = e->hash_next;
+            break;
+        }
+    lru_unlink(rc, e);
+    e->cached = 0;
+    if (--b->cached == 0 && b->nmem)
+        rc->bytes -= b->size;
+    rc->bytes -= sizeof(*e);
+    rc->num--;
+    if (!e->pins)
+        entry_free(e);
+    if (rc->num * 8 < rc->hash_size && rc->hash_size > RECORD_HASH_MIN)
+        hash_resize(rc, rc->hash_size / 2);
+}
+
+void ZOOM_record_cache_destroy(ZOOM_record_cache rc)
+{
+    int refcount;
+
     if (!rc)
+        return;
+    yaz_mutex_enter(rc->mutex);
+    refcount = --rc->refcount;
+    yaz_mutex_leave(rc->mutex);
+    if (refcount == 0)
+    {
+        /* result sets have released their pins */
+        while (rc->lru_first)
+            entry_remove(rc, rc->lru_first);
+        assert(rc->num == 0);
+        xfree(rc->hash);
+        yaz_mutex_destroy(&rc->mutex);
+        xfree(rc);
+    }
+}
+
+static void ZOOM_record_release(ZOOM_record rec);
+
+static void pin_free(struct record_pin *p)
+{
+    struct record_cache_entry *e = p->entry;
+    struct record_pin **pp = &e->pins;
+
+    for (; *pp; pp = &(*pp)->entry_next)
+        if (*pp == p)
+        {
+            *pp = p->entry_next;
+            break;
+        }
+    ZOOM_record_release(&p->rec);
+    xfree(p);
+    if (!e->cached && !e->pins)
+        entry_free(e);
+}
+
+/* releases pins of result set r; all or those of records removed from
+   the cache and handed out before generation gen */
+static void resultset_unpin(ZOOM_resultset r, int all, int gen)
+{
+    struct record_pin **pp = &r->cache_pins;
+
+    while (*pp)
+    {
+        struct record_pin *p = *pp;
+
+        if (all || (!p->entry->cached && p->gen < gen))
+        {
+            *pp = p->rs_next;
+            pin_free(p);
+        }
+        else
+            pp = &p->rs_next;
+    }
+}
+
+static ZOOM_record pin_get(ZOOM_resultset r, struct record_cache_entry *e)
+{
+    struct record_pin *p = e->pins;
+
+    for (; p; p = p->entry_next)
+        if (p->resultset == r)
+            break;
+    if (!p)
     {
-        rc = (ZOOM_record_cache) odr_malloc(r->odr, sizeof(*rc));
-        rc->rec.odr = 0;
+        p = (struct record_pin *) xmalloc(sizeof(*p));
+        p->rec.odr = 0;
 #if SHPTR
         YAZ_SHPTR_INC(r->record_wrbuf);
-        rc->rec.record_wrbuf = r->record_wrbuf;
+        p->rec.record_wrbuf = r->record_wrbuf;
 #else
-        rc->rec.wrbuf = 0;
+        p->rec.wrbuf = 0;
 #endif
-        rc->elementSetName = odr_strdup_null(r->odr, elementSetName);
+        p->rec.npr = e->npr;
+        p->rec.schema = e->schema;
+        p->rec.diag_set = e->diag_set;
+        p->rec.diag_uri = e->diag_uri;
+        p->rec.diag_message = e->diag_message;
+        p->rec.diag_details = e->diag_details;
+        p->entry = e;
+        p->resultset = r;
+        p->entry_next = e->pins;
+        e->pins = p;
+        p->rs_next = r->cache_pins;
+        r->cache_pins = p;
+    }
+    p->gen = r->cache_gen;
+    return &p->rec;
+}
 
-        rc->syntax = odr_strdup_null(r->odr, syntax);
+static int entry_match(struct record_cache_entry *e, const char *key,
+                       int pos, const char *syntax,
+                       const char *elementSetName, const char *schema)
+{
+    return pos == e->pos && !strcmp(key, e->key)
+        && yaz_strcmp_null(schema, e->schema) == 0
+        && yaz_strcmp_null(elementSetName, e->elementSetName) == 0
+        && yaz_strcmp_null(syntax, e->syntax) == 0;
+}
 
-        rc->schema = odr_strdup_null(r->odr, schema);
+static struct record_cache_entry *entry_lookup(ZOOM_record_cache rc,
+                                               const char *key, int pos,
+                                               const char *syntax,
+                                               const char *elementSetName,
+                                               const char *schema)
+{
+    struct record_cache_entry *e =
+        rc->hash[entry_hash(rc, key_hash(key), pos)];
+
+    for (; e; e = e->hash_next)
+        if (entry_match(e, key, pos, syntax, elementSetName, schema))
+            break;
+    return e;
+}
+
+/* removes least recently used records beyond the limit, but not those
+   of block keep */
+static void cache_evict(ZOOM_record_cache rc, struct record_block *keep)
+{
+    struct record_cache_entry *e = rc->lru_last;
 
-        rc->pos = pos;
-        rc->next = r->record_hash[record_hash(pos)];
-        r->record_hash[record_hash(pos)] = rc;
+    while (e && rc->max_bytes && rc->bytes > rc->max_bytes)
+    {
+        struct record_cache_entry *e_prev = e->lru_prev;
 
+        if (e->block != keep)
+        {
+            entry_remove(rc, e);
+            rc->evictions++;
+        }
+        e = e_prev;
     }
+}
+
+static char *xstrdup_null(const char *s)
+{
+    return s ? xstrdup(s) : 0;
+}
 
-    rc->rec.npr = npr;
-    rc->rec.schema = odr_strdup_null(r->odr, schema);
-    rc->rec.diag_set = 0;
-    rc->rec.diag_uri = 0;
-    rc->rec.diag_message = 0;
-    rc->rec.diag_details = 0;
+/* adds record to cache in block b, replacing an earlier one, and hands
+   it to r; mutex of cache must be held */
+static ZOOM_record entry_add(ZOOM_record_cache rc, ZOOM_resultset r,
+                             struct record_block *b,
+                             Z_NamePlusRecord *npr, int pos,
+                             const char *syntax, const char *elementSetName,
+                             const char *schema, Z_SRW_diagnostic *diag)
+{
+    struct record_cache_entry *e;
+    unsigned h;
+
+    e = entry_lookup(rc, r->cache_key, pos, syntax, elementSetName, schema);
+    if (e)
+        entry_remove(rc, e);
+
+    e = (struct record_cache_entry *) xmalloc(sizeof(*e));
+    strcpy(e->key, r->cache_key);
+    e->key_hash = key_hash(e->key);
+    e->pos = pos;
+    e->elementSetName = xstrdup_null(elementSetName);
+    e->syntax = xstrdup_null(syntax);
+    e->schema = xstrdup_null(schema);
+    e->npr = npr;
+    e->diag_set = 0;
+    e->diag_uri = 0;
+    e->diag_message = 0;
+    e->diag_details = 0;
     if (diag)
     {
         if (diag->uri)
         {
             char *cp;
-            rc->rec.diag_set = odr_strdup(r->odr, diag->uri);
-            if ((cp = strrchr(rc->rec.diag_set, '/')))
+
+            e->diag_set = xstrdup(diag->uri);
+            if ((cp = strrchr(e->diag_set, '/')))
                 *cp = '\0';
-            rc->rec.diag_uri = odr_strdup(r->odr, diag->uri);
+            e->diag_uri = xstrdup(diag->uri);
         }
-        rc->rec.diag_message = odr_strdup_null(r->odr, diag->message);
-        rc->rec.diag_details = odr_strdup_null(r->odr, diag->details);
+        e->diag_message = xstrdup_null(diag->message);
+        e->diag_details = xstrdup_null(diag->details);
     }
-    return &rc->rec;
+    e->cached = 1;
+    e->block = b;
+    b->refcount++;
+    if (b->cached++ == 0 && b->nmem)
+        rc->bytes += b->size;
+    e->pins = 0;
+
+    if (rc->num >= 2 * rc->hash_size)
+        hash_resize(rc, 2 * rc->hash_size);
+    h = entry_hash(rc, e->key_hash, pos);
+    e->hash_next = rc->hash[h];
+    rc->hash[h] = e;
+    lru_push(rc, e);
+    rc->num++;
+    rc->bytes += sizeof(*e);
+    return pin_get(r, e);
+}
+
+/* key of the search of r, so that result sets of the same search find
+   the same records */
+static void resultset_key(ZOOM_resultset r)
+{
+    ZOOM_connection c = r->connection;
+    WRBUF w = wrbuf_alloc();
+    WRBUF sha1 = wrbuf_alloc();
+    int i;
+
+    if (c)
+    {
+        wrbuf_printf(w, "%s;%s;%s;",
+                     c->host_port ? c->host_port : "",
+                     c->user ? c->user : "", c->group ? c->group : "");
+        if (c->password)
+            wrbuf_puts(w, c->password);
+    }
+    wrbuf_puts(w, ";");
+    for (i = 0; i < r->num_databaseNames; i++)
+    {
+        wrbuf_puts(w, r->databaseNames[i]);
+        wrbuf_puts(w, "+");
+    }
+    wrbuf_puts(w, ";");
+    if (r->options)
+    {
+        const char *extra_args = ZOOM_options_get(r->options, "extraArgs");
+
+        if (extra_args)
+            wrbuf_puts(w, extra_args);
+    }
+    wrbuf_puts(w, ";");
+    if (r->query)
+        ZOOM_query_get_hash(r->query, w);
+    wrbuf_sha1_puts(sha1, wrbuf_cstr(w), 1);
+    strcpy(r->cache_key, wrbuf_cstr(sha1));
+    wrbuf_destroy(sha1);
+    wrbuf_destroy(w);
+}
+
+void ZOOM_record_cache_attach(ZOOM_resultset r)
+{
+    const char *scope = ZOOM_options_get(r->options, "recordCache");
+    const char *max_bytes = ZOOM_options_get(r->options, "recordCacheSize");
+    ZOOM_record_cache rc = 0;
+    int shared = 0;
+
+    if (scope && !strcmp(scope, "process"))
+    {
+#if YAZ_POSIX_THREADS
+        pthread_once(&process_cache_once, process_cache_create);
+#else
+        if (!process_cache)
+            process_cache_create();
+#endif
+        rc = process_cache;
+    }
+    else if (scope && !strcmp(scope, "connection") && r->connection)
+    {
+        if (!r->connection->record_cache)
+            r->connection->record_cache = cache_create();
+        rc = r->connection->record_cache;
+    }
+    if (rc)
+    {
+        yaz_mutex_enter(rc->mutex);
+        rc->refcount++;
+        yaz_mutex_leave(rc->mutex);
+        shared = 1;
+    }
+    else
+        rc = cache_create();
+    if (max_bytes)
+    {
+        int v = ZOOM_options_get_int(r->options, "recordCacheSize", 0);
+
+        /* a shared cache gets the largest size asked for */
+        yaz_mutex_enter(rc->mutex);
+        if (!shared)
+            rc->max_bytes = v > 0 ? v : 0;
+        else if (v > 0 && (size_t) v > rc->max_bytes)
+            rc->max_bytes = v;
+        yaz_mutex_leave(rc->mutex);
+    }
+    ZOOM_record_cache_detach(r);
+    resultset_key(r);
+    r->record_cache = rc;
+}
+
+void ZOOM_record_cache_detach(ZOOM_resultset r)
+{
+    ZOOM_record_cache rc = r->record_cache;
+
+    if (!rc)
+        return;
+    yaz_mutex_enter(rc->mutex);
+    resultset_unpin(r, 1, 0);
+    block_release(r->cache_block);
+    r->cache_block = 0;
+    yaz_mutex_leave(rc->mutex);
+    ZOOM_record_cache_destroy(rc);
+    r->record_cache = 0;
+}
+
+void ZOOM_record_cache_adopt(ZOOM_resultset r, NMEM nmem, size_t extra)
+{
+    ZOOM_record_cache rc = r->record_cache;
+    struct record_block *b = r->cache_block;
+
+    if (!rc || !b)
+    {
+        nmem_transfer(odr_getmem(r->odr), nmem);
+        nmem_destroy(nmem);
+        return;
+    }
+    yaz_mutex_enter(rc->mutex);
+    r->cache_block = 0;
+    b->nmem = nmem;
+    b->size = nmem_total(nmem) + extra;
+    if (b->cached)
+        rc->bytes += b->size;
+    cache_evict(rc, b);
+    block_release(b);
+    /* records of earlier responses are no longer in use by r */
+    resultset_unpin(r, 0, r->cache_gen);
+    r->cache_gen++;
+    yaz_mutex_leave(rc->mutex);
 }
 
 void ZOOM_record_cache_add(ZOOM_resultset r, Z_NamePlusRecord *npr,
@@ -127,31 +615,95 @@ void ZOOM_record_cache_add(ZOOM_resultset r, Z_NamePlusRecord *npr,
                            const char *schema,
                            Z_SRW_diagnostic *diag)
 {
-    record_cache_add(r, npr, pos, syntax, elementSetName, schema, diag);
+    ZOOM_record_cache rc;
+
+    ZOOM_Event event = ZOOM_Event_create(ZOOM_EVENT_RECV_RECORD);
+    ZOOM_connection_put_event(r->connection, event);
+
+    if (!r->record_cache)
+        ZOOM_record_cache_attach(r);
+    rc = r->record_cache;
+    yaz_mutex_enter(rc->mutex);
+    if (!r->cache_block)
+        r->cache_block = block_create();
+    entry_add(rc, r, r->cache_block, npr, pos, syntax, elementSetName,
+              schema, diag);
+    yaz_mutex_leave(rc->mutex);
     ZOOM_memcached_add(r, npr, pos, syntax, elementSetName, schema, diag);
 }
 
+static ZOOM_record record_cache_lookup(ZOOM_resultset r, int pos,
+                                       const char *syntax,
+                                       const char *elementSetName,
+                                       const char *schema, int stat)
+{
+    ZOOM_record_cache rc = r->record_cache;
+    struct record_cache_entry *e;
+    ZOOM_record rec = 0;
+
+    if (!rc)
+        return 0;
+    yaz_mutex_enter(rc->mutex);
+    e = entry_lookup(rc, r->cache_key, pos, syntax, elementSetName, schema);
+    if (e)
+    {
+        lru_unlink(rc, e);
+        lru_push(rc, e);
+        rec = pin_get(r, e);
+    }
+    else
+    {
+        /* removed from cache, but still held by r */
+        struct record_pin *p = r->cache_pins;
+
+        for (; p; p = p->rs_next)
+            if (entry_match(p->entry, r->cache_key, pos, syntax,
+                            elementSetName, schema))
+            {
+                p->gen = r->cache_gen;
+                rec = &p->rec;
+                break;
+            }
+    }
+    if (stat)
+    {
+        if (rec)
+            rc->hits++;
+        else
+            rc->misses++;
+    }
+    yaz_mutex_leave(rc->mutex);
+    return rec;
+}
+
 ZOOM_record ZOOM_record_cache_lookup_i(ZOOM_resultset r, int pos,
                                        const char *syntax,
                                        const char *elementSetName,
-                                       const char *schema)
+                                       const char *schema, int stat)
 {
-    ZOOM_record_cache rc;
+    return record_cache_lookup(r, pos, syntax, elementSetName, schema, stat);
+}
+
+/* copy of npr in memory of its own */
+static Z_NamePlusRecord *npr_dup(Z_NamePlusRecord *npr, NMEM *nmem)
+{
+    ODR odr_enc = odr_createmem(ODR_ENCODE);
+    ODR odr_dec = odr_createmem(ODR_DECODE);
+    Z_NamePlusRecord *n = 0;
+    char *buf;
+    int size;
 
-    for (rc = r->record_hash[record_hash(pos)]; rc; rc = rc->next)
+    if (z_NamePlusRecord(odr_enc, &npr, 0, 0))
     {
-        if (pos == rc->pos)
-        {
-            if (yaz_strcmp_null(schema, rc->schema))
-                continue;
-            if (yaz_strcmp_null(elementSetName,rc->elementSetName))
-                continue;
-            if (yaz_strcmp_null(syntax, rc->syntax))
-                continue;
-            return &rc->rec;
-        }
+        buf = odr_getbuf(odr_enc, &size, 0);
+        odr_setbuf(odr_dec, buf, size, 0);
+        if (!z_NamePlusRecord(odr_dec, &n, 0, 0))
+            n = 0;
     }
-    return 0;
+    *nmem = odr_extract_mem(odr_dec);
+    odr_destroy(odr_dec);
+    odr_destroy(odr_enc);
+    return n;
 }
 
 ZOOM_record ZOOM_record_cache_lookup(ZOOM_resultset r, int pos,
@@ -160,8 +712,8 @@ ZOOM_record ZOOM_record_cache_lookup(ZOOM_resultset r, int pos,
                                      const char *schema)
 {
     Z_NamePlusRecord *npr;
-    ZOOM_record rec = ZOOM_record_cache_lookup_i(r, pos, syntax,
-                                                 elementSetName, schema);
+    ZOOM_record rec = record_cache_lookup(r, pos, syntax,
+                                          elementSetName, schema, 0);
     if (rec)
     {
         ZOOM_Event event = ZOOM_Event_create(ZOOM_EVENT_RECV_RECORD);
@@ -169,10 +721,67 @@ ZOOM_record ZOOM_record_cache_lookup(ZOOM_resultset r, int pos,
         return rec;
     }
     npr = ZOOM_memcached_lookup(r, pos, syntax, elementSetName, schema);
-    if (npr)
-        return record_cache_add(r, npr, pos, syntax, elementSetName,
-                                schema, 0);
-    return 0;
+    if (npr && r->record_cache)
+    {
+        ZOOM_record_cache rc = r->record_cache;
+        struct record_block *b;
+        ZOOM_Event event;
+        NMEM nmem;
+
+        /* decoded into r->odr; other result sets need a copy */
+        npr = npr_dup(npr, &nmem);
+        if (!npr)
+        {
+            nmem_destroy(nmem);
+            return 0;
+        }
+        yaz_mutex_enter(rc->mutex);
+        b = block_create();
+        b->nmem = nmem;
+        b->size = nmem_total(nmem);
+        rec = entry_add(rc, r, b, npr, pos, syntax, elementSetName,
+                        schema, 0);
+        cache_evict(rc, b);
+        block_release(b);
+        yaz_mutex_leave(rc->mutex);
+
+        event = ZOOM_Event_create(ZOOM_EVENT_RECV_RECORD);
+        ZOOM_connection_put_event(r->connection, event);
+    }
+    return rec;
+}
+
+const char *ZOOM_record_cache_option_get(ZOOM_resultset r, const char *key)
+{
+    ZOOM_record_cache rc = r->record_cache;
+    Odr_int v;
+    char buf[40];
+
+    if (strncmp(key, "recordCache", 11))
+        return 0;
+    if (rc)
+        yaz_mutex_enter(rc->mutex);
+    if (!strcmp(key, "recordCacheHits"))
+        v = rc ? rc->hits : 0;
+    else if (!strcmp(key, "recordCacheMisses"))
+        v = rc ? rc->misses : 0;
+    else if (!strcmp(key, "recordCacheEvictions"))
+        v = rc ? rc->evictions : 0;
+    else if (!strcmp(key, "recordCacheBytes"))
+        v = rc ? (Odr_int) rc->bytes : 0;
+    else if (!strcmp(key, "recordCacheRecords"))
+        v = rc ? rc->num : 0;
+    else
+    {
+        if (rc)
+            yaz_mutex_leave(rc->mutex);
+        return 0;
+    }
+    if (rc)
+        yaz_mutex_leave(rc->mutex);
+    sprintf(buf, ODR_INT_PRINTF, v);
+    ZOOM_options_set(r->options, key, buf);
+    return ZOOM_options_get(r->options, key);
 }
 
 ZOOM_API(ZOOM_record)
@@ -227,16 +836,22 @@ static void ZOOM_record_release(ZOOM_record rec)
 ZOOM_API(void)
     ZOOM_resultset_cache_reset(ZOOM_resultset r)
 {
-    int i;
-    for (i = 0; i<RECORD_HASH_SIZE; i++)
-    {
-        ZOOM_record_cache rc;
-        for (rc = r->record_hash[i]; rc; rc = rc->next)
-        {
-            ZOOM_record_release(&rc->rec);
-        }
-        r->record_hash[i] = 0;
-    }
+    ZOOM_record_cache rc = r->record_cache;
+    WRBUF w, sha1;
+
+    if (!rc)
+        return;
+    /* records of r change, so it no longer shares those of its search */
+    w = wrbuf_alloc();
+    sha1 = wrbuf_alloc();
+    yaz_mutex_enter(rc->mutex);
+    resultset_unpin(r, 1, 0);
+    wrbuf_printf(w, "%s;%u", r->cache_key, rc->resets++);
+    wrbuf_sha1_puts(sha1, wrbuf_cstr(w), 1);
+    strcpy(r->cache_key, wrbuf_cstr(sha1));
+    yaz_mutex_leave(rc->mutex);
+    wrbuf_destroy(sha1);
+    wrbuf_destroy(w);
 }
 
 
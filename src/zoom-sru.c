@@ -381,8 +381,7 @@ static zoom_ret handle_srw_response(ZOOM_connection c,
             *count = 0;
         *start += i;
         nmem = odr_extract_mem(c->odr_in);
-        nmem_transfer(odr_getmem(resultset->odr), nmem);
-        nmem_destroy(nmem);
+        ZOOM_record_cache_adopt(resultset, nmem, 0);
 
         return ZOOM_connection_srw_send_search(c);
     }
@@ -752,6 +752,8 @@ static zoom_ret Z3950_send_search(ZOOM_connection c)
         *search_req->smallSetUpperBound = 1;
         *search_req->mediumSetPresentNumber =
             r->step>0 ? r->step : c->tasks->u.search.count;
+        c->tasks->u.search.requested =
+            (int) *search_req->mediumSetPresentNumber;
     }
     else
     {
@@ -1413,6 +1415,47 @@ static void handle_Z3950_scan_response(ZOOM_connection c, Z_ScanResponse *res)
     nmem_destroy(nmem);
 }
 
+/* keeps average size of records in responses. If the target sends
+   several records beyond the preferredMessageSize, it ignores it, and
+   so do we */
+static void record_size_update(ZOOM_connection c, ZOOM_resultset r,
+                               int apdu_len, int num_records)
+{
+    if (num_records <= 0 || r->record_size < 0)
+        return;
+    if (apdu_len > c->message_size && num_records > 1)
+        r->record_size = -1;
+    else if (r->record_size == 0)
+        r->record_size = apdu_len / num_records;
+    else
+        r->record_size = (3 * r->record_size + apdu_len / num_records) / 4;
+    if (r->record_size == 0)
+        r->record_size = 1;
+}
+
+static int record_exceeds_message(Z_NamePlusRecord *npr)
+{
+    return npr->which == Z_NamePlusRecord_surrogateDiagnostic &&
+        npr->u.surrogateDiagnostic->which == Z_DiagRec_defaultFormat &&
+        *npr->u.surrogateDiagnostic->u.defaultFormat->condition ==
+        YAZ_BIB1_RECORD_EXCEEDS_PREFERRED_MESSAGE_SIZE;
+}
+
+int ZOOM_Z3950_present_fit(ZOOM_connection c, ZOOM_resultset r, int count)
+{
+    /* leave 1/4 for records larger than average */
+    if (c->proto == PROTO_Z3950 && r->record_size > 0)
+    {
+        int fit = (c->message_size - c->message_size / 4) / r->record_size;
+
+        if (fit < 1)
+            fit = 1;
+        if (count > fit)
+            count = fit;
+    }
+    return count;
+}
+
 static void handle_Z3950_records(ZOOM_connection c, Z_Records *sr,
                                  int present_phase)
 {
@@ -1451,15 +1494,42 @@ static void handle_Z3950_records(ZOOM_connection c, Z_Records *sr,
             *count = 0;
         if (sr && sr->which == Z_Records_DBOSD)
         {
-            int i;
-            NMEM nmem = odr_extract_mem(c->odr_in);
+            int i, first_big = -1;
             Z_NamePlusRecordList *p =
                 sr->u.databaseOrSurDiagnostics;
+            int apdu_len = odr_offset(c->odr_in);
+            Z_NamePlusRecord *myrec = 0;
+            NMEM nmem;
+
+            record_size_update(c, resultset, apdu_len, p->num_records);
+            if (present_phase && p->num_records == 0)
+            {
+                /* present response and we didn't get any records! */
+                myrec = zget_surrogateDiagRec(
+                    c->odr_in, 0,
+                    YAZ_BIB1_SYSTEM_ERROR_IN_PRESENTING_RECORDS,
+                    "ZOOM C generated. Present phase and no records");
+            }
+            nmem = odr_extract_mem(c->odr_in);
             for (i = 0; i < p->num_records; i++)
             {
+                if (c->tasks->u.search.requested > 1 &&
+                    record_exceeds_message(p->records[i]))
+                {
+                    /* ask for it by itself; target may then send it */
+                    if (first_big < 0)
+                        first_big = i;
+                    continue;
+                }
                 ZOOM_record_cache_add(resultset, p->records[i], i + *start,
                                       syntax, elementSetName, schema, 0);
             }
+            if (first_big >= 0)
+            {
+                /* records cached beyond it are skipped by next present */
+                c->tasks->u.search.fetch_one = 1;
+                i = first_big;
+            }
             *count -= i;
             if (*count < 0)
                 *count = 0;
@@ -1468,32 +1538,29 @@ static void handle_Z3950_records(ZOOM_connection c, Z_Records *sr,
                     "handle_records resultset=%p start=%d count=%d",
                     resultset, *start, *count);
 
-            /* transfer our response to search_nmem .. we need it later */
-            nmem_transfer(odr_getmem(resultset->odr), nmem);
-            nmem_destroy(nmem);
-            if (present_phase && p->num_records == 0)
+            if (myrec)
             {
-                /* present response and we didn't get any records! */
-                Z_NamePlusRecord *myrec =
-                    zget_surrogateDiagRec(
-                        resultset->odr, 0,
-                        YAZ_BIB1_SYSTEM_ERROR_IN_PRESENTING_RECORDS,
-                        "ZOOM C generated. Present phase and no records");
                 ZOOM_record_cache_add(resultset, myrec, *start,
                                       syntax, elementSetName, schema, 0);
                 *count = 0;
             }
+            /* records refer to response; buffer too if zero-copy */
+            ZOOM_record_cache_adopt(resultset, nmem,
+                                    c->zero_copy_decode ? apdu_len : 0);
         }
         else if (present_phase)
         {
             /* present response and we didn't get any records! */
             Z_NamePlusRecord *myrec =
                 zget_surrogateDiagRec(
-                    resultset->odr, 0,
+                    c->odr_in, 0,
                     YAZ_BIB1_SYSTEM_ERROR_IN_PRESENTING_RECORDS,
                     "ZOOM C generated: Present response and no records");
+            NMEM nmem = odr_extract_mem(c->odr_in);
+
             ZOOM_record_cache_add(resultset, myrec, *start,
                                   syntax, elementSetName, schema, 0);
+            ZOOM_record_cache_adopt(resultset, nmem, 0);
             *count = 0;
         }
     }
@@ -1559,6 +1626,14 @@ static zoom_ret Z3950_send_present(ZOOM_connection c)
     if (*req->numberOfRecordsRequested + c->tasks->u.search.start > resultset->size)
         *req->numberOfRecordsRequested = resultset->size - c->tasks->u.search.start;
     assert(*req->numberOfRecordsRequested > 0);
+    *req->numberOfRecordsRequested = ZOOM_Z3950_present_fit(
+        c, resultset, (int) *req->numberOfRecordsRequested);
+    if (c->tasks->u.search.fetch_one)
+    {
+        *req->numberOfRecordsRequested = 1;
+        c->tasks->u.search.fetch_one = 0;
+    }
+    c->tasks->u.search.requested = (int) *req->numberOfRecordsRequested;
 
     if (syntax && *syntax)
         req->preferredRecordSyntax =
@@ -1751,6 +1826,11 @@ void ZOOM_handle_Z3950_apdu(ZOOM_connection c, Z_APDU *apdu)
             if (ODR_MASK_GET(initrs->options, Z_Options_namedResultSets) &&
                 ODR_MASK_GET(initrs->protocolVersion, Z_ProtocolVersion_3))
                 c->support_named_resultsets = 1;
+            if (initrs->preferredMessageSize &&
+                *initrs->preferredMessageSize > 0 &&
+                *initrs->preferredMessageSize < c->message_size)
+                c->message_size = (int) *initrs->preferredMessageSize;
+            c->init_done = 1;
             if (c->tasks)
             {
                 assert(c->tasks->which == ZOOM_TASK_CONNECT);
@@ -0,0 +1,214 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+
+/**
+ * \file bench_accept.c
+ * \brief GFS connection rate benchmark
+ *
+ * A number of client threads each repeatedly connect to a server, do a
+ * Z39.50 init and disconnect. The number of connections per second is
+ * reported.
+ *
+ * With -s the benchmark starts the server itself (typically
+ * ../ztest/yaz-ztest) with 1, 4 and 16 session threads, in the shared
+ * listener mode (-T N) and in the SO_REUSEPORT mode (-T N -R).
+ * Otherwise it measures the server given by -a.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+
+#include <yaz/comstack.h>
+#include <yaz/options.h>
+#include <yaz/proto.h>
+#include <yaz/thread_create.h>
+#include <yaz/timing.h>
+
+static const char *addr = "tcp:localhost:9999";
+static int connections = 2000;
+
+/* connect, init and close; returns 0 on success */
+static int session(void)
+{
+    ODR odr = odr_createmem(ODR_ENCODE);
+    Z_APDU *apdu = zget_APDU(odr, Z_APDU_initRequest);
+    void *ap;
+    COMSTACK cs = cs_create_host(addr, 1, &ap);
+    char *buf = 0;
+    int size = 0, len, ret = -1;
+
+    if (cs && cs_connect(cs, ap) >= 0 && z_APDU(odr, &apdu, 0, 0))
+    {
+        char *pdu = odr_getbuf(odr, &len, 0);
+        if (cs_put(cs, pdu, len) >= 0 && cs_get(cs, &buf, &size) > 0)
+            ret = 0;
+    }
+    if (cs)
+        cs_close(cs);
+    xfree(buf);
+    odr_destroy(odr);
+    return ret;
+}
+
+static void *client_handler(void *p)
+{
+    int *failed = (int *) p;
+    int i;
+
+    for (i = 0; i < connections; i++)
+        if (session())
+            (*failed)++;
+    return 0;
+}
+
+static void bench(const char *name, int no_clients)
+{
+    yaz_thread_t *tids = (yaz_thread_t *)
+        xmalloc(sizeof(*tids) * no_clients);
+    int *failed = (int *) xmalloc(sizeof(*failed) * no_clients);
+    yaz_timing_t tim = yaz_timing_create();
+    double real;
+    int i, no_failed = 0;
+
+    yaz_timing_start(tim);
+    for (i = 0; i < no_clients; i++)
+    {
+        failed[i] = 0;
+        tids[i] = yaz_thread_create(client_handler, failed + i);
+    }
+    for (i = 0; i < no_clients; i++)
+    {
+        yaz_thread_join(&tids[i], 0);
+        no_failed += failed[i];
+    }
+    yaz_timing_stop(tim);
+    real = yaz_timing_get_real(tim);
+    printf("%-16s clients=%-3d real=%8.3f conn/s=%10.0f failed=%d\n",
+           name, no_clients, real,
+           (double) connections * no_clients / real, no_failed);
+    yaz_timing_destroy(&tim);
+    xfree(failed);
+    xfree(tids);
+}
+
+#if HAVE_UNISTD_H
+static pid_t start_server(const char *server, const char *listen,
+                          int threads, int reuseport)
+{
+    char threads_str[20];
+    pid_t pid;
+    int i;
+
+    sprintf(threads_str, "%d", threads);
+    pid = fork();
+    if (pid == 0)
+    {
+        if (reuseport)
+            execl(server, server, "-T", threads_str, "-R", "-l", "/dev/null",
+                  listen, (char *) 0);
+        else
+            execl(server, server, "-T", threads_str, "-l", "/dev/null",
+                  listen, (char *) 0);
+        perror(server);
+        _exit(1);
+    }
+    /* wait for it to listen */
+    for (i = 0; i < 100; i++)
+    {
+        if (!session())
+            break;
+        usleep(50000);
+    }
+    return pid;
+}
+
+static void stop_server(pid_t pid)
+{
+    kill(pid, SIGTERM);
+    waitpid(pid, 0, 0);
+}
+#endif
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "%s [-a addr] [-c clients] [-n connections] "
+            "[-s server]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int no_clients = 16;
+    const char *server = 0;
+    char *arg;
+    int ret;
+
+    while ((ret = options("a:c:n:s:", argv, argc, &arg)) != -2)
+    {
+        switch (ret)
+        {
+        case 'a':
+            addr = arg;
+            break;
+        case 'c':
+            no_clients = atoi(arg);
+            break;
+        case 'n':
+            connections = atoi(arg);
+            break;
+        case 's':
+            server = arg;
+            break;
+        default:
+            usage(*argv);
+        }
+    }
+    if (server)
+    {
+#if HAVE_UNISTD_H
+        int threads[3] = { 1, 4, 16 };
+        int i, reuseport;
+        const char *listen = strchr(addr, ':') ? strchr(addr, ':') + 1 : addr;
+
+        signal(SIGPIPE, SIG_IGN);
+        for (i = 0; i < 3; i++)
+            for (reuseport = 0; reuseport < 2; reuseport++)
+            {
+                char name[40];
+                pid_t pid = start_server(server, listen, threads[i],
+                                         reuseport);
+                sprintf(name, "%s %d", reuseport ? "reuseport" : "shared",
+                        threads[i]);
+                bench(name, no_clients);
+                stop_server(pid);
+            }
+#else
+        fprintf(stderr, "%s: -s unsupported on this platform\n", *argv);
+        exit(1);
+#endif
+    }
+    else
+        bench(addr, no_clients);
+    return 0;
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
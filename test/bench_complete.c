@@ -0,0 +1,180 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+
+/**
+ * \file bench_complete.c
+ * \brief PDU completion benchmark
+ *
+ * Simulates reception of large BER and HTTP PDUs arriving in pieces of
+ * 1 byte, 1 KiB and 64 KiB and measures the time spent checking for
+ * completion with cs_complete_auto (scans from the beginning) and
+ * cs_complete_auto_state (resumes).
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <yaz/comstack.h>
+#include <yaz/options.h>
+#include <yaz/timing.h>
+#include <yaz/wrbuf.h>
+
+static void make_ber_indefinite(WRBUF w, int size)
+{
+    char child[1028];
+
+    /* OCTET STRING children of 1 KiB (definite length) */
+    child[0] = 0x04;
+    child[1] = (char) 0x82;
+    child[2] = 0x04;
+    child[3] = 0x00;
+    memset(child + 4, 'x', 1024);
+    wrbuf_write(w, "\x30\x80", 2);
+    while (wrbuf_len(w) < size)
+        wrbuf_write(w, child, sizeof(child));
+    wrbuf_write(w, "\0\0", 2);
+}
+
+static void make_ber_definite(WRBUF w, int size)
+{
+    char hdr[6];
+
+    hdr[0] = 0x04;
+    hdr[1] = (char) 0x84;
+    hdr[2] = (size >> 24) & 255;
+    hdr[3] = (size >> 16) & 255;
+    hdr[4] = (size >> 8) & 255;
+    hdr[5] = size & 255;
+    wrbuf_write(w, hdr, sizeof(hdr));
+    while (wrbuf_len(w) < size + 6)
+        wrbuf_putc(w, 'x');
+}
+
+static void make_http_chunked(WRBUF w, int size)
+{
+    char chunk[4096];
+
+    memset(chunk, 'x', sizeof(chunk));
+    wrbuf_puts(w, "HTTP/1.1 200 OK\r\n"
+               "Content-Type: text/xml\r\n"
+               "Transfer-Encoding: chunked\r\n"
+               "\r\n");
+    while (wrbuf_len(w) < size)
+    {
+        wrbuf_printf(w, "%X\r\n", (unsigned) sizeof(chunk));
+        wrbuf_write(w, chunk, sizeof(chunk));
+        wrbuf_puts(w, "\r\n");
+    }
+    wrbuf_puts(w, "0\r\n\r\n");
+}
+
+static void make_http_length(WRBUF w, int size)
+{
+    int i;
+
+    wrbuf_printf(w, "POST /Default HTTP/1.1\r\n"
+                 "Content-Type: text/xml\r\n"
+                 "Content-Length: %d\r\n"
+                 "\r\n", size);
+    for (i = 0; i < size; i++)
+        wrbuf_putc(w, 'x');
+}
+
+static double bench(const char *buf, int len, int step, int resume)
+{
+    struct cs_complete_state st;
+    yaz_timing_t tim = yaz_timing_create();
+    double real;
+    int i, r = 0;
+
+    cs_complete_state_init(&st);
+    yaz_timing_start(tim);
+    for (i = step; !r; i += step)
+    {
+        if (i > len)
+            i = len;
+        if (resume)
+            r = cs_complete_auto_state(&st, buf, i, 0);
+        else
+            r = cs_complete_auto(buf, i);
+    }
+    yaz_timing_stop(tim);
+    real = yaz_timing_get_real(tim);
+    yaz_timing_destroy(&tim);
+    if (r != len)
+        printf("unexpected completion %d != %d\n", r, len);
+    return real;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "%s [-s size] [-a]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int size = 4 * 1024 * 1024;
+    int all = 0;
+    int steps[3] = { 1, 1024, 65536 };
+    struct {
+        const char *name;
+        void (*make)(WRBUF w, int size);
+    } pdus[] = {
+        { "BER definite", make_ber_definite },
+        { "BER indefinite", make_ber_indefinite },
+        { "HTTP Content-Length", make_http_length },
+        { "HTTP chunked", make_http_chunked },
+        { 0, 0 }
+    };
+    char *arg;
+    int ret, i, j;
+
+    while ((ret = options("s:a", argv, argc, &arg)) != -2)
+    {
+        switch (ret)
+        {
+        case 's':
+            size = atoi(arg);
+            break;
+        case 'a':
+            all = 1;
+            break;
+        default:
+            usage(*argv);
+        }
+    }
+    for (i = 0; pdus[i].name; i++)
+    {
+        WRBUF w = wrbuf_alloc();
+        (*pdus[i].make)(w, size);
+        for (j = 0; j < 3; j++)
+        {
+            double t_resume = bench(wrbuf_buf(w), wrbuf_len(w), steps[j], 1);
+            printf("%-20s len=%-9d step=%-6d resume=%9.4f", pdus[i].name,
+                   (int) wrbuf_len(w), steps[j], t_resume);
+            /* rescanning is quadratic; it takes long with 1 byte steps */
+            if (steps[j] > 1 || all)
+                printf(" rescan=%9.4f\n",
+                       bench(wrbuf_buf(w), wrbuf_len(w), steps[j], 0));
+            else
+                printf(" rescan=  skipped (use -a)\n");
+        }
+        wrbuf_destroy(w);
+    }
+    return 0;
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -0,0 +1,159 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+
+/**
+ * \file bench_encode.c
+ * \brief BER encoding benchmark
+ *
+ * Encodes a present response with a number of MARC records with the
+ * default encoder (z_APDU) and with the two-pass encoder
+ * (odr_encode_sized) and reports time spent encoding and time spent
+ * checking the result for completeness as a receiver would.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <yaz/odr.h>
+#include <yaz/oid_db.h>
+#include <yaz/options.h>
+#include <yaz/proto.h>
+#include <yaz/timing.h>
+
+static Z_APDU *make_present_response(ODR o, int no_records, int size)
+{
+    Z_APDU *apdu = zget_APDU(o, Z_APDU_presentResponse);
+    Z_PresentResponse *pr = apdu->u.presentResponse;
+    Z_Records *records = (Z_Records *) odr_malloc(o, sizeof(*records));
+    Z_NamePlusRecordList *l = (Z_NamePlusRecordList *)
+        odr_malloc(o, sizeof(*l));
+    char *buf = (char *) odr_malloc(o, size);
+    int i;
+
+    memset(buf, 'x', size);
+    l->num_records = no_records;
+    l->records = (Z_NamePlusRecord **)
+        odr_malloc(o, sizeof(*l->records) * no_records);
+    for (i = 0; i < no_records; i++)
+    {
+        Z_NamePlusRecord *npr = (Z_NamePlusRecord *)
+            odr_malloc(o, sizeof(*npr));
+        npr->databaseName = odr_strdup(o, "Default");
+        npr->which = Z_NamePlusRecord_databaseRecord;
+        npr->u.databaseRecord = z_ext_record_oid(o, yaz_oid_recsyn_usmarc,
+                                                 buf, size);
+        l->records[i] = npr;
+    }
+    records->which = Z_Records_DBOSD;
+    records->u.databaseOrSurDiagnostics = l;
+    pr->records = records;
+    *pr->numberOfRecordsReturned = no_records;
+    return apdu;
+}
+
+static void bench(const char *name, ODR o, Z_APDU *apdu, int iterations,
+                  int sized)
+{
+    yaz_timing_t tim = yaz_timing_create();
+    double t_encode, t_complete;
+    char *buf;
+    int i, len = 0;
+
+    yaz_timing_start(tim);
+    for (i = 0; i < iterations; i++)
+    {
+        int r;
+
+        odr_reset(o);
+        if (sized)
+            r = odr_encode_sized(o, (Odr_fun) z_APDU, &apdu, 0);
+        else
+            r = z_APDU(o, &apdu, 0, 0);
+        if (!r)
+        {
+            printf("%s: encoding failed\n", name);
+            exit(1);
+        }
+    }
+    yaz_timing_stop(tim);
+    t_encode = yaz_timing_get_real(tim);
+
+    buf = odr_getbuf(o, &len, 0);
+    yaz_timing_start(tim);
+    for (i = 0; i < iterations; i++)
+        if (completeBER(buf, len) != len)
+        {
+            printf("%s: incomplete PDU\n", name);
+            exit(1);
+        }
+    yaz_timing_stop(tim);
+    t_complete = yaz_timing_get_real(tim);
+    yaz_timing_destroy(&tim);
+
+    printf("%-8s len=%-9d encode=%9.4f complete=%9.4f\n", name, len,
+           t_encode, t_complete);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "%s [-r records] [-s size] [-n iterations]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int no_records = 500;
+    int size = 2000;
+    int iterations = 200;
+    ODR o_data, o;
+    Z_APDU *apdu;
+    char *arg;
+    int ret;
+
+    while ((ret = options("r:s:n:", argv, argc, &arg)) != -2)
+    {
+        switch (ret)
+        {
+        case 'r':
+            no_records = atoi(arg);
+            break;
+        case 's':
+            size = atoi(arg);
+            break;
+        case 'n':
+            iterations = atoi(arg);
+            break;
+        default:
+            usage(*argv);
+        }
+    }
+    o_data = odr_createmem(ODR_ENCODE);
+    apdu = make_present_response(o_data, no_records, size);
+    printf("records=%d size=%d iterations=%d\n", no_records, size,
+           iterations);
+
+    o = odr_createmem(ODR_ENCODE);
+    bench("default", o, apdu, iterations, 0);
+    odr_destroy(o);
+
+    o = odr_createmem(ODR_ENCODE);
+    bench("sized", o, apdu, iterations, 1);
+    odr_destroy(o);
+
+    odr_destroy(o_data);
+    return 0;
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
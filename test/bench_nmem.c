@@ -0,0 +1,107 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+
+/**
+ * \file bench_nmem.c
+ * \brief NMEM contention benchmark
+ *
+ * Runs 1, 2, 4, .. N threads each creating, filling and destroying
+ * NMEM handles and reports the number of handle cycles per second.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <yaz/nmem.h>
+#include <yaz/options.h>
+#include <yaz/thread_create.h>
+#include <yaz/timing.h>
+
+static int iterations = 100000;
+
+static void *bench_handler(void *p)
+{
+    int i;
+    for (i = 0; i < iterations; i++)
+    {
+        NMEM nmem = nmem_create();
+        int j;
+        for (j = 0; j < 20; j++)
+            nmem_malloc(nmem, 50 + j * 10);
+        nmem_malloc(nmem, 6000);
+        nmem_destroy(nmem);
+    }
+    return 0;
+}
+
+static void bench(int no_threads)
+{
+    yaz_thread_t *tids = (yaz_thread_t *)
+        malloc(sizeof(*tids) * no_threads);
+    yaz_timing_t tim = yaz_timing_create();
+    double real;
+    int i;
+
+    yaz_timing_start(tim);
+    for (i = 0; i < no_threads; i++)
+        tids[i] = yaz_thread_create(bench_handler, 0);
+    for (i = 0; i < no_threads; i++)
+        yaz_thread_join(&tids[i], 0);
+    yaz_timing_stop(tim);
+    real = yaz_timing_get_real(tim);
+    printf("threads=%-3d real=%8.3f cycles/s=%12.0f per-thread/s=%12.0f\n",
+           no_threads, real,
+           (double) iterations * no_threads / real,
+           (double) iterations / real);
+    yaz_timing_destroy(&tim);
+    free(tids);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "%s [-t maxthreads] [-n iterations] [-c cachemax]\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int max_threads = 16;
+    int no_threads;
+    char *arg;
+    int ret;
+
+    while ((ret = options("t:n:c:", argv, argc, &arg)) != -2)
+    {
+        switch (ret)
+        {
+        case 't':
+            max_threads = atoi(arg);
+            break;
+        case 'n':
+            iterations = atoi(arg);
+            break;
+        case 'c':
+            nmem_set_cache_max(atoi(arg));
+            break;
+        default:
+            usage(*argv);
+        }
+    }
+    for (no_threads = 1; no_threads <= max_threads; no_threads *= 2)
+        bench(no_threads);
+    return 0;
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
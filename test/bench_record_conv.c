@@ -0,0 +1,184 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+
+/**
+ * \file bench_record_conv.c
+ * \brief record conversion pipeline benchmark
+ *
+ * Converts a MARC record with a marc, xslt, xslt chain. The chain is
+ * run as one record_conv pipeline, where the parsed result of the first
+ * stylesheet is handed to the second, and as three separate pipelines
+ * of one step each, where every step parses and serializes the record.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <yaz/options.h>
+#include <yaz/record_conv.h>
+#include <yaz/timing.h>
+#include <yaz/xmalloc.h>
+
+#if YAZ_HAVE_XSLT
+#include <libxml/parser.h>
+
+static const char *path = "../etc:.";
+
+static const char *step_spec[3] = {
+    "<marc inputformat=\"marc\" outputformat=\"marcxml\""
+    " inputcharset=\"marc-8\"/>",
+    "<xslt stylesheet=\"MARC21slim2MODS.xsl\"/>",
+    "<xslt stylesheet=\"test_record_conv.xsl\"/>"
+};
+
+static yaz_record_conv_t create(int first, int last)
+{
+    yaz_record_conv_t p = yaz_record_conv_create();
+    WRBUF w = wrbuf_alloc();
+    xmlDocPtr doc;
+    int i;
+
+    wrbuf_puts(w, "<backend>");
+    for (i = first; i <= last; i++)
+        wrbuf_puts(w, step_spec[i]);
+    wrbuf_puts(w, "</backend>");
+    doc = xmlParseMemory(wrbuf_buf(w), wrbuf_len(w));
+    yaz_record_conv_set_path(p, path);
+    if (!doc || yaz_record_conv_configure(p, xmlDocGetRootElement(doc)))
+    {
+        fprintf(stderr, "configure failed: %s\n",
+                yaz_record_conv_get_error(p));
+        exit(1);
+    }
+    xmlFreeDoc(doc);
+    wrbuf_destroy(w);
+    return p;
+}
+
+static void bench(const char *name, yaz_record_conv_t *steps, int no_steps,
+                  const char *rec, size_t len, int iterations, WRBUF out)
+{
+    yaz_timing_t tim = yaz_timing_create();
+    WRBUF w = wrbuf_alloc();
+    double real;
+    int i, j;
+
+    yaz_timing_start(tim);
+    for (i = 0; i < iterations; i++)
+    {
+        wrbuf_rewind(out);
+        wrbuf_write(out, rec, len);
+        for (j = 0; j < no_steps; j++)
+        {
+            wrbuf_rewind(w);
+            if (yaz_record_conv_record(steps[j], wrbuf_buf(out),
+                                       wrbuf_len(out), w))
+            {
+                fprintf(stderr, "%s: conversion failed: %s\n", name,
+                        yaz_record_conv_get_error(steps[j]));
+                exit(1);
+            }
+            wrbuf_rewind(out);
+            wrbuf_write(out, wrbuf_buf(w), wrbuf_len(w));
+        }
+    }
+    yaz_timing_stop(tim);
+    real = yaz_timing_get_real(tim);
+    printf("%-10s real=%8.3f us/record=%8.1f size=%ld\n",
+           name, real, real * 1e6 / iterations, (long) wrbuf_len(out));
+    yaz_timing_destroy(&tim);
+    wrbuf_destroy(w);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "%s [-n iterations] [-p path] [marcfile]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *fname = "marc-files/marc10.marc";
+    int iterations = 1000;
+    yaz_record_conv_t chain, steps[3];
+    WRBUF out_chain = wrbuf_alloc();
+    WRBUF out_steps = wrbuf_alloc();
+    char *rec, *arg;
+    long len;
+    FILE *inf;
+    int i, ret;
+
+    while ((ret = options("n:p:", argv, argc, &arg)) != -2)
+    {
+        switch (ret)
+        {
+        case 0:
+            fname = arg;
+            break;
+        case 'n':
+            iterations = atoi(arg);
+            break;
+        case 'p':
+            path = arg;
+            break;
+        default:
+            usage(*argv);
+        }
+    }
+    inf = fopen(fname, "rb");
+    if (!inf)
+    {
+        perror(fname);
+        exit(1);
+    }
+    fseek(inf, 0L, SEEK_END);
+    len = ftell(inf);
+    fseek(inf, 0L, SEEK_SET);
+    rec = (char *) xmalloc(len);
+    if (fread(rec, 1, len, inf) != (size_t) len)
+    {
+        perror(fname);
+        exit(1);
+    }
+    fclose(inf);
+
+    chain = create(0, 2);
+    for (i = 0; i < 3; i++)
+        steps[i] = create(i, i);
+
+    bench("steps", steps, 3, rec, len, iterations, out_steps);
+    bench("pipeline", &chain, 1, rec, len, iterations, out_chain);
+    printf("identical output: %s\n",
+           wrbuf_len(out_chain) == wrbuf_len(out_steps) &&
+           !memcmp(wrbuf_buf(out_chain), wrbuf_buf(out_steps),
+                   wrbuf_len(out_chain)) ? "yes" : "no");
+
+    yaz_record_conv_destroy(chain);
+    for (i = 0; i < 3; i++)
+        yaz_record_conv_destroy(steps[i]);
+    wrbuf_destroy(out_chain);
+    wrbuf_destroy(out_steps);
+    xfree(rec);
+    return 0;
+}
+#else
+int main(int argc, char **argv)
+{
+    fprintf(stderr, "%s: XSLT not supported\n", *argv);
+    return 1;
+}
+#endif
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
@@ -11,6 +11,7 @@
 #include <stdio.h>
 
 #include <yaz/test.h>
+#include <yaz/log.h>
 #include <yaz/comstack.h>
 #include <yaz/tcpip.h>
 
@@ -204,6 +205,79 @@ static void tst_http_response(void)
     }
 }
 
+/* feeds buf in steps to cs_complete_auto_state and compares with
+   cs_complete_auto on whole prefix */
+static int complete_state_cmp(const char *buf, int len, int step)
+{
+    struct cs_complete_state st;
+    int i;
+
+    cs_complete_state_init(&st);
+    for (i = 0; i <= len; i += step)
+    {
+        int r1 = cs_complete_auto_state(&st, buf, i, 0);
+        int r2 = cs_complete_auto(buf, i);
+        if (r1 != r2)
+        {
+            yaz_log(YLOG_WARN, "len=%d step=%d i=%d r1=%d r2=%d",
+                    len, step, i, r1, r2);
+            return 0;
+        }
+        if (r1)
+            break;
+    }
+    return 1;
+}
+
+static void tst_complete_state(void)
+{
+    const char *bufs[] = {
+        "GET / HTTP/1.1\r\n"
+        "\r\n",
+        "POST / HTTP/1.1\r\n"
+        "Content-Type: text/xml\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n"
+        "12345",
+        "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "3\r\n"
+        "123\r\n"
+        "A\r\n"
+        "1234567890\r\n"
+        "0\r\n"
+        "\r\n",
+        "HTTP/1.1 200 OK\n"
+        "Content-Length: 2\n"
+        "\n"
+        "12",
+        "HTTP/1.1 200 OK\r\n"
+        "\r\n"
+        "unlimited",
+        /* definite length */
+        "\x30\x05\x02\x01\x01\x04\x00",
+        /* indefinite length, with nested indefinite length */
+        "\x30\x80\x02\x01\x01\x30\x80\x04\x01\x41\x00\x00"
+        "\x04\x02\x41\x42\x00\x00",
+        0
+    };
+    int i;
+
+    for (i = 0; bufs[i]; i++)
+    {
+        int len = strlen(bufs[i]);
+        int step;
+
+        if (i == 5)
+            len = 7;
+        else if (i == 6)
+            len = 18;
+        for (step = 1; step < 7; step++)
+            YAZ_CHECK(complete_state_cmp(bufs[i], len, step));
+    }
+}
+
 /** \brief COMSTACK synopsis from manual, doc/comstack.xml */
 static int comstack_example(const char *server_address_str)
 {
@@ -302,6 +376,7 @@ int main (int argc, char **argv)
        comstack_example(argv[1]);
     tst_http_request();
     tst_http_response();
+    tst_complete_state();
     tst_cs_get_host_args();
     YAZ_CHECK_TERM;
 }
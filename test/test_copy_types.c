@@ -0,0 +1,136 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <yaz/copy_types.h>
+#include <yaz/oid_db.h>
+#include <yaz/pquery.h>
+#include <yaz/querytowrbuf.h>
+#include <yaz/test.h>
+
+/* returns 1 if a and b have identical BER encodings */
+static int same_ber(Odr_fun fun, void *a, void *b)
+{
+    ODR o_a = odr_createmem(ODR_ENCODE);
+    ODR o_b = odr_createmem(ODR_ENCODE);
+    int ret = 0;
+
+    if ((*fun)(o_a, (char **) &a, 0, 0) && (*fun)(o_b, (char **) &b, 0, 0))
+    {
+        int len_a, len_b;
+        char *buf_a = odr_getbuf(o_a, &len_a, 0);
+        char *buf_b = odr_getbuf(o_b, &len_b, 0);
+        ret = len_a == len_b && !memcmp(buf_a, buf_b, len_a);
+    }
+    odr_destroy(o_a);
+    odr_destroy(o_b);
+    return ret;
+}
+
+static void tst_query(void)
+{
+    const char *pqf = "@attr 1=4 @and @or a b @prox 0 3 1 2 k 2 c d";
+    YAZ_PQF_Parser parser = yaz_pqf_create();
+    ODR odr = odr_createmem(ODR_ENCODE);
+    NMEM nmem = nmem_create();
+    Z_Query *q, *q1;
+    Z_RPNQuery *rpn, *rpn1;
+    WRBUF w = wrbuf_alloc();
+    WRBUF w1 = wrbuf_alloc();
+
+    rpn = yaz_pqf_parse(parser, odr, pqf);
+    YAZ_CHECK(rpn);
+    if (!rpn)
+        return;
+    q = (Z_Query *) odr_malloc(odr, sizeof(*q));
+    q->which = Z_Query_type_1;
+    q->u.type_1 = rpn;
+
+    q1 = yaz_clone_z_Query(q, nmem);
+    YAZ_CHECK(q1);
+    YAZ_CHECK(q1 != q);
+    YAZ_CHECK(q1->u.type_1 != q->u.type_1);
+    YAZ_CHECK(yaz_compare_z_Query(q, q1));
+    YAZ_CHECK(same_ber((Odr_fun) z_Query, q, q1));
+
+    /* the clone must not share memory with the original */
+    yaz_query_to_wrbuf(w, q);
+    odr_reset(odr);
+    yaz_query_to_wrbuf(w1, q1);
+    YAZ_CHECK(!strcmp(wrbuf_cstr(w), wrbuf_cstr(w1)));
+
+    rpn = yaz_pqf_parse(parser, odr, "@attr 1=4 @and a b");
+    rpn1 = yaz_clone_z_RPNQuery(rpn, nmem);
+    YAZ_CHECK(yaz_compare_z_RPNQuery(rpn, rpn1));
+    rpn1->RPNStructure->u.complex->s2->u.simple->u.
+        attributesPlusTerm->term->u.general->buf[0] = 'c';
+    YAZ_CHECK(!yaz_compare_z_RPNQuery(rpn, rpn1));
+    YAZ_CHECK(!yaz_compare_z_RPNQuery(rpn, 0));
+    YAZ_CHECK(yaz_compare_z_RPNQuery(0, 0));
+    YAZ_CHECK(!yaz_clone_z_RPNQuery(0, nmem));
+
+    wrbuf_destroy(w);
+    wrbuf_destroy(w1);
+    nmem_destroy(nmem);
+    odr_destroy(odr);
+    yaz_pqf_destroy(parser);
+}
+
+static void tst_record(void)
+{
+    ODR odr = odr_createmem(ODR_ENCODE);
+    NMEM nmem = nmem_create();
+    Z_NamePlusRecord *npr, *npr1;
+    const char *rec = "00366nam  22001698a 4500";
+
+    npr = (Z_NamePlusRecord *) odr_malloc(odr, sizeof(*npr));
+    npr->databaseName = odr_strdup(odr, "Default");
+    npr->which = Z_NamePlusRecord_databaseRecord;
+    npr->u.databaseRecord = z_ext_record_oid(odr, yaz_oid_recsyn_usmarc,
+                                             rec, strlen(rec));
+
+    npr1 = yaz_clone_z_NamePlusRecord(npr, nmem);
+    YAZ_CHECK(npr1);
+    YAZ_CHECK(yaz_compare_z_NamePlusRecord(npr, npr1));
+    YAZ_CHECK(same_ber((Odr_fun) z_NamePlusRecord, npr, npr1));
+    YAZ_CHECK(npr1->u.databaseRecord->u.octet_aligned->buf !=
+              npr->u.databaseRecord->u.octet_aligned->buf);
+
+    npr1->u.databaseRecord->direct_reference =
+        odr_oiddup_nmem(nmem, yaz_oid_recsyn_xml);
+    YAZ_CHECK(!yaz_compare_z_NamePlusRecord(npr, npr1));
+
+    /* SUTRS is a structured arm of the EXTERNAL */
+    npr->u.databaseRecord = z_ext_record_sutrs(odr, rec, strlen(rec));
+    YAZ_CHECK_EQ(npr->u.databaseRecord->which, Z_External_sutrs);
+    npr1 = yaz_clone_z_NamePlusRecord(npr, nmem);
+    YAZ_CHECK(yaz_compare_z_NamePlusRecord(npr, npr1));
+    YAZ_CHECK(same_ber((Odr_fun) z_NamePlusRecord, npr, npr1));
+
+    nmem_destroy(nmem);
+    odr_destroy(odr);
+}
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    tst_query();
+    tst_record();
+    YAZ_CHECK_TERM;
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
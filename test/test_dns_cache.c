@@ -0,0 +1,209 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#if HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#if HAVE_NETDB_H
+#include <netdb.h>
+#endif
+#if HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#include <yaz/test.h>
+#include <yaz/log.h>
+#include <yaz/comstack.h>
+#include <yaz/tcpip.h>
+#include "dns_cache.h"
+
+#if HAVE_NETINET_IN_H && HAVE_NETDB_H
+/* sets up an IPv4 address without resolving anything */
+static void ai_init(struct addrinfo *ai, struct sockaddr_in *sin,
+                    unsigned long addr)
+{
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons(210);
+    sin->sin_addr.s_addr = htonl(addr);
+    memset(ai, 0, sizeof(*ai));
+    ai->ai_family = AF_INET;
+    ai->ai_socktype = SOCK_STREAM;
+    ai->ai_addrlen = sizeof(*sin);
+    ai->ai_addr = (struct sockaddr *) sin;
+}
+
+static unsigned long ai_addr(const struct addrinfo *ai)
+{
+    return ntohl(((const struct sockaddr_in *) ai->ai_addr)->sin_addr.s_addr);
+}
+
+static void tst_lookup(void)
+{
+    struct addrinfo ai, *res;
+    struct sockaddr_in sin;
+
+    ai_init(&ai, &sin, 0x7f000001);
+
+    /* disabled by default; nothing is added */
+    YAZ_CHECK(!dns_cache_enabled());
+    dns_cache_add("host1", "210", &ai);
+    YAZ_CHECK(!dns_cache_lookup("host1", "210"));
+
+    cs_set_dns_cache(60);
+    YAZ_CHECK(dns_cache_enabled());
+    dns_cache_add("host1", "210", &ai);
+    res = dns_cache_lookup("host1", "210");
+    YAZ_CHECK(res && res != &ai);
+    if (res)
+    {
+        YAZ_CHECK_EQ(res->ai_family, AF_INET);
+        YAZ_CHECK_EQ(ai_addr(res), 0x7f000001);
+        YAZ_CHECK(res->ai_addr != ai.ai_addr);
+        YAZ_CHECK(!res->ai_next);
+    }
+    dns_cache_freeaddrinfo(res);
+    YAZ_CHECK(!dns_cache_lookup("host1", "211"));
+    YAZ_CHECK(!dns_cache_lookup("host2", "210"));
+
+    /* a later lookup replaces the entry */
+    ai_init(&ai, &sin, 0x7f000002);
+    dns_cache_add("host1", "210", &ai);
+    res = dns_cache_lookup("host1", "210");
+    YAZ_CHECK(res && ai_addr(res) == 0x7f000002 && !res->ai_next);
+    dns_cache_freeaddrinfo(res);
+
+    /* changing the setting empties the cache */
+    cs_set_dns_cache(0);
+    YAZ_CHECK(!dns_cache_enabled());
+    YAZ_CHECK(!dns_cache_lookup("host1", "210"));
+}
+
+static void tst_evict(void)
+{
+    struct addrinfo ai, *res;
+    struct sockaddr_in sin;
+    char host[40];
+    int i, no_found = 0;
+
+    cs_set_dns_cache(60);
+    /* far more hosts than the cache holds */
+    for (i = 0; i < 4000; i++)
+    {
+        sprintf(host, "host%d", i);
+        ai_init(&ai, &sin, i);
+        dns_cache_add(host, "210", &ai);
+    }
+    for (i = 0; i < 4000; i++)
+    {
+        sprintf(host, "host%d", i);
+        if ((res = dns_cache_lookup(host, "210")))
+        {
+            YAZ_CHECK_EQ(ai_addr(res), i);
+            no_found++;
+        }
+        dns_cache_freeaddrinfo(res);
+    }
+    YAZ_CHECK(no_found > 0 && no_found < 4000);
+
+    /* least recently used hosts go first */
+    YAZ_CHECK(!dns_cache_lookup("host0", "210"));
+    res = dns_cache_lookup("host3999", "210");
+    YAZ_CHECK(res);
+    dns_cache_freeaddrinfo(res);
+    cs_set_dns_cache(0);
+}
+
+static void tst_expire(void)
+{
+    struct addrinfo ai, *res;
+    struct sockaddr_in sin;
+
+    cs_set_dns_cache(1);
+    ai_init(&ai, &sin, 0x7f000001);
+    dns_cache_add("host1", "210", &ai);
+    res = dns_cache_lookup("host1", "210");
+    YAZ_CHECK(res);
+    dns_cache_freeaddrinfo(res);
+#if HAVE_UNISTD_H
+    sleep(2);
+    YAZ_CHECK(!dns_cache_lookup("host1", "210"));
+#endif
+    cs_set_dns_cache(0);
+}
+
+/* the TCP/IP COMSTACK fills the cache when enabled */
+static void tst_tcpip(void)
+{
+    COMSTACK cs;
+    struct addrinfo *res;
+
+    cs_set_dns_cache(60);
+    cs = cs_create(tcpip_type, 1, PROTO_Z3950);
+    YAZ_CHECK(cs);
+    if (cs)
+    {
+        YAZ_CHECK(cs_straddr(cs, "localhost:9999"));
+        cs_close(cs);
+    }
+    res = dns_cache_lookup("localhost", "9999");
+    YAZ_CHECK(res);
+    dns_cache_freeaddrinfo(res);
+
+    /* again, from the cache */
+    cs = cs_create(tcpip_type, 1, PROTO_Z3950);
+    YAZ_CHECK(cs);
+    if (cs)
+    {
+        YAZ_CHECK(cs_straddr(cs, "localhost:9999"));
+        cs_close(cs);
+    }
+    cs_set_dns_cache(0);
+
+    /* disabled: resolved directly and not cached */
+    cs = cs_create(tcpip_type, 1, PROTO_Z3950);
+    YAZ_CHECK(cs);
+    if (cs)
+    {
+        YAZ_CHECK(cs_straddr(cs, "localhost:9999"));
+        cs_close(cs);
+    }
+    YAZ_CHECK(!dns_cache_lookup("localhost", "9999"));
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+#if HAVE_NETINET_IN_H && HAVE_NETDB_H
+    tst_lookup();
+    tst_evict();
+    tst_expire();
+    tst_tcpip();
+#endif
+    YAZ_CHECK_TERM;
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
+
@@ -0,0 +1,113 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <yaz/test.h>
+#include <yaz/log.h>
+#include "eventl.h"
+
+#define NO_ADDED 3
+
+static IOCHAN chans = 0;
+static int fds[NO_ADDED + 1][2];
+static int no_events = 0;
+static int links_ok = 1;
+
+/* head has no previous channel; the others point back */
+static void check_links(void)
+{
+    IOCHAN p;
+
+    if (chans && chans->prev)
+        links_ok = 0;
+    for (p = chans; p; p = p->next)
+        if (p->next && p->next->prev != p)
+            links_ok = 0;
+}
+
+static void added_handler(IOCHAN i, int event)
+{
+    char buf[1];
+
+    if (event == EVENT_INPUT)
+    {
+        YAZ_CHECK_EQ(read(iochan_getfd(i), buf, 1), 1);
+        check_links();
+        no_events++;
+    }
+    iochan_destroy(i);
+}
+
+/* adds several channels at the head of the list in one pass */
+static void first_handler(IOCHAN i, int event)
+{
+    char buf[1];
+    int k;
+
+    YAZ_CHECK_EQ(event, EVENT_INPUT);
+    YAZ_CHECK_EQ(read(iochan_getfd(i), buf, 1), 1);
+    for (k = 1; k <= NO_ADDED; k++)
+    {
+        IOCHAN p = iochan_create(fds[k][0], added_handler, EVENT_INPUT, 0);
+
+        iochan_settimeout(p, 10);
+        p->next = chans;
+        chans = p;
+        YAZ_CHECK_EQ(write(fds[k][1], "x", 1), 1);
+    }
+    iochan_destroy(i);
+}
+
+static void tst_add_several(void)
+{
+    IOCHAN p;
+    int k;
+
+    for (k = 0; k <= NO_ADDED; k++)
+        YAZ_CHECK_EQ(pipe(fds[k]), 0);
+
+    p = iochan_create(fds[0][0], first_handler, EVENT_INPUT, 0);
+    iochan_settimeout(p, 10);
+    chans = p;
+    YAZ_CHECK_EQ(write(fds[0][1], "x", 1), 1);
+
+    YAZ_CHECK_EQ(iochan_event_loop(&chans, 0), 0);
+    YAZ_CHECK_EQ(no_events, NO_ADDED);
+    YAZ_CHECK(links_ok);
+    YAZ_CHECK(chans == 0);
+
+    for (k = 0; k <= NO_ADDED; k++)
+    {
+        close(fds[k][0]);
+        close(fds[k][1]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+#if HAVE_UNISTD_H
+    tst_add_several();
+#endif
+    YAZ_CHECK_TERM;
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
+
@@ -834,6 +834,40 @@ static void tst_utf8_to_danmarc2(void)
 }
 
 
+static void tst_cached(void)
+{
+    yaz_iconv_t cd, cd2;
+    char *inbuf = "\033$1" "\x21\x2B\x3B"; /* no escape back to ASCII */
+    size_t inbytesleft = strlen(inbuf);
+    char outbuf0[16];
+    char *outbuf = outbuf0;
+    size_t outbytesleft = sizeof(outbuf0);
+
+    cd = yaz_iconv_open_cached("UCS4", "MARC8");
+    YAZ_CHECK(cd);
+    if (!cd)
+        return;
+    /* handles in use are not shared */
+    cd2 = yaz_iconv_open_cached("UCS4", "MARC8");
+    YAZ_CHECK(cd2 && cd2 != cd);
+    yaz_iconv_close_cached(cd2);
+
+    yaz_iconv(cd, &inbuf, &inbytesleft, &outbuf, &outbytesleft);
+    yaz_iconv_close_cached(cd);
+
+    /* most recently released handle again, reset to initial state */
+    cd2 = yaz_iconv_open_cached("UCS4", "MARC8");
+#if YAZ_POSIX_THREADS
+    YAZ_CHECK(cd2 == cd);
+#endif
+    YAZ_CHECK(tst_convert_l(cd2, 0, "o", 4, "\x00\x00\x00o"));
+    yaz_iconv_close_cached(cd2);
+
+    YAZ_CHECK(!yaz_iconv_open_cached("x-unknown-charset", "utf-8"));
+    YAZ_CHECK(!yaz_iconv_open_cached("x-unknown-charset", "utf-8"));
+    YAZ_CHECK_EQ(yaz_iconv_close_cached(0), 0);
+}
+
 int main (int argc, char **argv)
 {
     YAZ_CHECK_INIT(argc, argv);
@@ -862,6 +896,8 @@ int main (int argc, char **argv)
     tst_marc8_to_ucs4b();
     tst_ucs4b_to_utf8();
 
+    tst_cached();
+
     dconvert(1, "UTF-8");
     dconvert(1, "ISO-8859-1");
     dconvert(1, "UCS4");
@@ -69,8 +69,8 @@ void tst_nmem_malloc(void)
         char stat_buf[200];
         const char *exp = "<nmem>\n"
             "  <handles>1</handles>\n"
-            "  <blocks>41</blocks>\n"
-            "  <allocated>223264</allocated>\n"
+            "  <blocks>7</blocks>\n"
+            "  <allocated>258048</allocated>\n"
             "</nmem>\n";
 
         nmem_get_status(stat_buf, sizeof stat_buf);
@@ -91,6 +91,79 @@ void tst_nmem_malloc(void)
     }
 }
 
+void tst_nmem_cache(void)
+{
+    NMEM n;
+    char *cp1, *cp2;
+
+    n = nmem_create();
+    cp1 = (char *) nmem_malloc(n, 100);
+    nmem_destroy(n);
+
+    /* block is recycled from the cache of this thread */
+    n = nmem_create();
+    cp2 = (char *) nmem_malloc(n, 200);
+    YAZ_CHECK(cp1 == cp2);
+    nmem_reset(n);
+    cp2 = (char *) nmem_malloc(n, 10);
+    YAZ_CHECK(cp1 == cp2);
+
+    /* larger than cached block: new block */
+    cp2 = (char *) nmem_malloc(n, 20000);
+    YAZ_CHECK(cp2 && cp1 != cp2);
+    nmem_destroy(n);
+
+    {
+        char stat_buf[200];
+        const char *exp = "<nmem>\n"
+            "  <handles>0</handles>\n"
+            "  <blocks>0</blocks>\n"
+            "  <allocated>0</allocated>\n"
+            "</nmem>\n";
+
+        nmem_get_status(stat_buf, sizeof stat_buf);
+        YAZ_CHECK(strcmp(exp, stat_buf) == 0);
+    }
+
+    nmem_cache_flush();
+    nmem_set_cache_max(0);
+    n = nmem_create();
+    cp1 = (char *) nmem_malloc(n, 100);
+    YAZ_CHECK(cp1);
+    nmem_destroy(n);
+    nmem_set_cache_max(256 * 1024);
+}
+
+void tst_nmem_mark(void)
+{
+    NMEM n = nmem_create();
+    nmem_mark_t mark;
+    char *cp1, *cp2;
+    int j;
+
+    nmem_mark(n, &mark); /* empty handle */
+    nmem_malloc(n, 10);
+    nmem_release_to_mark(n, &mark);
+    YAZ_CHECK(nmem_total(n) == 0);
+
+    cp1 = nmem_strdup(n, "abc");
+    nmem_mark(n, &mark);
+    cp2 = (char *) nmem_malloc(n, 10);
+    nmem_release_to_mark(n, &mark);
+    YAZ_CHECK(nmem_total(n) == 4);
+    YAZ_CHECK(cp2 == (char *) nmem_malloc(n, 10));
+    nmem_release_to_mark(n, &mark);
+
+    /* span several blocks */
+    for (j = 0; j < 100; j++)
+        nmem_malloc(n, 1000);
+    nmem_release_to_mark(n, &mark);
+    YAZ_CHECK(nmem_total(n) == 4);
+    YAZ_CHECK(!strcmp(cp1, "abc"));
+    YAZ_CHECK(cp2 == (char *) nmem_malloc(n, 10));
+    nmem_destroy(n);
+}
+
 void tst_nmem_strsplit(void)
 {
     NMEM nmem = nmem_create();
@@ -169,6 +242,8 @@ int main (int argc, char **argv)
     YAZ_CHECK_INIT(argc, argv);
     YAZ_CHECK_LOG();
     tst_nmem_malloc();
+    tst_nmem_cache();
+    tst_nmem_mark();
     tst_nmem_strsplit();
     YAZ_CHECK_TERM;
 }
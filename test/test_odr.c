@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <yaz/oid_util.h>
+#include <yaz/xmalloc.h>
 #include "test_odrcodec.h"
 
 #include <yaz/test.h>
@@ -121,6 +122,108 @@ void tst_MySequence3(ODR encode, ODR decode)
     }
 }
 
+static void tst_zero_copy(ODR encode, ODR decode)
+{
+    int ret;
+    char *ber_buf, *buf;
+    int ber_len;
+    NMEM nmem;
+    Yc_MySequence *s = (Yc_MySequence *) odr_malloc(encode, sizeof(*s));
+    Yc_MySequence *t;
+
+    s->first = odr_intdup(encode, 12345);
+    s->second = odr_create_Odr_oct(encode, "hello", 5);
+    s->third = odr_booldup(encode, 1);
+    s->fourth = odr_nullval();
+    s->fifth = odr_intdup(encode, YC_MySequence_enum1);
+    s->myoid = odr_getoidbystr(encode, MYOID);
+
+    ret = yc_MySequence(encode, &s, 0, 0);
+    YAZ_CHECK(ret);
+    if (!ret)
+        return;
+    ber_buf = odr_getbuf(encode, &ber_len, 0);
+    buf = (char *) xmalloc(ber_len);
+    memcpy(buf, ber_buf, ber_len);
+    odr_reset(encode);
+
+    /* copying decode (default) */
+    odr_reset(decode);
+    odr_setbuf(decode, buf, ber_len, 0);
+    ret = yc_MySequence(decode, &t, 0, 0);
+    YAZ_CHECK(ret);
+    if (!ret)
+        return;
+    YAZ_CHECK(t->second->len == 5 && !memcmp(t->second->buf, "hello", 5));
+    YAZ_CHECK(t->second->buf < buf || t->second->buf >= buf + ber_len);
+
+    /* zero-copy decode; buffer handed over to decode memory */
+    odr_reset(decode);
+    odr_setbuf(decode, buf, ber_len, 0);
+    odr_set_zero_copy(decode, 1);
+    nmem_adopt_buf(odr_getmem(decode), buf);
+    ret = yc_MySequence(decode, &t, 0, 0);
+    odr_set_zero_copy(decode, 0);
+    YAZ_CHECK(ret);
+    if (!ret)
+        return;
+    YAZ_CHECK(t->second->len == 5 && !memcmp(t->second->buf, "hello", 5));
+    YAZ_CHECK(t->second->buf >= buf && t->second->buf < buf + ber_len);
+    YAZ_CHECK(t->first && *t->first == 12345);
+
+    /* buffer follows the extracted memory and is freed with it */
+    nmem = odr_extract_mem(decode);
+    odr_reset(decode);
+    YAZ_CHECK(t->second->len == 5 && !memcmp(t->second->buf, "hello", 5));
+    nmem_destroy(nmem);
+}
+
+static void tst_encode_sized(ODR encode, ODR decode)
+{
+    int ret, len, len_sized;
+    char *buf;
+    char str[300];
+    Yc_MySequence *s = (Yc_MySequence *) odr_malloc(encode, sizeof(*s));
+    Yc_MySequence *t;
+
+    memset(str, 'x', sizeof(str));
+    s->first = odr_intdup(encode, 12345);
+    s->second = odr_create_Odr_oct(encode, str, sizeof(str));
+    s->third = odr_booldup(encode, 1);
+    s->fourth = odr_nullval();
+    s->fifth = odr_intdup(encode, YC_MySequence_enum1);
+    s->myoid = odr_getoidbystr(encode, MYOID);
+
+    /* default: indefinite length for SEQUENCE longer than 127 */
+    ret = yc_MySequence(encode, &s, 0, 0);
+    YAZ_CHECK(ret);
+    buf = odr_getbuf(encode, &len, 0);
+    YAZ_CHECK_EQ((unsigned char) buf[1], 0x80);
+
+    ret = odr_encode_sized(encode, (Odr_fun) yc_MySequence, &s, 0);
+    YAZ_CHECK(ret);
+    if (!ret)
+        return;
+    buf = odr_getbuf(encode, &len_sized, 0);
+    YAZ_CHECK_EQ((unsigned char) buf[1], 0x82);
+    YAZ_CHECK_EQ(((buf[2] & 0xff) << 8) + (buf[3] & 0xff), len_sized - 4);
+    /* 0x82 + two length octets instead of 0x80 + end-of-contents */
+    YAZ_CHECK_EQ(len_sized, len);
+    YAZ_CHECK_EQ(completeBER(buf, len_sized), len_sized);
+
+    odr_reset(decode);
+    odr_setbuf(decode, buf, len_sized, 0);
+    ret = yc_MySequence(decode, &t, 0, 0);
+    YAZ_CHECK(ret);
+    if (!ret)
+        return;
+    YAZ_CHECK(t->first && *t->first == 12345);
+    YAZ_CHECK(t->second && t->second->len == sizeof(str) &&
+              !memcmp(t->second->buf, str, sizeof(str)));
+    YAZ_CHECK(t->fifth && *t->fifth == YC_MySequence_enum1);
+    odr_reset(encode);
+}
+
 static void tst_berint32(ODR encode, ODR decode)
 {
     char *buf = 0;
@@ -323,6 +426,8 @@ static void tst(void)
     tst_MySequence1(odr_encode, odr_decode);
     tst_MySequence2(odr_encode, odr_decode);
     tst_MySequence3(odr_encode, odr_decode);
+    tst_zero_copy(odr_encode, odr_decode);
+    tst_encode_sized(odr_encode, odr_decode);
 
     tst_berint32(odr_encode, odr_decode);
     tst_berint64(odr_encode, odr_decode);
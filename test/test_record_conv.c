@@ -165,8 +165,27 @@ static int conv_convert_test(yaz_record_conv_t p,
     else
     {
         WRBUF output_record = wrbuf_alloc();
+        WRBUF output_r = wrbuf_alloc();
+        WRBUF error_r = wrbuf_alloc();
         int r = yaz_record_conv_record(p, input_record, strlen(input_record),
                                        output_record);
+
+        /* re-entrant variant must give same result */
+        YAZ_CHECK_EQ(yaz_record_conv_record_r(p, input_record,
+                                              strlen(input_record),
+                                              output_r, error_r), r);
+        if (r)
+        {
+            YAZ_CHECK(!strcmp(wrbuf_cstr(error_r),
+                              yaz_record_conv_get_error(p)));
+        }
+        else
+        {
+            YAZ_CHECK(!strcmp(wrbuf_cstr(output_r),
+                              wrbuf_cstr(output_record)));
+        }
+        wrbuf_destroy(output_r);
+        wrbuf_destroy(error_r);
         if (r)
         {
             if (output_expect_record)
@@ -344,6 +363,32 @@ static void tst_convert1(void)
                                   0, &p));
     YAZ_CHECK(conv_convert_test(p, raw_rec, marcxml_rec));
     yaz_record_conv_destroy(p);
+
+    /* select gets the result of xslt as a tree */
+    YAZ_CHECK(conv_configure_test("<backend>"
+                                  "<xslt stylesheet=\"test_record_conv.xsl\"/>"
+                                  "<select path=\"/raw\"/>"
+                                  "</backend>",
+                                  0, &p));
+    YAZ_CHECK(conv_convert_test(p, raw_rec, marcxml_rec));
+    yaz_record_conv_destroy(p);
+
+    /* no match: output of xslt is passed through */
+    YAZ_CHECK(conv_configure_test("<backend>"
+                                  "<xslt stylesheet=\"test_record_conv.xsl\"/>"
+                                  "<select path=\"/none\"/>"
+                                  "</backend>",
+                                  0, &p));
+    YAZ_CHECK(conv_convert_test(p, marcxml_rec,
+                                "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                                "<record xmlns=\"http://www.loc.gov/MARC21/slim\">\n"
+                                "  <leader>00080nam a22000498a 4500</leader>\n"
+                                "  <controlfield tag=\"001\">   11224466 </controlfield>\n"
+                                "  <datafield tag=\"010\" ind1=\" \" ind2=\" \">\n"
+                                "    <subfield code=\"a\">   11224466 </subfield>\n"
+                                "  </datafield>\n"
+                                "</record>\n"));
+    yaz_record_conv_destroy(p);
 }
 
 static void tst_convert2(void)
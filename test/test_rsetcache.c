@@ -0,0 +1,168 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <yaz/test.h>
+#include <yaz/log.h>
+#include "rsetcache.h"
+
+static void set_init(struct rsetcache_set *set, char *setname, int hits,
+                     int idle_time)
+{
+    set->setname = setname;
+    set->hits = hits;
+    set->estimated_hit_count = 0;
+    set->partial_resultset = 0;
+    set->idle_time = idle_time;
+    set->extra_response_data = 0;
+}
+
+static void tst_lookup(void)
+{
+    rsetcache_t c = rsetcache_create(300, 100000);
+    ODR odr = odr_createmem(ODR_ENCODE);
+    struct rsetcache_set set;
+
+    set_init(&set, "s1", 42, 60);
+    set.extra_response_data = "<x/>";
+    rsetcache_add(c, "db\nti=a", "", &set);
+
+    memset(&set, 0, sizeof(set));
+    YAZ_CHECK_EQ(rsetcache_lookup(c, "db\nti=a", odr, &set), 1);
+    YAZ_CHECK(set.setname && !strcmp(set.setname, "s1"));
+    YAZ_CHECK_EQ(set.hits, 42);
+    YAZ_CHECK(set.idle_time > 0 && set.idle_time <= 60);
+    YAZ_CHECK(set.extra_response_data
+              && !strcmp(set.extra_response_data, "<x/>"));
+    YAZ_CHECK_EQ(rsetcache_lookup(c, "db\nti=b", odr, &set), 0);
+
+    YAZ_CHECK_EQ(rsetcache_lookup_name(c, "s1", "", odr, &set), 1);
+    YAZ_CHECK_EQ(set.hits, 42);
+    YAZ_CHECK_EQ(rsetcache_lookup_name(c, "s2", "", odr, &set), 0);
+
+    /* an entry is replaced by a later search with the same key */
+    set_init(&set, "s2", 7, 60);
+    rsetcache_add(c, "db\nti=a", "", &set);
+    YAZ_CHECK_EQ(rsetcache_lookup(c, "db\nti=a", odr, &set), 1);
+    YAZ_CHECK(!strcmp(set.setname, "s2"));
+    YAZ_CHECK_EQ(rsetcache_lookup_name(c, "s1", "", odr, &set), 0);
+
+    rsetcache_remove_name(c, "s2");
+    YAZ_CHECK_EQ(rsetcache_lookup(c, "db\nti=a", odr, &set), 0);
+
+    /* sets without idle time are not kept */
+    set_init(&set, "s3", 1, 0);
+    rsetcache_add(c, "db\nti=c", "", &set);
+    YAZ_CHECK_EQ(rsetcache_lookup(c, "db\nti=c", odr, &set), 0);
+
+    odr_destroy(odr);
+    rsetcache_destroy(c);
+}
+
+static void tst_expire(void)
+{
+    rsetcache_t c = rsetcache_create(1, 100000); /* TTL 1 second */
+    ODR odr = odr_createmem(ODR_ENCODE);
+    struct rsetcache_set set;
+
+    set_init(&set, "s1", 1, 600);
+    rsetcache_add(c, "k1", "", &set);
+    YAZ_CHECK_EQ(rsetcache_lookup(c, "k1", odr, &set), 1);
+    YAZ_CHECK_EQ(set.idle_time, 1); /* limited by TTL */
+#if HAVE_UNISTD_H
+    sleep(2);
+    YAZ_CHECK_EQ(rsetcache_lookup(c, "k1", odr, &set), 0);
+    YAZ_CHECK_EQ(rsetcache_lookup_name(c, "s1", "", odr, &set), 0);
+#endif
+    odr_destroy(odr);
+    rsetcache_destroy(c);
+}
+
+static void tst_evict(void)
+{
+    /* budget for two of the entries below, but not three */
+    rsetcache_t c = rsetcache_create(300, 1000);
+    ODR odr = odr_createmem(ODR_ENCODE);
+    struct rsetcache_set set;
+    char name[4][301];
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        memset(name[i], 'a' + i, 300);
+        name[i][300] = '\0';
+    }
+    set_init(&set, name[0], 1, 60);
+    rsetcache_add(c, "k1", "", &set);
+    set_init(&set, name[1], 2, 60);
+    rsetcache_add(c, "k2", "", &set);
+    YAZ_CHECK_EQ(rsetcache_lookup(c, "k1", odr, &set), 1);
+
+    /* k2 is least recently used */
+    set_init(&set, name[2], 3, 60);
+    rsetcache_add(c, "k3", "", &set);
+    YAZ_CHECK_EQ(rsetcache_lookup(c, "k2", odr, &set), 0);
+    YAZ_CHECK_EQ(rsetcache_lookup(c, "k1", odr, &set), 1);
+    YAZ_CHECK_EQ(rsetcache_lookup(c, "k3", odr, &set), 1);
+
+    /* k1 is least recently used now */
+    set_init(&set, name[3], 4, 60);
+    rsetcache_add(c, "k4", "", &set);
+    YAZ_CHECK_EQ(rsetcache_lookup(c, "k1", odr, &set), 0);
+    YAZ_CHECK_EQ(rsetcache_lookup(c, "k3", odr, &set), 1);
+    YAZ_CHECK_EQ(rsetcache_lookup(c, "k4", odr, &set), 1);
+    YAZ_CHECK_EQ(set.hits, 4);
+
+    odr_destroy(odr);
+    rsetcache_destroy(c);
+}
+
+static void tst_owner(void)
+{
+    rsetcache_t c = rsetcache_create(300, 100000);
+    ODR odr = odr_createmem(ODR_ENCODE);
+    struct rsetcache_set set;
+
+    set_init(&set, "shared1", 5, 60);
+    rsetcache_add(c, "u1\np1\ndb\nti=a", "u1\np1", &set);
+
+    /* only the user who searched gets the set by name */
+    YAZ_CHECK_EQ(rsetcache_lookup_name(c, "shared1", "u1\np1", odr, &set), 1);
+    YAZ_CHECK_EQ(set.hits, 5);
+    YAZ_CHECK_EQ(rsetcache_lookup_name(c, "shared1", "u2\np2", odr, &set), 0);
+    YAZ_CHECK_EQ(rsetcache_lookup_name(c, "shared1", "u1\nx", odr, &set), 0);
+    YAZ_CHECK_EQ(rsetcache_lookup_name(c, "shared1", "\n", odr, &set), 0);
+
+    odr_destroy(odr);
+    rsetcache_destroy(c);
+}
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+    tst_lookup();
+    tst_expire();
+    tst_evict();
+    tst_owner();
+    YAZ_CHECK_TERM;
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
+
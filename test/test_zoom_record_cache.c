@@ -0,0 +1,219 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <yaz/test.h>
+#include <yaz/log.h>
+#include <yaz/proto.h>
+#include "zoom-p.h"
+
+/* connection that is never connected; searches are only queued */
+static ZOOM_connection conn_create(const char *scope, int size,
+                                   const char *db)
+{
+    ZOOM_connection c = ZOOM_connection_create(0);
+
+    ZOOM_connection_option_set(c, "async", "1");
+    ZOOM_connection_option_set(c, "databaseName", db);
+    if (scope)
+        ZOOM_connection_option_set(c, "recordCache", scope);
+    if (size)
+    {
+        char buf[40];
+
+        sprintf(buf, "%d", size);
+        ZOOM_connection_option_set(c, "recordCacheSize", buf);
+    }
+    ZOOM_connection_connect(c, "localhost:9999", 0);
+    return c;
+}
+
+/* a response of records pos .. pos + num - 1, with diagnostic 100 + pos;
+   records are large, so that the size of the cache is mostly theirs */
+static void response(ZOOM_resultset r, int pos, int num)
+{
+    ODR odr = odr_createmem(ODR_DECODE);
+    char addinfo[2001];
+    int i;
+
+    memset(addinfo, 'x', 2000);
+    addinfo[2000] = '\0';
+    for (i = pos; i < pos + num; i++)
+    {
+        Z_NamePlusRecord *npr =
+            zget_surrogateDiagRec(odr, "db", 100 + i, addinfo);
+        ZOOM_record_cache_add(r, npr, i, 0, 0, 0, 0);
+    }
+    ZOOM_record_cache_adopt(r, odr_extract_mem(odr), 0);
+    odr_destroy(odr);
+}
+
+static int lookup(ZOOM_resultset r, int pos)
+{
+    ZOOM_record rec = ZOOM_record_cache_lookup(r, pos, 0, 0, 0);
+
+    return rec ? ZOOM_record_error(rec, 0, 0, 0) : 0;
+}
+
+static int cache_stat(ZOOM_resultset r, const char *key)
+{
+    return atoi(ZOOM_resultset_option_get(r, key));
+}
+
+static void tst_share(void)
+{
+    ZOOM_connection c1 = conn_create("process", 0, "db");
+    ZOOM_connection c2 = conn_create("process", 0, "db");
+    ZOOM_connection c3 = conn_create("process", 0, "other");
+    ZOOM_connection c4 = conn_create("connection", 0, "db");
+    ZOOM_resultset r1 = ZOOM_connection_search_pqf(c1, "computer");
+    ZOOM_resultset r2 = ZOOM_connection_search_pqf(c2, "computer");
+    ZOOM_resultset r3 = ZOOM_connection_search_pqf(c2, "water");
+    ZOOM_resultset r4 = ZOOM_connection_search_pqf(c3, "computer");
+    ZOOM_resultset r5 = ZOOM_connection_search_pqf(c4, "computer");
+    ZOOM_resultset r6 = ZOOM_connection_search_pqf(c4, "computer");
+
+    response(r1, 0, 5);
+    YAZ_CHECK_EQ(lookup(r1, 2), 102);
+    YAZ_CHECK_EQ(lookup(r2, 2), 102);
+    YAZ_CHECK(!ZOOM_record_cache_lookup(r2, 2, "xml", 0, 0));
+    YAZ_CHECK_EQ(lookup(r2, 5), 0);
+    YAZ_CHECK_EQ(lookup(r3, 2), 0);  /* other query */
+    YAZ_CHECK_EQ(lookup(r4, 2), 0);  /* other database */
+    YAZ_CHECK_EQ(lookup(r5, 2), 0);  /* other cache */
+
+    /* records outlive the result set that retrieved them */
+    ZOOM_resultset_destroy(r1);
+    YAZ_CHECK_EQ(lookup(r2, 4), 104);
+
+    response(r5, 0, 2);
+    YAZ_CHECK_EQ(lookup(r6, 1), 101);
+
+    /* a sorted result set no longer shares */
+    ZOOM_resultset_cache_reset(r6);
+    YAZ_CHECK_EQ(lookup(r6, 1), 0);
+    YAZ_CHECK_EQ(lookup(r5, 1), 101);
+
+    ZOOM_resultset_destroy(r2);
+    ZOOM_resultset_destroy(r3);
+    ZOOM_resultset_destroy(r4);
+    ZOOM_resultset_destroy(r5);
+    ZOOM_resultset_destroy(r6);
+    ZOOM_connection_destroy(c1);
+    ZOOM_connection_destroy(c2);
+    ZOOM_connection_destroy(c3);
+    ZOOM_connection_destroy(c4);
+}
+
+/* bytes of a response of 5 records */
+static int response_size(void)
+{
+    ZOOM_connection c = conn_create(0, 0, "db");
+    ZOOM_resultset r = ZOOM_connection_search_pqf(c, "computer");
+    int bytes;
+
+    response(r, 0, 5);
+    bytes = cache_stat(r, "recordCacheBytes");
+    ZOOM_resultset_destroy(r);
+    ZOOM_connection_destroy(c);
+    return bytes;
+}
+
+static void tst_evict(void)
+{
+    int size = response_size();
+    /* budget for two responses, but not three */
+    ZOOM_connection c = conn_create("connection", size * 2 + size / 2, "db");
+    ZOOM_resultset r1 = ZOOM_connection_search_pqf(c, "computer");
+    ZOOM_resultset r2 = ZOOM_connection_search_pqf(c, "water");
+    ZOOM_resultset r1b, r2b;
+
+    YAZ_CHECK(size > 0);
+    response(r1, 0, 5);
+    response(r2, 0, 5);
+    YAZ_CHECK_EQ(cache_stat(r1, "recordCacheEvictions"), 0);
+    YAZ_CHECK_EQ(lookup(r1, 0), 100);
+
+    /* least recently used records go first, whichever result set
+       retrieved them */
+    response(r1, 5, 5);
+    YAZ_CHECK(cache_stat(r1, "recordCacheEvictions") > 0);
+    YAZ_CHECK(cache_stat(r1, "recordCacheBytes") <= size * 2 + size / 2);
+
+    r1b = ZOOM_connection_search_pqf(c, "computer");
+    r2b = ZOOM_connection_search_pqf(c, "water");
+    YAZ_CHECK_EQ(lookup(r1b, 0), 100);
+    YAZ_CHECK_EQ(lookup(r1b, 1), 0);
+    YAZ_CHECK_EQ(lookup(r1b, 9), 109);
+    YAZ_CHECK_EQ(lookup(r2b, 0), 0);
+    YAZ_CHECK_EQ(lookup(r2b, 4), 0);
+
+    /* removed records stay valid until the result set gets more */
+    YAZ_CHECK_EQ(lookup(r2, 4), 104);
+    response(r2, 10, 1);
+    response(r2, 11, 1);
+    YAZ_CHECK_EQ(lookup(r2, 4), 0);
+
+    ZOOM_resultset_destroy(r1);
+    ZOOM_resultset_destroy(r2);
+    ZOOM_resultset_destroy(r1b);
+    ZOOM_resultset_destroy(r2b);
+    ZOOM_connection_destroy(c);
+}
+
+static void tst_limit(void)
+{
+    int size = response_size();
+    ZOOM_connection c = conn_create("connection", size * 100, "db");
+    ZOOM_resultset r1 = ZOOM_connection_search_pqf(c, "computer");
+    ZOOM_resultset r2;
+    int i;
+
+    /* a shared cache keeps the largest size */
+    ZOOM_connection_option_set(c, "recordCacheSize", "1");
+    r2 = ZOOM_connection_search_pqf(c, "computer");
+    for (i = 0; i < 10; i++)
+        response(r2, i * 5, 5);
+    YAZ_CHECK_EQ(cache_stat(r1, "recordCacheEvictions"), 0);
+    YAZ_CHECK_EQ(cache_stat(r1, "recordCacheRecords"), 50);
+    ZOOM_resultset_destroy(r1);
+    ZOOM_resultset_destroy(r2);
+    ZOOM_connection_destroy(c);
+
+    /* a private cache has its own */
+    c = conn_create(0, 1, "db");
+    r1 = ZOOM_connection_search_pqf(c, "computer");
+    response(r1, 0, 5);
+    response(r1, 5, 5);
+    YAZ_CHECK_EQ(cache_stat(r1, "recordCacheEvictions"), 5);
+    YAZ_CHECK_EQ(cache_stat(r1, "recordCacheRecords"), 5);
+    ZOOM_resultset_destroy(r1);
+    ZOOM_connection_destroy(c);
+}
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+    tst_share();
+    tst_evict();
+    tst_limit();
+    YAZ_CHECK_TERM;
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
+
@@ -0,0 +1,95 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <yaz/test.h>
+#include <yaz/log.h>
+#include <yaz/zoom.h>
+#include "zoom-p.h"
+
+/* yaz-ztest started by test_present_size.sh with part.N.ps files in
+   its working directory: record 2 is 50000 bytes, records 1, 3, 4 are
+   1000 bytes */
+#define TARGET "localhost:9871"
+
+/* runs pending tasks; returns number of APDUs sent, at most 20 */
+static int run(ZOOM_connection c)
+{
+    int sends = 0;
+
+    while (sends < 20 && ZOOM_event(1, &c))
+        if (ZOOM_connection_last_event(c) == ZOOM_EVENT_SEND_APDU)
+            sends++;
+    return sends;
+}
+
+static int record_length(ZOOM_resultset r, int pos)
+{
+    ZOOM_record rec = ZOOM_resultset_record_immediate(r, pos);
+    int len = 0;
+
+    if (!rec || ZOOM_record_error(rec, 0, 0, 0))
+        return -1;
+    ZOOM_record_get(rec, "raw", &len);
+    return len;
+}
+
+/* record 2 exceeds preferred message size and is returned as a
+   diagnostic in the middle of a present of records 1-4 */
+static void tst_present(int adapt)
+{
+    ZOOM_options o = ZOOM_options_create();
+    ZOOM_connection c;
+    ZOOM_resultset r;
+
+    ZOOM_options_set(o, "async", "1");
+    ZOOM_options_set(o, "preferredRecordSyntax", "postscript");
+    ZOOM_options_set(o, "preferredMessageSize", "20000");
+    ZOOM_options_set(o, "count", "0");
+    c = ZOOM_connection_create(o);
+    ZOOM_connection_connect(c, TARGET, 0);
+    r = ZOOM_connection_search_pqf(c, "4");
+    if (!adapt)
+        r->record_size = -1;
+    YAZ_CHECK_EQ(run(c), 2);
+    YAZ_CHECK_EQ(ZOOM_connection_error(c, 0, 0), 0);
+    YAZ_CHECK_EQ(ZOOM_resultset_size(r), 4);
+
+    /* one present for all, then one for the large record by itself */
+    ZOOM_resultset_records(r, 0, 0, 4);
+    YAZ_CHECK_EQ(run(c), 2);
+    YAZ_CHECK_EQ(ZOOM_connection_error(c, 0, 0), 0);
+    YAZ_CHECK_EQ(record_length(r, 0), 1000);
+    YAZ_CHECK_EQ(record_length(r, 1), 50000);
+    YAZ_CHECK_EQ(record_length(r, 2), 1000);
+    YAZ_CHECK_EQ(record_length(r, 3), 1000);
+
+    ZOOM_resultset_destroy(r);
+    ZOOM_connection_destroy(c);
+    ZOOM_options_destroy(o);
+}
+
+int main(int argc, char **argv)
+{
+    YAZ_CHECK_INIT(argc, argv);
+    YAZ_CHECK_LOG();
+    tst_present(1);
+    tst_present(0);
+    YAZ_CHECK_TERM;
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
+
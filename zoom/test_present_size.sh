@@ -0,0 +1,26 @@
+#!/bin/sh
+# Tests that ZOOM retrieves records that exceed preferred message size
+# when yaz-ztest returns them as diagnostics in the middle of a present.
+#
+# Starts yaz-ztest on port 9871 serving postscript records from part.N.ps
+# files, then runs test_present_size against it.
+dir=test_present_size.d
+rm -rf $dir
+mkdir $dir || exit 1
+
+part() {
+    awk "BEGIN { for (i = 0; i < $2; i++) printf \"x\" }" >$dir/part.$1.ps
+}
+part 1 1000
+part 2 50000
+part 3 1000
+part 4 1000
+
+../ztest/yaz-ztest -w $dir -l $dir/ztest.log tcp:@:9871 &
+pid=$!
+sleep 1
+./test_present_size
+ecode=$?
+kill $pid
+rm -rf $dir
+exit $ecode
@@ -0,0 +1,214 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+/** \file zoom-benchmark-mt.c
+    \brief Multi-threaded stress test and benchmark for ZOOM
+
+    A number of threads each connect, search and retrieve records
+    repeatedly. All threads share the connection pool and the cache of
+    host lookups, so this exercises those under contention.
+*/
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <yaz/comstack.h>
+#include <yaz/mutex.h>
+#include <yaz/options.h>
+#include <yaz/thread_create.h>
+#include <yaz/timing.h>
+#include <yaz/xmalloc.h>
+#include <yaz/zoom.h>
+
+#define MAX_THREADS 1024
+
+static const char *host = 0;
+static const char *query = 0;
+static int no_threads = 16;
+static int no_repeat = 100;
+static int no_records = 5;
+static int use_pool = 1;
+
+struct worker {
+    yaz_thread_t tid;
+    int no;
+    int searches;
+    int records;
+    int errors;
+    double time_max;         /* slowest iteration */
+    double time_total;
+};
+
+static YAZ_MUTEX output_mutex = 0;
+
+static void *worker_handler(void *p)
+{
+    struct worker *w = (struct worker *) p;
+    int i;
+
+    for (i = 0; i < no_repeat; i++)
+    {
+        ZOOM_options o = ZOOM_options_create();
+        ZOOM_connection c;
+        ZOOM_resultset r;
+        yaz_timing_t timing = yaz_timing_create();
+        const char *errmsg, *addinfo;
+        double t;
+        int error;
+
+        ZOOM_options_set(o, "pool", use_pool ? "1" : "0");
+        ZOOM_options_set_int(o, "count", no_records);
+        c = ZOOM_connection_create(o);
+        ZOOM_connection_connect(c, host, 0);
+        r = ZOOM_connection_search_pqf(c, query);
+        if ((error = ZOOM_connection_error(c, &errmsg, &addinfo)))
+        {
+            yaz_mutex_enter(output_mutex);
+            fprintf(stderr, "thread %d: %s (%d) %s\n", w->no,
+                    errmsg, error, addinfo);
+            yaz_mutex_leave(output_mutex);
+            w->errors++;
+        }
+        else
+        {
+            size_t pos;
+
+            w->searches++;
+            for (pos = 0; pos < (size_t) no_records; pos++)
+            {
+                ZOOM_record rec = ZOOM_resultset_record(r, pos);
+
+                if (!rec)
+                    break;
+                if (ZOOM_record_get(rec, "render", 0))
+                    w->records++;
+            }
+        }
+        ZOOM_resultset_destroy(r);
+        ZOOM_connection_destroy(c);
+        ZOOM_options_destroy(o);
+
+        yaz_timing_stop(timing);
+        t = yaz_timing_get_real(timing);
+        yaz_timing_destroy(&timing);
+        w->time_total += t;
+        if (t > w->time_max)
+            w->time_max = t;
+    }
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "zoom-benchmark-mt -h host:port -q pqf-query "
+            "[-t no_threads (max %d)] "
+            "[-n no_repeat] "
+            "[-r no_records] "
+            "[-d dns_cache_ttl] "
+            "[-P (no pool)]\n", MAX_THREADS);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    struct worker *workers;
+    yaz_timing_t timing;
+    char *arg;
+    int ret, i;
+    int searches = 0, records = 0, errors = 0;
+    double time_total = 0.0, time_max = 0.0, real;
+
+    cs_set_dns_cache(60);
+    while ((ret = options("h:q:t:n:r:d:P", argv, argc, &arg)) != -2)
+    {
+        switch (ret)
+        {
+        case 'h':
+            host = arg;
+            break;
+        case 'q':
+            query = arg;
+            break;
+        case 't':
+            no_threads = atoi(arg);
+            break;
+        case 'n':
+            no_repeat = atoi(arg);
+            break;
+        case 'r':
+            no_records = atoi(arg);
+            break;
+        case 'd':
+            cs_set_dns_cache(atoi(arg));
+            break;
+        case 'P':
+            use_pool = 0;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (!host || !query || no_threads < 1 || no_threads > MAX_THREADS)
+        usage();
+    yaz_mutex_create(&output_mutex);
+    /* let the library set up its log levels before threads start */
+    ZOOM_connection_destroy(ZOOM_connection_create(0));
+
+    workers = (struct worker *) xcalloc(no_threads, sizeof(*workers));
+    timing = yaz_timing_create();
+    for (i = 0; i < no_threads; i++)
+    {
+        workers[i].no = i;
+        workers[i].tid = yaz_thread_create(worker_handler, workers + i);
+        if (!workers[i].tid)
+        {
+            fprintf(stderr, "zoom-benchmark-mt: thread create failed\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < no_threads; i++)
+    {
+        yaz_thread_join(&workers[i].tid, 0);
+        searches += workers[i].searches;
+        records += workers[i].records;
+        errors += workers[i].errors;
+        time_total += workers[i].time_total;
+        if (workers[i].time_max > time_max)
+            time_max = workers[i].time_max;
+    }
+    yaz_timing_stop(timing);
+    real = yaz_timing_get_real(timing);
+
+    printf("threads:    %d\n", no_threads);
+    printf("searches:   %d\n", searches);
+    printf("records:    %d\n", records);
+    printf("errors:     %d\n", errors);
+    printf("time:       %.3f s\n", real);
+    if (real > 0.0)
+        printf("throughput: %.1f searches/s\n", searches / real);
+    if (searches + errors > 0)
+        printf("latency:    avg %.2f ms, max %.2f ms\n",
+               1000.0 * time_total / (searches + errors),
+               1000.0 * time_max);
+
+    ZOOM_pool_clear();
+    cs_set_dns_cache(0);
+    yaz_timing_destroy(&timing);
+    yaz_mutex_destroy(&output_mutex);
+    xfree(workers);
+    return errors ? 1 : 0;
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
+
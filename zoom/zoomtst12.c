@@ -0,0 +1,107 @@
+/* This file is part of the YAZ toolkit.
+ * Copyright (C) Index Data
+ * See the file LICENSE for details.
+ */
+
+/** \file zoomtst12.c
+    \brief Asynchronous multi-target search with ZOOM reactor
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <yaz/yaz-iconv.h>
+
+#include <yaz/xmalloc.h>
+
+#include <yaz/zoom.h>
+
+struct target {
+    int no;
+    const char *name;
+    ZOOM_connection z;
+    ZOOM_resultset r;
+};
+
+static int no_done = 0;
+
+/* called by the reactor for each event of a connection */
+static void handler(void *data, ZOOM_connection z, int event)
+{
+    struct target *t = (struct target *) data;
+    int error;
+    const char *errmsg, *addinfo;
+
+    if (event != ZOOM_EVENT_END)
+        return;
+    if ((error = ZOOM_connection_error(z, &errmsg, &addinfo)))
+        printf("%d %s error: %s (%d) %s\n", t->no, t->name, errmsg,
+               error, addinfo);
+    else
+        printf("%d %s: %ld hits\n", t->no, t->name,
+               (long) ZOOM_resultset_size(t->r));
+    no_done++;
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+    int same_target = 0;
+    int no = argc - 2;
+    int no_events;
+    struct target *targets;
+    ZOOM_reactor reactor;
+    ZOOM_options o = ZOOM_options_create();
+
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage:\n%s target1 target2 ... targetN query\n"
+                "%s number target query\n", *argv, *argv);
+        exit(1);
+    }
+    if (argc == 4 && yaz_isdigit(argv[1][0]) && !strchr(argv[1],'.'))
+    {
+        no = atoi(argv[1]);
+        same_target = 1;
+    }
+
+    /* the reactor needs async mode */
+    ZOOM_options_set(o, "async", "1");
+    ZOOM_options_set(o, "count", "0");
+
+    reactor = ZOOM_reactor_create();
+    targets = (struct target *) xmalloc(sizeof(*targets) * (no > 0 ? no : 1));
+    for (i = 0; i < no; i++)
+    {
+        struct target *t = targets + i;
+
+        t->no = i;
+        t->name = same_target ? argv[2] : argv[1+i];
+        t->z = ZOOM_connection_create(o);
+        ZOOM_reactor_add(reactor, t->z, handler, t);
+        ZOOM_connection_connect(t->z, t->name, 0);
+        t->r = ZOOM_connection_search_pqf(t->z, argv[argc-1]);
+    }
+
+    /* network I/O for all connections; events are seen by handler */
+    no_events = ZOOM_reactor_run(reactor);
+    printf("%d events, %d of %d connections done\n", no_events, no_done, no);
+
+    for (i = 0; i < no; i++)
+    {
+        ZOOM_resultset_destroy(targets[i].r);
+        ZOOM_connection_destroy(targets[i].z);
+    }
+    ZOOM_reactor_destroy(reactor);
+    xfree(targets);
+    ZOOM_options_destroy(o);
+    exit(0);
+}
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * c-file-style: "Stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * vim: shiftwidth=4 tabstop=8 expandtab
+ */
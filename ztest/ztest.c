@@ -26,6 +26,9 @@
 #ifdef WIN32
 #include <windows.h>
 #endif
+#if YAZ_POSIX_THREADS
+#include <pthread.h>
+#endif
 
 #include <yaz/log.h>
 #include <yaz/backend.h>
@@ -34,6 +37,7 @@
 #include <yaz/otherinfo.h>
 #include <yaz/facet.h>
 #include <yaz/backtrace.h>
+#include <yaz/mutex.h>
 
 #include "ztest.h"
 
@@ -52,6 +56,7 @@ struct result_set {
     struct delay search_delay;
     struct delay present_delay;
     struct delay fetch_delay;
+    int async;      /* 1: delays of search and fetch off the event loop */
     struct result_set *next;
 };
 
@@ -59,6 +64,11 @@ struct session_handle {
     struct result_set *result_sets;
 };
 
+/* result sets of all sessions (SRU argument x-shared); never freed */
+static YAZ_MUTEX shared_sets_mutex = 0;
+static struct result_set *shared_sets = 0;
+static int shared_sets_no = 0;
+
 int ztest_search(void *handle, bend_search_rr *rr);
 int ztest_sort(void *handle, bend_sort_rr *rr);
 int ztest_present(void *handle, bend_present_rr *rr);
@@ -74,6 +84,50 @@ static struct result_set *get_set(struct session_handle *sh, const char *name)
     return 0;
 }
 
+/* like get_set, but also finds shared result sets */
+static struct result_set *find_set(struct session_handle *sh, const char *name)
+{
+    struct result_set *set = get_set(sh, name);
+
+    if (!set)
+    {
+        yaz_mutex_enter(shared_sets_mutex);
+        for (set = shared_sets; set; set = set->next)
+            if (!strcmp(name, set->name))
+                break;
+        yaz_mutex_leave(shared_sets_mutex);
+    }
+    return set;
+}
+
+/* makes result set available to all sessions under a name of its own */
+static void share_set(bend_search_rr *rr, struct result_set *set,
+                      int idle_time)
+{
+    struct result_set *s;
+
+    yaz_mutex_enter(shared_sets_mutex);
+    for (s = shared_sets; s; s = s->next)
+        if (s->hits == set->hits && !strcmp(s->db, set->db))
+            break;
+    if (!s)
+    {
+        char name[40];
+
+        sprintf(name, "shared%d", ++shared_sets_no);
+        s = xmalloc(sizeof(*s));
+        *s = *set;
+        s->name = xstrdup(name);
+        s->db = xstrdup(set->db);
+        s->next = shared_sets;
+        shared_sets = s;
+    }
+    rr->srw_setname = odr_strdup(rr->stream, s->name);
+    yaz_mutex_leave(shared_sets_mutex);
+    rr->srw_setnameIdleTime = odr_malloc(rr->stream, sizeof(int));
+    *rr->srw_setnameIdleTime = idle_time;
+}
+
 static void remove_sets(struct session_handle *sh)
 {
     struct result_set *set = sh->result_sets;
@@ -237,16 +291,67 @@ static void ztest_sleep(double d)
 #endif
 }
 
-static void do_delay(const struct delay *delayp)
+static double get_delay(const struct delay *delayp)
 {
     double d = delayp->d1;
 
+    if (d > 0.0 && delayp->d2 > d)
+        d += (rand()) * (delayp->d2 - d) / RAND_MAX;
+    return d;
+}
+
+static void do_delay(const struct delay *delayp)
+{
+    double d = get_delay(delayp);
+
     if (d > 0.0)
-    {
-        if (delayp->d2 > d)
-            d += (rand()) * (delayp->d2 - d) / RAND_MAX;
         ztest_sleep(d);
+}
+
+#if YAZ_POSIX_THREADS
+struct delay_thread_info {
+    double d;
+    bend_association assoc;
+};
+
+static void *delay_thread(void *p)
+{
+    struct delay_thread_info *info = (struct delay_thread_info *) p;
+
+    ztest_sleep(info->d);
+    bend_complete(info->assoc);
+    xfree(info);
+    return 0;
+}
+#endif
+
+/* delays; in another thread that calls bend_complete if async is set */
+static int delay_complete(const struct delay *delayp, int async,
+                          bend_association assoc)
+{
+    double d = get_delay(delayp);
+
+    if (d <= 0.0)
+        return 0;
+#if YAZ_POSIX_THREADS
+    if (async)
+    {
+        struct delay_thread_info *info = (struct delay_thread_info *)
+            xmalloc(sizeof(*info));
+        pthread_t tid;
+
+        info->d = d;
+        info->assoc = assoc;
+        if (pthread_create(&tid, 0, delay_thread, info) == 0)
+        {
+            pthread_detach(tid);
+            return BEND_PENDING;
+        }
+        xfree(info);
     }
+#endif
+    ztest_sleep(d);
+    return 0;
 }
 
 static void addterms(ODR odr, Z_FacetField *facet_field, const char *facet_name)
@@ -348,6 +453,8 @@ int ztest_search(void *handle, bend_search_rr *rr)
     struct session_handle *sh = (struct session_handle*) handle;
     struct result_set *new_set;
     const char *db, *db_sep;
+    Z_SRW_extra_arg *extra_arg;
+    int shared_idle_time = 0;
 
     if (rr->num_bases != 1)
     {
@@ -395,6 +502,7 @@ int ztest_search(void *handle, bend_search_rr *rr)
     init_delay(&new_set->search_delay);
     init_delay(&new_set->present_delay);
     init_delay(&new_set->fetch_delay);
+    new_set->async = 0;
 
     db_sep = strchr(db, '?');
     if (db_sep)
@@ -415,6 +523,8 @@ int ztest_search(void *handle, bend_search_rr *rr)
                 parse_delay(&new_set->present_delay, value);
             else if (!strcmp(name, "fetch-delay"))
                 parse_delay(&new_set->fetch_delay, value);
+            else if (!strcmp(name, "async"))
+                new_set->async = atoi(value);
             else
             {
                 rr->errcode = YAZ_BIB1_SERVICE_UNSUPP_FOR_THIS_DATABASE;
@@ -424,6 +534,9 @@ int ztest_search(void *handle, bend_search_rr *rr)
     }
 
     echo_extra_args(rr->stream, rr->extra_args, &rr->extra_response_data);
+    for (extra_arg = rr->extra_args; extra_arg; extra_arg = extra_arg->next)
+        if (!strcmp(extra_arg->name, "x-shared") && extra_arg->value)
+            shared_idle_time = atoi(extra_arg->value);
     rr->hits = get_hit_count(rr->query);
 
     if (1)
@@ -437,10 +550,12 @@ int ztest_search(void *handle, bend_search_rr *rr)
             yaz_log(YLOG_DEBUG, "No facets parsed search request.");
 
     }
-    do_delay(&new_set->search_delay);
     new_set->hits = rr->hits;
+    if (shared_idle_time > 0 && !rr->errcode)
+        share_set(rr, new_set, shared_idle_time);
 
-    return 0;
+    return delay_complete(&new_set->search_delay, new_set->async,
+                          rr->association);
 }
 
 
@@ -825,7 +940,7 @@ int ztest_sort(void *handle, bend_sort_rr *rr)
 int ztest_present(void *handle, bend_present_rr *rr)
 {
     struct session_handle *sh = (struct session_handle*) handle;
-    struct result_set *set = get_set(sh, rr->setname);
+    struct result_set *set = find_set(sh, rr->setname);
 
     if (!set)
     {
@@ -837,13 +952,10 @@ int ztest_present(void *handle, bend_present_rr *rr)
     return 0;
 }
 
-/* retrieval of a single record (present, and piggy back search) */
-int ztest_fetch(void *handle, bend_fetch_rr *r)
+static int fetch_record(struct result_set *set, bend_fetch_rr *r)
 {
-    struct session_handle *sh = (struct session_handle*) handle;
     char *cp;
     const Odr_oid *oid = r->request_format;
-    struct result_set *set = get_set(sh, r->setname);
     const char *esn = yaz_get_esn(r->comp);
 
     if (!set)
@@ -852,7 +964,6 @@ int ztest_fetch(void *handle, bend_fetch_rr *r)
         r->errstring = odr_strdup(r->stream, r->setname);
         return 0;
     }
-    do_delay(&set->fetch_delay);
     r->last_in_set = 0;
     r->basename = set->db;
     r->output_format = r->request_format;
@@ -984,6 +1095,38 @@ int ztest_fetch(void *handle, bend_fetch_rr *r)
     return 0;
 }
 
+/* retrieval of a single record (present, and piggy back search) */
+int ztest_fetch(void *handle, bend_fetch_rr *r)
+{
+    struct session_handle *sh = (struct session_handle*) handle;
+    struct result_set *set = find_set(sh, r->setname);
+
+    fetch_record(set, r);
+    if (!set)
+        return 0;
+    return delay_complete(&set->fetch_delay, set->async, r->association);
+}
+
+/* retrieval of a range of records; fetch-delay applies to the range */
+int ztest_fetch_batch(void *handle, bend_fetch_batch_rr *r)
+{
+    struct session_handle *sh = (struct session_handle*) handle;
+    struct result_set *set = find_set(sh, r->setname);
+    int i;
+
+    for (i = 0; i < r->number; i++)
+    {
+        bend_fetch_rr *rr = r->records + i;
+
+        fetch_record(set, rr);
+        if (rr->last_in_set || (rr->errcode && !rr->surrogate_flag))
+            break;
+    }
+    if (!set)
+        return 0;
+    return delay_complete(&set->fetch_delay, set->async, r->association);
+}
+
 /*
  * silly dummy-scan what reads words from a file.
  */
@@ -1149,6 +1292,7 @@ bend_initresult *bend_init(bend_initrequest *q)
     q->bend_esrequest = ztest_esrequest;
     q->bend_delete = ztest_delete;
     q->bend_fetch = ztest_fetch;
+    q->bend_fetch_batch = ztest_fetch_batch;
     q->bend_scan = ztest_scan;
 #if 0
     q->bend_explain = ztest_explain;
@@ -1159,6 +1303,9 @@ bend_initresult *bend_init(bend_initrequest *q)
     q->query_charset = "ISO-8859-1";
     q->records_in_same_charset = 0;
     q->named_result_sets = 1;
+#if YAZ_POSIX_THREADS
+    q->async_backend = 1;   /* for the async database option */
+#endif
 
     return r;
 }
@@ -1174,6 +1321,7 @@ void bend_close(void *handle)
 int main(int argc, char **argv)
 {
     yaz_enable_panic_backtrace(argv[0]);
+    yaz_mutex_create(&shared_sets_mutex);
 
     return statserv_main(argc, argv, bend_init, bend_close);
 }